@@ -0,0 +1,327 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// AudioNormalizer.cpp
+// Converts PCM and float audio to the format the device mixes in.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "AudioNormalizer.h"
+#include "Trace.h"
+
+#include <ksmedia.h>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#define AUDIO_SSE2
+#endif
+
+// 5.1 to stereo: center and surrounds at -3 dB, LFE dropped, scaled
+// so that a full scale input does not clip.
+const float DOWNMIX_CENTER = 0.7071f;
+const float DOWNMIX_SCALE = 1.0f / (1.0f + 2 * DOWNMIX_CENTER);
+
+/* Kernels */
+
+void AudioInt16ToFloat(INT16 const * pSrc, float * pDst, UINT32 uCount)
+{
+    float const scale = 1.0f / 32768.0f;
+    UINT32 i = 0;
+
+#ifdef AUDIO_SSE2
+    __m128 const mscale = _mm_set1_ps(scale);
+    for (; i + 8 <= uCount; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((__m128i const *)(pSrc + i));
+        // Sign extend to 32 bits.
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(pDst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), mscale));
+        _mm_storeu_ps(pDst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), mscale));
+    }
+#endif
+
+    for (; i < uCount; ++i)
+    {
+        pDst[i] = pSrc[i] * scale;
+    }
+}
+
+void AudioFloatToInt16(float const * pSrc, INT16 * pDst, UINT32 uCount)
+{
+    UINT32 i = 0;
+
+#ifdef AUDIO_SSE2
+    // Packing saturates, values beyond full scale clip.
+    __m128 const mscale = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= uCount; i += 8)
+    {
+        __m128i lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(pSrc + i), mscale));
+        __m128i hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(pSrc + i + 4), mscale));
+        _mm_storeu_si128((__m128i *)(pDst + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+
+    for (; i < uCount; ++i)
+    {
+        float v = pSrc[i] * 32767.0f;
+        v = v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v);
+        pDst[i] = (INT16)(v < 0 ? v - 0.5f : v + 0.5f);
+    }
+}
+
+/* AudioNormalizer class */
+
+AudioNormalizer::AudioNormalizer()
+    : m_bEnabled(FALSE)
+    , m_bFloatIn(FALSE)
+    , m_uBitsIn(0)
+    , m_uChannelsIn(0)
+    , m_uRateIn(0)
+    , m_bFloatOut(FALSE)
+    , m_uChannelsOut(0)
+    , m_uRateOut(0)
+    , m_dPosition(0)
+{
+    m_Options.uFormat = AUDIO_FORMAT_UNCHANGED;
+    m_Options.bDownmix = FALSE;
+    m_Options.uSampleRate = 0;
+}
+
+void AudioNormalizer::SetFormat(JUST_StreamInfo const & info)
+{
+    m_bEnabled = FALSE;
+    Reset();
+
+    if (info.type != JUST_StreamType::AUDI
+        || (info.sub_type != JUST_AudioSubType::PCM && info.sub_type != JUST_AudioSubType::FLT))
+    {
+        return;
+    }
+
+    m_bFloatIn = (info.sub_type == JUST_AudioSubType::FLT);
+    m_uBitsIn = m_bFloatIn ? 32 : info.format.audio.sample_size;
+    m_uChannelsIn = info.format.audio.channel_count;
+    m_uRateIn = info.format.audio.sample_rate;
+
+    if ((m_uBitsIn != 8 && m_uBitsIn != 16 && m_uBitsIn != 24 && m_uBitsIn != 32)
+        || m_uChannelsIn == 0 || m_uRateIn == 0)
+    {
+        return;
+    }
+
+    m_bFloatOut = m_Options.uFormat == AUDIO_FORMAT_UNCHANGED ? m_bFloatIn : m_Options.uFormat == AUDIO_FORMAT_FLOAT;
+    m_uChannelsOut = m_Options.bDownmix && m_uChannelsIn == 6 ? 2 : m_uChannelsIn;
+    m_uRateOut = m_Options.uSampleRate ? m_Options.uSampleRate : m_uRateIn;
+
+    // Integer output is always 16 bits.
+    UINT32 uBitsOut = m_bFloatOut ? 32 : 16;
+
+    m_bEnabled = (m_Options.uFormat != AUDIO_FORMAT_UNCHANGED && (m_bFloatOut != m_bFloatIn || uBitsOut != m_uBitsIn))
+        || m_uChannelsOut != m_uChannelsIn
+        || m_uRateOut != m_uRateIn;
+}
+
+HRESULT AudioNormalizer::ConvertMediaType(IMFMediaType *pType) const
+{
+    if (!m_bEnabled)
+    {
+        return S_OK;
+    }
+
+    UINT32 uBits = m_bFloatOut ? 32 : 16;
+    UINT32 uBlockAlign = m_uChannelsOut * uBits / 8;
+
+    HRESULT hr = pType->SetGUID(MF_MT_SUBTYPE, m_bFloatOut ? MFAudioFormat_Float : MFAudioFormat_PCM);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, uBits);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetUINT32(MF_MT_AUDIO_NUM_CHANNELS, m_uChannelsOut);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, m_uRateOut);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetUINT32(MF_MT_AUDIO_BLOCK_ALIGNMENT, uBlockAlign);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetUINT32(MF_MT_AUDIO_AVG_BYTES_PER_SECOND, uBlockAlign * m_uRateOut);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE);
+    }
+    if (SUCCEEDED(hr) && m_uChannelsOut == 2)
+    {
+        hr = pType->SetUINT32(MF_MT_AUDIO_CHANNEL_MASK, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT);
+    }
+    if (SUCCEEDED(hr))
+    {
+        // The format blob described the input.
+        (void)pType->DeleteItem(MF_MT_USER_DATA);
+    }
+
+    TRACEHR_RET(hr);
+}
+
+void AudioNormalizer::Reset()
+{
+    m_Previous.clear();
+    m_dPosition = 0;
+}
+
+HRESULT AudioNormalizer::Process(BYTE const * pData, UINT32 cbData)
+{
+    UINT32 uFrames = cbData / (m_uChannelsIn * m_uBitsIn / 8);
+
+    try
+    {
+        ToFloat(pData, uFrames);
+        Downmix(uFrames);
+        uFrames = Resample(uFrames);
+        FromFloat(uFrames);
+    }
+    catch (std::bad_alloc const &)
+    {
+        return E_OUTOFMEMORY;
+    }
+    return S_OK;
+}
+
+void AudioNormalizer::ToFloat(BYTE const * pData, UINT32 uFrames)
+{
+    UINT32 uCount = uFrames * m_uChannelsIn;
+    m_Work.resize(uCount);
+    float * pDst = m_Work.empty() ? NULL : &m_Work[0];
+
+    if (m_bFloatIn)
+    {
+        CopyMemory(pDst, pData, uCount * sizeof(float));
+    }
+    else if (m_uBitsIn == 16)
+    {
+        AudioInt16ToFloat((INT16 const *)pData, pDst, uCount);
+    }
+    else if (m_uBitsIn == 24)
+    {
+        for (UINT32 i = 0; i < uCount; ++i, pData += 3)
+        {
+            INT32 v = (INT32)(((UINT32)pData[0] << 8) | ((UINT32)pData[1] << 16) | ((UINT32)pData[2] << 24)) >> 8;
+            pDst[i] = v * (1.0f / 8388608.0f);
+        }
+    }
+    else if (m_uBitsIn == 32)
+    {
+        INT32 const * pSrc = (INT32 const *)pData;
+        for (UINT32 i = 0; i < uCount; ++i)
+        {
+            pDst[i] = pSrc[i] * (1.0f / 2147483648.0f);
+        }
+    }
+    else
+    {
+        for (UINT32 i = 0; i < uCount; ++i)
+        {
+            pDst[i] = ((int)pData[i] - 128) * (1.0f / 128.0f);
+        }
+    }
+}
+
+//-------------------------------------------------------------------
+// Downmix
+// 5.1 in WAVE order: FL FR FC LFE BL BR (or SL SR).
+//-------------------------------------------------------------------
+
+void AudioNormalizer::Downmix(UINT32 uFrames)
+{
+    if (m_uChannelsOut == m_uChannelsIn)
+    {
+        return;
+    }
+
+    float * p = m_Work.empty() ? NULL : &m_Work[0];
+    for (UINT32 i = 0; i < uFrames; ++i)
+    {
+        float const * s = p + i * 6;
+        float c = s[2] * DOWNMIX_CENTER;
+        float l = (s[0] + c + s[4] * DOWNMIX_CENTER) * DOWNMIX_SCALE;
+        float r = (s[1] + c + s[5] * DOWNMIX_CENTER) * DOWNMIX_SCALE;
+        // Writes behind the reads.
+        p[i * 2] = l;
+        p[i * 2 + 1] = r;
+    }
+    m_Work.resize(uFrames * 2);
+}
+
+//-------------------------------------------------------------------
+// Resample
+// Linear interpolation, continuous across payloads: position -1 is
+// the last frame of the previous payload.
+//-------------------------------------------------------------------
+
+UINT32 AudioNormalizer::Resample(UINT32 uFrames)
+{
+    if (m_uRateOut == m_uRateIn || uFrames == 0)
+    {
+        return uFrames;
+    }
+
+    UINT32 const n = m_uChannelsOut;
+    double const step = (double)m_uRateIn / m_uRateOut;
+    double t = m_dPosition;
+
+    if (m_Previous.empty() && t < 0)
+    {
+        t = 0;
+    }
+
+    m_Resampled.clear();
+    m_Resampled.reserve((size_t)(uFrames / step + 2) * n);
+
+    while (t < (double)uFrames - 1)
+    {
+        INT64 i = (INT64)(t + 1) - 1;       // floor, t >= -1
+        float frac = (float)(t - i);
+        float const * a = i < 0 ? &m_Previous[0] : &m_Work[(size_t)i * n];
+        float const * b = &m_Work[(size_t)(i + 1) * n];
+        for (UINT32 c = 0; c < n; ++c)
+        {
+            m_Resampled.push_back(a[c] + (b[c] - a[c]) * frac);
+        }
+        t += step;
+    }
+
+    m_dPosition = t - uFrames;
+    m_Previous.assign(m_Work.end() - n, m_Work.end());
+    m_Work.swap(m_Resampled);
+    return (UINT32)(m_Work.size() / n);
+}
+
+void AudioNormalizer::FromFloat(UINT32 uFrames)
+{
+    UINT32 uCount = uFrames * m_uChannelsOut;
+
+    if (m_bFloatOut)
+    {
+        m_Output.resize(uCount * sizeof(float));
+        if (uCount)
+        {
+            CopyMemory(&m_Output[0], &m_Work[0], uCount * sizeof(float));
+        }
+    }
+    else
+    {
+        m_Output.resize(uCount * sizeof(INT16));
+        if (uCount)
+        {
+            AudioFloatToInt16(&m_Work[0], (INT16 *)&m_Output[0], uCount);
+        }
+    }
+}
@@ -0,0 +1,91 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// AudioNormalizer.h
+// Converts PCM and float audio to the format the device mixes in.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <windows.h>
+#include <mfapi.h>
+
+#include <vector>
+
+// Sample formats of normalized audio
+const UINT32 AUDIO_FORMAT_UNCHANGED = 0;
+const UINT32 AUDIO_FORMAT_INT16 = 1;
+const UINT32 AUDIO_FORMAT_FLOAT = 2;
+
+struct AudioNormalizeOptions
+{
+    UINT32  uFormat;            // AUDIO_FORMAT_*
+    BOOL    bDownmix;           // 5.1 to stereo
+    UINT32  uSampleRate;        // 0 keeps the rate
+};
+
+// Sample conversion kernels, SSE2 on x86 and x64.
+void AudioInt16ToFloat(INT16 const * pSrc, float * pDst, UINT32 uCount);
+void AudioFloatToInt16(float const * pSrc, INT16 * pDst, UINT32 uCount);
+
+//-------------------------------------------------------------------
+// AudioNormalizer class
+//
+// Without it, the pipeline inserts a resampler/channel mixer after the
+// source whenever a PCM or float track differs from the mix format of
+// the device. Samples are converted to float, downmixed from 5.1 to
+// stereo, resampled with linear interpolation and converted to the
+// output format.
+//-------------------------------------------------------------------
+
+class AudioNormalizer
+{
+public:
+    AudioNormalizer();
+
+    void    SetOptions(AudioNormalizeOptions const & options) { m_Options = options; }
+
+    // Sets the input format. Tracks other than PCM and float, and
+    // tracks already in the output format, are left alone.
+    void    SetFormat(JUST_StreamInfo const & info);
+
+    BOOL    IsEnabled() const { return m_bEnabled; }
+
+    // Changes a media type of the input format to the output format.
+    HRESULT ConvertMediaType(IMFMediaType *pType) const;
+
+    // Converts one payload into Output().
+    HRESULT Process(BYTE const * pData, UINT32 cbData);
+
+    // Valid until the next call to Process.
+    BYTE *  Output() { return m_Output.empty() ? NULL : &m_Output[0]; }
+    UINT32  OutputSize() const { return (UINT32)m_Output.size(); }
+
+    // Forgets the resampler history, after a seek.
+    void    Reset();
+
+private:
+    void    ToFloat(BYTE const * pData, UINT32 uFrames);
+    void    Downmix(UINT32 uFrames);
+    UINT32  Resample(UINT32 uFrames);
+    void    FromFloat(UINT32 uFrames);
+
+private:
+    AudioNormalizeOptions   m_Options;
+    BOOL                    m_bEnabled;
+
+    BOOL                    m_bFloatIn;
+    UINT32                  m_uBitsIn;
+    UINT32                  m_uChannelsIn;
+    UINT32                  m_uRateIn;
+
+    BOOL                    m_bFloatOut;
+    UINT32                  m_uChannelsOut;
+    UINT32                  m_uRateOut;
+
+    std::vector<float>      m_Work;             // Interleaved float frames
+    std::vector<float>      m_Resampled;
+    std::vector<float>      m_Previous;         // Last input frame, for interpolation
+    double                  m_dPosition;        // Next output position, in input frames
+    std::vector<BYTE>       m_Output;
+};
@@ -0,0 +1,400 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// AvcBitstream.cpp
+// Helpers for inspecting AVC (H.264) access units.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "AvcBitstream.h"
+#include "CodecPrivate.h"
+
+#ifndef AVC_SCAN_SCALAR
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define AVC_SCAN_SSE2
+#ifndef AVC_SCAN_NO_AVX2
+#include <immintrin.h>
+#define AVC_SCAN_AVX2
+#endif
+#endif
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// The AVX2 scan is compiled for AVX2 whatever the target of the build,
+// and only called where the processor has it. Visual C++ takes the
+// intrinsics without /arch:AVX2; GCC and Clang need the attribute.
+#if defined(AVC_SCAN_AVX2) && defined(__GNUC__) && !defined(__AVX2__)
+#define AVC_SCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define AVC_SCAN_TARGET_AVX2
+#endif
+
+//-------------------------------------------------------------------
+// IsReferenceNal
+// Checks one NAL header. Returns S_OK if the NAL is a reference
+// picture, S_FALSE if it is a non-reference slice and E_NOTIMPL for
+// non-picture NALs.
+//-------------------------------------------------------------------
+
+static HRESULT IsReferenceNal(BYTE nal)
+{
+    BYTE type = nal & 0x1f;
+    if (type < AVC_NAL_SLICE || type > AVC_NAL_IDR)
+    {
+        return E_NOTIMPL;
+    }
+    if (type == AVC_NAL_IDR || (nal & 0x60) != 0)
+    {
+        return S_OK;
+    }
+    return S_FALSE;
+}
+
+BOOL AvcIsDisposable(BYTE const * pData, UINT32 cbData, UINT32 cbLength)
+{
+    BOOL bSlice = FALSE;
+
+    if (cbLength == 0)
+    {
+        for (UINT32 i = 0; i + 3 < cbData; ++i)
+        {
+            if (pData[i] == 0 && pData[i + 1] == 0 && pData[i + 2] == 1)
+            {
+                HRESULT hr = IsReferenceNal(pData[i + 3]);
+                if (hr == S_OK)
+                {
+                    return FALSE;
+                }
+                bSlice |= (hr == S_FALSE);
+                i += 2;
+            }
+        }
+    }
+    else
+    {
+        UINT32 i = 0;
+        while (i + cbLength < cbData)
+        {
+            UINT32 cbNal = 0;
+            for (UINT32 j = 0; j < cbLength; ++j)
+            {
+                cbNal = (cbNal << 8) | pData[i + j];
+            }
+            HRESULT hr = IsReferenceNal(pData[i + cbLength]);
+            if (hr == S_OK)
+            {
+                return FALSE;
+            }
+            bSlice |= (hr == S_FALSE);
+            if (cbNal > cbData - i - cbLength)
+            {
+                break;
+            }
+            i += cbLength + cbNal;
+        }
+    }
+
+    return bSlice;
+}
+
+#if defined(AVC_SCAN_SSE2) || defined(AVC_SCAN_AVX2)
+
+static UINT32 LowestBit(UINT32 uMask)
+{
+#ifdef _MSC_VER
+    unsigned long uIndex;
+    _BitScanForward(&uIndex, uMask);
+    return uIndex;
+#else
+    return __builtin_ctz(uMask);
+#endif
+}
+
+#endif
+
+#ifdef AVC_SCAN_AVX2
+
+//-------------------------------------------------------------------
+// HasAvx2
+// Checks the processor, and for Visual C++ that the system saves the
+// YMM registers, as __builtin_cpu_supports does.
+//-------------------------------------------------------------------
+
+static BOOL HasAvx2()
+{
+#if defined(__AVX2__)
+    return TRUE;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return FALSE;
+    }
+    __cpuid(info, 1);
+    BOOL bOsYmm = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0
+        && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return bOsYmm && (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+static BOOL const s_bAvx2 = HasAvx2();
+
+//-------------------------------------------------------------------
+// FindStartCodeAvx2
+// Matches the three bytes of a start code at 32 positions at once,
+// from loads shifted by 0, 1 and 2 bytes. Returns TRUE with the offset
+// of the start code in *pOffset, or FALSE with the offset where the
+// narrower scans go on.
+//-------------------------------------------------------------------
+
+static AVC_SCAN_TARGET_AVX2 BOOL FindStartCodeAvx2(BYTE const * pData, UINT32 cbData, UINT32 * pOffset)
+{
+    UINT32 i = *pOffset;
+    BOOL bFound = FALSE;
+
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i const one = _mm256_set1_epi8(1);
+    while (i + 32 + 2 <= cbData)
+    {
+        __m256i b0 = _mm256_loadu_si256((__m256i const *)(pData + i));
+        __m256i b1 = _mm256_loadu_si256((__m256i const *)(pData + i + 1));
+        __m256i b2 = _mm256_loadu_si256((__m256i const *)(pData + i + 2));
+        __m256i match = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi8(b0, zero), _mm256_cmpeq_epi8(b1, zero)),
+            _mm256_cmpeq_epi8(b2, one));
+        UINT32 uMask = (UINT32)_mm256_movemask_epi8(match);
+        if (uMask != 0)
+        {
+            i += LowestBit(uMask);
+            bFound = TRUE;
+            break;
+        }
+        i += 32;
+    }
+    _mm256_zeroupper();
+
+    *pOffset = i;
+    return bFound;
+}
+
+#endif
+
+UINT32 AvcFindStartCode(BYTE const * pData, UINT32 cbData, UINT32 uOffset)
+{
+    UINT32 i = uOffset;
+
+#ifdef AVC_SCAN_AVX2
+    if (s_bAvx2 && FindStartCodeAvx2(pData, cbData, &i))
+    {
+        return i;
+    }
+#endif
+
+#ifdef AVC_SCAN_SSE2
+    // The same at 16 positions. Checking all three bytes keeps zero
+    // rich data, where most blocks hold a zero, off the byte loop.
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const one = _mm_set1_epi8(1);
+    while (i + 16 + 2 <= cbData)
+    {
+        __m128i b0 = _mm_loadu_si128((__m128i const *)(pData + i));
+        __m128i b1 = _mm_loadu_si128((__m128i const *)(pData + i + 1));
+        __m128i b2 = _mm_loadu_si128((__m128i const *)(pData + i + 2));
+        __m128i match = _mm_and_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)),
+            _mm_cmpeq_epi8(b2, one));
+        UINT32 uMask = (UINT32)_mm_movemask_epi8(match);
+        if (uMask != 0)
+        {
+            return i + LowestBit(uMask);
+        }
+        i += 16;
+    }
+#endif
+
+    // Scalar: a byte above 1 at i + 2 excludes a start code at i,
+    // i + 1 and i + 2.
+    while (i + 3 <= cbData)
+    {
+        if (pData[i + 2] > 1)
+        {
+            i += 3;
+        }
+        else if (pData[i + 2] == 1 && pData[i + 1] == 0 && pData[i] == 0)
+        {
+            return i;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    return cbData;
+}
+
+/* AvcRewriter class */
+
+AvcRewriter::AvcRewriter()
+    : m_uFormat(AVC_FORMAT_UNCHANGED)
+    , m_bInsertParameterSets(FALSE)
+    , m_cbLength(0)
+{
+}
+
+void AvcRewriter::SetCodecPrivate(BYTE const * pData, UINT32 cbData)
+{
+    AvcConfig config;
+
+    m_ParameterSets.clear();
+    m_cbLength = 0;
+
+    if (pData == NULL || !AvcParseConfig(pData, cbData, config))
+    {
+        return;
+    }
+    m_cbLength = config.nal_length_size;
+    m_ParameterSets.insert(m_ParameterSets.end(), config.sps.begin(), config.sps.end());
+    m_ParameterSets.insert(m_ParameterSets.end(), config.pps.begin(), config.pps.end());
+}
+
+//-------------------------------------------------------------------
+// SplitAnnexB / SplitLength
+// Fill m_Nals with the NAL units of an access unit. Return FALSE if
+// the access unit is malformed.
+//-------------------------------------------------------------------
+
+BOOL AvcRewriter::SplitAnnexB(BYTE const * pData, UINT32 cbData)
+{
+    UINT32 i = AvcFindStartCode(pData, cbData, 0);
+    while (i < cbData)
+    {
+        UINT32 uBegin = i + 3;
+        UINT32 uNext = AvcFindStartCode(pData, cbData, uBegin);
+        UINT32 uEnd = uNext;
+
+        // Trailing zeros belong to the next start code.
+        while (uEnd > uBegin && pData[uEnd - 1] == 0)
+        {
+            --uEnd;
+        }
+        if (uEnd > uBegin)
+        {
+            Nal nal = {uBegin, uEnd - uBegin};
+            m_Nals.push_back(nal);
+        }
+        i = uNext;
+    }
+    return !m_Nals.empty();
+}
+
+BOOL AvcRewriter::SplitLength(BYTE const * pData, UINT32 cbData)
+{
+    UINT32 i = 0;
+    while (i + m_cbLength <= cbData)
+    {
+        UINT32 cbNal = 0;
+        for (UINT32 j = 0; j < m_cbLength; ++j)
+        {
+            cbNal = (cbNal << 8) | pData[i + j];
+        }
+        i += m_cbLength;
+        if (cbNal > cbData - i)
+        {
+            return FALSE;
+        }
+        if (cbNal)
+        {
+            Nal nal = {i, cbNal};
+            m_Nals.push_back(nal);
+        }
+        i += cbNal;
+    }
+    return i == cbData && !m_Nals.empty();
+}
+
+//-------------------------------------------------------------------
+// AppendNal
+// Appends a NAL unit with a start code if cbLength is 0, otherwise
+// with a big endian length of cbLength bytes.
+//-------------------------------------------------------------------
+
+void AvcRewriter::AppendNal(BYTE const * pNal, UINT32 cbNal, UINT32 cbLength)
+{
+    BYTE prefix[4] = {0, 0, 0, 1};
+    UINT32 cbPrefix = 4;
+    if (cbLength)
+    {
+        cbPrefix = cbLength;
+        for (UINT32 i = 0; i < cbLength; ++i)
+        {
+            prefix[i] = (BYTE)(cbNal >> (8 * (cbLength - 1 - i)));
+        }
+    }
+    m_Output.insert(m_Output.end(), prefix, prefix + cbPrefix);
+    m_Output.insert(m_Output.end(), pNal, pNal + cbNal);
+}
+
+HRESULT AvcRewriter::Rewrite(BYTE const * pData, UINT32 cbData, BOOL bKey)
+{
+    UINT32 cbLengthOut = m_uFormat == AVC_FORMAT_ANNEXB ? 0 : m_cbLength;
+
+    m_Nals.clear();
+    BOOL bValid = m_cbLength == 0 ? SplitAnnexB(pData, cbData) : SplitLength(pData, cbData);
+    if (!bValid)
+    {
+        // Pass malformed data on, the decoder copes with it.
+        return S_FALSE;
+    }
+
+    BOOL bInsert = bKey && m_bInsertParameterSets && !m_ParameterSets.empty();
+    for (size_t i = 0; bInsert && i < m_Nals.size(); ++i)
+    {
+        if ((pData[m_Nals[i].uOffset] & 0x1f) == AVC_NAL_SPS)
+        {
+            bInsert = FALSE;
+        }
+    }
+
+    if (!bInsert && cbLengthOut == m_cbLength)
+    {
+        return S_FALSE;
+    }
+
+    try
+    {
+        m_Output.clear();
+        m_Output.reserve(cbData + 64);
+
+        size_t i = 0;
+
+        // An access unit delimiter stays first.
+        if (!m_Nals.empty() && (pData[m_Nals[0].uOffset] & 0x1f) == AVC_NAL_AUD)
+        {
+            AppendNal(pData + m_Nals[0].uOffset, m_Nals[0].cbSize, cbLengthOut);
+            ++i;
+        }
+        for (size_t j = 0; bInsert && j < m_ParameterSets.size(); ++j)
+        {
+            AppendNal(&m_ParameterSets[j][0], (UINT32)m_ParameterSets[j].size(), cbLengthOut);
+        }
+        for (; i < m_Nals.size(); ++i)
+        {
+            AppendNal(pData + m_Nals[i].uOffset, m_Nals[i].cbSize, cbLengthOut);
+        }
+    }
+    catch (std::bad_alloc const &)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    return S_OK;
+}
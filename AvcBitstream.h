@@ -0,0 +1,101 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// AvcBitstream.h
+// Helpers for inspecting AVC (H.264) access units.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+#include <vector>
+
+// NAL unit types
+const BYTE AVC_NAL_SLICE = 1;
+const BYTE AVC_NAL_IDR = 5;
+const BYTE AVC_NAL_SPS = 7;
+const BYTE AVC_NAL_PPS = 8;
+const BYTE AVC_NAL_AUD = 9;
+
+// AvcIsDisposable:
+// Returns TRUE if no picture in the access unit is used for reference
+// (nal_ref_idc is 0 on every slice), so it can be dropped without
+// breaking the decoding of later pictures. cbLength is the NAL length
+// size of the stream, 0 for Annex B.
+BOOL AvcIsDisposable(BYTE const * pData, UINT32 cbData, UINT32 cbLength);
+
+// AvcFindStartCode:
+// Returns the offset of the first start code (00 00 01) at or after
+// uOffset, or cbData if there is none. Scans 16 bytes at a time with
+// SSE2 on x86 and x64, and 32 with AVX2 where the processor has it,
+// checked once at run time. AVC_SCAN_NO_AVX2 leaves the SSE2 scan,
+// AVC_SCAN_SCALAR the plain loop only.
+UINT32 AvcFindStartCode(BYTE const * pData, UINT32 cbData, UINT32 uOffset);
+
+// Bitstream formats of AVC samples
+const UINT32 AVC_FORMAT_UNCHANGED = 0;      // Keep the format of the runtime
+const UINT32 AVC_FORMAT_ANNEXB = 1;         // Start code prefixed NAL units
+
+//-------------------------------------------------------------------
+// AvcRewriter class
+//
+// Converts length prefixed AVC samples to Annex B, which the
+// MFVideoFormat_H264 media type and its sequence header describe, and
+// optionally inserts the SPS/PPS of the codec private data in key
+// frames that lack them, so that a decoder can start or restart at
+// any key frame.
+//
+// The form of the input is a property of the stream, not of the
+// sample: the first bytes of a length prefixed sample can look like a
+// start code. It is taken from the codec private data: an avcC record
+// gives the NAL length size, anything else means Annex B.
+//
+// The NAL payloads are copied as they are: both forms carry escaped
+// NAL units, so the emulation prevention bytes are kept.
+//-------------------------------------------------------------------
+
+class AvcRewriter
+{
+public:
+    AvcRewriter();
+
+    void    SetOutputFormat(UINT32 uFormat) { m_uFormat = uFormat; }
+    void    SetInsertParameterSets(BOOL bInsert) { m_bInsertParameterSets = bInsert; }
+
+    // Takes the SPS/PPS and the NAL length size from the avcC (or
+    // Annex B) codec private data.
+    void    SetCodecPrivate(BYTE const * pData, UINT32 cbData);
+
+    // NAL length size of the input, 0 for Annex B.
+    UINT32  NalLengthSize() const { return m_cbLength; }
+
+    BOOL    IsEnabled() const { return m_uFormat != AVC_FORMAT_UNCHANGED || m_bInsertParameterSets; }
+
+    // Rewrites one access unit into Output(). Returns S_FALSE when
+    // there is nothing to change, the input is then used as it is.
+    HRESULT Rewrite(BYTE const * pData, UINT32 cbData, BOOL bKey);
+
+    // Valid until the next call to Rewrite.
+    BYTE *  Output() { return &m_Output[0]; }
+    UINT32  OutputSize() const { return (UINT32)m_Output.size(); }
+
+private:
+    struct Nal
+    {
+        UINT32 uOffset;
+        UINT32 cbSize;
+    };
+
+    BOOL    SplitAnnexB(BYTE const * pData, UINT32 cbData);
+    BOOL    SplitLength(BYTE const * pData, UINT32 cbData);
+    void    AppendNal(BYTE const * pNal, UINT32 cbNal, UINT32 cbLength);
+
+private:
+    UINT32                  m_uFormat;
+    BOOL                    m_bInsertParameterSets;
+    UINT32                  m_cbLength;         // NAL length size of the input, 0 for Annex B
+    std::vector<std::vector<BYTE> > m_ParameterSets;    // SPS then PPS NAL units
+    std::vector<Nal>        m_Nals;             // NAL units of the current access unit
+    std::vector<BYTE>       m_Output;
+};
@@ -0,0 +1,100 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// BufferingController.cpp
+// Paces the progress checks of the runtime while it is buffering.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "BufferingController.h"
+
+BufferingController::BufferingController()
+    : m_bBuffering(FALSE)
+    , m_uStart(0)
+    , m_uPercent(0)
+    , m_uDelay(BUFFERING_MIN_DELAY)
+    , m_cFailures(0)
+    , m_uPhases(0)
+    , m_uChecks(0)
+    , m_uTotalTime(0)
+{
+}
+
+void BufferingController::Start(UINT64 uNow)
+{
+    if (m_bBuffering)
+    {
+        return;
+    }
+    m_bBuffering = TRUE;
+    m_uStart = uNow;
+    m_uPercent = 0;
+    m_uDelay = BUFFERING_MIN_DELAY;
+    m_cFailures = 0;
+    ++m_uPhases;
+}
+
+//-------------------------------------------------------------------
+// Check
+// A check that sees no progress doubles the delay, up to
+// BUFFERING_MAX_DELAY, so a stuck download costs a few checks per
+// second. Progress brings the delay back to BUFFERING_MIN_DELAY, so
+// the end of the phase is seen soon after it happens.
+//-------------------------------------------------------------------
+
+BOOL BufferingController::Check(UINT64 uNow, UINT32 uPercent)
+{
+    if (!m_bBuffering)
+    {
+        return TRUE;
+    }
+
+    ++m_uChecks;
+    m_cFailures = 0;
+
+    if (uPercent >= 100)
+    {
+        m_bBuffering = FALSE;
+        m_uTotalTime += uNow > m_uStart ? uNow - m_uStart : 0;
+        return TRUE;
+    }
+
+    if (uPercent > m_uPercent)
+    {
+        m_uDelay = BUFFERING_MIN_DELAY;
+    }
+    else
+    {
+        m_uDelay = m_uDelay * 2 < BUFFERING_MAX_DELAY ? m_uDelay * 2 : BUFFERING_MAX_DELAY;
+    }
+    m_uPercent = uPercent;
+
+    return FALSE;
+}
+
+//-------------------------------------------------------------------
+// Fail
+// A failed check backs off like one without progress. The runtime
+// does not recover from most failures, so the phase is not kept
+// open forever waiting for a progress it cannot report.
+//-------------------------------------------------------------------
+
+BOOL BufferingController::Fail(UINT64 uNow)
+{
+    if (!m_bBuffering)
+    {
+        return TRUE;
+    }
+
+    ++m_uChecks;
+
+    if (++m_cFailures >= BUFFERING_MAX_FAILURES)
+    {
+        m_bBuffering = FALSE;
+        m_uTotalTime += uNow > m_uStart ? uNow - m_uStart : 0;
+        return TRUE;
+    }
+
+    m_uDelay = m_uDelay * 2 < BUFFERING_MAX_DELAY ? m_uDelay * 2 : BUFFERING_MAX_DELAY;
+    return FALSE;
+}
@@ -0,0 +1,68 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// BufferingController.h
+// Paces the progress checks of the runtime while it is buffering.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+const UINT32 BUFFERING_MIN_DELAY = 20;          // Milliseconds between checks, while progressing
+const UINT32 BUFFERING_MAX_DELAY = 200;         // Milliseconds between checks, while stuck
+const UINT32 BUFFERING_MAX_FAILURES = 25;       // Failed checks in a row that end the phase
+
+//-------------------------------------------------------------------
+// BufferingController class
+//
+// While the runtime buffers, the source checks its progress once per
+// timer callback, and returns to the work queue in between, so the
+// source lock is free and no thread waits. Each check tells the
+// controller the progress; the controller ends the buffering phase at
+// 100 percent, or gives the delay until the next check. The delay is
+// short while the progress moves, and doubles while it does not.
+//-------------------------------------------------------------------
+
+class BufferingController
+{
+public:
+    BufferingController();
+
+    BOOL    IsBuffering() const { return m_bBuffering; }
+
+    // Enters the buffering phase.
+    // uNow: Tick count, in milliseconds.
+    void    Start(UINT64 uNow);
+
+    // Feeds one progress check. Returns TRUE when the buffering phase is
+    // over; otherwise the caller waits NextDelay before the next check.
+    //
+    // uNow:        Tick count, in milliseconds.
+    // uPercent:    Buffering progress reported by the runtime.
+    BOOL    Check(UINT64 uNow, UINT32 uPercent);
+
+    // Feeds a check that could not read the progress. Returns TRUE, and
+    // ends the buffering phase, after BUFFERING_MAX_FAILURES of them in
+    // a row; the caller then reports the error.
+    BOOL    Fail(UINT64 uNow);
+
+    // Milliseconds until the next check.
+    UINT32  NextDelay() const { return m_uDelay; }
+
+    // Counters, over all the buffering phases.
+    UINT32  Phases() const { return m_uPhases; }
+    UINT32  Checks() const { return m_uChecks; }
+    UINT64  TotalTime() const { return m_uTotalTime; }
+
+private:
+    BOOL    m_bBuffering;
+    UINT64  m_uStart;               // Tick count when the phase started
+    UINT32  m_uPercent;             // Progress at the last check
+    UINT32  m_uDelay;
+    UINT32  m_cFailures;            // Failed checks in a row
+
+    UINT32  m_uPhases;
+    UINT32  m_uChecks;
+    UINT64  m_uTotalTime;           // Milliseconds spent buffering
+};
@@ -0,0 +1,547 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// CodecPrivate.h
+// Parsers for the codec private data of video streams.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// The parsers only depend on the C++ standard library and are kept in
+// this header, so they can be built and fuzzed on any platform without
+// the precompiled header of the plug-in.
+//
+// They never read outside the buffer they are given and return false
+// on any malformed input.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+//-------------------------------------------------------------------
+// CodecBitReader class
+//
+// Reads bits from a RBSP, that is a payload with the emulation
+// prevention bytes already removed.
+//-------------------------------------------------------------------
+
+class CodecBitReader
+{
+public:
+    CodecBitReader(uint8_t const * data, size_t size)
+        : m_data(data)
+        , m_size(size)
+        , m_pos(0)
+        , m_overrun(false)
+    {
+    }
+
+    bool overrun() const { return m_overrun; }
+    size_t left() const { return m_size * 8 - (m_pos < m_size * 8 ? m_pos : m_size * 8); }
+
+    uint32_t bit()
+    {
+        if (m_pos >= m_size * 8)
+        {
+            m_overrun = true;
+            return 0;
+        }
+        uint32_t b = (m_data[m_pos >> 3] >> (7 - (m_pos & 7))) & 1;
+        ++m_pos;
+        return b;
+    }
+
+    uint32_t bits(unsigned n)
+    {
+        uint32_t v = 0;
+        for (unsigned i = 0; i < n; ++i)
+        {
+            v = (v << 1) | bit();
+        }
+        return v;
+    }
+
+    void skip(unsigned n)
+    {
+        m_pos += n;
+        if (m_pos > m_size * 8)
+        {
+            m_overrun = true;
+        }
+    }
+
+    // Exp-Golomb codes
+    uint32_t ue()
+    {
+        unsigned zeros = 0;
+        while (bit() == 0)
+        {
+            if (m_overrun || ++zeros > 31)
+            {
+                m_overrun = true;
+                return 0;
+            }
+        }
+        return ((1u << zeros) - 1) + bits(zeros);
+    }
+
+    int32_t se()
+    {
+        uint32_t v = ue();
+        return (v & 1) ? (int32_t)((v + 1) / 2) : -(int32_t)(v / 2);
+    }
+
+private:
+    uint8_t const * m_data;
+    size_t m_size;
+    size_t m_pos;
+    bool m_overrun;
+};
+
+// Removes the emulation prevention bytes (00 00 03) of a NAL unit.
+inline void CodecUnescapeRbsp(uint8_t const * data, size_t size, std::vector<uint8_t> & rbsp)
+{
+    rbsp.clear();
+    rbsp.reserve(size);
+    unsigned zeros = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (zeros >= 2 && data[i] == 3)
+        {
+            zeros = 0;
+            continue;
+        }
+        zeros = data[i] == 0 ? zeros + 1 : 0;
+        rbsp.push_back(data[i]);
+    }
+}
+
+//-------------------------------------------------------------------
+// AVC (H.264)
+//-------------------------------------------------------------------
+
+struct AvcSpsInfo
+{
+    uint32_t profile_idc;
+    uint32_t constraint_flags;
+    uint32_t level_idc;
+    uint32_t chroma_format_idc;
+    uint32_t bit_depth_luma;
+    uint32_t width;                 // Cropped size, in pixels
+    uint32_t height;
+    bool frame_mbs_only;
+    uint32_t sar_num;               // 0 if not present
+    uint32_t sar_den;
+    bool video_signal_present;
+    bool full_range;
+    bool colour_present;
+    uint32_t colour_primaries;
+    uint32_t transfer_characteristics;
+    uint32_t matrix_coefficients;
+    uint32_t num_units_in_tick;     // 0 if not present
+    uint32_t time_scale;
+};
+
+struct AvcConfig
+{
+    uint32_t nal_length_size;       // 0 for Annex B private data
+    std::vector<std::vector<uint8_t> > sps;
+    std::vector<std::vector<uint8_t> > pps;
+};
+
+inline void AvcSkipScalingList(CodecBitReader & br, unsigned size)
+{
+    int32_t last = 8, next = 8;
+    for (unsigned j = 0; j < size && !br.overrun(); ++j)
+    {
+        if (next != 0)
+        {
+            next = (last + br.se() + 256) % 256;
+        }
+        last = next == 0 ? last : next;
+    }
+}
+
+// Parses a SPS NAL unit, including its NAL header byte.
+inline bool AvcParseSps(uint8_t const * nal, size_t size, AvcSpsInfo & info)
+{
+    memset(&info, 0, sizeof(info));
+    if (size < 4 || (nal[0] & 0x1f) != 7)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> rbsp;
+    CodecUnescapeRbsp(nal + 1, size - 1, rbsp);
+    CodecBitReader br(&rbsp[0], rbsp.size());
+
+    info.profile_idc = br.bits(8);
+    info.constraint_flags = br.bits(8);
+    info.level_idc = br.bits(8);
+    br.ue();                                    // seq_parameter_set_id
+    info.chroma_format_idc = 1;
+    info.bit_depth_luma = 8;
+
+    uint32_t p = info.profile_idc;
+    if (p == 100 || p == 110 || p == 122 || p == 244 || p == 44
+        || p == 83 || p == 86 || p == 118 || p == 128 || p == 138 || p == 139 || p == 134)
+    {
+        info.chroma_format_idc = br.ue();
+        if (info.chroma_format_idc > 3)
+        {
+            return false;
+        }
+        if (info.chroma_format_idc == 3)
+        {
+            br.bit();                           // separate_colour_plane_flag
+        }
+        info.bit_depth_luma = br.ue() + 8;
+        br.ue();                                // bit_depth_chroma_minus8
+        br.bit();                               // qpprime_y_zero_transform_bypass_flag
+        if (br.bit())                           // seq_scaling_matrix_present_flag
+        {
+            unsigned n = info.chroma_format_idc != 3 ? 8 : 12;
+            for (unsigned i = 0; i < n && !br.overrun(); ++i)
+            {
+                if (br.bit())
+                {
+                    AvcSkipScalingList(br, i < 6 ? 16 : 64);
+                }
+            }
+        }
+    }
+
+    br.ue();                                    // log2_max_frame_num_minus4
+    uint32_t poc_type = br.ue();
+    if (poc_type == 0)
+    {
+        br.ue();                                // log2_max_pic_order_cnt_lsb_minus4
+    }
+    else if (poc_type == 1)
+    {
+        br.bit();                               // delta_pic_order_always_zero_flag
+        br.se();                                // offset_for_non_ref_pic
+        br.se();                                // offset_for_top_to_bottom_field
+        uint32_t n = br.ue();
+        if (n > 255)
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < n && !br.overrun(); ++i)
+        {
+            br.se();
+        }
+    }
+    else if (poc_type != 2)
+    {
+        return false;
+    }
+
+    br.ue();                                    // max_num_ref_frames
+    br.bit();                                   // gaps_in_frame_num_value_allowed_flag
+    uint32_t width_mbs = br.ue() + 1;
+    uint32_t height_map_units = br.ue() + 1;
+    info.frame_mbs_only = br.bit() != 0;
+    if (!info.frame_mbs_only)
+    {
+        br.bit();                               // mb_adaptive_frame_field_flag
+    }
+    br.bit();                                   // direct_8x8_inference_flag
+
+    if (width_mbs > 1024 || height_map_units > 1024)
+    {
+        return false;
+    }
+    uint32_t width = width_mbs * 16;
+    uint32_t height = height_map_units * 16 * (info.frame_mbs_only ? 1 : 2);
+
+    if (br.bit())                               // frame_cropping_flag
+    {
+        uint32_t crop_unit_x = info.chroma_format_idc == 1 || info.chroma_format_idc == 2 ? 2 : 1;
+        uint32_t crop_unit_y = (info.chroma_format_idc == 1 ? 2 : 1) * (info.frame_mbs_only ? 1 : 2);
+        uint32_t left = br.ue(), right = br.ue(), top = br.ue(), bottom = br.ue();
+        uint32_t crop_x = (left + right) * crop_unit_x;
+        uint32_t crop_y = (top + bottom) * crop_unit_y;
+        if (crop_x >= width || crop_y >= height)
+        {
+            return false;
+        }
+        width -= crop_x;
+        height -= crop_y;
+    }
+    info.width = width;
+    info.height = height;
+
+    if (br.bit())                               // vui_parameters_present_flag
+    {
+        if (br.bit())                           // aspect_ratio_info_present_flag
+        {
+            static uint32_t const sar_table[17][2] = {
+                {0, 0}, {1, 1}, {12, 11}, {10, 11}, {16, 11}, {40, 33}, {24, 11}, {20, 11},
+                {32, 11}, {80, 33}, {18, 11}, {15, 11}, {64, 33}, {160, 99}, {4, 3}, {3, 2}, {2, 1},
+            };
+            uint32_t idc = br.bits(8);
+            if (idc == 255)
+            {
+                info.sar_num = br.bits(16);
+                info.sar_den = br.bits(16);
+            }
+            else if (idc < 17)
+            {
+                info.sar_num = sar_table[idc][0];
+                info.sar_den = sar_table[idc][1];
+            }
+        }
+        if (br.bit())                           // overscan_info_present_flag
+        {
+            br.bit();
+        }
+        info.video_signal_present = br.bit() != 0;
+        if (info.video_signal_present)
+        {
+            br.bits(3);                         // video_format
+            info.full_range = br.bit() != 0;
+            info.colour_present = br.bit() != 0;
+            if (info.colour_present)
+            {
+                info.colour_primaries = br.bits(8);
+                info.transfer_characteristics = br.bits(8);
+                info.matrix_coefficients = br.bits(8);
+            }
+        }
+        if (br.bit())                           // chroma_loc_info_present_flag
+        {
+            br.ue();
+            br.ue();
+        }
+        if (br.bit())                           // timing_info_present_flag
+        {
+            info.num_units_in_tick = br.bits(32);
+            info.time_scale = br.bits(32);
+        }
+    }
+
+    return !br.overrun();
+}
+
+// Splits Annex B data (start code prefixed) into NAL units.
+inline void AvcSplitAnnexB(uint8_t const * data, size_t size, AvcConfig & config)
+{
+    size_t i = 0;
+    size_t begin = size;
+    while (i + 3 <= size)
+    {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)
+        {
+            if (begin < size)
+            {
+                size_t end = i;
+                while (end > begin && data[end - 1] == 0)
+                {
+                    --end;
+                }
+                std::vector<uint8_t> nal(data + begin, data + end);
+                if (!nal.empty() && (nal[0] & 0x1f) == 7) config.sps.push_back(nal);
+                if (!nal.empty() && (nal[0] & 0x1f) == 8) config.pps.push_back(nal);
+            }
+            i += 3;
+            begin = i;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    if (begin < size)
+    {
+        std::vector<uint8_t> nal(data + begin, data + size);
+        if ((nal[0] & 0x1f) == 7) config.sps.push_back(nal);
+        if ((nal[0] & 0x1f) == 8) config.pps.push_back(nal);
+    }
+}
+
+// Parses an AVCDecoderConfigurationRecord (avcC), or Annex B private
+// data, which some muxers produce instead.
+inline bool AvcParseConfig(uint8_t const * data, size_t size, AvcConfig & config)
+{
+    config.nal_length_size = 0;
+    config.sps.clear();
+    config.pps.clear();
+
+    if (size >= 3 && data[0] == 0 && data[1] == 0 && (data[2] == 1 || (size >= 4 && data[2] == 0 && data[3] == 1)))
+    {
+        AvcSplitAnnexB(data, size, config);
+        return !config.sps.empty();
+    }
+
+    if (size < 7 || data[0] != 1)
+    {
+        return false;
+    }
+    config.nal_length_size = (data[4] & 3) + 1;
+
+    size_t pos = 5;
+    for (int list = 0; list < 2; ++list)
+    {
+        if (pos >= size)
+        {
+            return false;
+        }
+        unsigned count = list == 0 ? (data[pos] & 0x1f) : data[pos];
+        ++pos;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            if (pos + 2 > size)
+            {
+                return false;
+            }
+            size_t len = (data[pos] << 8) | data[pos + 1];
+            pos += 2;
+            if (len == 0 || pos + len > size)
+            {
+                return false;
+            }
+            std::vector<uint8_t> nal(data + pos, data + pos + len);
+            (list == 0 ? config.sps : config.pps).push_back(nal);
+            pos += len;
+        }
+    }
+    return !config.sps.empty();
+}
+
+// Builds the Annex B sequence header (start code + SPS/PPS NALs).
+inline void AvcBuildSequenceHeader(AvcConfig const & config, std::vector<uint8_t> & header)
+{
+    static uint8_t const start_code[4] = {0, 0, 0, 1};
+    header.clear();
+    for (size_t i = 0; i < config.sps.size(); ++i)
+    {
+        header.insert(header.end(), start_code, start_code + 4);
+        header.insert(header.end(), config.sps[i].begin(), config.sps[i].end());
+    }
+    for (size_t i = 0; i < config.pps.size(); ++i)
+    {
+        header.insert(header.end(), start_code, start_code + 4);
+        header.insert(header.end(), config.pps[i].begin(), config.pps[i].end());
+    }
+}
+
+//-------------------------------------------------------------------
+// MPEG-4 Part 2
+//-------------------------------------------------------------------
+
+struct Mp4vVolInfo
+{
+    uint32_t width;
+    uint32_t height;
+    bool interlaced;
+    uint32_t par_num;               // 0 if not present
+    uint32_t par_den;
+    bool colour_present;
+    bool full_range;
+    uint32_t colour_primaries;
+    uint32_t transfer_characteristics;
+    uint32_t matrix_coefficients;
+};
+
+// Parses the first video object layer header of the configuration.
+inline bool Mp4vParseVol(uint8_t const * data, size_t size, Mp4vVolInfo & info)
+{
+    memset(&info, 0, sizeof(info));
+
+    size_t vol = size;
+    for (size_t i = 0; i + 4 <= size; ++i)
+    {
+        if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1)
+        {
+            continue;
+        }
+        if (data[i + 3] >= 0x20 && data[i + 3] <= 0x2f)
+        {
+            vol = i + 4;
+            break;
+        }
+    }
+    if (vol >= size)
+    {
+        return false;
+    }
+
+    CodecBitReader br(data + vol, size - vol);
+    br.bit();                                   // random_accessible_vol
+    br.bits(8);                                 // video_object_type_indication
+    if (br.bit())                               // is_object_layer_identifier
+    {
+        br.bits(4);                             // video_object_layer_verid
+        br.bits(3);                             // video_object_layer_priority
+    }
+    uint32_t aspect = br.bits(4);
+    if (aspect == 15)
+    {
+        info.par_num = br.bits(8);
+        info.par_den = br.bits(8);
+    }
+    else
+    {
+        static uint32_t const par_table[6][2] = {
+            {0, 0}, {1, 1}, {12, 11}, {10, 11}, {16, 11}, {40, 33},
+        };
+        if (aspect < 6)
+        {
+            info.par_num = par_table[aspect][0];
+            info.par_den = par_table[aspect][1];
+        }
+    }
+    if (br.bit())                               // vol_control_parameters
+    {
+        br.bits(2);                             // chroma_format
+        br.bit();                               // low_delay
+        if (br.bit())                           // vbv_parameters
+        {
+            br.skip(15 + 1 + 15 + 1 + 15 + 1 + 3 + 11 + 1 + 15 + 1);
+        }
+    }
+    uint32_t shape = br.bits(2);
+    if (shape != 0)
+    {
+        // Only rectangular shapes are used for playback.
+        return false;
+    }
+    if (!br.bit())                              // marker
+    {
+        return false;
+    }
+    uint32_t resolution = br.bits(16);          // vop_time_increment_resolution
+    if (resolution == 0 || !br.bit())
+    {
+        return false;
+    }
+    if (br.bit())                               // fixed_vop_rate
+    {
+        unsigned n = 1;
+        while ((1u << n) < resolution && n < 16)
+        {
+            ++n;
+        }
+        br.bits(n);
+    }
+    if (!br.bit())
+    {
+        return false;
+    }
+    info.width = br.bits(13);
+    if (!br.bit())
+    {
+        return false;
+    }
+    info.height = br.bits(13);
+    if (!br.bit())
+    {
+        return false;
+    }
+    info.interlaced = br.bit() != 0;
+
+    return !br.overrun() && info.width && info.height;
+}
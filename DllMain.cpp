@@ -14,6 +14,7 @@
 #include "StdAfx.h"
 #include <wrl\module.h>
 #include "PpboxSchemeHandler.h"
+#include "EventTrace.h"
 
 namespace Microsoft { namespace Samples {
     ActivatableClass(PpboxSchemeHandler);
@@ -33,6 +34,7 @@ BOOL WINAPI DllMain( _In_ HINSTANCE hInstance, _In_ DWORD dwReason, _In_opt_ LPV
     }
     else if( DLL_PROCESS_DETACH == dwReason )
     {
+        EventTrace::Terminate();
         Module<InProc>::GetModule().Terminate();
     }
 
@@ -56,3 +58,12 @@ STDAPI DllGetClassObject( _In_ REFCLSID rclsid, _In_ REFIID riid, _Outptr_ LPVOI
     auto &module = Microsoft::WRL::Module<Microsoft::WRL::InProc>::GetModule();
     return module.GetClassObject( rclsid, riid, ppv );
 }
+
+//
+//  Writes the event trace of the process as Chrome trace JSON, for a
+//  host or a debugger to call on demand.
+//
+STDAPI PpboxDumpEventTrace( _In_ LPCWSTR pszPath )
+{
+    return EventTrace::Dump( pszPath );
+}
@@ -0,0 +1,407 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// EventTrace.cpp
+// Binary event trace of the sample path, exported as a Chrome trace.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "EventTrace.h"
+#include "Trace.h"
+
+#include <new>
+#include <string>
+#include <stdio.h>
+
+// Orders the stores of a record against the store of its sequence, and
+// the loads of Dump likewise. x86 and x64 keep stores, and loads, in
+// order, so only the compiler has to be stopped.
+#if defined(_M_IX86) || defined(_M_X64)
+#define EVENT_TRACE_FENCE() _ReadWriteBarrier()
+#else
+#define EVENT_TRACE_FENCE() MemoryBarrier()
+#endif
+
+struct EventTraceRing
+{
+    DWORD volatile      dwThreadId;
+    LONG volatile       lOwned;         // 1 until the writing thread exits
+    UINT32 volatile     uFirst;         // First record of that thread
+    UINT32 volatile     uHead;          // Records written
+    EventTraceRecord    records[EVENT_TRACE_RING_SIZE];
+};
+
+BOOL volatile   EventTrace::s_bEnabled = FALSE;
+UINT32          EventTrace::s_uCostNs = 0;
+
+static EventTraceRing * volatile    s_rings[EVENT_TRACE_MAX_THREADS];
+static LONG volatile                s_cRings = 0;       // Slots taken, may pass the maximum
+static UINT64                       s_uFrequency = 0;
+static UINT64                       s_uOrigin = 0;      // Time 0 of the dump
+static DWORD                        s_dwFlsIndex = FLS_OUT_OF_INDEXES;  // Ring of the thread
+
+__declspec(thread) static EventTraceRing *  t_pRing = NULL;
+__declspec(thread) static BOOL              t_bUntraced = FALSE;
+
+// Called by the fiber local storage when a thread exits, so another
+// thread can take its ring over.
+static VOID WINAPI ReleaseRing(PVOID pData)
+{
+    EventTraceRing *pRing = (EventTraceRing *)pData;
+    if (pRing)
+    {
+        InterlockedExchange(&pRing->lOwned, 0);
+    }
+}
+
+void EventTrace::Enable(BOOL bEnable)
+{
+    if (bEnable && s_uFrequency == 0)
+    {
+        LARGE_INTEGER li;
+        QueryPerformanceFrequency(&li);
+        s_uFrequency = li.QuadPart;
+        s_uOrigin = Now();
+        s_dwFlsIndex = FlsAlloc(&ReleaseRing);
+        Calibrate();
+    }
+    s_bEnabled = bEnable;
+}
+
+void EventTrace::Terminate()
+{
+    s_bEnabled = FALSE;
+    if (s_dwFlsIndex != FLS_OUT_OF_INDEXES)
+    {
+        FlsFree(s_dwFlsIndex);
+        s_dwFlsIndex = FLS_OUT_OF_INDEXES;
+    }
+}
+
+UINT64 EventTrace::Now()
+{
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+    return li.QuadPart;
+}
+
+void EventTrace::Write(EventTraceType type, UINT64 uStart, UINT32 uDuration, UINT32 uArg0, UINT64 uArg1)
+{
+    EventTraceRing *pRing = ThreadRing();
+    if (pRing)
+    {
+        WriteTo(pRing, type, uStart, uDuration, uArg0, uArg1);
+    }
+}
+
+void EventTrace::WriteTo(EventTraceRing *pRing, EventTraceType type, UINT64 uStart, UINT32 uDuration, UINT32 uArg0, UINT64 uArg1)
+{
+    UINT32 uIndex = pRing->uHead;
+    EventTraceRecord &record = pRing->records[uIndex & (EVENT_TRACE_RING_SIZE - 1)];
+
+    record.uSequence = 0;
+    EVENT_TRACE_FENCE();
+    record.uStart = uStart;
+    record.uDuration = uDuration;
+    record.uType = (UINT16)type;
+    record.uArg0 = uArg0;
+    record.uArg1 = uArg1;
+    EVENT_TRACE_FENCE();
+    record.uSequence = uIndex + 1;
+    pRing->uHead = uIndex + 1;
+}
+
+//-------------------------------------------------------------------
+// ThreadRing
+// Returns the ring of the calling thread, allocating it on the first
+// record, or taking over the ring of an exited thread once all the
+// slots are used. NULL if the thread is not traced.
+//-------------------------------------------------------------------
+
+EventTraceRing * EventTrace::ThreadRing()
+{
+    if (t_pRing || t_bUntraced)
+    {
+        return t_pRing;
+    }
+
+    t_bUntraced = TRUE;
+
+    EventTraceRing *pRing = NULL;
+    ULONG iSlot = (ULONG)InterlockedIncrement(&s_cRings) - 1;
+    if (iSlot < EVENT_TRACE_MAX_THREADS)
+    {
+        pRing = new (std::nothrow) EventTraceRing;
+        if (pRing == NULL)
+        {
+            return NULL;
+        }
+        ZeroMemory(pRing, sizeof(*pRing));
+        pRing->dwThreadId = GetCurrentThreadId();
+        pRing->lOwned = 1;
+
+        // Rings live as long as the process; Dump may be reading them.
+        InterlockedExchangePointer((PVOID volatile *)&s_rings[iSlot], pRing);
+    }
+    else
+    {
+        InterlockedDecrement(&s_cRings);
+        pRing = ReuseRing();
+        if (pRing == NULL)
+        {
+            TRACE(1, L"EventTrace: thread %u not traced, %u threads running\r\n",
+                GetCurrentThreadId(), EVENT_TRACE_MAX_THREADS);
+            return NULL;
+        }
+    }
+
+    if (s_dwFlsIndex != FLS_OUT_OF_INDEXES)
+    {
+        (void)FlsSetValue(s_dwFlsIndex, pRing);
+    }
+    t_pRing = pRing;
+    t_bUntraced = FALSE;
+    return pRing;
+}
+
+//-------------------------------------------------------------------
+// ReuseRing
+// Takes over the ring of a thread that exited. Its records are
+// dropped from the dump rather than shown under the new thread.
+//-------------------------------------------------------------------
+
+EventTraceRing * EventTrace::ReuseRing()
+{
+    for (DWORD i = 0; i < EVENT_TRACE_MAX_THREADS; ++i)
+    {
+        EventTraceRing *pRing = s_rings[i];
+        if (pRing && InterlockedCompareExchange(&pRing->lOwned, 1, 0) == 0)
+        {
+            pRing->dwThreadId = GetCurrentThreadId();
+            pRing->uFirst = pRing->uHead;
+            return pRing;
+        }
+    }
+    return NULL;
+}
+
+//-------------------------------------------------------------------
+// Calibrate
+// Measures the cost of a trace point, counter read included, on a ring
+// of its own.
+//-------------------------------------------------------------------
+
+void EventTrace::Calibrate()
+{
+    const UINT32 cRecords = 4 * EVENT_TRACE_RING_SIZE;
+
+    EventTraceRing *pRing = new (std::nothrow) EventTraceRing;
+    if (pRing == NULL)
+    {
+        return;
+    }
+    ZeroMemory(pRing, sizeof(*pRing));
+
+    UINT64 uStart = Now();
+    for (UINT32 i = 0; i < cRecords; ++i)
+    {
+        WriteTo(pRing, EVENT_TRACE_OP, Now(), 0, i, 0);
+    }
+    UINT64 uElapsed = Now() - uStart;
+
+    s_uCostNs = (UINT32)(uElapsed * 1000000000 / s_uFrequency / cRecords);
+    delete pRing;
+
+    TRACE(3, L"EventTrace: %u ns per record\r\n", s_uCostNs);
+}
+
+void EventTrace::EnterLock(CRITICAL_SECTION *pcs)
+{
+    if (!s_bEnabled)
+    {
+        EnterCriticalSection(pcs);
+        return;
+    }
+    if (!TryEnterCriticalSection(pcs))
+    {
+        UINT64 uStart = Now();
+        EnterCriticalSection(pcs);
+        End(EVENT_TRACE_LOCK_WAIT, uStart);
+    }
+}
+
+UINT64 EventTrace::Events()
+{
+    LONG cRings = min(s_cRings, (LONG)EVENT_TRACE_MAX_THREADS);
+    UINT64 cEvents = 0;
+
+    for (LONG i = 0; i < cRings; ++i)
+    {
+        EventTraceRing *pRing = s_rings[i];
+        if (pRing)
+        {
+            cEvents += pRing->uHead;
+        }
+    }
+    return cEvents;
+}
+
+/* Chrome trace export */
+
+static char const * EventName(UINT16 uType, UINT32 uArg0)
+{
+    switch (uType)
+    {
+    case EVENT_TRACE_OP:            return "Operation";
+    case EVENT_TRACE_READ_SAMPLE:   return "ReadSample";
+    case EVENT_TRACE_ENQUEUE:       return "Enqueue";
+    case EVENT_TRACE_DISPATCH:      return "Dispatch";
+    case EVENT_TRACE_BUFFERING:     return uArg0 ? "BufferingStarted" : "BufferingStopped";
+    case EVENT_TRACE_LOCK_WAIT:     return "LockWait";
+    default:                        return "Unknown";
+    }
+}
+
+static void FormatArgs(EventTraceRecord const & record, char * psz, size_t cch)
+{
+    switch (record.uType)
+    {
+    case EVENT_TRACE_OP:
+        sprintf_s(psz, cch, "{\"op\":%u}", record.uArg0);
+        break;
+    case EVENT_TRACE_READ_SAMPLE:
+        sprintf_s(psz, cch, "{\"result\":%u,\"track\":%llu}", record.uArg0, record.uArg1);
+        break;
+    case EVENT_TRACE_ENQUEUE:
+    case EVENT_TRACE_DISPATCH:
+        sprintf_s(psz, cch, "{\"stream\":%u,\"time\":%llu}", record.uArg0, record.uArg1);
+        break;
+    default:
+        sprintf_s(psz, cch, "{}");
+        break;
+    }
+}
+
+//-------------------------------------------------------------------
+// Dump
+// Copies each record, then checks that its sequence did not change
+// while copying, so the writers are never stopped.
+//-------------------------------------------------------------------
+
+HRESULT EventTrace::Dump(LPCWSTR pszPath)
+{
+    if (s_uFrequency == 0)
+    {
+        return MF_E_INVALIDREQUEST;
+    }
+
+    std::string json;
+    char szLine[320];
+    char szArgs[128];
+    DWORD dwProcessId = GetCurrentProcessId();
+    LONG cRings = min(s_cRings, (LONG)EVENT_TRACE_MAX_THREADS);
+    BOOL bFirst = TRUE;
+
+    try
+    {
+        json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+        for (LONG i = 0; i < cRings; ++i)
+        {
+            EventTraceRing *pRing = s_rings[i];
+            if (pRing == NULL)
+            {
+                continue;
+            }
+
+            UINT32 uFirst = pRing->uFirst;
+            UINT32 uHead = pRing->uHead;
+            UINT32 uTail = uHead > EVENT_TRACE_RING_SIZE ? uHead - EVENT_TRACE_RING_SIZE : 0;
+            if (uTail < uFirst)
+            {
+                uTail = uFirst;
+            }
+
+            for (UINT32 uIndex = uTail; uIndex != uHead; ++uIndex)
+            {
+                EventTraceRecord const & slot = pRing->records[uIndex & (EVENT_TRACE_RING_SIZE - 1)];
+                UINT32 uSequence = slot.uSequence;
+                EVENT_TRACE_FENCE();
+                EventTraceRecord record;
+                CopyMemory(&record, (void const *)&slot, sizeof(record));
+                EVENT_TRACE_FENCE();
+                if (uSequence != uIndex + 1 || slot.uSequence != uSequence)
+                {
+                    continue;
+                }
+
+                double ts = (double)(LONGLONG)(record.uStart - s_uOrigin) * 1000000.0 / s_uFrequency;
+                FormatArgs(record, szArgs, ARRAYSIZE(szArgs));
+
+                if (record.uDuration)
+                {
+                    double dur = (double)record.uDuration * 1000000.0 / s_uFrequency;
+                    sprintf_s(szLine, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u,\"args\":%s}",
+                        bFirst ? "" : ",\n", EventName(record.uType, record.uArg0), ts, dur, dwProcessId, pRing->dwThreadId, szArgs);
+                }
+                else
+                {
+                    sprintf_s(szLine, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%u,\"tid\":%u,\"args\":%s}",
+                        bFirst ? "" : ",\n", EventName(record.uType, record.uArg0), ts, dwProcessId, pRing->dwThreadId, szArgs);
+                }
+                json += szLine;
+                bFirst = FALSE;
+            }
+        }
+
+        json += "\n]}\n";
+    }
+    catch (std::bad_alloc const &)
+    {
+        TRACEHR_RET(E_OUTOFMEMORY);
+    }
+
+    HRESULT hr = S_OK;
+    DWORD cbWritten = 0;
+    HANDLE hFile = CreateFile2(pszPath, GENERIC_WRITE, 0, CREATE_ALWAYS, NULL);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    if (SUCCEEDED(hr) && !WriteFile(hFile, json.c_str(), (DWORD)json.size(), &cbWritten, NULL))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    if (hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hFile);
+    }
+    TRACEHR_RET(hr);
+}
+
+/* EventTraceOverhead class */
+
+EventTraceOverhead::EventTraceOverhead()
+    : m_uBudget(EVENT_TRACE_DEFAULT_BUDGET)
+    , m_uCurrent(0)
+    , m_uLastTick(0)
+    , m_uLastEvents(0)
+{
+}
+
+BOOL EventTraceOverhead::Update(ULONGLONG uTick)
+{
+    UINT64 cEvents = EventTrace::Events();
+
+    if (m_uLastTick != 0 && uTick > m_uLastTick)
+    {
+        // Nanoseconds spent per millisecond is per mille.
+        m_uCurrent = (UINT32)((cEvents - m_uLastEvents) * EventTrace::CostNs()
+            / ((uTick - m_uLastTick) * 1000));
+    }
+    m_uLastTick = uTick;
+    m_uLastEvents = cEvents;
+
+    return m_uBudget == 0 || m_uCurrent <= m_uBudget;
+}
@@ -0,0 +1,146 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// EventTrace.h
+// Binary event trace of the sample path, exported as a Chrome trace.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <windows.h>
+
+const DWORD EVENT_TRACE_RING_SIZE = 2048;       // Records per thread, a power of 2
+const DWORD EVENT_TRACE_MAX_THREADS = 64;
+const DWORD EVENT_TRACE_DEFAULT_BUDGET = 10;    // Per mille of one core
+
+struct EventTraceRing;
+
+enum EventTraceType
+{
+    EVENT_TRACE_OP = 1,             // Operation dispatched: op type
+    EVENT_TRACE_READ_SAMPLE,        // Runtime read: result, track
+    EVENT_TRACE_ENQUEUE,            // Sample queued on a stream: stream, time
+    EVENT_TRACE_DISPATCH,           // Sample sent to the pipeline: stream, time
+    EVENT_TRACE_BUFFERING,          // Buffering started (1) or stopped (0)
+    EVENT_TRACE_LOCK_WAIT,          // Wait for the source lock
+};
+
+// 32 bytes. uSequence is written last; a record whose sequence does not
+// match its position is being written, or was overwritten.
+struct EventTraceRecord
+{
+    UINT64          uStart;         // Performance counter
+    UINT32          uDuration;      // Performance counter ticks, 0 for a mark
+    UINT16          uType;
+    UINT16          uReserved;
+    UINT64          uArg1;
+    UINT32          uArg0;
+    UINT32 volatile uSequence;
+};
+
+//-------------------------------------------------------------------
+// EventTrace class
+//
+// TRACE and TRACEHR_RET format a string per call, which is too slow to
+// leave on, and give no timeline. EventTrace keeps fixed-size binary
+// records in one ring per thread: only the owning thread writes a ring, so a
+// record costs a performance counter read and a few stores, without a
+// lock or an interlocked operation. Dump reads the rings while they are
+// written and skips the records that change under it.
+//
+// A thread gets a ring on its first record, and keeps it until it
+// exits. Past EVENT_TRACE_MAX_THREADS rings, a new thread takes over the
+// ring of a thread that exited, whose records are then dropped; if
+// none did, the thread is not traced. This bounds the memory even when
+// the work queues replace their threads.
+//
+// Disabled, a trace point costs one load and a branch.
+//-------------------------------------------------------------------
+
+class EventTrace
+{
+public:
+    static void    Enable(BOOL bEnable);
+
+    // Stops watching for thread exits. Called when the module unloads.
+    static void    Terminate();
+    static BOOL    IsEnabled() { return s_bEnabled; }
+
+    // Start of a span, 0 when disabled.
+    static UINT64  Begin()
+    {
+        return s_bEnabled ? Now() : 0;
+    }
+
+    // Records a span from uStart, taken with Begin, to now.
+    static void    End(EventTraceType type, UINT64 uStart, UINT32 uArg0 = 0, UINT64 uArg1 = 0)
+    {
+        if (uStart)
+        {
+            Write(type, uStart, (UINT32)(Now() - uStart), uArg0, uArg1);
+        }
+    }
+
+    // Records an event without a duration.
+    static void    Mark(EventTraceType type, UINT32 uArg0 = 0, UINT64 uArg1 = 0)
+    {
+        if (s_bEnabled)
+        {
+            Write(type, Now(), 0, uArg0, uArg1);
+        }
+    }
+
+    // Enters a critical section, and records the wait if it was held.
+    static void    EnterLock(CRITICAL_SECTION *pcs);
+
+    // Writes the records of all threads as Chrome trace JSON, for
+    // chrome://tracing or a trace viewer.
+    static HRESULT Dump(LPCWSTR pszPath);
+
+    // Records written by all threads.
+    static UINT64  Events();
+
+    // Measured cost of a record, in nanoseconds.
+    static UINT32  CostNs() { return s_uCostNs; }
+
+private:
+    static UINT64  Now();
+    static void    Write(EventTraceType type, UINT64 uStart, UINT32 uDuration, UINT32 uArg0, UINT64 uArg1);
+    static void    WriteTo(EventTraceRing *pRing, EventTraceType type, UINT64 uStart, UINT32 uDuration, UINT32 uArg0, UINT64 uArg1);
+    static EventTraceRing * ThreadRing();
+    static EventTraceRing * ReuseRing();
+    static void    Calibrate();
+
+private:
+    static BOOL volatile    s_bEnabled;
+    static UINT32           s_uCostNs;
+};
+
+//-------------------------------------------------------------------
+// EventTraceOverhead class
+//
+// Estimates the share of one core spent writing records, from the
+// measured cost of a record and the records written between updates.
+//-------------------------------------------------------------------
+
+class EventTraceOverhead
+{
+public:
+    EventTraceOverhead();
+
+    // uBudget: Per mille of one core, 0 for no budget.
+    void    SetBudget(UINT32 uBudget) { m_uBudget = uBudget; }
+
+    // Returns FALSE when the overhead since the last update is over the
+    // budget.
+    BOOL    Update(ULONGLONG uTick);
+
+    // Per mille of one core, since the last update.
+    UINT32  Current() const { return m_uCurrent; }
+
+private:
+    UINT32      m_uBudget;
+    UINT32      m_uCurrent;
+    ULONGLONG   m_uLastTick;
+    UINT64      m_uLastEvents;
+};
@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// InterleaveBalancer.cpp
+// Keeps badly interleaved content from starving one stream.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "InterleaveBalancer.h"
+
+InterleaveBalancer::InterleaveBalancer()
+    : m_uMaxSkew(0)
+    , m_uStarvations(0)
+{
+    Reset();
+}
+
+//-------------------------------------------------------------------
+// Reset
+// Starts over after a seek. The maximum skew and the starvation count
+// are kept.
+//-------------------------------------------------------------------
+
+void InterleaveBalancer::Reset()
+{
+    m_hnsMin = (UINT64)-1;
+    m_hnsMax = 0;
+    m_bStarving = FALSE;
+    m_bBoosted = FALSE;
+    m_uSkew = 0;
+}
+
+void InterleaveBalancer::Observe(UINT64 hnsQueued, BOOL bStarving)
+{
+    if (hnsQueued < m_hnsMin)
+    {
+        m_hnsMin = hnsQueued;
+    }
+    if (hnsQueued > m_hnsMax)
+    {
+        m_hnsMax = hnsQueued;
+    }
+    m_bStarving |= bStarving;
+}
+
+DWORD InterleaveBalancer::Update()
+{
+    if (m_hnsMin != (UINT64)-1)
+    {
+        m_uSkew = (UINT32)((m_hnsMax - m_hnsMin) / 10000);
+        if (m_uSkew > m_uMaxSkew)
+        {
+            m_uMaxSkew = m_uSkew;
+        }
+    }
+
+    // Only a stream starving while others have data is an interleave
+    // problem. With every queue empty, the network is the bottleneck.
+    BOOL bBoost = m_bStarving && m_hnsMax > 0;
+    if (bBoost && !m_bBoosted)
+    {
+        ++m_uStarvations;
+    }
+    m_bBoosted = bBoost;
+
+    m_hnsMin = (UINT64)-1;
+    m_hnsMax = 0;
+    m_bStarving = FALSE;
+
+    return bBoost ? INTERLEAVE_QUEUE_BOOST : INTERLEAVE_QUEUE_LIMIT;
+}
@@ -0,0 +1,62 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// InterleaveBalancer.h
+// Keeps badly interleaved content from starving one stream.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+const DWORD INTERLEAVE_QUEUE_LIMIT = 200;       // Samples a stream queues before dropping the oldest
+const DWORD INTERLEAVE_QUEUE_BOOST = 2000;      // Limit while another stream starves
+
+//-------------------------------------------------------------------
+// InterleaveBalancer class
+//
+// The runtime returns the samples of all streams in file order. When
+// the content is badly interleaved, the source has to read far ahead
+// on one stream to reach the next sample of another, and the queue of
+// the first stream grows until it drops samples.
+//
+// While a stream starves (it has requests and no samples), the other
+// streams may queue up to INTERLEAVE_QUEUE_BOOST samples instead, so
+// that reads can go on until the starving stream is served without
+// losing anything.
+//
+// The skew is the spread of the queued media time between the
+// streams. It stays small for well interleaved content.
+//-------------------------------------------------------------------
+
+class InterleaveBalancer
+{
+public:
+    InterleaveBalancer();
+
+    void    Reset();
+
+    // Feeds the level of one active stream.
+    //
+    // hnsQueued:   Queued media time, in 100-nanosecond units.
+    // bStarving:   Sample requests are waiting for data.
+    void    Observe(UINT64 hnsQueued, BOOL bStarving);
+
+    // Ends a round of observations. Returns the queue limit for all
+    // streams.
+    DWORD   Update();
+
+    UINT32  Skew() const { return m_uSkew; }
+    UINT32  MaxSkew() const { return m_uMaxSkew; }
+    UINT32  Starvations() const { return m_uStarvations; }
+
+private:
+    UINT64  m_hnsMin;
+    UINT64  m_hnsMax;
+    BOOL    m_bStarving;                // A stream starves in this round
+    BOOL    m_bBoosted;
+
+    UINT32  m_uSkew;                    // Milliseconds
+    UINT32  m_uMaxSkew;
+    UINT32  m_uStarvations;
+};
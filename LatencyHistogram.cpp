@@ -0,0 +1,95 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LatencyHistogram.cpp
+// Log-linear histogram of latencies, with percentile queries.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "LatencyHistogram.h"
+
+#include <string.h>
+
+LatencyHistogram::LatencyHistogram()
+{
+    Reset();
+}
+
+void LatencyHistogram::Reset()
+{
+    m_uCount = 0;
+    m_uMax = 0;
+    memset(m_Counts, 0, sizeof(m_Counts));
+}
+
+void LatencyHistogram::Add(UINT32 uValue)
+{
+    ++m_Counts[Bucket(uValue)];
+    ++m_uCount;
+    if (uValue > m_uMax)
+    {
+        m_uMax = uValue;
+    }
+}
+
+UINT32 LatencyHistogram::Percentile(DWORD dwPercent) const
+{
+    if (m_uCount == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the value, rounded up, 1-based.
+    UINT64 uRank = ((UINT64)m_uCount * dwPercent + 99) / 100;
+    if (uRank == 0)
+    {
+        uRank = 1;
+    }
+
+    UINT64 uSeen = 0;
+    for (DWORD i = 0; i < LATENCY_BUCKETS; ++i)
+    {
+        uSeen += m_Counts[i];
+        if (uSeen >= uRank)
+        {
+            UINT32 uEnd = BucketEnd(i);
+            return uEnd < m_uMax ? uEnd : m_uMax;
+        }
+    }
+    return m_uMax;
+}
+
+//-------------------------------------------------------------------
+// Bucket
+// Values below LATENCY_SUB_BUCKETS map to themselves. Above, the bucket
+// is given by the position of the highest bit and the LATENCY_SUB_BITS
+// bits below it.
+//-------------------------------------------------------------------
+
+DWORD LatencyHistogram::Bucket(UINT32 uValue)
+{
+    if (uValue < LATENCY_SUB_BUCKETS)
+    {
+        return uValue;
+    }
+
+    DWORD dwShift = 0;
+    while ((uValue >> dwShift) >= 2 * LATENCY_SUB_BUCKETS)
+    {
+        ++dwShift;
+    }
+    return ((dwShift + 1) << LATENCY_SUB_BITS) + ((uValue >> dwShift) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+UINT32 LatencyHistogram::BucketEnd(DWORD dwBucket)
+{
+    if (dwBucket < LATENCY_SUB_BUCKETS)
+    {
+        return dwBucket;
+    }
+
+    DWORD dwShift = (dwBucket >> LATENCY_SUB_BITS) - 1;
+    UINT64 uStart = (UINT64)(LATENCY_SUB_BUCKETS + (dwBucket & (LATENCY_SUB_BUCKETS - 1))) << dwShift;
+    UINT64 uEnd = uStart + ((UINT64)1 << dwShift) - 1;
+    return uEnd > 0xffffffff ? 0xffffffff : (UINT32)uEnd;
+}
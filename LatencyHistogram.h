@@ -0,0 +1,50 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LatencyHistogram.h
+// Log-linear histogram of latencies, with percentile queries.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+const DWORD LATENCY_SUB_BITS = 4;               // 16 buckets per power of 2
+const DWORD LATENCY_SUB_BUCKETS = 1 << LATENCY_SUB_BITS;
+const DWORD LATENCY_BUCKETS = (32 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS;
+
+//-------------------------------------------------------------------
+// LatencyHistogram class
+//
+// Values below 16 have a bucket each. Above, each power of 2 is split
+// into 16 buckets, so a percentile is within 1/16 of the true value
+// over the whole UINT32 range, like an HDR histogram with one
+// significant digit. Adding a value is a few shifts and an increment.
+//
+// The unit is the caller's; the source uses microseconds.
+//-------------------------------------------------------------------
+
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void    Reset();
+    void    Add(UINT32 uValue);
+
+    UINT32  Count() const { return m_uCount; }
+    UINT32  Max() const { return m_uMax; }
+
+    // Upper bound of the bucket holding the given percentile, at most
+    // Max. 0 when empty.
+    UINT32  Percentile(DWORD dwPercent) const;
+
+private:
+    static DWORD   Bucket(UINT32 uValue);
+    static UINT32  BucketEnd(DWORD dwBucket);
+
+private:
+    UINT32  m_uCount;
+    UINT32  m_uMax;
+    UINT32  m_Counts[LATENCY_BUCKETS];
+};
@@ -0,0 +1,105 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LiveLatencyController.cpp
+// Keeps the distance to the live edge of live playlinks under a target.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "LiveLatencyController.h"
+
+LiveLatencyController::LiveLatencyController()
+    : m_uTarget(0)
+    , m_uJump(0)
+    , m_bHasVideo(FALSE)
+    , m_uCatchUps(0)
+    , m_uJumps(0)
+    , m_uDropped(0)
+{
+    Reset();
+}
+
+void LiveLatencyController::Reset()
+{
+    m_mode = MODE_NORMAL;
+    m_uLatency = 0;
+    m_bJumpStarted = FALSE;
+    m_uJumpFrom = 0;
+    m_bDiscontinuity = FALSE;
+}
+
+BOOL LiveLatencyController::Update(UINT32 uLatency)
+{
+    Mode mode = m_mode;
+
+    m_uLatency = uLatency;
+
+    if (!IsEnabled() || m_mode == MODE_JUMP)
+    {
+        // While jumping, the progress is tracked with sample times.
+        return FALSE;
+    }
+
+    if (uLatency > JumpThreshold())
+    {
+        m_mode = MODE_JUMP;
+        m_bJumpStarted = FALSE;
+        ++m_uJumps;
+    }
+    else if (m_mode == MODE_NORMAL && uLatency > m_uTarget + m_uTarget / 4)
+    {
+        m_mode = MODE_CATCHUP;
+        ++m_uCatchUps;
+    }
+    else if (m_mode == MODE_CATCHUP && uLatency <= m_uTarget)
+    {
+        m_mode = MODE_NORMAL;
+    }
+
+    return mode != m_mode;
+}
+
+BOOL LiveLatencyController::OnSample(BOOL bVideo, BOOL bSync, BOOL bDisposable, UINT64 uTime)
+{
+    switch (m_mode)
+    {
+    case MODE_CATCHUP:
+        if (bVideo && bDisposable)
+        {
+            ++m_uDropped;
+            return TRUE;
+        }
+        return FALSE;
+
+    case MODE_JUMP:
+        if (!m_bJumpStarted)
+        {
+            m_bJumpStarted = TRUE;
+            m_uJumpFrom = uTime;
+        }
+        else
+        {
+            UINT32 uSkipped = uTime > m_uJumpFrom ? (UINT32)((uTime - m_uJumpFrom) / 10000) : 0;
+            BOOL bKey = m_bHasVideo ? (bVideo && bSync) : bSync;
+            if (bKey && uSkipped + m_uTarget >= m_uLatency)
+            {
+                m_uLatency -= uSkipped < m_uLatency ? uSkipped : m_uLatency;
+                m_mode = MODE_NORMAL;
+                m_bDiscontinuity = TRUE;
+                return FALSE;
+            }
+        }
+        ++m_uDropped;
+        return TRUE;
+
+    default:
+        return FALSE;
+    }
+}
+
+BOOL LiveLatencyController::TakeDiscontinuity()
+{
+    BOOL bDiscontinuity = m_bDiscontinuity;
+    m_bDiscontinuity = FALSE;
+    return bDiscontinuity;
+}
@@ -0,0 +1,92 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LiveLatencyController.h
+// Keeps the distance to the live edge of live playlinks under a target.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+const double LIVE_CATCHUP_RATE = 1.1;       // Playback rate suggested while catching up.
+
+//-------------------------------------------------------------------
+// LiveLatencyController class
+//
+// The runtime downloads live content up to the live edge, so the data
+// it has buffered ahead of the read position (buffer_time) is the
+// latency the source adds on top of the live edge.
+//
+// When the latency exceeds the target, the controller catches up:
+// - Slightly over the target, it drops non-reference video frames and
+//   suggests a faster playback rate, so that audio can be time
+//   compressed by the application.
+// - Far over the target (the jump threshold), it discards everything
+//   up to the first video key frame that brings the latency back to
+//   the target.
+//-------------------------------------------------------------------
+
+class LiveLatencyController
+{
+public:
+    enum Mode
+    {
+        MODE_NORMAL,
+        MODE_CATCHUP,       // Dropping non-reference frames
+        MODE_JUMP,          // Skipping to a key frame
+    };
+
+    LiveLatencyController();
+
+    // uTarget: Latency target in milliseconds, 0 disables the controller.
+    void    SetTarget(UINT32 uTarget) { m_uTarget = uTarget; }
+    // uJump: Latency in milliseconds over which the controller jumps, 0 for 3 times the target.
+    void    SetJumpThreshold(UINT32 uJump) { m_uJump = uJump; }
+    void    SetHasVideo(BOOL bHasVideo) { m_bHasVideo = bHasVideo; }
+
+    BOOL    IsEnabled() const { return m_uTarget != 0; }
+    Mode    GetMode() const { return m_mode; }
+
+    // Feeds the current latency (ms). Returns TRUE if the mode changed.
+    BOOL    Update(UINT32 uLatency);
+
+    // Decides if a sample is to be dropped.
+    //
+    // bVideo:      The sample belongs to a video stream.
+    // bSync:       The sample is a key frame (always TRUE for audio).
+    // bDisposable: The sample is a non-reference video frame.
+    // uTime:       Presentation time, in 100-nanosecond units.
+    BOOL    OnSample(BOOL bVideo, BOOL bSync, BOOL bDisposable, UINT64 uTime);
+
+    // Returns TRUE once after a jump completed. The next sample of
+    // each stream should be marked as a discontinuity.
+    BOOL    TakeDiscontinuity();
+
+    void    Reset();
+
+    double  RateHint() const { return m_mode == MODE_CATCHUP ? LIVE_CATCHUP_RATE : 1.0; }
+
+    UINT32  Latency() const { return m_uLatency; }
+    UINT32  CatchUps() const { return m_uCatchUps; }
+    UINT32  Jumps() const { return m_uJumps; }
+    UINT32  DroppedSamples() const { return m_uDropped; }
+
+private:
+    UINT32  JumpThreshold() const { return m_uJump ? m_uJump : m_uTarget * 3; }
+
+private:
+    UINT32  m_uTarget;
+    UINT32  m_uJump;
+    BOOL    m_bHasVideo;
+
+    Mode    m_mode;
+    UINT32  m_uLatency;
+    BOOL    m_bJumpStarted;
+    UINT64  m_uJumpFrom;            // Time of the first skipped sample
+    BOOL    m_bDiscontinuity;
+
+    UINT32  m_uCatchUps;
+    UINT32  m_uJumps;
+    UINT32  m_uDropped;
+};
@@ -0,0 +1,47 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// MemoryGovernor.cpp
+// Keeps the memory held by a source under a byte budget.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "MemoryGovernor.h"
+
+MemoryGovernor::MemoryGovernor()
+    : m_cbBudget(0)
+    , m_cbCurrent(0)
+    , m_cbPeak(0)
+    , m_uEvictions(0)
+{
+}
+
+UINT64 MemoryGovernor::Update(UINT64 cbUsed)
+{
+    m_cbCurrent = cbUsed;
+    if (cbUsed > m_cbPeak)
+    {
+        m_cbPeak = cbUsed;
+    }
+
+    if (m_cbBudget == 0 || cbUsed <= m_cbBudget)
+    {
+        return 0;
+    }
+    return cbUsed - m_cbBudget;
+}
+
+UINT64 MemoryGovernor::FairShare(UINT64 cbFixed, DWORD cStreams) const
+{
+    if (cStreams == 0 || cbFixed >= m_cbBudget)
+    {
+        return 0;
+    }
+    return (m_cbBudget - cbFixed) / cStreams;
+}
+
+void MemoryGovernor::OnEvicted(UINT64 cbEvicted)
+{
+    m_cbCurrent = cbEvicted < m_cbCurrent ? m_cbCurrent - cbEvicted : 0;
+    ++m_uEvictions;
+}
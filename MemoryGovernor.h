@@ -0,0 +1,54 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// MemoryGovernor.h
+// Keeps the memory held by a source under a byte budget.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+//-------------------------------------------------------------------
+// MemoryGovernor class
+//
+// Accounts the bytes a source holds: samples queued in its streams,
+// idle samples in the pools of the raw video converters, and the time
+// shift buffer. When the total exceeds the budget, the source frees
+// the idle pooled samples first, then drops the oldest queued samples
+// of the streams holding more than their fair share of what is left.
+//
+// The class only does the accounting, so that the policy can be driven
+// without Media Foundation.
+//-------------------------------------------------------------------
+
+class MemoryGovernor
+{
+public:
+    MemoryGovernor();
+
+    // cbBudget: Bytes, 0 for no limit.
+    void    SetBudget(UINT64 cbBudget) { m_cbBudget = cbBudget; }
+
+    BOOL    IsEnabled() const { return m_cbBudget != 0; }
+
+    // Records the bytes in use. Returns the bytes over the budget.
+    UINT64  Update(UINT64 cbUsed);
+
+    // Bytes each of cStreams queues may hold, once cbFixed bytes that
+    // cannot be evicted are taken from the budget.
+    UINT64  FairShare(UINT64 cbFixed, DWORD cStreams) const;
+
+    // Accounts evicted bytes.
+    void    OnEvicted(UINT64 cbEvicted);
+
+    UINT64  Current() const { return m_cbCurrent; }
+    UINT64  Peak() const { return m_cbPeak; }
+    UINT32  Evictions() const { return m_uEvictions; }
+
+private:
+    UINT64  m_cbBudget;
+    UINT64  m_cbCurrent;
+    UINT64  m_cbPeak;
+    UINT32  m_uEvictions;
+};
@@ -0,0 +1,160 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// PayloadAllocator.cpp
+// Allocates aligned and padded buffers for compressed payloads.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "PayloadAllocator.h"
+#include "SafeRelease.h"
+#include "Trace.h"
+
+#include <assert.h>
+
+PayloadAllocator::PayloadAllocator()
+    : m_cbAlignment(0)
+    , m_cbPadding(PAYLOAD_DEFAULT_PADDING)
+{
+    ZeroMemory(m_Pools, sizeof(m_Pools));
+}
+
+PayloadAllocator::~PayloadAllocator()
+{
+    ReleasePools();
+}
+
+void PayloadAllocator::SetLayout(DWORD cbAlignment, DWORD cbPadding)
+{
+    // Outstanding samples keep their pools.
+    ReleasePools();
+    m_cbAlignment = (cbAlignment & (cbAlignment - 1)) == 0 ? cbAlignment : 0;
+    m_cbPadding = cbPadding;
+}
+
+HRESULT PayloadAllocator::CreateSample(BYTE const * pData, DWORD cbData, IMFSample **ppSample)
+{
+    IMFSample *pSample = NULL;
+    IMFMediaBuffer *pBuffer = NULL;
+    BYTE *pDst = NULL;
+    DWORD cbMax = 0;
+
+    HRESULT hr = CreateBuffer(cbData + m_cbPadding, &pSample);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pSample->GetBufferByIndex(0, &pBuffer);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pBuffer->Lock(&pDst, &cbMax, NULL);
+    }
+
+    // A pooled buffer may hold an older payload, so the padding is
+    // zeroed every time.
+    if (SUCCEEDED(hr))
+    {
+        assert(cbMax >= cbData + m_cbPadding);
+        CopyMemory(pDst, pData, cbData);
+        ZeroMemory(pDst + cbData, m_cbPadding);
+        hr = pBuffer->Unlock();
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pBuffer->SetCurrentLength(cbData);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        *ppSample = pSample;
+        (*ppSample)->AddRef();
+    }
+
+    SafeRelease(&pBuffer);
+    SafeRelease(&pSample);
+    TRACEHR_RET(hr);
+}
+
+//-------------------------------------------------------------------
+// CreateBuffer
+// Gets a sample with a buffer of at least cbBuffer bytes, from the
+// pool of the next power of 2.
+//-------------------------------------------------------------------
+
+HRESULT PayloadAllocator::CreateBuffer(DWORD cbBuffer, IMFSample **ppSample)
+{
+    DWORD dwClass = PAYLOAD_MIN_CLASS;
+    while (dwClass <= PAYLOAD_MAX_CLASS && (1UL << dwClass) < cbBuffer)
+    {
+        ++dwClass;
+    }
+
+    if (dwClass > PAYLOAD_MAX_CLASS)
+    {
+        IMFSample *pSample = NULL;
+        IMFMediaBuffer *pBuffer = NULL;
+
+        HRESULT hr = MFCreateAlignedMemoryBuffer(cbBuffer, m_cbAlignment - 1, &pBuffer);
+        if (SUCCEEDED(hr))
+        {
+            hr = MFCreateSample(&pSample);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = pSample->AddBuffer(pBuffer);
+        }
+        if (SUCCEEDED(hr))
+        {
+            *ppSample = pSample;
+            (*ppSample)->AddRef();
+        }
+        SafeRelease(&pBuffer);
+        SafeRelease(&pSample);
+        TRACEHR_RET(hr);
+    }
+
+    SamplePool *& pPool = m_Pools[dwClass - PAYLOAD_MIN_CLASS];
+    HRESULT hr = S_OK;
+
+    if (pPool == NULL)
+    {
+        hr = SamplePool::CreateInstance(1UL << dwClass, m_cbAlignment, &pPool);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pPool->GetSample(ppSample);
+    }
+    TRACEHR_RET(hr);
+}
+
+UINT64 PayloadAllocator::PoolBytes()
+{
+    UINT64 cbIdle = 0;
+    for (DWORD i = 0; i < ARRAYSIZE(m_Pools); ++i)
+    {
+        if (m_Pools[i])
+        {
+            cbIdle += m_Pools[i]->IdleBytes();
+        }
+    }
+    return cbIdle;
+}
+
+void PayloadAllocator::TrimPools()
+{
+    for (DWORD i = 0; i < ARRAYSIZE(m_Pools); ++i)
+    {
+        if (m_Pools[i])
+        {
+            m_Pools[i]->Trim();
+        }
+    }
+}
+
+void PayloadAllocator::ReleasePools()
+{
+    for (DWORD i = 0; i < ARRAYSIZE(m_Pools); ++i)
+    {
+        SafeRelease(&m_Pools[i]);
+    }
+}
@@ -0,0 +1,59 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// PayloadAllocator.h
+// Allocates aligned and padded buffers for compressed payloads.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <windows.h>
+#include <mfapi.h>
+
+#include "SamplePool.h"
+
+const DWORD PAYLOAD_DEFAULT_PADDING = 64;
+const DWORD PAYLOAD_MIN_CLASS = 10;             // Smallest pooled buffer, 1 KB
+const DWORD PAYLOAD_MAX_CLASS = 22;             // Largest pooled buffer, 4 MB
+
+//-------------------------------------------------------------------
+// PayloadAllocator class
+//
+// MFCreateMemoryBuffer gives no alignment and no padding, and bitstream
+// readers of several decoders copy each payload into a padded buffer of
+// their own before parsing it. The allocator copies the payload into a
+// buffer that starts on the configured alignment and is followed by
+// zeroed padding, so the decoder can read it in place.
+//
+// Buffers come from pools with one size per power of 2. Payloads over
+// the largest size get a buffer of their own.
+//-------------------------------------------------------------------
+
+class PayloadAllocator
+{
+public:
+    PayloadAllocator();
+    ~PayloadAllocator();
+
+    // cbAlignment: Power of 2, 0 disables the allocator.
+    void    SetLayout(DWORD cbAlignment, DWORD cbPadding);
+
+    BOOL    IsEnabled() const { return m_cbAlignment != 0; }
+
+    // Creates a sample holding a copy of the payload. The sample has no
+    // time stamp.
+    HRESULT CreateSample(BYTE const * pData, DWORD cbData, IMFSample **ppSample);
+
+    // Memory of the idle pooled samples.
+    UINT64  PoolBytes();
+    void    TrimPools();
+
+private:
+    HRESULT CreateBuffer(DWORD cbBuffer, IMFSample **ppSample);
+    void    ReleasePools();
+
+private:
+    DWORD       m_cbAlignment;
+    DWORD       m_cbPadding;
+    SamplePool  *m_Pools[PAYLOAD_MAX_CLASS - PAYLOAD_MIN_CLASS + 1];
+};
@@ -0,0 +1,62 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// PortableTypes.h
+// Windows base types for the classes that do not depend on Windows.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+//-------------------------------------------------------------------
+// The decision logic of the source lives in classes that only use the
+// Windows base types, and get their inputs (tick counts, levels, byte
+// counts) from the caller:
+//
+//   RebufferPredictor, LiveLatencyController, StreamClock,
+//   InterleaveBalancer, MemoryGovernor, LatencyHistogram, StatHistory,
+//   BufferingController, StatSampler
+//
+// and so do the kernels of RawVideoKernels.h and the AVC bitstream
+// helpers of AvcBitstream.h.
+//
+// They include this header instead of <windows.h>, and do not use the
+// min and max macros, so they also compile on other platforms to be
+// profiled or replayed offline. Their source files still start with
+// StdAfx.h for the precompiled header, so a build outside the project
+// supplies an empty StdAfx.h in its place.
+//-------------------------------------------------------------------
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <stdint.h>
+
+typedef int             BOOL;
+typedef uint8_t         BYTE;
+typedef int16_t         INT16;
+typedef uint16_t        UINT16;
+typedef int32_t         INT32;
+typedef int32_t         LONG;
+typedef uint32_t        UINT32;
+typedef uint32_t        DWORD;
+typedef int64_t         LONGLONG;
+typedef uint64_t        UINT64;
+typedef int32_t         HRESULT;
+
+#define S_OK            ((HRESULT)0)
+#define S_FALSE         ((HRESULT)1)
+#define E_NOTIMPL       ((HRESULT)0x80004001)
+#define E_FAIL          ((HRESULT)0x80004005)
+#define E_OUTOFMEMORY   ((HRESULT)0x8007000E)
+#define SUCCEEDED(hr)   (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)      (((HRESULT)(hr)) < 0)
+
+#ifndef TRUE
+#define TRUE            1
+#define FALSE           0
+#endif
+
+#endif
@@ -23,8 +23,10 @@
 #include "SourceOp.h"
 #include "PropertySet.h"
 #include "Trace.h"
+#include "TraceGate.h"
 
 #include "PpboxMediaType.h"
+#include "AvcBitstream.h"
 //-------------------------------------------------------------------
 //
 // Notes:
@@ -76,6 +78,172 @@ HRESULT PpboxMediaSource::CreateInstance(PpboxMediaSource **ppSource)
 }
 
 
+//-------------------------------------------------------------------
+// LookupConfig
+// Finds an option in the configuration property set.
+//
+// Returns S_FALSE if the option is absent.
+//-------------------------------------------------------------------
+
+static HRESULT LookupConfig(
+    ABI::Windows::Foundation::Collections::IPropertySet *pConfiguration,
+    LPCWSTR pszKey,
+    ComPtr<ABI::Windows::Foundation::IPropertyValue> &spValue)
+{
+    using namespace ABI::Windows::Foundation;
+    using namespace ABI::Windows::Foundation::Collections;
+
+    ComPtr<IMap<HSTRING, IInspectable *>> spMap;
+    ComPtr<IInspectable> spInspectable;
+    Microsoft::WRL::Wrappers::HStringReference key(pszKey);
+    boolean bFound = false;
+
+    if (pConfiguration == NULL)
+    {
+        return S_FALSE;
+    }
+
+    HRESULT hr = pConfiguration->QueryInterface(IID_PPV_ARGS(&spMap));
+
+    if (SUCCEEDED(hr))
+    {
+        hr = spMap->HasKey(key.Get(), &bFound);
+    }
+    if (SUCCEEDED(hr) && !bFound)
+    {
+        return S_FALSE;
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = spMap->Lookup(key.Get(), &spInspectable);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = spInspectable.As(&spValue);
+    }
+    return hr;
+}
+
+//-------------------------------------------------------------------
+// GetConfigValue
+// Reads a numeric option from the configuration property set.
+//
+// Returns S_FALSE and leaves value untouched if the option is absent.
+//-------------------------------------------------------------------
+
+static HRESULT GetConfigValue(
+    ABI::Windows::Foundation::Collections::IPropertySet *pConfiguration,
+    LPCWSTR pszKey,
+    UINT32 &value)
+{
+    using namespace ABI::Windows::Foundation;
+
+    ComPtr<IPropertyValue> spValue;
+    PropertyType type;
+
+    HRESULT hr = LookupConfig(pConfiguration, pszKey, spValue);
+
+    if (hr == S_OK)
+    {
+        hr = spValue->get_Type(&type);
+    }
+    if (SUCCEEDED(hr))
+    {
+        // Javascript passes every number as a double.
+        if (type == PropertyType_Double)
+        {
+            DOUBLE d = 0;
+            hr = spValue->GetDouble(&d);
+            value = (UINT32)d;
+        }
+        else if (type == PropertyType_Boolean)
+        {
+            boolean b = false;
+            hr = spValue->GetBoolean(&b);
+            value = b ? 1 : 0;
+        }
+        else
+        {
+            hr = spValue->GetUInt32(&value);
+        }
+    }
+    return hr;
+}
+
+//-------------------------------------------------------------------
+// GetConfigString
+// Reads a string option from the configuration property set.
+//
+// Returns S_FALSE and leaves value untouched if the option is absent.
+//-------------------------------------------------------------------
+
+static HRESULT GetConfigString(
+    ABI::Windows::Foundation::Collections::IPropertySet *pConfiguration,
+    LPCWSTR pszKey,
+    std::wstring &value)
+{
+    ComPtr<ABI::Windows::Foundation::IPropertyValue> spValue;
+    Microsoft::WRL::Wrappers::HString str;
+
+    HRESULT hr = LookupConfig(pConfiguration, pszKey, spValue);
+
+    if (hr == S_OK)
+    {
+        hr = spValue->GetString(str.GetAddressOf());
+    }
+    if (hr == S_OK)
+    {
+        UINT32 cch = 0;
+        LPCWSTR psz = str.GetRawBuffer(&cch);
+        value.assign(psz, cch);
+    }
+    return hr;
+}
+
+//-------------------------------------------------------------------
+// SetStatValue64
+// Writes a 64-bit counter to the statistics. PropertySetSet only
+// writes 32-bit values, which byte counters outgrow.
+//-------------------------------------------------------------------
+
+static HRESULT SetStatValue64(
+    ABI::Windows::Foundation::Collections::IPropertySet *pMap,
+    LPCWSTR pszKey,
+    UINT64 value)
+{
+    using namespace ABI::Windows::Foundation;
+    using namespace ABI::Windows::Foundation::Collections;
+
+    ComPtr<IPropertyValueStatics> spStatics;
+    ComPtr<IMap<HSTRING, IInspectable *>> spMap;
+    ComPtr<IInspectable> spValue;
+    Microsoft::WRL::Wrappers::HStringReference key(pszKey);
+    boolean bReplaced = false;
+
+    if (pMap == NULL)
+    {
+        return S_FALSE;
+    }
+
+    HRESULT hr = Windows::Foundation::GetActivationFactory(
+        Microsoft::WRL::Wrappers::HStringReference(RuntimeClass_Windows_Foundation_PropertyValue).Get(),
+        &spStatics);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = spStatics->CreateUInt64(value, &spValue);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pMap->QueryInterface(IID_PPV_ARGS(&spMap));
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = spMap->Insert(key.Get(), spValue.Get(), &bReplaced);
+    }
+    return hr;
+}
+
 IFACEMETHODIMP PpboxMediaSource::SetProperties(ABI::Windows::Foundation::Collections::IPropertySet *pConfiguration)
 {
     using namespace ABI::Windows::Foundation;
@@ -88,6 +256,136 @@ IFACEMETHODIMP PpboxMediaSource::SetProperties(ABI::Windows::Foundation::Collect
     PropertySetSet(m_pStatMap, L"BytesRecevied", m_uBytesRecevied);
     PropertySetSet(m_pStatMap, L"DownloadSpeed", m_uDownloadSpeed);
 
+    UINT32 value = 0;
+    if (GetConfigValue(pConfiguration, L"LiveLatencyTarget", value) == S_OK)
+    {
+        m_LiveLatency.SetTarget(value);
+    }
+    if (GetConfigValue(pConfiguration, L"LiveLatencyJump", value) == S_OK)
+    {
+        m_LiveLatency.SetJumpThreshold(value);
+    }
+    if (GetConfigValue(pConfiguration, L"TimeShiftWindow", value) == S_OK)
+    {
+        m_TimeShift.SetWindow(value);
+    }
+    if (GetConfigValue(pConfiguration, L"TimeShiftBudget", value) == S_OK)
+    {
+        m_TimeShift.SetBudget(value);
+    }
+    if (GetConfigValue(pConfiguration, L"AvcBitstreamFormat", value) == S_OK && value <= AVC_FORMAT_ANNEXB)
+    {
+        m_uAvcFormat = value;
+    }
+    if (GetConfigValue(pConfiguration, L"AvcInsertParameterSets", value) == S_OK)
+    {
+        m_bAvcInsertParameterSets = (value != 0);
+    }
+    if (GetConfigValue(pConfiguration, L"RawVideoConversion", value) == S_OK)
+    {
+        m_bConvertRawVideo = (value != 0);
+    }
+    if (GetConfigValue(pConfiguration, L"AudioFormat", value) == S_OK && value <= AUDIO_FORMAT_FLOAT)
+    {
+        m_AudioOptions.uFormat = value;
+    }
+    if (GetConfigValue(pConfiguration, L"AudioDownmix", value) == S_OK)
+    {
+        m_AudioOptions.bDownmix = (value != 0);
+    }
+    if (GetConfigValue(pConfiguration, L"AudioSampleRate", value) == S_OK)
+    {
+        m_AudioOptions.uSampleRate = value;
+    }
+    if (GetConfigValue(pConfiguration, L"AudioAggregateFrames", value) == S_OK)
+    {
+        m_uAggregateFrames = value;
+    }
+    if (GetConfigValue(pConfiguration, L"AudioAggregateLatency", value) == S_OK)
+    {
+        m_uAggregateLatency = value;
+    }
+    if (GetConfigValue(pConfiguration, L"BufferAlignment", value) == S_OK && (value & (value - 1)) == 0)
+    {
+        m_cbBufferAlignment = value;
+    }
+    if (GetConfigValue(pConfiguration, L"BufferPadding", value) == S_OK)
+    {
+        m_cbBufferPadding = value;
+    }
+    if (GetConfigValue(pConfiguration, L"MemoryBudget", value) == S_OK)
+    {
+        m_Memory.SetBudget(value);
+    }
+    if (GetConfigValue(pConfiguration, L"EventTraceBudget", value) == S_OK)
+    {
+        m_TraceOverhead.SetBudget(value);
+    }
+    if (GetConfigValue(pConfiguration, L"TraceLevel", value) == S_OK)
+    {
+        TraceGate::SetLevel((int)value);
+    }
+    if (GetConfigValue(pConfiguration, L"EventTrace", value) == S_OK)
+    {
+        EventTrace::Enable(value != 0);
+    }
+    GetConfigString(pConfiguration, L"EventTraceFile", m_strTraceFile);
+
+    DWORD cHistory = STAT_HISTORY_DEFAULT_LENGTH;
+    if (GetConfigValue(pConfiguration, L"StatHistoryLength", value) == S_OK)
+    {
+        cHistory = value;
+    }
+    if (GetConfigValue(pConfiguration, L"StatHistoryInterval", value) == S_OK && value != 0)
+    {
+        m_StatSampler.SetInterval(SAMPLER_HISTORY, value);
+    }
+
+    // Intervals of the statistics sampler, in milliseconds; 0 stops
+    // the metric.
+    if (GetConfigValue(pConfiguration, L"StatPlayInterval", value) == S_OK)
+    {
+        m_StatSampler.SetInterval(SAMPLER_PLAY_STAT, value);
+    }
+    if (GetConfigValue(pConfiguration, L"StatDataInterval", value) == S_OK)
+    {
+        m_StatSampler.SetInterval(SAMPLER_DATA_STAT, value);
+    }
+    if (GetConfigValue(pConfiguration, L"StatPublishInterval", value) == S_OK)
+    {
+        m_StatSampler.SetInterval(SAMPLER_PUBLISH, value);
+    }
+    if (GetConfigValue(pConfiguration, L"StatHistoryWindow", value) == S_OK && value != 0)
+    {
+        m_uHistoryWindow = value;
+    }
+    if (SUCCEEDED(hr) && !m_History.SetLength(cHistory))
+    {
+        hr = E_OUTOFMEMORY;
+    }
+
+    // Recording and replay of the runtime calls, for diagnostics.
+    std::wstring path;
+    BOOL bRecordPayloads = FALSE;
+    if (GetConfigValue(pConfiguration, L"SessionRecordPayloads", value) == S_OK)
+    {
+        bRecordPayloads = (value != 0);
+    }
+    if (SUCCEEDED(hr) && GetConfigString(pConfiguration, L"SessionRecordFile", path) == S_OK)
+    {
+        hr = m_session.SetRecordFile(path.c_str(), bRecordPayloads);
+    }
+    if (SUCCEEDED(hr) && GetConfigString(pConfiguration, L"SessionReplayFile", path) == S_OK)
+    {
+        hr = m_session.SetReplayFile(path.c_str());
+    }
+
+    // Shared-memory telemetry, for monitoring from another process.
+    if (SUCCEEDED(hr) && GetConfigString(pConfiguration, L"TelemetryName", path) == S_OK)
+    {
+        hr = m_Telemetry.Open(path.c_str());
+    }
+
     TRACEHR_RET(hr);
 }
 
@@ -407,12 +705,24 @@ HRESULT PpboxMediaSource::GetCharacteristics(DWORD* pdwCharacteristics)
     TRACEHR_RET(hr);
 }
 
+//-------------------------------------------------------------------
+// OnPpboxTimer
+// Runtime callback of the timers, armed with a TimerOp. The op is the
+// state of the work item, and the source compares it with the op it
+// has armed. The runtime does not call back once CancelCallback has
+// returned, and the source holds the op until then.
+//-------------------------------------------------------------------
+
 static void OnPpboxTimer(
-	PP_context callback, 
-	PP_err result)
+    PP_context context,
+    PP_err result)
 {
-	AsyncCallback<PpboxMediaSource> * async_callback = (AsyncCallback<PpboxMediaSource> *)callback;
-	MFPutWorkItem2(MFASYNC_CALLBACK_QUEUE_STANDARD, 0, async_callback, NULL);
+    TimerOp * pOp = (TimerOp *)context;
+    if (result == just_operation_canceled)
+    {
+        return;
+    }
+    MFPutWorkItem2(MFASYNC_CALLBACK_QUEUE_STANDARD, 0, pOp->Callback(), pOp);
 }
 
 
@@ -452,7 +762,7 @@ HRESULT PpboxMediaSource::AsyncOpen(
         m_state = STATE_OPENING;
 
 		AddRef();
-        JUST_AsyncOpenEx(
+        m_session.AsyncOpen(
 			pszPlaylink, 
             "format=raw"
                 "&mux.RawMuxer.real_format=asf"
@@ -462,9 +772,7 @@ HRESULT PpboxMediaSource::AsyncOpen(
                 "&mux.Encoder.AVC1.param={profile:baseline,ref:2}", // &mux.TimeScale.time_adjust_mode=2
 			this, 
 			&PpboxMediaSource::StaticOpenCallback);
-        m_OnScheduleTimer.AddRef();
-		m_keyScheduleTimer = 
-			JUST_ScheduleCallback(100, &m_OnScheduleTimer, OnPpboxTimer);
+        ScheduleTimer(100);
     }
 
 	SafeRelease(&pResult);
@@ -477,7 +785,7 @@ void __cdecl PpboxMediaSource::StaticOpenCallback(PP_context user, PP_err err)
 	PpboxMediaSource * inst = (PpboxMediaSource *)user;
     if (err != just_success && err != just_already_open && err != just_operation_canceled)
     {
-        JUST_Close();
+        inst->m_session.Close();
     }
     inst->OpenCallback(err == just_success ? S_OK : E_FAIL);
 	SafeRelease(&inst);
@@ -496,6 +804,7 @@ void PpboxMediaSource::OpenCallback(HRESULT hr)
     else
     {
         m_state = STATE_INVALID;
+        DumpEventTrace();
     }
 
     m_pOpenResult->SetStatus(hr);
@@ -512,7 +821,7 @@ HRESULT PpboxMediaSource::CancelOpen(
 {
     TRACE(3, L"PpboxMediaSource::CancelOpen %p\r\n", this);
 
-    JUST_Close();
+    m_session.Close();
     return S_OK;
 }
 
@@ -537,7 +846,7 @@ HRESULT PpboxMediaSource::RequestSample()
     }
 
     LeaveCriticalSection(&m_critSec);
-    TRACEHR_RET(hr);
+    TRACEHR_HOT_RET(hr);
 }
 
 
@@ -614,23 +923,24 @@ HRESULT PpboxMediaSource::OnScheduleTimer(SourceOp *pOp)
     // Decrement the count of end-of-stream notifications.
     if (SUCCEEDED(hr))
     {
-        if (m_state == STATE_OPENING)
+        // The op of a canceled arm may still be queued.
+        BOOL bArmed = FireTimer(pOp, &m_pScheduleTimerOp, &m_keyScheduleTimer);
+        if (bArmed && m_state == STATE_OPENING)
         {
             UpdateNetStat();
 			    //OutputDebugString(L"[DeliverPayload] would block\r\n");
-			m_keyScheduleTimer = 
-				JUST_ScheduleCallback(100, &m_OnScheduleTimer, OnPpboxTimer);
-        }
-        else if (m_state == STATE_STARTED)
-        {
-            m_keyScheduleTimer = 0;
-            m_OnScheduleTimer.Release();
-            DeliverPayload();
+            ScheduleTimer(100);
         }
-        else
+        else if (bArmed && m_state == STATE_STARTED)
         {
-            m_keyScheduleTimer = 0;
-            m_OnScheduleTimer.Release();
+            if (m_Buffering.IsBuffering())
+            {
+                CheckBuffering();
+            }
+            if (!m_Buffering.IsBuffering())
+            {
+                DeliverPayload();
+            }
         }
     }
 
@@ -710,14 +1020,20 @@ HRESULT PpboxMediaSource::Shutdown()
         SafeRelease(&m_pPresentationDescriptor);
         SafeRelease(&m_pCurrentOp);
 
-		if (m_keyScheduleTimer) {
-            JUST_CancelCallback(m_keyScheduleTimer);
-        }
+        m_TimeShift.Clear();
+
+        CancelScheduleTimer();
+        CancelStatTimer();
 
-        JUST_Close();
+        m_session.Close();
+
+        DumpEventTrace();
 
         // Set the state.
         m_state = STATE_SHUTDOWN;
+
+        PublishTelemetry(TRUE);
+        m_Telemetry.Close();
     }
 
     LeaveCriticalSection(&m_critSec);
@@ -814,6 +1130,10 @@ HRESULT PpboxMediaSource::Start(
     }
 
     hr = QueueOperation(pAsyncOp);
+    if (SUCCEEDED(hr))
+    {
+        InterlockedIncrement(&m_cOpsQueued);
+    }
 
 done:
     SafeRelease(&pAsyncOp);
@@ -873,23 +1193,50 @@ PpboxMediaSource::PpboxMediaSource(HRESULT& hr) :
     m_pCurrentOp(NULL),
     m_cPendingEOS(0),
 	m_bLive(FALSE),
+    m_bHasVideo(FALSE),
     m_uDuration(0),
 	m_uTime(0),
-    m_uTimeGetBufferStat(GetTickCount64()),
-    m_bBufferring(FALSE),
+    m_uClockReference(0),
+    m_bClockValid(FALSE),
+    m_uAVSkew(0),
+    m_uBitrate(0),
     m_uDownloadSpeed(0),
     m_uBytesRecevied(0),
     m_uBufferSize(0),
     m_uBufferProcess(0),
     m_uDownloadProcess(0),
     m_uConnectionStatus(0),
+    m_dwDiscontinuity(0),
+    m_uFormatChanges(0),
+    m_uSkippedBytes(0),
+    m_uAvcFormat(AVC_FORMAT_UNCHANGED),
+    m_bAvcInsertParameterSets(FALSE),
+    m_bConvertRawVideo(FALSE),
+    m_uAggregateFrames(0),
+    m_uAggregateLatency(AGGREGATE_DEFAULT_LATENCY),
+    m_cbBufferAlignment(0),
+    m_cbBufferPadding(PAYLOAD_DEFAULT_PADDING),
+    m_uHistoryWindow(STAT_HISTORY_DEFAULT_WINDOW),
+    m_uTelemetryTick(0),
+    m_cOpsQueued(0),
+    m_uStalls(0),
     m_OnScheduleTimer(this, &PpboxMediaSource::OnScheduleTimerCallback),
-    m_keyScheduleTimer(0)
+    m_pScheduleTimerOp(NULL),
+    m_keyScheduleTimer(0),
+    m_OnStatTimer(this, &PpboxMediaSource::OnStatTimerCallback),
+    m_pStatTimerOp(NULL),
+    m_keyStatTimer(0)
 {
     TRACE(3, L"PpboxMediaSource::PpboxMediaSource %p\r\n", this);
 
     InitializeCriticalSectionEx(&m_critSec, 1000, 0);
 
+    m_StatSampler.SetInterval(SAMPLER_HISTORY, STAT_HISTORY_DEFAULT_INTERVAL);
+
+    m_AudioOptions.uFormat = AUDIO_FORMAT_UNCHANGED;
+    m_AudioOptions.bDownmix = FALSE;
+    m_AudioOptions.uSampleRate = 0;
+
     auto module = ::Microsoft::WRL::GetModuleBase();
     if (module != nullptr)
     {
@@ -958,11 +1305,11 @@ HRESULT PpboxMediaSource::InitPresentationDescriptor()
 
     assert(m_pPresentationDescriptor == NULL);
 
-    m_uDuration = JUST_GetDuration();
+    m_uDuration = m_session.GetDuration();
 	m_bLive = m_uDuration == (PP_uint)-1;
     m_uDuration *= 10000;
 
-	m_stream_number = JUST_GetStreamCount();
+	m_stream_number = m_session.GetStreamCount();
     // Ready to create the presentation descriptor.
 
     // Create an array of IMFStreamDescriptor pointers.
@@ -988,6 +1335,15 @@ HRESULT PpboxMediaSource::InitPresentationDescriptor()
         }
     }
 
+    for (DWORD i = 0; i < m_stream_number; i++)
+    {
+        if (m_streams[i]->IsVideo())
+        {
+            m_bHasVideo = TRUE;
+        }
+    }
+    m_LiveLatency.SetHasVideo(m_bHasVideo);
+
     // Create the presentation descriptor.
     hr = MFCreatePresentationDescriptor(m_stream_number, ppSD,
         &m_pPresentationDescriptor);
@@ -1054,9 +1410,13 @@ HRESULT PpboxMediaSource::QueueAsyncOperation(SourceOp::Operation OpType)
     {
         hr = QueueOperation(pOp);
     }
+    if (SUCCEEDED(hr))
+    {
+        InterlockedIncrement(&m_cOpsQueued);
+    }
 
     SafeRelease(&pOp);
-    TRACEHR_RET(hr);
+    TRACEHR_HOT_RET(hr);
 }
 
 //-------------------------------------------------------------------
@@ -1133,10 +1493,12 @@ HRESULT PpboxMediaSource::CompleteAsyncOp(SourceOp *pOp)
 
 HRESULT PpboxMediaSource::DispatchOperation(SourceOp *pOp)
 {
-    EnterCriticalSection(&m_critSec);
+    Lock();
 
     HRESULT hr = S_OK;
 
+    InterlockedDecrement(&m_cOpsQueued);
+
     if (m_state == STATE_SHUTDOWN)
     {
         LeaveCriticalSection(&m_critSec);
@@ -1144,6 +1506,8 @@ HRESULT PpboxMediaSource::DispatchOperation(SourceOp *pOp)
         return S_OK; // Already shut down, ignore the request.
     }
 
+    UINT64 uTraceStart = EventTrace::Begin();
+
     switch (pOp->Op())
     {
 
@@ -1179,13 +1543,19 @@ HRESULT PpboxMediaSource::DispatchOperation(SourceOp *pOp)
         hr = E_UNEXPECTED;
     }
 
+    EventTrace::End(EVENT_TRACE_OP, uTraceStart, pOp->Op());
+
+    // State changes are published at once, sample requests at most
+    // once per interval.
+    PublishTelemetry(pOp->Op() != SourceOp::OP_REQUEST_DATA && pOp->Op() != SourceOp::OP_TIMER);
+
     if (FAILED(hr))
     {
         StreamingError(hr);
     }
 
     LeaveCriticalSection(&m_critSec);
-    TRACEHR_RET(hr);
+    TRACEHR_HOT_RET(hr);
 }
 
 
@@ -1260,6 +1630,7 @@ HRESULT PpboxMediaSource::DoStart(StartOp *pOp)
     if (SUCCEEDED(hr))
     {
         m_state = STATE_STARTED;
+        ArmStatTimer();
 
         // Queue the "started" event. The event data is the start position.
         hr = m_pEventQueue->QueueEventParamVar(
@@ -1320,8 +1691,10 @@ HRESULT PpboxMediaSource::DoStop(SourceOp *pOp)
 
     m_state = STATE_STOPPED;
 
-	if (m_keyScheduleTimer)
-		JUST_CancelCallback(m_keyScheduleTimer);
+    // A Start may follow while buffering; it has to be able to arm the
+    // timer again.
+    CancelScheduleTimer();
+    CancelStatTimer();
 
     // Send the "stopped" event. This might include a failure code.
     (void)m_pEventQueue->QueueEventParamVar(MESourceStopped, GUID_NULL, hr, NULL);
@@ -1401,7 +1774,7 @@ HRESULT PpboxMediaSource::OnStreamRequestSample(SourceOp *pOp)
         CompleteAsyncOp(pOp);
     }
 
-    TRACEHR_RET(hr);
+    TRACEHR_HOT_RET(hr);
 }
 
 
@@ -1429,14 +1802,34 @@ HRESULT PpboxMediaSource::SelectStreams(
 
     if (varStart->vt == VT_I8 && !m_bLive && m_state == STATE_STOPPED)
     {
-        hr = JUST_Seek((PP_uint)(varStart->hVal.QuadPart / 10000));
+        hr = m_session.Seek((PP_uint)(varStart->hVal.QuadPart / 10000));
         if (hr == just_success || hr == just_would_block) {
-			m_uTime = varStart->hVal.QuadPart;
+            ResetClocks(varStart->hVal.QuadPart);
+            m_RebufferPredictor.Reset();
+            m_Interleave.Reset();
+            for (DWORD i = 0; i < m_stream_number; i++)
+            {
+                m_streams[i]->Normalizer().Reset();
+            }
             hr = S_OK;
         } else {
             hr = E_FAIL;
         }
     }
+    else if (varStart->vt == VT_I8 && m_bLive && m_TimeShift.IsEnabled() && m_state == STATE_STOPPED)
+    {
+        // Seek inside the time shift window, snapped to a key frame.
+        UINT64 uTime = 0;
+        hr = m_TimeShift.Seek(varStart->hVal.QuadPart, &uTime);
+        if (SUCCEEDED(hr))
+        {
+            varStart->hVal.QuadPart = uTime;
+            ResetClocks(uTime);
+            m_Interleave.Reset();
+            m_dwDiscontinuity = (DWORD)-1;
+            m_LiveLatency.Reset();
+        }
+    }
     else
     {
         //varStart->vt = VT_I8;
@@ -1505,6 +1898,25 @@ HRESULT PpboxMediaSource::SelectStreams(
         SafeRelease(&pSD);
     }
 
+    // Sum up the nominal bitrate of the selected streams for the
+    // rebuffer prediction. If one of them does not report it, the
+    // predictor measures the consumption instead.
+    m_uBitrate = 0;
+    for (DWORD i = 0; i < m_stream_number; i++)
+    {
+        if (!m_streams[i]->IsActive())
+        {
+            continue;
+        }
+        if (m_streams[i]->Bitrate() == 0)
+        {
+            m_uBitrate = 0;
+            break;
+        }
+        m_uBitrate += m_streams[i]->Bitrate();
+    }
+    m_RebufferPredictor.SetBitrate(m_uBitrate);
+
 done:
     SafeRelease(&pSD);
     TRACEHR_RET(hr);
@@ -1547,7 +1959,7 @@ HRESULT PpboxMediaSource::UpdatePlayStat()
 {
     HRESULT hr = S_OK;
     JUST_PlayStatistic stat = {sizeof(stat)};
-    hr = JUST_GetPlayStat(&stat);
+    hr = m_session.GetPlayStat(&stat);
     if (hr == just_success || hr == just_would_block)
     {
         m_uBufferSize = stat.buffer_time;
@@ -1556,6 +1968,18 @@ HRESULT PpboxMediaSource::UpdatePlayStat()
         {
             m_uDownloadProcess = (UINT32)((m_uTime + m_uBufferSize * 10000) * 100 / m_uDuration);
         }
+        if (!m_Buffering.IsBuffering() && m_state == STATE_STARTED)
+        {
+            UpdateRebufferPrediction();
+        }
+        if (m_bLive && m_LiveLatency.IsEnabled() && !m_TimeShift.IsReplaying())
+        {
+            UpdateLiveLatency();
+        }
+        if (m_bLive && m_TimeShift.IsEnabled())
+        {
+            UpdateTimeShiftRange();
+        }
         if (hr == just_success)
         {
             hr = S_OK;
@@ -1578,7 +2002,7 @@ HRESULT PpboxMediaSource::UpdateNetStat()
 {
     HRESULT hr = S_OK;
     JUST_DataStat stat;
-    hr = JUST_GetDataStat(&stat);
+    hr = m_session.GetDataStat(&stat);
     if (hr == just_success || hr == just_would_block)
     {
         m_uDownloadSpeed = stat.average_speed_five_seconds;
@@ -1588,6 +2012,8 @@ HRESULT PpboxMediaSource::UpdateNetStat()
         PropertySetSet(m_pStatMap, L"ConnectionStatus", m_uConnectionStatus);
         PropertySetSet(m_pStatMap, L"BytesRecevied", m_uBytesRecevied);
         PropertySetSet(m_pStatMap, L"DownloadSpeed", m_uDownloadSpeed);
+        PropertySetSet(m_pStatMap, L"SharedSessions", PpboxSession::SharedSessions());
+        PropertySetSet(m_pStatMap, L"SharedBytes", (UINT32)PpboxSession::SharedBytes());
         if (hr == just_success)
         {
             hr = S_OK;
@@ -1605,96 +2031,621 @@ HRESULT PpboxMediaSource::UpdateNetStat()
 }
 
 //-------------------------------------------------------------------
-// StreamsNeedData:
-// Returns TRUE if any streams need more data.
+// UpdateSourceStat:
+// Writes the counters of the source to the statistics. They are
+// already up to date, so this does not call the runtime.
 //-------------------------------------------------------------------
 
-BOOL PpboxMediaSource::StreamsNeedData() const
+void PpboxMediaSource::UpdateSourceStat()
 {
-    BOOL bNeedData = FALSE;
+    static LPCWSTR const s_Names[SAMPLER_METRICS] =
+    {
+        L"PlayStat", L"DataStat", L"History", L"Publish",
+    };
 
-    switch (m_state)
+    UINT32 uGaps = 0, uRewinds = 0;
+    for (DWORD i = 0; i < m_stream_number; i++)
     {
-    case STATE_SHUTDOWN:
-        // While shut down, we never need data.
-        return FALSE;
+        uGaps += m_streams[i]->Clock().Gaps();
+        uRewinds += m_streams[i]->Clock().Rewinds();
+    }
+    PropertySetSet(m_pStatMap, L"TimestampGaps", uGaps);
+    PropertySetSet(m_pStatMap, L"TimestampRewinds", uRewinds);
+    PropertySetSet(m_pStatMap, L"AVSkew", m_uAVSkew);
+    (void)SetStatValue64(m_pStatMap.Get(), L"SkippedBytes", m_uSkippedBytes);
+    PropertySetSet(m_pStatMap, L"InterleaveSkew", m_Interleave.Skew());
+    PropertySetSet(m_pStatMap, L"InterleaveSkewMax", m_Interleave.MaxSkew());
+    PropertySetSet(m_pStatMap, L"InterleaveStarvations", m_Interleave.Starvations());
+    PropertySetSet(m_pStatMap, L"MemoryBytes", (UINT32)m_Memory.Current());
+    PropertySetSet(m_pStatMap, L"MemoryPeakBytes", (UINT32)m_Memory.Peak());
+    PropertySetSet(m_pStatMap, L"MemoryEvictions", m_Memory.Evictions());
+    PropertySetSet(m_pStatMap, L"BufferingChecks", m_Buffering.Checks());
+    PropertySetSet(m_pStatMap, L"BufferingTime", (UINT32)m_Buffering.TotalTime());
 
-    default:
-        // If none of the above, ask the streams.
+    if (EventTrace::IsEnabled())
+    {
+        UpdateTraceStat();
+    }
+    UpdateLatencyStat();
+    UpdateHistoryStat();
+    if (m_uAggregateFrames > 1)
+    {
+        UINT32 uMerged = 0;
         for (DWORD i = 0; i < m_stream_number; i++)
         {
-            if (m_streams[i]->NeedsData())
-            {
-                bNeedData = TRUE;
-                break;
-            }
+            uMerged += m_streams[i]->Aggregator().Merged();
         }
-        return bNeedData;
+        PropertySetSet(m_pStatMap, L"AudioSamplesAggregated", uMerged);
+    }
+
+    // Cost of the sampler: <metric>Samples, CostMean and CostMax, in
+    // microseconds.
+    if (m_pStatMap == nullptr)
+    {
+        return;
+    }
+    if (m_pSamplerStat == nullptr
+        && FAILED(PropertySetAddSubMap(m_pStatMap, L"Sampler", m_pSamplerStat)))
+    {
+        return;
+    }
+    for (DWORD i = 0; i < SAMPLER_METRICS; i++)
+    {
+        SamplerMetric metric = (SamplerMetric)i;
+        WCHAR szName[32];
+        swprintf_s(szName, L"%sSamples", s_Names[i]);
+        PropertySetSet(m_pSamplerStat, szName, m_StatSampler.Samples(metric));
+        swprintf_s(szName, L"%sCostMean", s_Names[i]);
+        PropertySetSet(m_pSamplerStat, szName, m_StatSampler.MeanCost(metric));
+        swprintf_s(szName, L"%sCostMax", s_Names[i]);
+        PropertySetSet(m_pSamplerStat, szName, m_StatSampler.MaxCost(metric));
     }
 }
 
 //-------------------------------------------------------------------
-// DeliverPayload:
-// Delivers an Ppbox payload.
+// UpdateRebufferPrediction:
+// Estimates the time until the buffer runs dry, and warns the
+// application when a stall is getting close.
 //-------------------------------------------------------------------
 
-HRESULT PpboxMediaSource::DeliverPayload()
+void PpboxMediaSource::UpdateRebufferPrediction()
 {
-    // When this method is called, the read buffer contains a complete
-    // payload, and the payload belongs to a stream whose type we support.
+    if (m_RebufferPredictor.Update(m_session.TickCount(), m_uDownloadSpeed, m_uBufferSize))
+    {
+        PROPVARIANT var;
+        var.vt = VT_UI4;
+        var.ulVal = m_RebufferPredictor.TimeToStall();
+        (void)m_pEventQueue->QueueEventParamVar(MEExtendedType, PPBOX_EVENT_REBUFFER_WARNING, S_OK, &var);
+    }
 
-    HRESULT             hr = S_OK;
-    JUST_Sample        sample;
+    // While the buffer is not draining there is no time to stall.
+    BOOL bDraining = m_RebufferPredictor.TimeToStall() != REBUFFER_NEVER;
+    PropertySetSet(m_pStatMap, L"BufferDraining", (UINT32)bDraining);
+    PropertySetSet(m_pStatMap, L"TimeToStall", bDraining ? m_RebufferPredictor.TimeToStall() : 0);
+}
 
-    IMFMediaBuffer      *pBuffer = NULL;
-    IMFSample           *pSample = NULL;
-    BYTE                *pData = NULL;      // Pointer to the IMFMediaBuffer data.
+//-------------------------------------------------------------------
+// UpdateLiveLatency:
+// Feeds the live latency controller and notifies the application
+// when it starts or stops catching up.
+//-------------------------------------------------------------------
 
-    if (m_bBufferring)
+void PpboxMediaSource::UpdateLiveLatency()
+{
+    if (m_LiveLatency.Update(m_uBufferSize))
     {
-        while (true)
+        TRACE(3, L"PpboxMediaSource::UpdateLiveLatency latency = %u, mode = %u\r\n",
+            m_LiveLatency.Latency(), m_LiveLatency.GetMode());
+
+        PROPVARIANT var;
+        var.vt = VT_R8;
+        var.dblVal = m_LiveLatency.RateHint();
+        (void)m_pEventQueue->QueueEventParamVar(MEExtendedType, PPBOX_EVENT_LIVE_CATCHUP, S_OK, &var);
+    }
+
+    PropertySetSet(m_pStatMap, L"LiveLatency", m_LiveLatency.Latency());
+    PropertySetSet(m_pStatMap, L"LiveCatchUps", m_LiveLatency.CatchUps());
+    PropertySetSet(m_pStatMap, L"LiveJumps", m_LiveLatency.Jumps());
+    PropertySetSet(m_pStatMap, L"LiveDroppedSamples", m_LiveLatency.DroppedSamples());
+}
+
+//-------------------------------------------------------------------
+// FilterLiveSample:
+// Returns TRUE if the live latency controller drops the sample.
+//-------------------------------------------------------------------
+
+BOOL PpboxMediaSource::FilterLiveSample(JUST_Sample const & sample)
+{
+    PpboxMediaStream *pStream = m_streams[sample.itrack];
+    BOOL bVideo = pStream->IsVideo();
+    BOOL bSync = !bVideo || (sample.flags & JUST_SampleFlag::sync) != 0;
+    BOOL bDisposable = FALSE;
+
+    // Only parse the payload when the controller may use the result.
+    if (bVideo && !bSync
+        && m_LiveLatency.GetMode() == LiveLatencyController::MODE_CATCHUP
+        && pStream->SubType() == MFVideoFormat_H264)
+    {
+        bDisposable = AvcIsDisposable(sample.buffer, sample.size, pStream->Rewriter().NalLengthSize());
+    }
+
+    if (m_LiveLatency.OnSample(bVideo, bSync, bDisposable, sample.decode_time + sample.composite_time_delta))
+    {
+        return TRUE;
+    }
+
+    if (m_LiveLatency.TakeDiscontinuity())
+    {
+        m_dwDiscontinuity = (DWORD)-1;
+    }
+    return FALSE;
+}
+
+//-------------------------------------------------------------------
+// ResetClocks:
+// Restarts the presentation clock at a seek position.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::ResetClocks(UINT64 uTime)
+{
+    for (DWORD i = 0; i < m_stream_number; i++)
+    {
+        m_streams[i]->Clock().Reset();
+    }
+    m_uTime = uTime;
+    m_bClockValid = FALSE;
+    m_uAVSkew = 0;
+}
+
+//-------------------------------------------------------------------
+// UpdatePresentationClock:
+// Moves the presentation clock with the slowest active stream, which
+// is how far all of them have been read. The clock only moves
+// forward, and does not follow discontinuities: m_uTime then keeps
+// counting media time from where it was.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::UpdatePresentationClock(BOOL bDiscontinuity)
+{
+    UINT64 uSlowest = (UINT64)-1;
+    UINT64 uVideo = 0, uAudio = 0;
+    BOOL bVideo = FALSE, bAudio = FALSE;
+
+    for (DWORD i = 0; i < m_stream_number; i++)
+    {
+        StreamClock const & clock = m_streams[i]->Clock();
+        if (!m_streams[i]->IsActive() || !clock.IsValid())
         {
-            hr = UpdatePlayStat();
+            continue;
+        }
+        uSlowest = min(uSlowest, clock.Time());
+        if (m_streams[i]->IsVideo() && !bVideo)
+        {
+            uVideo = clock.Time();
+            bVideo = TRUE;
+        }
+        else if (!m_streams[i]->IsVideo() && !bAudio)
+        {
+            uAudio = clock.Time();
+            bAudio = TRUE;
+        }
+    }
 
-            if (m_uBufferProcess >= 100)
-            {
-                m_bBufferring = FALSE;
-                hr = m_pEventQueue->QueueEventParamVar(MEBufferingStopped, GUID_NULL, S_OK, NULL);
-                hr = S_OK;
-                break;
-            }
+    if (uSlowest == (UINT64)-1)
+    {
+        return;
+    }
 
-            if (hr == S_OK)
-            {
-                continue;
-            }
-            else if (hr == E_PENDING)
+    if (!m_bClockValid)
+    {
+        // Start from the first sample, which a seek snaps to.
+        m_uTime = uSlowest;
+        m_uClockReference = uSlowest;
+        m_bClockValid = TRUE;
+    }
+    else if (bDiscontinuity)
+    {
+        m_uClockReference = uSlowest;
+    }
+    else if (uSlowest > m_uClockReference)
+    {
+        m_uTime += uSlowest - m_uClockReference;
+        m_uClockReference = uSlowest;
+    }
+
+    if (bVideo && bAudio)
+    {
+        m_uAVSkew = (UINT32)((uVideo > uAudio ? uVideo - uAudio : uAudio - uVideo) / 10000);
+    }
+}
+
+//-------------------------------------------------------------------
+// BalanceInterleave:
+// Lets the streams queue more samples while another one starves.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::BalanceInterleave()
+{
+    for (DWORD i = 0; i < m_stream_number; i++)
+    {
+        if (m_streams[i]->IsActive())
+        {
+            m_Interleave.Observe(m_streams[i]->QueuedDuration(), m_streams[i]->IsStarving());
+        }
+    }
+
+    DWORD cLimit = m_Interleave.Update();
+
+    for (DWORD i = 0; i < m_stream_number; i++)
+    {
+        m_streams[i]->SetQueueLimit(cLimit);
+    }
+}
+
+//-------------------------------------------------------------------
+// EnforceMemoryBudget:
+// Accounts the memory held by the source, and frees some when it is
+// over the budget: the idle pooled samples first, then the oldest
+// samples of the streams furthest over their fair share. A stream
+// always keeps one sample. The time shift buffer has its own budget.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::EnforceMemoryBudget()
+{
+    UINT64 cbQueued = 0, cbPools = 0;
+    UINT64 cbFixed = m_TimeShift.Bytes();
+    DWORD cActive = 0;
+
+    for (DWORD i = 0; i < m_stream_number; i++)
+    {
+        cbQueued += m_streams[i]->QueuedBytes();
+        cbPools += m_streams[i]->Converter().PoolBytes();
+        cbPools += m_streams[i]->Payload().PoolBytes();
+        if (m_streams[i]->IsActive())
+        {
+            ++cActive;
+        }
+    }
+
+    UINT64 cbExcess = m_Memory.Update(cbQueued + cbPools + cbFixed);
+    if (cbExcess == 0)
+    {
+        return;
+    }
+
+    if (cbPools)
+    {
+        for (DWORD i = 0; i < m_stream_number; i++)
+        {
+            m_streams[i]->Converter().TrimPool();
+            m_streams[i]->Payload().TrimPools();
+        }
+        m_Memory.OnEvicted(cbPools);
+        cbExcess -= min(cbPools, cbExcess);
+    }
+
+    UINT64 cbShare = m_Memory.FairShare(cbFixed, cActive);
+
+    while (cbExcess)
+    {
+        PpboxMediaStream *pStream = NULL;
+        UINT64 cbOver = 0;
+
+        for (DWORD i = 0; i < m_stream_number; i++)
+        {
+            UINT64 cbStream = m_streams[i]->QueuedBytes();
+            if (m_streams[i]->QueuedSamples() > 1 && cbStream > cbShare && cbStream - cbShare > cbOver)
             {
-		        if (m_keyScheduleTimer == 0) {
-			        //OutputDebugString(L"[DeliverPayload] would block\r\n");
-                    m_OnScheduleTimer.AddRef();
-			        m_keyScheduleTimer = 
-				        JUST_ScheduleCallback(100, &m_OnScheduleTimer, OnPpboxTimer);
-		        }
-                UpdateNetStat();
-                hr = S_OK;
-                TRACEHR_RET(hr);
+                pStream = m_streams[i];
+                cbOver = cbStream - cbShare;
             }
-            else
+        }
+        if (pStream == NULL)
+        {
+            break;
+        }
+
+        DWORD cbDropped = pStream->DropOldest();
+        TRACE(3, L"PpboxMediaSource::EnforceMemoryBudget dropped %u bytes\r\n", cbDropped);
+        m_Memory.OnEvicted(cbDropped);
+        cbExcess -= min((UINT64)cbDropped, cbExcess);
+    }
+}
+
+//-------------------------------------------------------------------
+// CheckFormatChange:
+// Detects a change of the stream format (resolution, audio config,
+// codec private data) at a sync sample, as happens with ad insertion,
+// bitrate switches and multi-part playlinks. Returns the new media
+// type, or NULL. The caller attaches it to the sample, and the stream
+// applies it in order.
+//-------------------------------------------------------------------
+
+HRESULT PpboxMediaSource::CheckFormatChange(JUST_Sample const & sample, IMFMediaType **ppType)
+{
+    PpboxMediaStream *pStream = m_streams[sample.itrack];
+
+    *ppType = NULL;
+
+    if ((sample.flags & JUST_SampleFlag::sync) == 0 || !pStream->IsActive())
+    {
+        return S_OK;
+    }
+
+    JUST_StreamInfo info;
+    if (m_session.GetStreamInfo(sample.itrack, &info) != just_success)
+    {
+        return S_OK;
+    }
+
+    UINT32 uSignature = StreamInfoSignature(info);
+    if (uSignature == pStream->FormatSignature())
+    {
+        return S_OK;
+    }
+
+    IMFMediaType *pType = NULL;
+    GUID guidSubType = GUID_NULL;
+    GUID guidRaw = GUID_NULL;
+
+    // Frames of the old format are not merged with the new ones.
+    HRESULT hr = pStream->FlushAggregate();
+
+    if (SUCCEEDED(hr))
+    {
+        hr = CreateStreamMediaType(info, &pType, &guidRaw);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->GetGUID(MF_MT_SUBTYPE, &guidSubType);
+    }
+    if (SUCCEEDED(hr) && pStream->IsVideo())
+    {
+        hr = pStream->Converter().SetFormat(guidRaw, info.format.video.width, info.format.video.height);
+    }
+    if (SUCCEEDED(hr))
+    {
+        TRACE_HOT(3, L"PpboxMediaSource::CheckFormatChange stream %u\r\n", sample.itrack);
+        pStream->SetFormat(uSignature, guidSubType);
+        pStream->Rewriter().SetCodecPrivate(info.format_buffer, info.format_size);
+        pStream->Normalizer().SetFormat(info);
+        SetAggregateLimits(pStream);
+        m_dwDiscontinuity |= (1u << sample.itrack);
+        PropertySetSet(m_pStatMap, L"FormatChanges", ++m_uFormatChanges);
+
+        *ppType = pType;
+        (*ppType)->AddRef();
+    }
+
+    SafeRelease(&pType);
+    TRACEHR_HOT_RET(hr);
+}
+
+//-------------------------------------------------------------------
+// RewriteSample:
+// Converts H.264 samples to the configured bitstream format, and PCM
+// and float samples to the configured audio format. On success, the
+// sample refers to the rewritten payload, which stays valid until the
+// next sample of the stream.
+//-------------------------------------------------------------------
+
+HRESULT PpboxMediaSource::RewriteSample(JUST_Sample & sample)
+{
+    PpboxMediaStream *pStream = m_streams[sample.itrack];
+    AvcRewriter & rewriter = pStream->Rewriter();
+    AudioNormalizer & normalizer = pStream->Normalizer();
+
+    if (normalizer.IsEnabled())
+    {
+        HRESULT hr = normalizer.Process(sample.buffer, sample.size);
+        if (SUCCEEDED(hr))
+        {
+            sample.buffer = normalizer.Output();
+            sample.size = normalizer.OutputSize();
+        }
+        TRACEHR_HOT_RET(hr);
+    }
+
+    if (!rewriter.IsEnabled() || pStream->SubType() != MFVideoFormat_H264)
+    {
+        return S_OK;
+    }
+
+    HRESULT hr = rewriter.Rewrite(sample.buffer, sample.size, (sample.flags & JUST_SampleFlag::sync) != 0);
+    if (hr == S_OK)
+    {
+        sample.buffer = rewriter.Output();
+        sample.size = rewriter.OutputSize();
+    }
+    else if (hr == S_FALSE)
+    {
+        hr = S_OK;
+    }
+    TRACEHR_HOT_RET(hr);
+}
+
+//-------------------------------------------------------------------
+// CreateStreamSample:
+// Creates the sample for a payload, converted if the stream is raw
+// video with conversion enabled, and otherwise copied into an aligned
+// buffer if BufferAlignment is set.
+//-------------------------------------------------------------------
+
+HRESULT PpboxMediaSource::CreateStreamSample(JUST_Sample const & sample, IMFSample **ppSample)
+{
+    RawVideoConverter & converter = m_streams[sample.itrack]->Converter();
+    PayloadAllocator & allocator = m_streams[sample.itrack]->Payload();
+
+    if (!converter.IsEnabled() && !allocator.IsEnabled())
+    {
+        return CreateSample(sample, ppSample);
+    }
+
+    IMFSample *pSample = NULL;
+
+    HRESULT hr = converter.IsEnabled()
+        ? converter.Convert(sample.buffer, sample.size, &pSample)
+        : allocator.CreateSample(sample.buffer, sample.size, &pSample);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pSample->SetSampleTime(sample.decode_time + sample.composite_time_delta);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pSample->SetSampleDuration(sample.duration);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        *ppSample = pSample;
+        (*ppSample)->AddRef();
+    }
+
+    SafeRelease(&pSample);
+    TRACEHR_HOT_RET(hr);
+}
+
+//-------------------------------------------------------------------
+// CreateStreamMediaType:
+// Creates the media type of a stream, in the format the source
+// delivers after conversion. pguidRaw receives the subtype of raw
+// video that the source converts, or GUID_NULL.
+//-------------------------------------------------------------------
+
+HRESULT PpboxMediaSource::CreateStreamMediaType(JUST_StreamInfo const & info, IMFMediaType **ppType, GUID *pguidRaw)
+{
+    IMFMediaType *pType = NULL;
+
+    *pguidRaw = GUID_NULL;
+
+    HRESULT hr = CreateMediaType(info, &pType);
+
+    if (SUCCEEDED(hr) && m_bConvertRawVideo && info.type == JUST_StreamType::VIDE)
+    {
+        hr = ConvertRawVideoType(pType, pguidRaw);
+    }
+
+    if (SUCCEEDED(hr) && info.type == JUST_StreamType::AUDI)
+    {
+        AudioNormalizer normalizer;
+        normalizer.SetOptions(m_AudioOptions);
+        normalizer.SetFormat(info);
+        hr = normalizer.ConvertMediaType(pType);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        *ppType = pType;
+        (*ppType)->AddRef();
+    }
+
+    SafeRelease(&pType);
+    TRACEHR_RET(hr);
+}
+
+//-------------------------------------------------------------------
+// SetAggregateLimits:
+// Enables the aggregation on audio streams whose decoder or renderer
+// takes several frames per sample. The AAC and WMA decoders expect one
+// frame per sample, so those streams are left alone.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::SetAggregateLimits(PpboxMediaStream *pStream)
+{
+    REFGUID guidSubType = pStream->SubType();
+    BOOL bEligible = !pStream->IsVideo()
+        && (guidSubType == MFAudioFormat_PCM
+            || guidSubType == MFAudioFormat_Float
+            || guidSubType == MFAudioFormat_MP3
+            || guidSubType == MFAudioFormat_MPEG
+            || guidSubType == MFAudioFormat_Dolby_AC3
+            || guidSubType == MFAudioFormat_Dolby_DDPlus);
+
+    pStream->Aggregator().SetLimits(bEligible ? m_uAggregateFrames : 0, m_uAggregateLatency);
+}
+
+//-------------------------------------------------------------------
+// FlushAggregates:
+// Queues the audio frames held back for aggregation, when no more
+// samples can be read for now.
+//-------------------------------------------------------------------
+
+HRESULT PpboxMediaSource::FlushAggregates()
+{
+    HRESULT hr = S_OK;
+
+    for (DWORD i = 0; SUCCEEDED(hr) && i < m_stream_number; i++)
+    {
+        hr = m_streams[i]->FlushAggregate();
+    }
+
+    TRACEHR_RET(hr);
+}
+
+//-------------------------------------------------------------------
+// StreamsNeedData:
+// Returns TRUE if any streams need more data.
+//-------------------------------------------------------------------
+
+BOOL PpboxMediaSource::StreamsNeedData() const
+{
+    BOOL bNeedData = FALSE;
+
+    switch (m_state)
+    {
+    case STATE_SHUTDOWN:
+        // While shut down, we never need data.
+        return FALSE;
+
+    default:
+        // If none of the above, ask the streams.
+        for (DWORD i = 0; i < m_stream_number; i++)
+        {
+            if (m_streams[i]->NeedsData())
             {
-                TRACEHR_RET(hr);
+                bNeedData = TRUE;
+                break;
             }
         }
+        return bNeedData;
     }
+}
+
+//-------------------------------------------------------------------
+// DeliverPayload:
+// Delivers an Ppbox payload.
+//-------------------------------------------------------------------
+
+HRESULT PpboxMediaSource::DeliverPayload()
+{
+    // When this method is called, the read buffer contains a complete
+    // payload, and the payload belongs to a stream whose type we support.
 
-    if (m_uTimeGetBufferStat <= GetTickCount64())
+    HRESULT             hr = S_OK;
+    JUST_Sample        sample;
+
+    IMFSample           *pSample = NULL;
+
+    if (m_bLive && m_TimeShift.IsReplaying())
     {
-        UpdatePlayStat();
-        UpdateNetStat();
-        m_uTimeGetBufferStat += 1000;
+        hr = DeliverTimeShiftPayload();
+        TRACEHR_HOT_RET(hr);
     }
 
-    hr = JUST_ReadSample(&sample);
+    // While buffering, the timer checks the progress, and delivers
+    // again when it is done. The timer may have been dropped by a
+    // pause.
+    if (m_Buffering.IsBuffering())
+    {
+        ScheduleTimer(m_Buffering.NextDelay());
+        TRACEHR_HOT_RET(hr);
+    }
+
+    UINT64 uTraceStart = EventTrace::Begin();
+    hr = m_session.ReadSample(&sample);
+    EventTrace::End(EVENT_TRACE_READ_SAMPLE, uTraceStart, hr, hr == just_success ? sample.itrack : 0);
+    UINT64 uReadTime = PpboxMediaStream::Microseconds();
 
     if (hr == just_success)
     {
@@ -1703,86 +2654,246 @@ HRESULT PpboxMediaSource::DeliverPayload()
     else if (hr == just_would_block)
     {
         //hr = MFScheduleWorkItem(&m_OnScheduleTimer, NULL, -100, NULL);
-        //TRACEHR_RET(hr);
-        m_bBufferring = TRUE;
+        //TRACEHR_HOT_RET(hr);
+        m_Buffering.Start(m_session.TickCount());
+        ++m_uStalls;
+        EventTrace::Mark(EVENT_TRACE_BUFFERING, 1);
+        m_RebufferPredictor.OnStall(m_session.TickCount());
+        PropertySetSet(m_pStatMap, L"RebufferWarnings", m_RebufferPredictor.Warnings());
+        PropertySetSet(m_pStatMap, L"RebufferMisses", m_RebufferPredictor.Misses());
+        PropertySetSet(m_pStatMap, L"RebufferFalseAlarms", m_RebufferPredictor.FalseAlarms());
+        PropertySetSet(m_pStatMap, L"RebufferPredictionError", m_RebufferPredictor.MeanError());
+        FlushAggregates();
         hr = m_pEventQueue->QueueEventParamVar(MEBufferingStarted, GUID_NULL, S_OK, NULL);
-		if (m_keyScheduleTimer == 0) {
-			//OutputDebugString(L"[DeliverPayload] would block\r\n");
-            m_OnScheduleTimer.AddRef();
-			m_keyScheduleTimer = 
-				JUST_ScheduleCallback(100, &m_OnScheduleTimer, OnPpboxTimer);
-		}
+        ScheduleTimer(m_Buffering.NextDelay());
 		hr = S_OK;
-        TRACEHR_RET(hr);
+        TRACEHR_HOT_RET(hr);
     }
     else if (hr == just_stream_end)
     {
         hr = EndOfPpboxStream();
-        TRACEHR_RET(hr);
+        TRACEHR_HOT_RET(hr);
+    }
+    else if (hr == just_not_open && m_session.IsTakenOver())
+    {
+        // Another source opened a different playlink in the runtime;
+        // nothing will come for this one any more.
+        hr = HRESULT_FROM_WIN32(ERROR_OPERATION_ABORTED);
+        StreamingError(hr);
+        TRACEHR_HOT_RET(hr);
     }
     else
     {
         hr = E_FAIL;
-        TRACEHR_RET(hr);
+        TRACEHR_HOT_RET(hr);
+    }
+
+    // Samples of deselected streams are dropped before anything is
+    // allocated for them.
+    assert(sample.itrack < m_stream_number);
+    if (!m_streams[sample.itrack]->IsActive())
+    {
+        m_uSkippedBytes += sample.size;
+        if (StreamsNeedData())
+        {
+            hr = RequestSample();
+        }
+        TRACEHR_HOT_RET(hr);
+    }
+
+    // Bytes as read from the runtime, for the rebuffer prediction.
+    UINT32 cbRead = sample.size;
+
+    hr = PrepareSample(sample, &pSample);
+
+    // Dropped to catch up with the live edge.
+    if (hr == S_FALSE)
+    {
+        hr = S_OK;
+        if (StreamsNeedData())
+        {
+            hr = RequestSample();
+        }
+        TRACEHR_HOT_RET(hr);
     }
 
-    // Create a media buffer for the payload.
     if (SUCCEEDED(hr))
     {
-		hr = MFCreateMemoryBuffer(sample.size, &pBuffer);
+        hr = pSample->SetUINT64(PPBOX_SAMPLE_READ_TIME, uReadTime);
     }
 
+    // Check the timestamps against the previous sample of the stream.
     if (SUCCEEDED(hr))
     {
-        hr = pBuffer->Lock(&pData, NULL, NULL);
+        BOOL bDiscontinuity = m_streams[sample.itrack]->Clock().Update(
+            sample.decode_time, sample.decode_time + sample.composite_time_delta, sample.duration);
+        if (bDiscontinuity)
+        {
+            TRACE_HOT(3, L"PpboxMediaSource::DeliverPayload discontinuity on stream %u\r\n", sample.itrack);
+            m_dwDiscontinuity |= (1u << sample.itrack);
+        }
+        UpdatePresentationClock((m_dwDiscontinuity & (1u << sample.itrack)) != 0);
+    }
+
+    // First sample after a live jump or a format change.
+    if (SUCCEEDED(hr) && (m_dwDiscontinuity & (1u << sample.itrack)))
+    {
+        m_dwDiscontinuity &= ~(1u << sample.itrack);
+        hr = pSample->SetUINT32(MFSampleExtension_Discontinuity, TRUE);
     }
 
+    // Let the application time compress audio while catching up.
+    if (SUCCEEDED(hr)
+        && m_LiveLatency.GetMode() == LiveLatencyController::MODE_CATCHUP
+        && !m_streams[sample.itrack]->IsVideo())
+    {
+        hr = pSample->SetDouble(PPBOX_SAMPLE_RATE_HINT, m_LiveLatency.RateHint());
+    }
+
+    // Deliver the payload to the stream.
     if (SUCCEEDED(hr))
     {
-        CopyMemory(pData, sample.buffer, sample.size);
+        assert(sample.itrack < m_stream_number);
+        //TRACE(0, L"sample itrack = %u, pts = %lu\r\n", sample.itrack, sample.decode_time + sample.composite_time_delta);
+        m_RebufferPredictor.AddConsumed(cbRead, sample.duration);
+        hr = m_streams[sample.itrack]->DeliverPayload(pSample);
+        BalanceInterleave();
+        EnforceMemoryBudget();
     }
 
     if (SUCCEEDED(hr))
     {
-        hr = pBuffer->Unlock();
+        if (StreamsNeedData())
+        {
+            hr = RequestSample();
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        hr = EndOfPpboxStream();
+    }
+
+    SafeRelease(&pSample);
+    TRACEHR_HOT_RET(hr);
+}
+
+//-------------------------------------------------------------------
+// PrepareSample:
+// The per-sample pipeline of a payload read from the runtime, shared
+// by DeliverPayload and the recording of DeliverTimeShiftPayload:
+// drops samples to catch up with the live edge, detects a new format,
+// rewrites the payload, creates its sample, and keeps it for seeking
+// back. Returns S_FALSE, and no sample, if the sample is dropped.
+//-------------------------------------------------------------------
+
+HRESULT PpboxMediaSource::PrepareSample(JUST_Sample & sample, IMFSample **ppSample)
+{
+    HRESULT             hr = S_OK;
+    IMFSample           *pSample = NULL;
+    IMFMediaType        *pType = NULL;      // New format, starting with this sample
+
+    *ppSample = NULL;
+
+    if (m_bLive && m_LiveLatency.IsEnabled() && FilterLiveSample(sample))
+    {
+        return S_FALSE;
     }
 
+    // Detect a new format before the payload is rewritten with it.
+    hr = CheckFormatChange(sample, &pType);
+
     if (SUCCEEDED(hr))
     {
-        hr = pBuffer->SetCurrentLength(sample.size);
+        hr = RewriteSample(sample);
     }
 
-    // Create a sample to hold the buffer.
+    // Create a sample for the payload.
     if (SUCCEEDED(hr))
     {
-        hr = MFCreateSample(&pSample);
+        hr = CreateStreamSample(sample, &pSample);
+    }
+
+    // First sample of a new format.
+    if (SUCCEEDED(hr) && pType)
+    {
+        hr = pSample->SetUnknown(PPBOX_SAMPLE_MEDIA_TYPE, pType);
+    }
+
+    // Keep the sample for seeking back.
+    if (SUCCEEDED(hr) && m_bLive && m_TimeShift.IsEnabled())
+    {
+        hr = RecordTimeShiftSample(sample, pSample);
     }
+
     if (SUCCEEDED(hr))
     {
-        hr = pSample->AddBuffer(pBuffer);
+        *ppSample = pSample;
+        (*ppSample)->AddRef();
+    }
+
+    SafeRelease(&pSample);
+    SafeRelease(&pType);
+    TRACEHR_HOT_RET(hr);
+}
+
+//-------------------------------------------------------------------
+// DeliverTimeShiftPayload:
+// Delivers a sample from the time shift buffer, after a seek into
+// the time shift window of a live session.
+//-------------------------------------------------------------------
+
+HRESULT PpboxMediaSource::DeliverTimeShiftPayload()
+{
+    HRESULT             hr = S_OK;
+    JUST_Sample         sample;
+    IMFSample           *pSample = NULL;
+    DWORD               dwStream = 0;
+
+    // Keep recording the live stream, through the same pipeline as
+    // DeliverPayload. A stall of the runtime does not stall the
+    // replay, so the result is only used to record.
+    if (m_session.ReadSample(&sample) == just_success
+        && m_streams[sample.itrack]->IsActive())
+    {
+        hr = PrepareSample(sample, &pSample);
+        if (hr == S_FALSE)
+        {
+            hr = S_OK;
+        }
+        SafeRelease(&pSample);
     }
 
-    // Time stamp
     if (SUCCEEDED(hr))
     {
-        m_uTime = (sample.decode_time + sample.composite_time_delta);
-		
-        hr = pSample->SetSampleTime(m_uTime);
+        hr = m_TimeShift.Pop(&dwStream, &pSample);
     }
 
-    // Duration
+    // Only samples read now count in the read latency.
     if (SUCCEEDED(hr))
     {
-        hr = pSample->SetSampleDuration(sample.duration);
+        (void)pSample->DeleteItem(PPBOX_SAMPLE_READ_TIME);
+    }
+
+    if (SUCCEEDED(hr) && (m_dwDiscontinuity & (1u << dwStream)))
+    {
+        m_dwDiscontinuity &= ~(1u << dwStream);
+        hr = pSample->SetUINT32(MFSampleExtension_Discontinuity, TRUE);
     }
 
-    // Deliver the payload to the stream.
     if (SUCCEEDED(hr))
     {
-        assert(sample.itrack < m_stream_number);
-        //TRACE(0, L"sample itrack = %u, pts = %lu\r\n", sample.itrack, sample.decode_time + sample.composite_time_delta);
-		if (m_streams[sample.itrack]->IsActive())
-			hr = m_streams[sample.itrack]->DeliverPayload(pSample);
+        LONGLONG hnsTime = 0, hnsDuration = 0;
+        (void)pSample->GetSampleTime(&hnsTime);
+        (void)pSample->GetSampleDuration(&hnsDuration);
+        m_streams[dwStream]->Clock().Advance(hnsTime, hnsDuration);
+        UpdatePresentationClock(FALSE);
+        if (m_streams[dwStream]->IsActive())
+        {
+            hr = m_streams[dwStream]->DeliverPayload(pSample);
+        }
+        BalanceInterleave();
+        EnforceMemoryBudget();
     }
 
     if (SUCCEEDED(hr))
@@ -1793,14 +2904,44 @@ HRESULT PpboxMediaSource::DeliverPayload()
         }
     }
 
-    if (FAILED(hr))
+    SafeRelease(&pSample);
+    TRACEHR_HOT_RET(hr);
+}
+
+//-------------------------------------------------------------------
+// RecordTimeShiftSample:
+// Appends a sample read from the runtime to the time shift buffer.
+//-------------------------------------------------------------------
+
+HRESULT PpboxMediaSource::RecordTimeShiftSample(JUST_Sample const & sample, IMFSample *pSample)
+{
+    // Seeks snap to video key frames, or to any key frame of audio
+    // only content.
+    BOOL bKey = (sample.flags & JUST_SampleFlag::sync) != 0
+        && (m_streams[sample.itrack]->IsVideo() || !m_bHasVideo);
+
+    HRESULT hr = m_TimeShift.Push(
+        sample.itrack,
+        pSample,
+        sample.decode_time + sample.composite_time_delta,
+        bKey,
+        sample.size);
+    TRACEHR_RET(hr);
+}
+
+//-------------------------------------------------------------------
+// UpdateTimeShiftRange:
+// Advertises the seekable range on the presentation descriptor.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::UpdateTimeShiftRange()
+{
+    if (m_pPresentationDescriptor)
     {
-        hr = EndOfPpboxStream();
+        (void)m_pPresentationDescriptor->SetUINT64(PPBOX_PD_TIMESHIFT_START, m_TimeShift.Start());
+        (void)m_pPresentationDescriptor->SetUINT64(PPBOX_PD_TIMESHIFT_END, m_TimeShift.End());
     }
-
-    SafeRelease(&pBuffer);
-    SafeRelease(&pSample);
-    TRACEHR_RET(hr);
+    PropertySetSet(m_pStatMap, L"TimeShiftBytes", (UINT32)m_TimeShift.Bytes());
 }
 
 
@@ -1820,23 +2961,12 @@ HRESULT PpboxMediaSource::CreateStream(long stream_id, PpboxMediaStream **ppStre
     IMFStreamDescriptor *pSD = NULL;
     IMFMediaTypeHandler *pHandler = NULL;
     PpboxMediaStream *pStream = NULL;
+    GUID guidRaw = GUID_NULL;                   // Raw video subtype converted by the source
 
-    JUST_GetStreamInfo(stream_id, &info);
-
-    switch (info.type)
-    {
-    case JUST_StreamType::VIDE:
-        hr = CreateVideoMediaType(info, &pType);
-        break;
-
-    case JUST_StreamType::AUDI:
-        hr = CreateAudioMediaType(info, &pType);
-        break;
+    m_session.GetStreamInfo(stream_id, &info);
 
-    default:
-        assert(false); // If this case occurs, then IsStreamTypeSupported() is wrong.
-        hr = E_UNEXPECTED;
-    }
+    hr = CreateStreamMediaType(info, &pType, &guidRaw);
+    assert(hr != MF_E_INVALIDMEDIATYPE); // If this occurs, then IsStreamTypeSupported() is wrong.
 
     if (SUCCEEDED(hr))
     {
@@ -1864,6 +2994,20 @@ HRESULT PpboxMediaSource::CreateStream(long stream_id, PpboxMediaStream **ppStre
         }
     }
 
+    if (SUCCEEDED(hr))
+    {
+        pStream->SetFormat(StreamInfoSignature(info), pStream->SubType());
+        pStream->SetBitrate(info.bitrate);
+        pStream->Rewriter().SetOutputFormat(m_uAvcFormat);
+        pStream->Rewriter().SetInsertParameterSets(m_bAvcInsertParameterSets);
+        pStream->Rewriter().SetCodecPrivate(info.format_buffer, info.format_size);
+        pStream->Normalizer().SetOptions(m_AudioOptions);
+        pStream->Normalizer().SetFormat(info);
+        pStream->Payload().SetLayout(m_cbBufferAlignment, m_cbBufferPadding);
+        SetAggregateLimits(pStream);
+        hr = pStream->Converter().SetFormat(guidRaw, info.format.video.width, info.format.video.height);
+    }
+
     if (SUCCEEDED(hr))
     {
         *ppStream = pStream;
@@ -1952,7 +3096,454 @@ void PpboxMediaSource::StreamingError(HRESULT hr)
         // to notify the pipeline.
 
         QueueEvent(MEError, GUID_NULL, hr, NULL);
+        DumpEventTrace();
+    }
+}
+
+//-------------------------------------------------------------------
+// UpdateTraceStat
+// Publishes the event trace statistics, and stops the trace when its
+// overhead goes over the budget.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::UpdateTraceStat()
+{
+    if (!m_TraceOverhead.Update(GetTickCount64()))
+    {
+        TRACE(1, L"PpboxMediaSource: event trace overhead %u per mille, over budget, trace stopped\r\n",
+            m_TraceOverhead.Current());
+        EventTrace::Enable(FALSE);
+    }
+    PropertySetSet(m_pStatMap, L"TraceEvents", (UINT32)EventTrace::Events());
+    PropertySetSet(m_pStatMap, L"TraceCost", EventTrace::CostNs());
+    PropertySetSet(m_pStatMap, L"TraceOverhead", m_TraceOverhead.Current());
+}
+
+//-------------------------------------------------------------------
+// UpdateLatencyStat
+// Publishes the latency percentiles of each stream, in microseconds,
+// in a Stream<index> map of the statistics. The application resets
+// them by setting LatencyReset to a non-zero value.
+//-------------------------------------------------------------------
+
+static void PublishLatency(
+    ComPtr<ABI::Windows::Foundation::Collections::IPropertySet> & pMap,
+    LPCWSTR pszName,
+    LatencyHistogram const & histogram)
+{
+    static struct { LPCWSTR pszSuffix; DWORD dwPercent; } const s_Points[] =
+    {
+        { L"P50", 50 }, { L"P90", 90 }, { L"P99", 99 },
+    };
+    WCHAR szKey[64];
+
+    for (DWORD i = 0; i < ARRAYSIZE(s_Points); ++i)
+    {
+        swprintf_s(szKey, L"%s%s", pszName, s_Points[i].pszSuffix);
+        PropertySetSet(pMap, szKey, histogram.Percentile(s_Points[i].dwPercent));
+    }
+    swprintf_s(szKey, L"%sMax", pszName);
+    PropertySetSet(pMap, szKey, histogram.Max());
+}
+
+void PpboxMediaSource::UpdateLatencyStat()
+{
+    if (m_pStatMap == nullptr)
+    {
+        return;
+    }
+
+    UINT32 value = 0;
+    BOOL bReset = GetConfigValue(m_pStatMap.Get(), L"LatencyReset", value) == S_OK && value != 0;
+
+    if (bReset)
+    {
+        PropertySetSet(m_pStatMap, L"LatencyReset", (UINT32)0);
+    }
+
+    if (m_LatencyStat.size() < m_stream_number)
+    {
+        m_LatencyStat.resize(m_stream_number);
+    }
+
+    for (DWORD i = 0; i < m_stream_number; i++)
+    {
+        if (bReset)
+        {
+            m_streams[i]->ResetLatency();
+        }
+
+        if (m_LatencyStat[i].Get() == NULL)
+        {
+            WCHAR szName[16];
+            swprintf_s(szName, L"Stream%u", i);
+            if (FAILED(PropertySetAddSubMap(m_pStatMap, szName, m_LatencyStat[i])))
+            {
+                continue;
+            }
+        }
+        PublishLatency(m_LatencyStat[i], L"ReadLatency", m_streams[i]->ReadLatency());
+        PublishLatency(m_LatencyStat[i], L"QueueLatency", m_streams[i]->QueueLatency());
+        PublishLatency(m_LatencyStat[i], L"DeliveryLatency", m_streams[i]->DeliveryLatency());
+    }
+}
+
+//-------------------------------------------------------------------
+// SampleHistory
+// Adds the current statistics to the history. The values are the ones
+// already read, so sampling does not call the runtime.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::SampleHistory()
+{
+    ULONGLONG uTick = m_session.TickCount();
+
+    if (!m_History.IsEnabled())
+    {
+        return;
+    }
+
+    UINT64 hnsQueued = 0;
+    for (DWORD i = 0; i < m_stream_number; i++)
+    {
+        if (m_streams[i]->IsActive())
+        {
+            hnsQueued = max(hnsQueued, m_streams[i]->QueuedDuration());
+        }
+    }
+
+    UINT32 values[STAT_METRICS];
+    values[STAT_DOWNLOAD_SPEED] = m_uDownloadSpeed;
+    values[STAT_BUFFER_TIME] = m_uBufferSize;
+    values[STAT_QUEUE_DEPTH] = (UINT32)(hnsQueued / 10000);
+    values[STAT_STALLED] = m_Buffering.IsBuffering() ? 1000 : 0;
+    m_History.Add(uTick, values);
+}
+
+//-------------------------------------------------------------------
+// UpdateHistoryStat
+// Publishes the summaries of the last window in the History map of
+// the statistics: <metric>Min, Max, Mean, P50, P90 and P99.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::UpdateHistoryStat()
+{
+    static LPCWSTR const s_Names[STAT_METRICS] =
+    {
+        L"DownloadSpeed", L"BufferTime", L"QueueDepth", L"Stalled",
+    };
+
+    if (!m_History.IsEnabled() || m_pStatMap == nullptr)
+    {
+        return;
+    }
+    if (m_pHistoryStat == nullptr
+        && FAILED(PropertySetAddSubMap(m_pStatMap, L"History", m_pHistoryStat)))
+    {
+        return;
+    }
+
+    PropertySetSet(m_pHistoryStat, L"Window", m_uHistoryWindow);
+
+    for (DWORD i = 0; i < STAT_METRICS; ++i)
+    {
+        StatSummary summary;
+        if (!m_History.Summarize((StatMetric)i, m_session.TickCount(), m_uHistoryWindow, &summary))
+        {
+            continue;
+        }
+
+        struct { LPCWSTR pszSuffix; UINT32 uValue; } const values[] =
+        {
+            { L"Min", summary.uMin }, { L"Max", summary.uMax }, { L"Mean", summary.uMean },
+            { L"P50", summary.uP50 }, { L"P90", summary.uP90 }, { L"P99", summary.uP99 },
+        };
+        WCHAR szKey[64];
+        for (DWORD j = 0; j < ARRAYSIZE(values); ++j)
+        {
+            swprintf_s(szKey, L"%s%s", s_Names[i], values[j].pszSuffix);
+            PropertySetSet(m_pHistoryStat, szKey, values[j].uValue);
+        }
+    }
+}
+
+//-------------------------------------------------------------------
+// PublishTelemetry
+// Writes the counters and state to the telemetry segment, if one is
+// open. Called under the source lock.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::PublishTelemetry(BOOL bForce)
+{
+    if (!m_Telemetry.IsOpen())
+    {
+        return;
+    }
+
+    ULONGLONG uTick = m_session.TickCount();
+    if (!bForce && uTick < m_uTelemetryTick)
+    {
+        return;
+    }
+    m_uTelemetryTick = uTick + TELEMETRY_INTERVAL;
+
+    TelemetryData data;
+    ZeroMemory(&data, sizeof(data));
+    data.uTick = uTick;
+    data.uState = m_state;
+    data.bBuffering = m_Buffering.IsBuffering();
+    data.uBufferTime = m_uBufferSize;
+    data.uBufferPercent = m_uBufferProcess;
+    data.uDownloadSpeed = m_uDownloadSpeed;
+    data.uConnectionStatus = m_uConnectionStatus;
+    data.uBytesReceived = m_uBytesRecevied;
+    data.uStalls = m_uStalls;
+    data.uOpQueueDepth = (UINT32)max(m_cOpsQueued, 0L);
+    data.cStreams = min(m_stream_number, TELEMETRY_MAX_STREAMS);
+
+    // Streams are released at shutdown.
+    for (DWORD i = 0; i < m_stream_number; i++)
+    {
+        if (m_streams == NULL || m_streams[i] == NULL)
+        {
+            continue;
+        }
+        data.uDropped += m_streams[i]->Dropped();
+        if (i < TELEMETRY_MAX_STREAMS)
+        {
+            TelemetryStream &stream = data.streams[i];
+            stream.uQueuedSamples = m_streams[i]->QueuedSamples();
+            stream.uQueuedTime = (UINT32)(m_streams[i]->QueuedDuration() / 10000);
+            stream.uDropped = m_streams[i]->Dropped();
+            stream.bActive = m_streams[i]->IsActive();
+        }
+    }
+
+    m_Telemetry.Publish(data);
+}
+
+//-------------------------------------------------------------------
+// DumpEventTrace
+// Writes the event trace to the configured file, if any.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::DumpEventTrace()
+{
+    if (!m_strTraceFile.empty() && EventTrace::Events() != 0)
+    {
+        (void)EventTrace::Dump(m_strTraceFile.c_str());
+    }
+}
+
+//-------------------------------------------------------------------
+// ScheduleTimer
+// Arms the timer, unless it is already armed. The callback queues the
+// TimerOp of the arm as an OP_TIMER operation, which checks the
+// buffering, if any, and calls DeliverPayload again.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::ScheduleTimer(UINT32 uDelay)
+{
+    HRESULT hr = ArmTimer(uDelay, &m_OnScheduleTimer, &m_pScheduleTimerOp, &m_keyScheduleTimer);
+    if (FAILED(hr))
+    {
+        StreamingError(hr);
+    }
+}
+
+//-------------------------------------------------------------------
+// CancelScheduleTimer
+// Cancels the timer, if armed, and releases its TimerOp.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::CancelScheduleTimer()
+{
+    CancelTimer(&m_pScheduleTimerOp, &m_keyScheduleTimer);
+}
+
+//-------------------------------------------------------------------
+// CheckBuffering
+// Reads the buffering progress from the runtime, and ends the
+// buffering phase when it is complete. Otherwise, arms the timer for
+// the next check. If the runtime keeps failing to report the
+// progress, the phase ends with a streaming error.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::CheckBuffering()
+{
+    ULONGLONG uTick = m_session.TickCount();
+
+    HRESULT hr = SampleStat(SAMPLER_PLAY_STAT, uTick);
+
+    // E_PENDING: The runtime is still buffering, the progress is read.
+    BOOL bDone = (FAILED(hr) && hr != E_PENDING)
+        ? m_Buffering.Fail(uTick)
+        : m_Buffering.Check(uTick, m_uBufferProcess);
+    if (!bDone)
+    {
+        ScheduleTimer(m_Buffering.NextDelay());
+        return;
+    }
+
+    EventTrace::Mark(EVENT_TRACE_BUFFERING, 0);
+    (void)m_pEventQueue->QueueEventParamVar(MEBufferingStopped, GUID_NULL, S_OK, NULL);
+
+    if (FAILED(hr) && hr != E_PENDING)
+    {
+        StreamingError(hr);
+    }
+}
+
+/* Statistics sampler */
+
+//-------------------------------------------------------------------
+// SampleStat
+// Samples one metric, and accounts its cost. Returns the result of
+// the runtime call, if any.
+//-------------------------------------------------------------------
+
+HRESULT PpboxMediaSource::SampleStat(SamplerMetric metric, ULONGLONG uTick)
+{
+    HRESULT hr = S_OK;
+    UINT64 uStart = PpboxMediaStream::Microseconds();
+
+    switch (metric)
+    {
+    case SAMPLER_PLAY_STAT:
+        hr = UpdatePlayStat();
+        break;
+    case SAMPLER_DATA_STAT:
+        hr = UpdateNetStat();
+        break;
+    case SAMPLER_HISTORY:
+        SampleHistory();
+        break;
+    case SAMPLER_PUBLISH:
+        UpdateSourceStat();
+        break;
+    }
+
+    m_StatSampler.Sampled(metric, uTick);
+    m_StatSampler.AddCost(metric, (UINT32)(PpboxMediaStream::Microseconds() - uStart));
+
+    return hr;
+}
+
+//-------------------------------------------------------------------
+// SampleStats
+// Samples the metrics that are due. Called on the statistics timer,
+// so the runtime statistics calls and the property set writes stay
+// off the sample path; DeliverPayload only reads the values cached
+// here.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::SampleStats()
+{
+    ULONGLONG uTick = m_session.TickCount();
+
+    for (DWORD i = 0; i < SAMPLER_METRICS; i++)
+    {
+        if (m_StatSampler.IsDue((SamplerMetric)i, uTick))
+        {
+            (void)SampleStat((SamplerMetric)i, uTick);
+        }
+    }
+}
+
+//-------------------------------------------------------------------
+// ArmStatTimer
+// Arms the statistics timer for the next metric due, unless it is
+// already armed. Each arm is a TimerOp, held until the callback or
+// CancelStatTimer. The statistics are only sampled while started:
+// Start arms the timer, and it stops at the first callback in another
+// state.
+//-------------------------------------------------------------------
+
+void PpboxMediaSource::ArmStatTimer()
+{
+    (void)ArmTimer(m_StatSampler.NextDelay(m_session.TickCount()),
+        &m_OnStatTimer, &m_pStatTimerOp, &m_keyStatTimer);
+}
+
+void PpboxMediaSource::CancelStatTimer()
+{
+    CancelTimer(&m_pStatTimerOp, &m_keyStatTimer);
+}
+
+HRESULT PpboxMediaSource::OnStatTimerCallback(IMFAsyncResult *pResult)
+{
+    IUnknown *pState = NULL;
+
+    Lock();
+
+    (void)pResult->GetState(&pState);
+
+    // A callback of a canceled arm may still come, after it fired.
+    if (FireTimer(pState, &m_pStatTimerOp, &m_keyStatTimer) && m_state == STATE_STARTED)
+    {
+        SampleStats();
+        ArmStatTimer();
+    }
+
+    LeaveCriticalSection(&m_critSec);
+
+    SafeRelease(&pState);
+    return S_OK;
+}
+
+/* Timers */
+
+//-------------------------------------------------------------------
+// ArmTimer
+// Arms a timer with a new TimerOp, unless one is armed. The source
+// holds the op, and the op holds the callback, until the timer fires
+// or is canceled.
+//-------------------------------------------------------------------
+
+HRESULT PpboxMediaSource::ArmTimer(
+    UINT32 uDelay, IMFAsyncCallback *pCallback, TimerOp **ppOp, void const **pKey)
+{
+    HRESULT hr = S_OK;
+
+    if (*ppOp == NULL)
+    {
+        hr = SourceOp::CreateTimerOp(pCallback, ppOp);
+        if (SUCCEEDED(hr))
+        {
+            *pKey = PpboxSession::ScheduleCallback(uDelay, *ppOp, OnPpboxTimer);
+        }
+    }
+
+    TRACEHR_RET(hr);
+}
+
+void PpboxMediaSource::CancelTimer(TimerOp **ppOp, void const **pKey)
+{
+    if (*ppOp)
+    {
+        PpboxSession::CancelCallback(*pKey);
+        *pKey = 0;
+        SafeRelease(ppOp);
+    }
+}
+
+//-------------------------------------------------------------------
+// FireTimer
+// Returns TRUE if pState is the op of the armed timer, and disarms it.
+// Otherwise the callback belongs to an arm that was canceled after it
+// fired, maybe followed by a new arm, and is ignored.
+//-------------------------------------------------------------------
+
+BOOL PpboxMediaSource::FireTimer(IUnknown *pState, TimerOp **ppOp, void const **pKey)
+{
+    if (*ppOp == NULL || pState != static_cast<IUnknown *>(*ppOp))
+    {
+        return FALSE;
     }
+
+    *pKey = 0;
+    SafeRelease(ppOp);
+    return TRUE;
 }
 
 //-------------------------------------------------------------------
@@ -1964,7 +3555,7 @@ void PpboxMediaSource::StreamingError(HRESULT hr)
 
 HRESULT PpboxMediaSource::OnScheduleTimerCallback(IMFAsyncResult *pResult)
 {
-    EnterCriticalSection(&m_critSec);
+    Lock();
 
     HRESULT hr = S_OK;
     DWORD cbRead = 0;
@@ -1979,8 +3570,7 @@ HRESULT PpboxMediaSource::OnScheduleTimerCallback(IMFAsyncResult *pResult)
         return S_OK;
     }
 
-    // Get the state object. This is either NULL or the most
-    // recent OP_REQUEST_DATA operation.
+    // Get the state object, the TimerOp of the arm that fired.
     (void)pResult->GetState(&pState);
 
     // Complete the read opertation.
@@ -1993,7 +3583,20 @@ HRESULT PpboxMediaSource::OnScheduleTimerCallback(IMFAsyncResult *pResult)
 
 	//OutputDebugString(L"OnScheduleTimer\r\n");
 
-    hr = QueueAsyncOperation(SourceOp::OP_TIMER);
+    // The arm was canceled after it fired. Otherwise OnScheduleTimer
+    // checks the op again, as Stop may cancel it while it is queued.
+    if (m_pScheduleTimerOp == NULL || pState != static_cast<IUnknown *>(m_pScheduleTimerOp))
+    {
+        hr = S_OK;
+    }
+    else
+    {
+        hr = QueueOperation(m_pScheduleTimerOp);
+        if (SUCCEEDED(hr))
+        {
+            InterlockedIncrement(&m_cOpsQueued);
+        }
+    }
 
     SafeRelease(&pState);
     LeaveCriticalSection(&m_critSec);
@@ -18,6 +18,8 @@
 #include <new.h>
 #include <windows.h>
 #include <assert.h>
+#include <string>
+#include <deque>
 
 #ifndef _ASSERTE
 #define _ASSERTE assert
@@ -33,6 +35,26 @@
 
 #include "OpQueue.h"
 #include "SourceOp.h"
+#include "RebufferPredictor.h"
+#include "BufferingController.h"
+#include "LiveLatencyController.h"
+#include "TimeShiftBuffer.h"
+#include "PpboxSession.h"
+#include "AvcBitstream.h"
+#include "RawVideoConverter.h"
+#include "PayloadAllocator.h"
+#include "AudioNormalizer.h"
+#include "SampleAggregator.h"
+#include "SampleQueue.h"
+#include "SampleAttributes.h"
+#include "StreamClock.h"
+#include "InterleaveBalancer.h"
+#include "MemoryGovernor.h"
+#include "EventTrace.h"
+#include "LatencyHistogram.h"
+#include "StatHistory.h"
+#include "StatSampler.h"
+#include "TelemetrySegment.h"
 
 // Forward declares
 class PpboxSchemeHandler;
@@ -40,7 +62,6 @@ class PpboxMediaSource;
 class PpboxMediaStream;
 class SourceOp;
 
-typedef ComPtrList<IMFSample>       SampleList;
 typedef ComPtrList<IUnknown, true>  TokenList;    // List of tokens for IMFMediaStream::RequestSample
 
 enum SourceState
@@ -67,6 +88,28 @@ const DWORD INITIAL_BUFFER_SIZE = 4 * 1024; // Initial size of the read buffer.
 const DWORD READ_SIZE = 4 * 1024;           // Size of each read request.
 const DWORD SAMPLE_QUEUE = 2;               // How many samples does each stream try to hold in its queue?
 
+// Extended events (MEExtendedType) sent by the source.
+
+// Playback is predicted to stall soon. Value: VT_UI4, milliseconds until the stall.
+// {6C1B6E0A-3F2D-4E8B-9A57-0D2C8E41B7F3}
+DEFINE_GUID(PPBOX_EVENT_REBUFFER_WARNING,
+    0x6c1b6e0a, 0x3f2d, 0x4e8b, 0x9a, 0x57, 0x0d, 0x2c, 0x8e, 0x41, 0xb7, 0xf3);
+
+// Live catch-up started or stopped. Value: VT_R8, suggested playback rate.
+// {B2E4F1C7-58A9-4D03-8E6B-71F0C3A95D24}
+DEFINE_GUID(PPBOX_EVENT_LIVE_CATCHUP,
+    0xb2e4f1c7, 0x58a9, 0x4d03, 0x8e, 0x6b, 0x71, 0xf0, 0xc3, 0xa9, 0x5d, 0x24);
+
+// Presentation descriptor attributes set by the source.
+
+// Seekable range of a live session with time shifting, in 100-nanosecond units (UINT64).
+// {4D7A2C91-E0B3-4F68-B915-3C8D6A07E2F5}
+DEFINE_GUID(PPBOX_PD_TIMESHIFT_START,
+    0x4d7a2c91, 0xe0b3, 0x4f68, 0xb9, 0x15, 0x3c, 0x8d, 0x6a, 0x07, 0xe2, 0xf5);
+// {9E1F5B38-7A26-4C4D-83E0-D6B2F91C4A67}
+DEFINE_GUID(PPBOX_PD_TIMESHIFT_END,
+    0x9e1f5b38, 0x7a26, 0x4c4d, 0x83, 0xe0, 0xd6, 0xb2, 0xf9, 0x1c, 0x4a, 0x67);
+
 // PpboxMediaSource: The media source object.
 class PpboxMediaSource 
     : public OpQueue<SourceOp>
@@ -138,7 +181,8 @@ public:
 
     // Lock/Unlock:
     // Holds and releases the source's critical section. Called by the streams.
-    void    Lock() { EnterCriticalSection(&m_critSec); }
+    // Waits for the lock are traced.
+    void    Lock() { EventTrace::EnterLock(&m_critSec); }
     void    Unlock() { LeaveCriticalSection(&m_critSec); }
 
 private:
@@ -174,9 +218,32 @@ private:
     HRESULT     SelectStreams(IMFPresentationDescriptor *pPD, PROPVARIANT * varStart);
 
     HRESULT     DeliverPayload();
+    HRESULT     DeliverTimeShiftPayload();
+    HRESULT     PrepareSample(JUST_Sample & sample, IMFSample **ppSample);
+    HRESULT     RecordTimeShiftSample(JUST_Sample const & sample, IMFSample *pSample);
+    void        UpdateTimeShiftRange();
     HRESULT     EndOfPpboxStream();
     HRESULT     UpdatePlayStat();
     HRESULT     UpdateNetStat();
+    void        UpdateSourceStat();
+    HRESULT     SampleStat(SamplerMetric metric, ULONGLONG uTick);
+    void        SampleStats();
+    void        ArmStatTimer();
+    void        CancelStatTimer();
+    void        CheckBuffering();
+    void        UpdateRebufferPrediction();
+    void        UpdateLiveLatency();
+    BOOL        FilterLiveSample(JUST_Sample const & sample);
+    void        ResetClocks(UINT64 uTime);
+    void        UpdatePresentationClock(BOOL bDiscontinuity);
+    void        BalanceInterleave();
+    void        EnforceMemoryBudget();
+    HRESULT     CheckFormatChange(JUST_Sample const & sample, IMFMediaType **ppType);
+    HRESULT     RewriteSample(JUST_Sample & sample);
+    HRESULT     CreateStreamSample(JUST_Sample const & sample, IMFSample **ppSample);
+    HRESULT     CreateStreamMediaType(JUST_StreamInfo const & info, IMFMediaType **ppType, GUID *pguidRaw);
+    void        SetAggregateLimits(PpboxMediaStream *pStream);
+    HRESULT     FlushAggregates();
 
     HRESULT     CreateStream(long stream_id, PpboxMediaStream **ppStream);
 
@@ -184,13 +251,26 @@ private:
 
     // Handler for async errors.
     void        StreamingError(HRESULT hr);
+    void        UpdateTraceStat();
+    void        UpdateLatencyStat();
+    void        SampleHistory();
+    void        UpdateHistoryStat();
+    void        PublishTelemetry(BOOL bForce);
+    void        DumpEventTrace();
 
     HRESULT     BeginAsyncOp(SourceOp *pOp);
     HRESULT     CompleteAsyncOp(SourceOp *pOp);
     HRESULT     DispatchOperation(SourceOp *pOp);
     HRESULT     ValidateOperation(SourceOp *pOp);
 
+    void        ScheduleTimer(UINT32 uDelay);
+    void        CancelScheduleTimer();
     HRESULT     OnScheduleTimerCallback(IMFAsyncResult *pResult);
+    HRESULT     OnStatTimerCallback(IMFAsyncResult *pResult);
+
+    HRESULT     ArmTimer(UINT32 uDelay, IMFAsyncCallback *pCallback, TimerOp **ppOp, void const **pKey);
+    void        CancelTimer(TimerOp **ppOp, void const **pKey);
+    BOOL        FireTimer(IUnknown *pState, TimerOp **ppOp, void const **pKey);
 
 private:
     long                        m_cRef;                     // reference count
@@ -202,6 +282,8 @@ private:
 
     ComPtr<StatMap>             m_pStatMap;
 
+    PpboxSession                m_session;                  // Access to the runtime
+
     IMFMediaEventQueue          *m_pEventQueue;             // Event generator helper
 
     IMFAsyncResult              *m_pOpenResult;
@@ -215,10 +297,13 @@ private:
     SourceOp                    *m_pCurrentOp;
 
     BOOL                        m_bLive;
+    BOOL                        m_bHasVideo;
     UINT64                      m_uDuration;
-    UINT64                      m_uTime;
-    UINT64                      m_uTimeGetBufferStat;
-    BOOL                        m_bBufferring;
+    UINT64                      m_uTime;                    // Presentation clock, monotonic between seeks
+    UINT64                      m_uClockReference;          // Slowest stream clock when m_uTime last moved
+    BOOL                        m_bClockValid;
+    UINT32                      m_uAVSkew;                  // Milliseconds between audio and video clocks
+    UINT32                      m_uBitrate;                 // Sum of selected stream bitrates, 0 if unknown
     // MFNETSOURCE_STATISTICS
     UINT32                      m_uDownloadSpeed;
     UINT32                      m_uBytesRecevied;
@@ -227,10 +312,44 @@ private:
     UINT32                      m_uDownloadProcess;
     UINT32                      m_uConnectionStatus;
 
+    RebufferPredictor           m_RebufferPredictor;
+    BufferingController         m_Buffering;
+    LiveLatencyController       m_LiveLatency;
+    InterleaveBalancer          m_Interleave;
+    MemoryGovernor              m_Memory;
+    DWORD                       m_dwDiscontinuity;          // Streams whose next sample is a discontinuity
+    TimeShiftBuffer             m_TimeShift;
+    UINT32                      m_uFormatChanges;
+    UINT64                      m_uSkippedBytes;            // Payload of deselected streams, not copied
+    UINT32                      m_uAvcFormat;               // AVC_FORMAT_* of delivered H.264 samples
+    BOOL                        m_bAvcInsertParameterSets;
+    BOOL                        m_bConvertRawVideo;         // Deliver I420 as NV12 and RGB24 as RGB32
+    AudioNormalizeOptions       m_AudioOptions;             // Conversion of PCM and float tracks
+    UINT32                      m_uAggregateFrames;         // Audio frames per sample, 0 or 1 for no aggregation
+    UINT32                      m_uAggregateLatency;        // Milliseconds
+    DWORD                       m_cbBufferAlignment;        // Of payload buffers, 0 for plain memory buffers
+    DWORD                       m_cbBufferPadding;
+    std::wstring                m_strTraceFile;             // Event trace dump on error and shutdown
+    EventTraceOverhead          m_TraceOverhead;
+    std::vector<ComPtr<StatMap>> m_LatencyStat;             // Per stream, Stream<index> in the statistics
+    StatHistory                 m_History;
+    ComPtr<StatMap>             m_pHistoryStat;             // History in the statistics
+    UINT32                      m_uHistoryWindow;           // Milliseconds summarized in the statistics
+    TelemetrySegment            m_Telemetry;
+    ULONGLONG                   m_uTelemetryTick;           // Next update of the telemetry
+    LONG volatile               m_cOpsQueued;               // Operations queued, not dispatched
+    UINT32                      m_uStalls;                  // Buffering events
+    StatSampler                 m_StatSampler;
+    ComPtr<StatMap>             m_pSamplerStat;             // Sampler in the statistics
+
     // Async callback helper.
     AsyncCallback<PpboxMediaSource>  m_OnScheduleTimer;
     //MFWORKITEM_KEY              m_keyScheduleDelayRequestSample;
+    TimerOp *                   m_pScheduleTimerOp;         // Armed schedule timer, if any
 	void const *				m_keyScheduleTimer;
+    AsyncCallback<PpboxMediaSource>  m_OnStatTimer;
+    TimerOp *                   m_pStatTimerOp;             // Armed statistics timer, if any
+    void const *                m_keyStatTimer;
 };
 
 
@@ -16,6 +16,7 @@
 #include "PpboxMediaSource.h"
 #include "SafeRelease.h"
 #include "Trace.h"
+#include "TraceGate.h"
 
 #pragma warning( push )
 #pragma warning( disable : 4355 )  // 'this' used in base member initializer list
@@ -297,6 +298,7 @@ HRESULT PpboxMediaStream::RequestSample(IUnknown* pToken)
     {
         goto done;
     }
+    m_RequestTimes.push_back(Microseconds());
 
     // Dispatch the request.
     hr = DispatchSamples();
@@ -312,7 +314,7 @@ done:
         // unless the source is already shut down.
         hr = m_pSource->QueueEvent(MEError, GUID_NULL, hr, NULL);
     }
-    TRACEHR_RET(hr);
+    TRACEHR_HOT_RET(hr);
 }
 
 
@@ -327,7 +329,13 @@ PpboxMediaStream::PpboxMediaStream(PpboxMediaSource *pSource, IMFStreamDescripto
     m_pEventQueue(NULL),
     m_state(STATE_STOPPED),
     m_bActive(FALSE),
-    m_bEOS(FALSE)
+    m_bEOS(FALSE),
+    m_guidMajorType(GUID_NULL),
+    m_guidSubType(GUID_NULL),
+    m_uFormatSignature(0),
+    m_uBitrate(0),
+    m_cQueueLimit(INTERLEAVE_QUEUE_LIMIT),
+    m_cDropped(0)
 {
     TRACE(3, L"PpboxMediaStream::PpboxMediaStream %p\r\n", this);
 
@@ -348,6 +356,30 @@ PpboxMediaStream::PpboxMediaStream(PpboxMediaSource *pSource, IMFStreamDescripto
 
     // Create the media event queue.
     hr = MFCreateEventQueue(&m_pEventQueue);
+
+    // Cache the stream format, the source looks at it for each sample.
+    IMFMediaTypeHandler *pHandler = NULL;
+    IMFMediaType *pType = NULL;
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pStreamDescriptor->GetMediaTypeHandler(&pHandler);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pHandler->GetCurrentMediaType(&pType);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->GetMajorType(&m_guidMajorType);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->GetGUID(MF_MT_SUBTYPE, &m_guidSubType);
+    }
+
+    SafeRelease(&pType);
+    SafeRelease(&pHandler);
 }
 
 PpboxMediaStream::~PpboxMediaStream()
@@ -386,6 +418,8 @@ HRESULT PpboxMediaStream::Activate(BOOL bActive)
     {
         m_Samples.Clear();
         m_Requests.Clear();
+        m_RequestTimes.clear();
+        m_Aggregator.Clear();
     }
     return S_OK;
 }
@@ -467,7 +501,9 @@ HRESULT PpboxMediaStream::Stop()
     if (SUCCEEDED(hr))
     {
         m_Requests.Clear();
+        m_RequestTimes.clear();
         m_Samples.Clear();
+        m_Aggregator.Clear();
 
         m_state = STATE_STOPPED;
 
@@ -488,9 +524,16 @@ HRESULT PpboxMediaStream::EndOfStream()
 {
     SourceLock lock(m_pSource);
 
+    // Queue the last aggregate before the end of stream.
+    HRESULT hr = FlushAggregate();
+
     m_bEOS = TRUE;
 
-    return DispatchSamples();
+    if (SUCCEEDED(hr))
+    {
+        hr = DispatchSamples();
+    }
+    TRACEHR_RET(hr);
 }
 
 
@@ -520,6 +563,8 @@ HRESULT PpboxMediaStream::Shutdown()
         // Release objects.
         m_Samples.Clear();
         m_Requests.Clear();
+        m_RequestTimes.clear();
+        m_Aggregator.Clear();
 
         SafeRelease(&m_pStreamDescriptor);
         SafeRelease(&m_pEventQueue);
@@ -552,7 +597,21 @@ BOOL PpboxMediaStream::NeedsData()
     // Note: The stream tries to keep a minimum number of samples
     // queued ahead.
 
-    return (m_bActive && !m_bEOS && (m_Samples.GetCount() < SAMPLE_QUEUE));
+    return (m_bActive && !m_bEOS && (m_Samples.Count() < SAMPLE_QUEUE));
+}
+
+
+//-------------------------------------------------------------------
+// IsStarving
+// Returns TRUE if the pipeline waits for samples of this stream.
+//-------------------------------------------------------------------
+
+BOOL PpboxMediaStream::IsStarving()
+{
+    SourceLock lock(m_pSource);
+
+    return (m_bActive && !m_bEOS && m_state == STATE_STARTED
+        && m_Samples.IsEmpty() && !m_Requests.IsEmpty());
 }
 
 
@@ -566,28 +625,186 @@ HRESULT PpboxMediaStream::DeliverPayload(IMFSample *pSample)
     SourceLock lock(m_pSource);
 
     HRESULT hr = S_OK;
+    IMFSample *pReady = NULL;
+
+    // Audio frames may be merged into a later sample.
+    if (m_Aggregator.IsEnabled())
+    {
+        hr = m_Aggregator.Add(pSample, &pReady);
+        if (FAILED(hr) || pReady == NULL)
+        {
+            TRACEHR_HOT_RET(hr);
+        }
+        pSample = pReady;
+    }
 
     // Queue the sample.
-	if (m_Samples.GetCount() > 200) {
-		IMFSample *pSample = NULL;
-		m_Samples.RemoveFront(&pSample);
-		SafeRelease(&pSample);
-        Trace(3, L"[PpboxMediaStream::DeliverPayload] drop sample\r\n");
+	if (m_Samples.Count() > m_cQueueLimit) {
+		DropOldest();
+        TRACE_HOT_SAMPLED(3, 64, L"[PpboxMediaStream::DeliverPayload] drop sample\r\n");
 	}
 
-    hr = m_Samples.InsertBack(pSample);
+    hr = m_Samples.Push(pSample);
 
     // Deliver the sample if there is an outstanding request.
     if (SUCCEEDED(hr))
     {
+        StampQueued(pSample);
+        TraceSample(EVENT_TRACE_ENQUEUE, pSample);
         hr = DispatchSamples();
     }
 
+    SafeRelease(&pReady);
+    TRACEHR_HOT_RET(hr);
+}
+
+//-------------------------------------------------------------------
+// DropOldest
+// Drops the oldest queued sample, and returns its size. The next
+// sample takes over a format change, and is marked discontinuous.
+//-------------------------------------------------------------------
+
+DWORD PpboxMediaStream::DropOldest()
+{
+    SourceLock lock(m_pSource);
+
+    if (m_Samples.IsEmpty())
+    {
+        return 0;
+    }
+
+    ++m_cDropped;
+    return m_Samples.DropOldest();
+}
+
+//-------------------------------------------------------------------
+// FlushAggregate
+// Queues the frames held by the aggregator. Called at the end of the
+// stream and when the source stalls, so they do not wait for frames
+// that are not coming.
+//-------------------------------------------------------------------
+
+HRESULT PpboxMediaStream::FlushAggregate()
+{
+    SourceLock lock(m_pSource);
+
+    HRESULT hr = S_OK;
+    IMFSample *pReady = NULL;
+
+    m_Aggregator.Flush(&pReady);
+
+    if (pReady)
+    {
+        hr = m_Samples.Push(pReady);
+        if (SUCCEEDED(hr))
+        {
+            StampQueued(pReady);
+            TraceSample(EVENT_TRACE_ENQUEUE, pReady);
+            hr = DispatchSamples();
+        }
+    }
+
+    SafeRelease(&pReady);
     TRACEHR_RET(hr);
 }
 
+//-------------------------------------------------------------------
+// SetFormat
+// Records the format of the samples the source reads from now on.
+// The media type handler is only updated when the first sample of
+// that format is dispatched.
+//-------------------------------------------------------------------
+
+void PpboxMediaStream::SetFormat(UINT32 uSignature, REFGUID guidSubType)
+{
+    m_uFormatSignature = uSignature;
+    m_guidSubType = guidSubType;
+}
+
 /* Private methods */
 
+//-------------------------------------------------------------------
+// StampQueued, StampDispatched
+// Account the latencies of a sample entering and leaving the queue.
+// Samples without a read time, time-shift replays, are not counted
+// before the queue. The attributes are private to the source, so
+// StampDispatched removes them before the sample goes downstream.
+//-------------------------------------------------------------------
+
+static UINT32 Elapsed(UINT64 uFrom, UINT64 uTo)
+{
+    return uTo <= uFrom ? 0 : (UINT32)min(uTo - uFrom, (UINT64)0xffffffff);
+}
+
+void PpboxMediaStream::StampQueued(IMFSample *pSample)
+{
+    UINT64 uNow = Microseconds();
+    UINT64 uReadTime = 0;
+
+    if (SUCCEEDED(pSample->GetUINT64(PPBOX_SAMPLE_READ_TIME, &uReadTime)))
+    {
+        m_ReadLatency.Add(Elapsed(uReadTime, uNow));
+    }
+    (void)pSample->SetUINT64(PPBOX_SAMPLE_QUEUE_TIME, uNow);
+}
+
+void PpboxMediaStream::StampDispatched(IMFSample *pSample)
+{
+    UINT64 uNow = Microseconds();
+    UINT64 uQueueTime = 0;
+
+    if (SUCCEEDED(pSample->GetUINT64(PPBOX_SAMPLE_QUEUE_TIME, &uQueueTime)))
+    {
+        m_QueueLatency.Add(Elapsed(uQueueTime, uNow));
+    }
+    (void)pSample->DeleteItem(PPBOX_SAMPLE_READ_TIME);
+    (void)pSample->DeleteItem(PPBOX_SAMPLE_QUEUE_TIME);
+    if (!m_RequestTimes.empty())
+    {
+        m_DeliveryLatency.Add(Elapsed(m_RequestTimes.front(), uNow));
+        m_RequestTimes.pop_front();
+    }
+}
+
+void PpboxMediaStream::ResetLatency()
+{
+    m_ReadLatency.Reset();
+    m_QueueLatency.Reset();
+    m_DeliveryLatency.Reset();
+}
+
+UINT64 PpboxMediaStream::Microseconds()
+{
+    static UINT64 s_uFrequency = 0;
+    LARGE_INTEGER li;
+
+    if (s_uFrequency == 0)
+    {
+        QueryPerformanceFrequency(&li);
+        s_uFrequency = li.QuadPart;
+    }
+    QueryPerformanceCounter(&li);
+    return li.QuadPart / s_uFrequency * 1000000 + li.QuadPart % s_uFrequency * 1000000 / s_uFrequency;
+}
+
+//-------------------------------------------------------------------
+// TraceSample
+// Records an event trace mark with the stream identifier and the
+// sample time.
+//-------------------------------------------------------------------
+
+void PpboxMediaStream::TraceSample(EventTraceType type, IMFSample *pSample)
+{
+    if (EventTrace::IsEnabled())
+    {
+        DWORD dwId = 0;
+        LONGLONG hnsTime = 0;
+        (void)m_pStreamDescriptor->GetStreamIdentifier(&dwId);
+        (void)pSample->GetSampleTime(&hnsTime);
+        EventTrace::Mark(type, dwId, hnsTime);
+    }
+}
+
 //-------------------------------------------------------------------
 // DispatchSamples
 // Dispatches as many pending sample requests as possible.
@@ -615,7 +832,7 @@ HRESULT PpboxMediaStream::DispatchSamples()
     while (!m_Samples.IsEmpty() && !m_Requests.IsEmpty())
     {
         // Pull the next sample from the queue.
-        hr = m_Samples.RemoveFront(&pSample);
+        hr = m_Samples.Pop(&pSample);
         if (FAILED(hr))
         {
             goto done;
@@ -638,6 +855,16 @@ HRESULT PpboxMediaStream::DispatchSamples()
             }
         }
 
+        // Announce a new format before its first sample.
+        hr = ApplyFormatChange(pSample);
+        if (FAILED(hr))
+        {
+            goto done;
+        }
+
+        // Takes the latency attributes off, before the sample leaves.
+        StampDispatched(pSample);
+
         // Send an MEMediaSample event with the sample.
         hr = m_pEventQueue->QueueEventParamUnk(
             MEMediaSample, GUID_NULL, S_OK, pSample);
@@ -646,6 +873,7 @@ HRESULT PpboxMediaStream::DispatchSamples()
         {
             goto done;
         }
+        TraceSample(EVENT_TRACE_DISPATCH, pSample);
 
         SafeRelease(&pSample);
         SafeRelease(&pToken);
@@ -698,4 +926,43 @@ done:
     return S_OK;
 }
 
+//-------------------------------------------------------------------
+// ApplyFormatChange
+// Makes the media type attached to a sample the current one, and
+// sends MEStreamFormatChanged so that the pipeline reconfigures
+// without reopening the source.
+//-------------------------------------------------------------------
+
+HRESULT PpboxMediaStream::ApplyFormatChange(IMFSample *pSample)
+{
+    IMFMediaType *pType = NULL;
+    IMFMediaTypeHandler *pHandler = NULL;
+
+    HRESULT hr = pSample->GetUnknown(PPBOX_SAMPLE_MEDIA_TYPE, IID_PPV_ARGS(&pType));
+    if (FAILED(hr))
+    {
+        return S_OK;
+    }
+
+    hr = pSample->DeleteItem(PPBOX_SAMPLE_MEDIA_TYPE);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pStreamDescriptor->GetMediaTypeHandler(&pHandler);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pHandler->SetCurrentMediaType(pType);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pEventQueue->QueueEventParamUnk(
+            MEStreamFormatChanged, GUID_NULL, S_OK, pType);
+    }
+
+    SafeRelease(&pHandler);
+    SafeRelease(&pType);
+    TRACEHR_HOT_RET(hr);
+}
+
 #pragma warning( pop )
\ No newline at end of file
@@ -49,9 +49,39 @@ public:
     HRESULT     Shutdown();
 
     BOOL        IsActive() const { return m_bActive; }
+    BOOL        IsVideo() const { return m_guidMajorType == MFMediaType_Video; }
+    REFGUID     SubType() const { return m_guidSubType; }
+    UINT32      FormatSignature() const { return m_uFormatSignature; }
+    void        SetFormat(UINT32 uSignature, REFGUID guidSubType);
+    UINT32      Bitrate() const { return m_uBitrate; }
+    void        SetBitrate(UINT32 uBitrate) { m_uBitrate = uBitrate; }
+    AvcRewriter &   Rewriter() { return m_AvcRewriter; }
+    RawVideoConverter & Converter() { return m_RawVideo; }
+    PayloadAllocator &  Payload() { return m_Payload; }
+    AudioNormalizer &   Normalizer() { return m_Audio; }
+    SampleAggregator &  Aggregator() { return m_Aggregator; }
+    StreamClock &       Clock() { return m_Clock; }
     BOOL        NeedsData();
+    BOOL        IsStarving();
+    UINT64      QueuedDuration() const { return m_Samples.Duration(); }
+    UINT64      QueuedBytes() const { return m_Samples.Bytes(); }
+    DWORD       QueuedSamples() const { return m_Samples.Count(); }
+    DWORD       DropOldest();
+    UINT32      Dropped() const { return m_cDropped; }
+    void        SetQueueLimit(DWORD cLimit) { m_cQueueLimit = cLimit; }
+
+    // Microseconds from the source reading a payload to queuing it, of
+    // a sample in the queue, and from a request to its sample.
+    LatencyHistogram const &    ReadLatency() const { return m_ReadLatency; }
+    LatencyHistogram const &    QueueLatency() const { return m_QueueLatency; }
+    LatencyHistogram const &    DeliveryLatency() const { return m_DeliveryLatency; }
+    void        ResetLatency();
+
+    // Clock of the latency statistics.
+    static UINT64 Microseconds();
 
     HRESULT     DeliverPayload(IMFSample *pSample);
+    HRESULT     FlushAggregate();
 
     // Callbacks
     HRESULT     OnDispatchSamples(IMFAsyncResult *pResult);
@@ -71,11 +101,16 @@ private:
 
 private:
 
+    void    TraceSample(EventTraceType type, IMFSample *pSample);
+    void    StampQueued(IMFSample *pSample);
+    void    StampDispatched(IMFSample *pSample);
+
     HRESULT CheckShutdown() const
     {
         return ( m_state == STATE_SHUTDOWN ? MF_E_SHUTDOWN : S_OK );
     }
     HRESULT DispatchSamples();
+    HRESULT ApplyFormatChange(IMFSample *pSample);
 
 
 private:
@@ -89,8 +124,26 @@ private:
     BOOL                m_bActive;              // Is the stream active?
     BOOL                m_bEOS;                 // Did the source reach the end of the stream?
 
-    SampleList          m_Samples;              // Samples waiting to be delivered.
+    GUID                m_guidMajorType;        // Major type and subtype of the stream format
+    GUID                m_guidSubType;
+    UINT32              m_uFormatSignature;     // StreamInfoSignature() of the format read last
+    UINT32              m_uBitrate;             // Nominal bitrate, 0 if unknown
+    AvcRewriter         m_AvcRewriter;          // Bitstream conversion of H.264 samples
+    RawVideoConverter   m_RawVideo;             // Color conversion of raw video samples
+    PayloadAllocator    m_Payload;              // Aligned buffers of the other samples
+    AudioNormalizer     m_Audio;                // Format conversion of PCM and float samples
+    SampleAggregator    m_Aggregator;           // Audio frames not queued yet
+    StreamClock         m_Clock;                // Timestamps of the samples read
+
+    SampleQueue         m_Samples;              // Samples waiting to be delivered.
+    DWORD               m_cQueueLimit;          // Samples queued before dropping the oldest.
+    UINT32              m_cDropped;             // Samples dropped by DropOldest.
     TokenList           m_Requests;             // Sample requests, waiting to be dispatched.
+    std::deque<UINT64>  m_RequestTimes;         // Microseconds of each request in m_Requests.
+
+    LatencyHistogram    m_ReadLatency;
+    LatencyHistogram    m_QueueLatency;
+    LatencyHistogram    m_DeliveryLatency;
 };
 
 
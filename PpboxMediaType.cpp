@@ -20,6 +20,7 @@
 #include "SafeRelease.h"
 
 #include "PpboxMediaType.h"
+#include "CodecPrivate.h"
 
 
 /*  Static functions */
@@ -75,6 +76,184 @@ static PP_uint find_codec_by_mf_type(
     return 0;
 }
 
+//-------------------------------------------------------------------
+// SetVideoCodecAttributes:
+// Sets the attributes a decoder would otherwise learn from the first
+// frames (profile, level, aspect ratio, interlacing, colors), so it
+// does not have to renegotiate its output type.
+//
+// The codec private data is only a hint: when it does not parse, the
+// media type is left as it is.
+//-------------------------------------------------------------------
+
+static MFVideoPrimaries primaries_from_iso(uint32_t v)
+{
+    switch (v) {
+        case 1: return MFVideoPrimaries_BT709;
+        case 4: return MFVideoPrimaries_BT470_2_SysM;
+        case 5: return MFVideoPrimaries_BT470_2_SysBG;
+        case 6: return MFVideoPrimaries_SMPTE170M;
+        case 7: return MFVideoPrimaries_SMPTE240M;
+        default: return MFVideoPrimaries_Unknown;
+    }
+}
+
+static MFVideoTransferFunction transfer_from_iso(uint32_t v)
+{
+    switch (v) {
+        case 1: case 6: case 14: case 15: return MFVideoTransFunc_709;
+        case 4: return MFVideoTransFunc_22;
+        case 5: return MFVideoTransFunc_28;
+        case 7: return MFVideoTransFunc_240M;
+        case 8: return MFVideoTransFunc_10;
+        default: return MFVideoTransFunc_Unknown;
+    }
+}
+
+static MFVideoTransferMatrix matrix_from_iso(uint32_t v)
+{
+    switch (v) {
+        case 1: return MFVideoTransferMatrix_BT709;
+        case 5: case 6: return MFVideoTransferMatrix_BT601;
+        case 7: return MFVideoTransferMatrix_SMPTE240M;
+        default: return MFVideoTransferMatrix_Unknown;
+    }
+}
+
+static HRESULT SetVideoColorAttributes(
+    IMFMediaType *pType,
+    bool full_range,
+    bool colour_present,
+    uint32_t primaries,
+    uint32_t transfer,
+    uint32_t matrix)
+{
+    HRESULT hr = pType->SetUINT32(
+        MF_MT_VIDEO_NOMINAL_RANGE,
+        full_range ? MFNominalRange_0_255 : MFNominalRange_16_235
+        );
+
+    if (SUCCEEDED(hr) && colour_present && primaries_from_iso(primaries) != MFVideoPrimaries_Unknown)
+    {
+        hr = pType->SetUINT32(MF_MT_VIDEO_PRIMARIES, primaries_from_iso(primaries));
+    }
+    if (SUCCEEDED(hr) && colour_present && transfer_from_iso(transfer) != MFVideoTransFunc_Unknown)
+    {
+        hr = pType->SetUINT32(MF_MT_TRANSFER_FUNCTION, transfer_from_iso(transfer));
+    }
+    if (SUCCEEDED(hr) && colour_present && matrix_from_iso(matrix) != MFVideoTransferMatrix_Unknown)
+    {
+        hr = pType->SetUINT32(MF_MT_YUV_MATRIX, matrix_from_iso(matrix));
+    }
+    return hr;
+}
+
+static HRESULT SetAvcAttributes(const JUST_StreamInfo& info, IMFMediaType *pType)
+{
+    HRESULT hr = S_OK;
+
+    AvcConfig config;
+    AvcSpsInfo sps;
+    if (!AvcParseConfig(info.format_buffer, info.format_size, config)
+        || !AvcParseSps(&config.sps[0][0], config.sps[0].size(), sps))
+    {
+        return S_OK;
+    }
+
+    // eAVEncH264VProfile values are the profile_idc of the SPS.
+    hr = pType->SetUINT32(MF_MT_MPEG2_PROFILE, sps.profile_idc);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetUINT32(MF_MT_MPEG2_LEVEL, sps.level_idc);
+    }
+
+    if (SUCCEEDED(hr) && sps.sar_num && sps.sar_den)
+    {
+        hr = MFSetAttributeRatio(pType, MF_MT_PIXEL_ASPECT_RATIO, sps.sar_num, sps.sar_den);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetUINT32(
+            MF_MT_INTERLACE_MODE,
+            sps.frame_mbs_only ? MFVideoInterlace_Progressive : MFVideoInterlace_MixedInterlaceOrProgressive
+            );
+    }
+
+    if (SUCCEEDED(hr) && sps.video_signal_present)
+    {
+        hr = SetVideoColorAttributes(
+            pType,
+            sps.full_range,
+            sps.colour_present,
+            sps.colour_primaries,
+            sps.transfer_characteristics,
+            sps.matrix_coefficients
+            );
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        std::vector<uint8_t> header;
+        AvcBuildSequenceHeader(config, header);
+        hr = pType->SetBlob(MF_MT_MPEG_SEQUENCE_HEADER, &header[0], (UINT32)header.size());
+    }
+
+    return hr;
+}
+
+static HRESULT SetMp4vAttributes(const JUST_StreamInfo& info, IMFMediaType *pType)
+{
+    HRESULT hr = S_OK;
+
+    Mp4vVolInfo vol;
+    if (!Mp4vParseVol(info.format_buffer, info.format_size, vol))
+    {
+        return S_OK;
+    }
+
+    // MF_MT_MPEG2_PROFILE and MF_MT_MPEG2_LEVEL have no values for the
+    // MPEG-4 part 2 profiles; the decoder reads them from the sequence
+    // header.
+    if (vol.par_num && vol.par_den)
+    {
+        hr = MFSetAttributeRatio(pType, MF_MT_PIXEL_ASPECT_RATIO, vol.par_num, vol.par_den);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetUINT32(
+            MF_MT_INTERLACE_MODE,
+            vol.interlaced ? MFVideoInterlace_MixedInterlaceOrProgressive : MFVideoInterlace_Progressive
+            );
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetBlob(MF_MT_MPEG_SEQUENCE_HEADER, info.format_buffer, info.format_size);
+    }
+
+    return hr;
+}
+
+static HRESULT SetVideoCodecAttributes(const JUST_StreamInfo& info, IMFMediaType *pType)
+{
+    if (info.format_buffer == NULL || info.format_size == 0)
+    {
+        return S_OK;
+    }
+    if (info.sub_type == JUST_VideoSubType::AVC1)
+    {
+        return SetAvcAttributes(info, pType);
+    }
+    if (info.sub_type == JUST_VideoSubType::MP4V)
+    {
+        return SetMp4vAttributes(info, pType);
+    }
+    return S_OK;
+}
+
 HRESULT CreateVideoMediaType(const JUST_StreamInfo& info, IMFMediaType **ppType)
 {
     HRESULT hr = S_OK;
@@ -130,6 +309,11 @@ HRESULT CreateVideoMediaType(const JUST_StreamInfo& info, IMFMediaType **ppType)
             );
     }
 
+    if (SUCCEEDED(hr))
+    {
+        hr = SetVideoCodecAttributes(info, pType);
+    }
+
     if (SUCCEEDED(hr))
     {
         *ppType = pType;
@@ -457,6 +641,11 @@ HRESULT CreateSample(JUST_Sample const & sample, IMFSample **ppSample)
         hr = pSample->SetSampleTime(time);
     }
 
+    if (SUCCEEDED(hr))
+    {
+        hr = pSample->SetSampleDuration(sample.duration);
+    }
+
     if (SUCCEEDED(hr))
     {
         *ppSample = pSample;
@@ -468,3 +657,67 @@ HRESULT CreateSample(JUST_Sample const & sample, IMFSample **ppSample)
 
     return hr;
 }
+
+//-------------------------------------------------------------------
+// CreateMediaType:
+// Create a media type for a stream of any supported type.
+//-------------------------------------------------------------------
+
+HRESULT CreateMediaType(const JUST_StreamInfo& info, IMFMediaType **ppType)
+{
+    switch (info.type)
+    {
+    case JUST_StreamType::VIDE:
+        return CreateVideoMediaType(info, ppType);
+
+    case JUST_StreamType::AUDI:
+        return CreateAudioMediaType(info, ppType);
+
+    default:
+        return MF_E_INVALIDMEDIATYPE;
+    }
+}
+
+//-------------------------------------------------------------------
+// StreamInfoSignature:
+// Hash of the parts of the stream info that make up the media type.
+// The bitrate is left out, a decoder does not care about it.
+//-------------------------------------------------------------------
+
+static UINT32 fnv1a(UINT32 hash, void const * data, size_t size)
+{
+    BYTE const * p = (BYTE const *)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+UINT32 StreamInfoSignature(const JUST_StreamInfo& info)
+{
+    UINT32 hash = 2166136261u;
+    UINT32 fields[6] = {info.type, info.sub_type};
+
+    if (info.type == JUST_StreamType::VIDE)
+    {
+        fields[2] = info.format.video.width;
+        fields[3] = info.format.video.height;
+        fields[4] = info.format.video.frame_rate_num;
+        fields[5] = info.format.video.frame_rate_den;
+    }
+    else if (info.type == JUST_StreamType::AUDI)
+    {
+        fields[2] = info.format.audio.channel_count;
+        fields[3] = info.format.audio.sample_rate;
+        fields[4] = info.format.audio.sample_size;
+        fields[5] = info.format.audio.block_align;
+    }
+
+    hash = fnv1a(hash, fields, sizeof(fields));
+    if (info.format_buffer)
+    {
+        hash = fnv1a(hash, info.format_buffer, info.format_size);
+    }
+    return hash;
+}
@@ -17,3 +17,6 @@
 
 HRESULT CreateVideoMediaType(const JUST_StreamInfo& info, IMFMediaType **ppType);
 HRESULT CreateAudioMediaType(const JUST_StreamInfo& info, IMFMediaType **ppType);
+HRESULT CreateMediaType(const JUST_StreamInfo& info, IMFMediaType **ppType);
+UINT32  StreamInfoSignature(const JUST_StreamInfo& info);
+HRESULT CreateSample(JUST_Sample const & sample, IMFSample **ppSample);
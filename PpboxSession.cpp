@@ -0,0 +1,600 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// PpboxSession.cpp
+// Per-source access to the process-global JUST runtime.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "PpboxSession.h"
+
+#include <algorithm>
+#include <new>
+#include <string>
+
+// s_RuntimeLock serializes the runtime calls of all sessions. It is
+// recursive, because JUST_Close may complete an open synchronously.
+// s_OpenLock keeps the opens in order, while JUST_AsyncOpenEx runs
+// outside the runtime lock.
+static class RuntimeLock
+{
+public:
+    RuntimeLock() { InitializeCriticalSectionEx(&m_critSec, 1000, 0); }
+    ~RuntimeLock() { DeleteCriticalSection(&m_critSec); }
+
+    void Lock() { EnterCriticalSection(&m_critSec); }
+    void Unlock() { LeaveCriticalSection(&m_critSec); }
+
+private:
+    CRITICAL_SECTION m_critSec;
+} s_RuntimeLock, s_OpenLock;
+
+struct OpenResult
+{
+    PpboxSession *  session;
+    PP_err          err;
+};
+
+// Open results posted while the thread holds a runtime lock, reported
+// by its outermost AutoRuntimeLock once released.
+static __declspec(thread) std::vector<OpenResult> * t_pPosted = NULL;
+
+class AutoRuntimeLock
+{
+public:
+    AutoRuntimeLock(RuntimeLock & lock = s_RuntimeLock)
+        : m_lock(lock)
+    {
+        m_lock.Lock();
+        m_bOutermost = (t_pPosted == NULL);
+        if (m_bOutermost)
+        {
+            t_pPosted = &m_posted;
+        }
+    }
+
+    ~AutoRuntimeLock()
+    {
+        if (m_bOutermost)
+        {
+            t_pPosted = NULL;
+        }
+        m_lock.Unlock();
+        for (size_t i = 0; i < m_posted.size(); ++i)
+        {
+            m_posted[i].session->CompleteOpen(m_posted[i].err);
+        }
+    }
+
+private:
+    RuntimeLock &               m_lock;
+    BOOL                        m_bOutermost;
+    std::vector<OpenResult>     m_posted;
+};
+
+// State of the runtime, protected by the runtime lock.
+static std::string                  s_playlink;     // Playlink open in the runtime
+static std::vector<PpboxSession *>  s_sessions;     // Sessions on that playlink
+static BOOL                         s_bOpening = FALSE; // Runtime open pending
+static UINT64                       s_uOpenSerial = 0;  // Number of the last runtime open
+static SharedSampleStore            s_store;
+
+static BOOL IsMember(PpboxSession const * session)
+{
+    return std::find(s_sessions.begin(), s_sessions.end(), session) != s_sessions.end();
+}
+
+PpboxSession::PpboxSession()
+    : m_user(NULL)
+    , m_callback(NULL)
+    , m_bOpened(FALSE)
+    , m_bOpener(FALSE)
+    , m_uOpenSerial(0)
+    , m_bTakenOver(FALSE)
+    , m_uCursor(0)
+{
+}
+
+PpboxSession::~PpboxSession()
+{
+    Close();
+}
+
+//-------------------------------------------------------------------
+// AsyncOpen
+// Opens the playlink, or joins the sessions already playing it.
+//-------------------------------------------------------------------
+
+void PpboxSession::AsyncOpen(
+    char const * playlink,
+    char const * config,
+    PP_context user,
+    PpboxSessionCallback callback)
+{
+    if (m_replay.IsOpen())
+    {
+        m_user = user;
+        m_callback = callback;
+        m_bOpened = TRUE;
+        m_callback(m_user, m_replay.ReadOpen());
+        return;
+    }
+
+    AutoRuntimeLock openLock(s_OpenLock);
+    BOOL bOpen = FALSE;
+
+    {
+        AutoRuntimeLock lock;
+
+        m_user = user;
+        m_callback = callback;
+        m_bOpened = FALSE;
+        m_bTakenOver = FALSE;
+        m_payload.reset();
+
+        if (!s_sessions.empty() && s_playlink == playlink)
+        {
+            s_sessions.push_back(this);
+            m_uCursor = s_store.End();
+            m_uOpenSerial = s_uOpenSerial;
+            // Otherwise completes with the pending open.
+            if (!s_bOpening)
+            {
+                m_bOpened = TRUE;
+                PostOpen(this, just_success);
+            }
+        }
+        else
+        {
+            if (!s_sessions.empty())
+            {
+                // Take the runtime over. A pending open completes with
+                // just_operation_canceled for its opener; sessions that
+                // were waiting for it are canceled here.
+                for (size_t i = 0; i < s_sessions.size(); ++i)
+                {
+                    PpboxSession * session = s_sessions[i];
+                    if (session->m_bOpened)
+                    {
+                        session->m_bTakenOver = TRUE;
+                    }
+                    else if (!session->m_bOpener)
+                    {
+                        session->m_bOpened = TRUE;
+                        PostOpen(session, just_operation_canceled);
+                    }
+                }
+                s_sessions.clear();
+                s_store.Clear();
+                JUST_Close();
+            }
+
+            s_playlink = playlink;
+            s_sessions.push_back(this);
+            s_bOpening = TRUE;
+            m_bOpener = TRUE;
+            m_uOpenSerial = ++s_uOpenSerial;
+            m_uCursor = s_store.End();
+            bOpen = TRUE;
+        }
+    }
+
+    // A synchronous completion posts its results to openLock.
+    if (bOpen)
+    {
+        JUST_AsyncOpenEx(playlink, config, this, &PpboxSession::StaticOpenCallback);
+    }
+}
+
+//-------------------------------------------------------------------
+// StaticOpenCallback
+// The session of the context stays alive until its open completes:
+// the media source holds a reference on itself meanwhile.
+//-------------------------------------------------------------------
+
+void __cdecl PpboxSession::StaticOpenCallback(PP_context user, PP_err err)
+{
+    PpboxSession * session = (PpboxSession *)user;
+
+    AutoRuntimeLock lock;
+
+    session->m_bOpener = FALSE;
+    session->m_bOpened = TRUE;
+    PostOpen(session, IsMember(session) ? err : just_operation_canceled);
+
+    // Sessions that joined this open complete with it, unless the
+    // runtime was closed or taken over since.
+    if (session->m_uOpenSerial == s_uOpenSerial && s_bOpening)
+    {
+        s_bOpening = FALSE;
+        for (size_t i = 0; i < s_sessions.size(); ++i)
+        {
+            if (!s_sessions[i]->m_bOpened)
+            {
+                s_sessions[i]->m_bOpened = TRUE;
+                PostOpen(s_sessions[i], err);
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------
+// PostOpen
+// Reports an open result once the runtime locks are released, or now
+// if the thread holds none.
+//-------------------------------------------------------------------
+
+void PpboxSession::PostOpen(PpboxSession *session, PP_err err)
+{
+    if (t_pPosted == NULL)
+    {
+        session->CompleteOpen(err);
+        return;
+    }
+    OpenResult result = {session, err};
+    t_pPosted->push_back(result);
+}
+
+void PpboxSession::CompleteOpen(PP_err err)
+{
+    m_record.WriteOpen(err);
+    m_record.Commit();
+    m_callback(m_user, err);
+}
+
+//-------------------------------------------------------------------
+// Close
+// The session log is closed, and written out, once the runtime lock
+// is released, so the file I/O does not hold the other sessions.
+//-------------------------------------------------------------------
+
+void PpboxSession::Close()
+{
+    if (m_replay.IsOpen())
+    {
+        m_replay.Close();
+        return;
+    }
+
+    BOOL bClosed = FALSE;
+    {
+        AutoRuntimeLock lock;
+        bClosed = CloseLocked();
+    }
+    if (bClosed)
+    {
+        m_record.Close();
+    }
+}
+
+BOOL PpboxSession::CloseLocked()
+{
+    std::vector<PpboxSession *>::iterator iter =
+        std::find(s_sessions.begin(), s_sessions.end(), this);
+    if (iter == s_sessions.end())
+    {
+        return FALSE;
+    }
+
+    s_sessions.erase(iter);
+    m_payload.reset();
+
+    // A session waiting for the open of another one is canceled here;
+    // an opener is answered by the runtime.
+    if (!m_bOpened && !m_bOpener)
+    {
+        m_bOpened = TRUE;
+        PostOpen(this, just_operation_canceled);
+    }
+
+    if (s_sessions.empty())
+    {
+        // A pending open is no longer the current one; it completes
+        // with just_operation_canceled.
+        s_bOpening = FALSE;
+        ++s_uOpenSerial;
+        JUST_Close();
+        s_store.Clear();
+        s_playlink.clear();
+    }
+    return TRUE;
+}
+
+BOOL PpboxSession::IsOwner() const
+{
+    if (m_replay.IsOpen())
+    {
+        return TRUE;
+    }
+
+    AutoRuntimeLock lock;
+    return IsMember(this);
+}
+
+BOOL PpboxSession::IsTakenOver() const
+{
+    if (m_replay.IsOpen())
+    {
+        return FALSE;
+    }
+
+    AutoRuntimeLock lock;
+    return m_bTakenOver;
+}
+
+//-------------------------------------------------------------------
+// SetRecordFile, SetReplayFile
+// A closed session only. Recording starts with the next AsyncOpen;
+// a replaying session never reaches the runtime.
+//-------------------------------------------------------------------
+
+HRESULT PpboxSession::SetRecordFile(LPCWSTR pszPath, BOOL bPayloads)
+{
+    if (IsOwner())
+    {
+        return MF_E_INVALIDREQUEST;
+    }
+    m_record.Close();
+    return m_record.Open(pszPath, bPayloads);
+}
+
+HRESULT PpboxSession::SetReplayFile(LPCWSTR pszPath)
+{
+    if (IsOwner())
+    {
+        return MF_E_INVALIDREQUEST;
+    }
+    m_record.Close();
+    return m_replay.Open(pszPath);
+}
+
+ULONGLONG PpboxSession::TickCount() const
+{
+    return m_replay.IsOpen() ? m_replay.Tick() : GetTickCount64();
+}
+
+PP_uint PpboxSession::GetDuration()
+{
+    if (m_replay.IsOpen())
+    {
+        return m_replay.ReadValue(SESSION_LOG_DURATION);
+    }
+
+    PP_uint value = 0;
+    {
+        AutoRuntimeLock lock;
+        value = IsMember(this) ? JUST_GetDuration() : 0;
+        m_record.WriteValue(SESSION_LOG_DURATION, value);
+    }
+    m_record.Commit();
+    return value;
+}
+
+PP_uint PpboxSession::GetStreamCount()
+{
+    if (m_replay.IsOpen())
+    {
+        return m_replay.ReadValue(SESSION_LOG_STREAMS);
+    }
+
+    PP_uint value = 0;
+    {
+        AutoRuntimeLock lock;
+        value = IsMember(this) ? JUST_GetStreamCount() : 0;
+        m_record.WriteValue(SESSION_LOG_STREAMS, value);
+    }
+    m_record.Commit();
+    return value;
+}
+
+PP_err PpboxSession::GetStreamInfo(PP_uint index, JUST_StreamInfo *info)
+{
+    if (m_replay.IsOpen())
+    {
+        return m_replay.ReadStreamInfo(index, info);
+    }
+
+    PP_err err = just_not_open;
+    {
+        AutoRuntimeLock lock;
+        err = IsMember(this) ? JUST_GetStreamInfo(index, info) : just_not_open;
+        m_record.WriteStreamInfo(index, err, info);
+    }
+    m_record.Commit();
+    return err;
+}
+
+//-------------------------------------------------------------------
+// Seek
+// Only a session that plays the playlink alone can seek, because the
+// runtime position is shared.
+//-------------------------------------------------------------------
+
+PP_err PpboxSession::Seek(PP_uint time)
+{
+    if (m_replay.IsOpen())
+    {
+        return m_replay.ReadSeek(time);
+    }
+
+    PP_err err = just_not_open;
+    {
+        AutoRuntimeLock lock;
+
+        if (!IsMember(this))
+        {
+            return just_not_open;
+        }
+        if (s_sessions.size() > 1)
+        {
+            return just_already_open;
+        }
+
+        s_store.Clear();
+        m_uCursor = s_store.End();
+        m_payload.reset();
+
+        err = JUST_Seek(time);
+        m_record.WriteSeek(time, err);
+    }
+    m_record.Commit();
+    return err;
+}
+
+//-------------------------------------------------------------------
+// ReadSample
+// Reads the next sample of this session. The payload stays valid
+// until the next call, as with JUST_ReadSample.
+//-------------------------------------------------------------------
+
+PP_err PpboxSession::ReadSample(JUST_Sample *sample)
+{
+    if (m_replay.IsOpen())
+    {
+        return m_replay.ReadSample(sample);
+    }
+
+    PP_err err = just_not_open;
+    {
+        AutoRuntimeLock lock;
+        err = ReadSampleLocked(sample);
+        m_record.WriteSample(err, sample);
+    }
+    m_record.Commit();
+    return err;
+}
+
+PP_err PpboxSession::ReadSampleLocked(JUST_Sample *sample)
+{
+    if (!IsMember(this))
+    {
+        return just_not_open;
+    }
+
+    // Lagging readers skip the samples evicted over the budget.
+    if (m_uCursor < s_store.Begin())
+    {
+        m_uCursor = s_store.Begin();
+    }
+
+    if (m_uCursor == s_store.End())
+    {
+        PP_err err = JUST_ReadSample(sample);
+        if (err != just_success)
+        {
+            return err;
+        }
+
+        // A sole reader copies the payload itself, without the store.
+        if (s_sessions.size() == 1 || FAILED(s_store.Push(*sample)))
+        {
+            m_uCursor = s_store.End();
+            return CopyPayload(sample);
+        }
+    }
+
+    s_store.Get(m_uCursor++, sample, &m_payload);
+
+    UINT64 uBegin = m_uCursor;
+    for (size_t i = 0; i < s_sessions.size(); ++i)
+    {
+        uBegin = min(uBegin, s_sessions[i]->m_uCursor);
+    }
+    s_store.Trim(uBegin);
+
+    return just_success;
+}
+
+//-------------------------------------------------------------------
+// CopyPayload
+// Copies the runtime buffer of the sample to the payload of the
+// session, reusing it when no other reader holds it, so a single
+// session does not allocate per sample. If the copy cannot be
+// allocated, the runtime buffer is used as it is.
+//-------------------------------------------------------------------
+
+PP_err PpboxSession::CopyPayload(JUST_Sample *sample)
+{
+    try
+    {
+        if (!m_payload || !m_payload.unique())
+        {
+            m_payload = std::make_shared<std::vector<BYTE> >();
+        }
+        m_payload->assign(sample->buffer, sample->buffer + sample->size);
+    }
+    catch (std::bad_alloc const &)
+    {
+        m_payload.reset();
+        return just_success;
+    }
+
+    sample->buffer = m_payload->empty() ? NULL : &m_payload->front();
+    return just_success;
+}
+
+PP_err PpboxSession::GetPlayStat(JUST_PlayStatistic *stat)
+{
+    if (m_replay.IsOpen())
+    {
+        return m_replay.ReadPlayStat(stat);
+    }
+
+    PP_err err = just_not_open;
+    {
+        AutoRuntimeLock lock;
+        err = IsMember(this) ? JUST_GetPlayStat(stat) : just_not_open;
+        m_record.WritePlayStat(err, stat);
+    }
+    m_record.Commit();
+    return err;
+}
+
+PP_err PpboxSession::GetDataStat(JUST_DataStat *stat)
+{
+    if (m_replay.IsOpen())
+    {
+        return m_replay.ReadDataStat(stat);
+    }
+
+    PP_err err = just_not_open;
+    {
+        AutoRuntimeLock lock;
+        err = IsMember(this) ? JUST_GetDataStat(stat) : just_not_open;
+        m_record.WriteDataStat(err, stat);
+    }
+    m_record.Commit();
+    return err;
+}
+
+UINT32 PpboxSession::SharedSessions()
+{
+    AutoRuntimeLock lock;
+    return (UINT32)s_sessions.size();
+}
+
+UINT64 PpboxSession::SharedBytes()
+{
+    AutoRuntimeLock lock;
+    return s_store.Bytes();
+}
+
+//-------------------------------------------------------------------
+// ScheduleCallback, CancelCallback
+// Serialized with the other runtime calls, as the runtime is not known
+// to be thread safe. The callbacks of the source take no runtime lock,
+// so a runtime that runs them from its timer thread, or waits for them
+// in JUST_CancelCallback, cannot deadlock here.
+//-------------------------------------------------------------------
+
+void const * PpboxSession::ScheduleCallback(PP_uint delay, PP_context user, PpboxSessionCallback callback)
+{
+    AutoRuntimeLock lock;
+    return JUST_ScheduleCallback(delay, user, callback);
+}
+
+void PpboxSession::CancelCallback(void const * key)
+{
+    AutoRuntimeLock lock;
+    JUST_CancelCallback(key);
+}
@@ -0,0 +1,114 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// PpboxSession.h
+// Per-source access to the process-global JUST runtime.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <windows.h>
+
+#include "SharedSampleStore.h"
+#include "SessionLog.h"
+
+typedef void (__cdecl * PpboxSessionCallback)(PP_context user, PP_err err);
+
+//-------------------------------------------------------------------
+// PpboxSession class
+//
+// The JUST_* functions act on one process-global playlink. Each media
+// source owns a session object instead of calling them directly:
+//
+// - Calls from all sessions are serialized.
+// - Sessions that open the same playlink share the runtime. The first
+//   one opens it, the others join, and samples are read from the
+//   runtime once and handed to every session through a shared store.
+// - Opening another playlink takes the runtime over; calls of the
+//   superseded sessions then fail with just_not_open, and IsTakenOver
+//   tells them from a closed session.
+// - A payload is copied before the runtime lock is released, because
+//   another session may close the runtime right after.
+// - Open results are reported once the session has released all the
+//   runtime locks, since reporting takes the lock of the media source.
+// - Closing a session only closes the runtime when it was the last
+//   one on the playlink, so CancelOpen or Shutdown of one source no
+//   longer closes another.
+//
+// A runtime that supports several playlinks at once would be
+// multiplexed here, without changes to the media source.
+//
+// A session can record the results of its calls to a log, or answer
+// them from a log instead of the runtime, to reproduce a playback
+// without the network. A replaying session takes no part in the
+// sharing above.
+//-------------------------------------------------------------------
+
+class PpboxSession
+{
+public:
+    PpboxSession();
+    ~PpboxSession();
+
+    void    AsyncOpen(
+        char const * playlink,
+        char const * config,
+        PP_context user,
+        PpboxSessionCallback callback);
+
+    void    Close();
+
+    BOOL    IsOwner() const;
+
+    // TRUE if another session opened a different playlink in the
+    // runtime since this one was opened.
+    BOOL    IsTakenOver() const;
+
+    // Set before AsyncOpen. bPayloads: Also record the sample payloads.
+    HRESULT SetRecordFile(LPCWSTR pszPath, BOOL bPayloads);
+    HRESULT SetReplayFile(LPCWSTR pszPath);
+
+    // Tick count in milliseconds, virtual when replaying.
+    ULONGLONG TickCount() const;
+
+    PP_uint GetDuration();
+    PP_uint GetStreamCount();
+    PP_err  GetStreamInfo(PP_uint index, JUST_StreamInfo *info);
+    PP_err  Seek(PP_uint time);
+    PP_err  ReadSample(JUST_Sample *sample);
+    PP_err  GetPlayStat(JUST_PlayStatistic *stat);
+    PP_err  GetDataStat(JUST_DataStat *stat);
+
+    // Sharing statistics of the current playlink.
+    static UINT32 SharedSessions();
+    static UINT64 SharedBytes();
+
+    // Timers are not bound to the playlink.
+    static void const * ScheduleCallback(PP_uint delay, PP_context user, PpboxSessionCallback callback);
+    static void CancelCallback(void const * key);
+
+private:
+    friend class AutoRuntimeLock;
+
+    static void __cdecl StaticOpenCallback(PP_context user, PP_err err);
+    static void PostOpen(PpboxSession *session, PP_err err);
+
+    void    CompleteOpen(PP_err err);
+    BOOL    CloseLocked();
+    PP_err  ReadSampleLocked(JUST_Sample *sample);
+    PP_err  CopyPayload(JUST_Sample *sample);
+
+private:
+    PP_context              m_user;
+    PpboxSessionCallback    m_callback;
+    BOOL                    m_bOpened;      // Open result reported
+    BOOL                    m_bOpener;      // Runtime open pending for this session
+    UINT64                  m_uOpenSerial;  // Runtime open this session waits for
+    BOOL                    m_bTakenOver;
+
+    UINT64                  m_uCursor;      // Next sample in the shared store
+    SharedPayload           m_payload;      // Payload of the last sample read
+
+    SessionLogWriter        m_record;
+    SessionLogReader        m_replay;
+};
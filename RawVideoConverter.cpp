@@ -0,0 +1,174 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RawVideoConverter.cpp
+// Converts raw video to formats the renderer takes directly.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "RawVideoConverter.h"
+#include "SafeRelease.h"
+#include "Trace.h"
+
+/* Media type */
+
+HRESULT ConvertRawVideoType(IMFMediaType *pType, GUID *pguidInput)
+{
+    GUID guidSubType = GUID_NULL;
+    UINT32 uWidth = 0, uHeight = 0;
+
+    *pguidInput = GUID_NULL;
+
+    HRESULT hr = pType->GetGUID(MF_MT_SUBTYPE, &guidSubType);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = MFGetAttributeSize(pType, MF_MT_FRAME_SIZE, &uWidth, &uHeight);
+    }
+    if (FAILED(hr) || uWidth == 0 || uHeight == 0)
+    {
+        return S_OK;
+    }
+
+    if (guidSubType == MFVideoFormat_I420)
+    {
+        hr = pType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12);
+        if (SUCCEEDED(hr))
+        {
+            hr = pType->SetUINT32(MF_MT_DEFAULT_STRIDE, uWidth);
+        }
+    }
+    else if (guidSubType == MFVideoFormat_RGB24)
+    {
+        // Without a stride, RGB types are bottom-up; the pooled 2D
+        // buffers are not.
+        hr = pType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_RGB32);
+        if (SUCCEEDED(hr))
+        {
+            hr = pType->SetUINT32(MF_MT_DEFAULT_STRIDE, uWidth * 4);
+        }
+    }
+    else
+    {
+        return S_OK;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        *pguidInput = guidSubType;
+    }
+    TRACEHR_RET(hr);
+}
+
+/* RawVideoConverter class */
+
+RawVideoConverter::RawVideoConverter()
+    : m_guidInput(GUID_NULL)
+    , m_uWidth(0)
+    , m_uHeight(0)
+    , m_pPool(NULL)
+{
+}
+
+RawVideoConverter::~RawVideoConverter()
+{
+    SafeRelease(&m_pPool);
+}
+
+HRESULT RawVideoConverter::SetFormat(REFGUID guidInput, UINT32 uWidth, UINT32 uHeight)
+{
+    HRESULT hr = S_OK;
+
+    // Samples of the old format stay valid, they keep their pool.
+    SafeRelease(&m_pPool);
+    m_guidInput = guidInput;
+    m_uWidth = uWidth;
+    m_uHeight = uHeight;
+
+    if (guidInput == MFVideoFormat_I420)
+    {
+        hr = SamplePool::CreateInstance(uWidth, uHeight, MFVideoFormat_NV12.Data1, &m_pPool);
+    }
+    else if (guidInput == MFVideoFormat_RGB24)
+    {
+        hr = SamplePool::CreateInstance(uWidth, uHeight, MFVideoFormat_RGB32.Data1, &m_pPool);
+    }
+
+    TRACEHR_RET(hr);
+}
+
+HRESULT RawVideoConverter::Convert(BYTE const * pData, UINT32 cbData, IMFSample **ppSample)
+{
+    IMFSample *pSample = NULL;
+    IMFMediaBuffer *pBuffer = NULL;
+    IMF2DBuffer *p2DBuffer = NULL;
+    BYTE *pScanline0 = NULL;
+    LONG lPitch = 0;
+    DWORD cbContiguous = 0;
+    UINT32 uSrcPitch = 0;
+
+    HRESULT hr = S_OK;
+
+    // Check the payload size before writing anything.
+    if (m_guidInput == MFVideoFormat_I420)
+    {
+        UINT64 cbFrame = (UINT64)m_uWidth * m_uHeight + 2ull * ((m_uWidth + 1) / 2) * ((m_uHeight + 1) / 2);
+        hr = cbData >= cbFrame ? S_OK : MF_E_INVALID_FORMAT;
+    }
+    else
+    {
+        // Rows may be padded, as in bitmaps.
+        uSrcPitch = cbData / m_uHeight;
+        hr = uSrcPitch >= m_uWidth * 3 ? S_OK : MF_E_INVALID_FORMAT;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pPool->GetSample(&pSample);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pSample->GetBufferByIndex(0, &pBuffer);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pBuffer->QueryInterface(IID_PPV_ARGS(&p2DBuffer));
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = p2DBuffer->Lock2D(&pScanline0, &lPitch);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        if (m_guidInput == MFVideoFormat_I420)
+        {
+            ConvertI420ToNV12(pData, m_uWidth, m_uHeight, pScanline0, lPitch);
+        }
+        else
+        {
+            ConvertRGB24ToRGB32(pData, uSrcPitch, m_uWidth, m_uHeight, pScanline0, lPitch);
+        }
+        hr = p2DBuffer->Unlock2D();
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = p2DBuffer->GetContiguousLength(&cbContiguous);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pBuffer->SetCurrentLength(cbContiguous);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        *ppSample = pSample;
+        (*ppSample)->AddRef();
+    }
+
+    SafeRelease(&p2DBuffer);
+    SafeRelease(&pBuffer);
+    SafeRelease(&pSample);
+    TRACEHR_RET(hr);
+}
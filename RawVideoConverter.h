@@ -0,0 +1,55 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RawVideoConverter.h
+// Converts raw video to formats the renderer takes directly.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <windows.h>
+#include <mfapi.h>
+
+#include "SamplePool.h"
+#include "RawVideoKernels.h"
+
+// ConvertRawVideoType:
+// Changes an I420 media type to NV12 and an RGB24 one to RGB32, with a
+// positive default stride: the converted frames are top-down.
+// Returns the original subtype in pguidInput, or GUID_NULL if the
+// type is not converted.
+HRESULT ConvertRawVideoType(IMFMediaType *pType, GUID *pguidInput);
+
+//-------------------------------------------------------------------
+// RawVideoConverter class
+//
+// Without it, the pipeline inserts a software color converter after
+// the source for I420 and RGB24 streams, which is very slow for RGB24
+// at HD sizes. The converted frames are written into pooled 2D
+// buffers with the pitch the renderer expects.
+//-------------------------------------------------------------------
+
+class RawVideoConverter
+{
+public:
+    RawVideoConverter();
+    ~RawVideoConverter();
+
+    // Sets the input format, GUID_NULL disables the conversion.
+    HRESULT SetFormat(REFGUID guidInput, UINT32 uWidth, UINT32 uHeight);
+
+    BOOL    IsEnabled() const { return m_pPool != NULL; }
+
+    // Converts a frame into a pooled sample, which has no time stamp.
+    HRESULT Convert(BYTE const * pData, UINT32 cbData, IMFSample **ppSample);
+
+    // Memory of the idle pooled samples.
+    UINT64  PoolBytes() { return m_pPool ? m_pPool->IdleBytes() : 0; }
+    void    TrimPool() { if (m_pPool) m_pPool->Trim(); }
+
+private:
+    GUID        m_guidInput;
+    UINT32      m_uWidth;
+    UINT32      m_uHeight;
+    SamplePool  *m_pPool;
+};
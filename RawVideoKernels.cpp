@@ -0,0 +1,144 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RawVideoKernels.cpp
+// Pixel conversion kernels of the raw video converter.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "RawVideoKernels.h"
+
+#include <string.h>
+
+#ifndef RAW_VIDEO_SCALAR
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define RAW_VIDEO_SSE2
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#define RAW_VIDEO_AVX2
+#endif
+#endif
+
+//-------------------------------------------------------------------
+// ConvertI420ToNV12
+// Copies the Y plane and interleaves the U and V planes, 32 pixel
+// pairs at a time with AVX2, then 16 with SSE2.
+//-------------------------------------------------------------------
+
+void ConvertI420ToNV12(
+    BYTE const * pSrc,
+    UINT32 uWidth,
+    UINT32 uHeight,
+    BYTE * pDst,
+    LONG lDstPitch)
+{
+    UINT32 uChromaWidth = (uWidth + 1) / 2;
+    UINT32 uChromaHeight = (uHeight + 1) / 2;
+
+    BYTE const * pY = pSrc;
+    BYTE const * pU = pY + uWidth * uHeight;
+    BYTE const * pV = pU + uChromaWidth * uChromaHeight;
+
+    for (UINT32 y = 0; y < uHeight; ++y)
+    {
+        memcpy(pDst + y * lDstPitch, pY + y * uWidth, uWidth);
+    }
+
+    BYTE * pUV = pDst + uHeight * lDstPitch;
+    for (UINT32 y = 0; y < uChromaHeight; ++y)
+    {
+        BYTE const * u = pU + y * uChromaWidth;
+        BYTE const * v = pV + y * uChromaWidth;
+        BYTE * uv = pUV + y * lDstPitch;
+        UINT32 x = 0;
+
+#ifdef RAW_VIDEO_AVX2
+        // The unpacks work within 128-bit lanes; ordering the 64-bit
+        // quarters 0, 2, 1, 3 first makes their output sequential.
+        for (; x + 32 <= uChromaWidth; x += 32)
+        {
+            __m256i mu = _mm256_permute4x64_epi64(_mm256_loadu_si256((__m256i const *)(u + x)), 0xd8);
+            __m256i mv = _mm256_permute4x64_epi64(_mm256_loadu_si256((__m256i const *)(v + x)), 0xd8);
+            _mm256_storeu_si256((__m256i *)(uv + 2 * x), _mm256_unpacklo_epi8(mu, mv));
+            _mm256_storeu_si256((__m256i *)(uv + 2 * x + 32), _mm256_unpackhi_epi8(mu, mv));
+        }
+#endif
+
+#ifdef RAW_VIDEO_SSE2
+        for (; x + 16 <= uChromaWidth; x += 16)
+        {
+            __m128i mu = _mm_loadu_si128((__m128i const *)(u + x));
+            __m128i mv = _mm_loadu_si128((__m128i const *)(v + x));
+            _mm_storeu_si128((__m128i *)(uv + 2 * x), _mm_unpacklo_epi8(mu, mv));
+            _mm_storeu_si128((__m128i *)(uv + 2 * x + 16), _mm_unpackhi_epi8(mu, mv));
+        }
+#endif
+
+        for (; x < uChromaWidth; ++x)
+        {
+            uv[2 * x] = u[x];
+            uv[2 * x + 1] = v[x];
+        }
+    }
+}
+
+//-------------------------------------------------------------------
+// ConvertRGB24ToRGB32
+// With AVX2, spreads 8 pixels at a time with a byte shuffle. Otherwise
+// expands 4 pixels (3 words) to 4 words at a time: SSE2 has no byte
+// shuffle, and these word operations run as fast on x86 and ARM. The
+// source is read from its last row up, so the top-down destination
+// keeps the picture upright.
+//-------------------------------------------------------------------
+
+void ConvertRGB24ToRGB32(
+    BYTE const * pSrc,
+    UINT32 uSrcPitch,
+    UINT32 uWidth,
+    UINT32 uHeight,
+    BYTE * pDst,
+    LONG lDstPitch)
+{
+#ifdef RAW_VIDEO_AVX2
+    __m256i const mask = _mm256_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    __m256i const alpha = _mm256_set1_epi32((int)0xff000000);
+#endif
+
+    for (UINT32 y = 0; y < uHeight; ++y)
+    {
+        BYTE const * s = pSrc + (uHeight - 1 - y) * uSrcPitch;
+        UINT32 * d = (UINT32 *)(pDst + y * lDstPitch);
+        UINT32 x = 0;
+
+#ifdef RAW_VIDEO_AVX2
+        // Each lane loads 16 bytes for 12, so stop while the second
+        // load still ends inside the row.
+        for (; x + 10 <= uWidth; x += 8, s += 24, d += 8)
+        {
+            __m256i m = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((__m128i const *)s)),
+                _mm_loadu_si128((__m128i const *)(s + 12)), 1);
+            _mm256_storeu_si256((__m256i *)d, _mm256_or_si256(_mm256_shuffle_epi8(m, mask), alpha));
+        }
+#endif
+
+        for (; x + 4 <= uWidth; x += 4, s += 12, d += 4)
+        {
+            UINT32 w[3];
+            memcpy(w, s, 12);
+            d[0] = w[0] | 0xff000000;
+            d[1] = (w[0] >> 24) | (w[1] << 8) | 0xff000000;
+            d[2] = (w[1] >> 16) | (w[2] << 16) | 0xff000000;
+            d[3] = (w[2] >> 8) | 0xff000000;
+        }
+
+        for (; x < uWidth; ++x, s += 3, ++d)
+        {
+            *d = s[0] | (s[1] << 8) | (s[2] << 16) | 0xff000000;
+        }
+    }
+}
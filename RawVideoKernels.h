@@ -0,0 +1,32 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RawVideoKernels.h
+// Pixel conversion kernels of the raw video converter.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+// Rows of the destination start every lDstPitch bytes, top row first.
+// The chroma planes of I420 are (width + 1) / 2 by (height + 1) / 2,
+// the UV plane of NV12 follows the Y plane. RGB24 rows are bottom-up,
+// as in bitmaps.
+//
+// The kernels use SSE2 on x86 and x64, and AVX2 where the compiler
+// targets it. RAW_VIDEO_SCALAR leaves the plain C loops only.
+void ConvertI420ToNV12(
+    BYTE const * pSrc,
+    UINT32 uWidth,
+    UINT32 uHeight,
+    BYTE * pDst,
+    LONG lDstPitch);
+
+void ConvertRGB24ToRGB32(
+    BYTE const * pSrc,
+    UINT32 uSrcPitch,
+    UINT32 uWidth,
+    UINT32 uHeight,
+    BYTE * pDst,
+    LONG lDstPitch);
@@ -0,0 +1,123 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RebufferPredictor.cpp
+// Estimates the time left until the playback buffer runs dry.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "RebufferPredictor.h"
+
+RebufferPredictor::RebufferPredictor()
+    : m_uBitrate(0)
+    , m_uWarningThreshold(REBUFFER_WARNING_THRESHOLD)
+    , m_uWarnings(0)
+    , m_uHits(0)
+    , m_uMisses(0)
+    , m_uFalseAlarms(0)
+    , m_uTotalError(0)
+{
+    Reset();
+}
+
+//-------------------------------------------------------------------
+// Reset
+// Forgets the consumption history and the pending prediction, for
+// example after a seek. The accuracy counters are kept.
+//-------------------------------------------------------------------
+
+void RebufferPredictor::Reset()
+{
+    m_uConsumedBytes = 0;
+    m_uConsumedTime = 0;
+    m_uTimeToStall = REBUFFER_NEVER;
+    m_bWarning = FALSE;
+    m_uPredictedStall = 0;
+}
+
+void RebufferPredictor::AddConsumed(UINT32 uBytes, UINT64 uDuration)
+{
+    m_uConsumedBytes += uBytes;
+    m_uConsumedTime += uDuration;
+}
+
+//-------------------------------------------------------------------
+// ConsumeRate
+// Returns the rate the player consumes data, in bytes per second.
+//-------------------------------------------------------------------
+
+UINT32 RebufferPredictor::ConsumeRate() const
+{
+    if (m_uBitrate)
+    {
+        return m_uBitrate / 8;
+    }
+    if (m_uConsumedTime >= 10000000)
+    {
+        return (UINT32)(m_uConsumedBytes * 10000000 / m_uConsumedTime);
+    }
+    return 0;
+}
+
+BOOL RebufferPredictor::Update(UINT64 uNow, UINT32 uDownloadSpeed, UINT32 uBufferTime)
+{
+    UINT32 uConsumeRate = ConsumeRate();
+
+    // While downloading faster than consuming the buffer only grows.
+    // Otherwise it drains with the rate (1 - download / consume).
+    if (uConsumeRate == 0 || uDownloadSpeed >= uConsumeRate)
+    {
+        m_uTimeToStall = REBUFFER_NEVER;
+    }
+    else
+    {
+        m_uTimeToStall = (UINT32)((UINT64)uBufferTime * uConsumeRate / (uConsumeRate - uDownloadSpeed));
+    }
+
+    if (m_uTimeToStall < m_uWarningThreshold)
+    {
+        if (!m_bWarning)
+        {
+            m_bWarning = TRUE;
+            m_uPredictedStall = uNow + m_uTimeToStall;
+            ++m_uWarnings;
+            return TRUE;
+        }
+        // Refine the pending prediction with the latest estimation.
+        m_uPredictedStall = uNow + m_uTimeToStall;
+    }
+    else if (m_bWarning && m_uTimeToStall >= m_uWarningThreshold * 2)
+    {
+        // Recovered without stalling.
+        m_bWarning = FALSE;
+        ++m_uFalseAlarms;
+    }
+    return FALSE;
+}
+
+void RebufferPredictor::OnStall(UINT64 uNow)
+{
+    if (m_bWarning)
+    {
+        m_bWarning = FALSE;
+        ++m_uHits;
+        m_uTotalError += uNow > m_uPredictedStall
+            ? uNow - m_uPredictedStall
+            : m_uPredictedStall - uNow;
+    }
+    else
+    {
+        ++m_uMisses;
+    }
+    m_uTimeToStall = 0;
+}
+
+//-------------------------------------------------------------------
+// MeanError
+// Returns the mean absolute error of scored predictions (ms).
+//-------------------------------------------------------------------
+
+UINT32 RebufferPredictor::MeanError() const
+{
+    return m_uHits ? (UINT32)(m_uTotalError / m_uHits) : 0;
+}
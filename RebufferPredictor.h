@@ -0,0 +1,80 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RebufferPredictor.h
+// Estimates the time left until the playback buffer runs dry.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+const UINT32 REBUFFER_NEVER = (UINT32)-1;               // Buffer is not draining.
+const UINT32 REBUFFER_WARNING_THRESHOLD = 5000;         // Warn when a stall is closer than this (ms).
+
+//-------------------------------------------------------------------
+// RebufferPredictor class
+//
+// Combines the download speed with the consumption rate of the
+// selected streams to predict how long the buffered data will last.
+//
+// The class has no dependency on the runtime or on Media Foundation,
+// so it can also be driven offline with observations taken from a
+// recorded session to measure how accurate the prediction is.
+//-------------------------------------------------------------------
+
+class RebufferPredictor
+{
+public:
+    RebufferPredictor();
+
+    void    Reset();
+
+    // uBitrate: Nominal bitrate of all streams, in bits per second.
+    void    SetBitrate(UINT32 uBitrate) { m_uBitrate = uBitrate; }
+    void    SetWarningThreshold(UINT32 uThreshold) { m_uWarningThreshold = uThreshold; }
+
+    // Accounts a delivered sample, used to measure the real consumption
+    // rate when the streams do not report a nominal bitrate.
+    void    AddConsumed(UINT32 uBytes, UINT64 uDuration);
+
+    // Feeds one observation. Returns TRUE when the predicted stall just
+    // moved under the warning threshold (edge triggered).
+    //
+    // uNow:            Tick count, in milliseconds.
+    // uDownloadSpeed:  Download speed, in bytes per second.
+    // uBufferTime:     Buffered media time, in milliseconds.
+    BOOL    Update(UINT64 uNow, UINT32 uDownloadSpeed, UINT32 uBufferTime);
+
+    // Reports an actual stall, scoring the pending prediction.
+    void    OnStall(UINT64 uNow);
+
+    UINT32  TimeToStall() const { return m_uTimeToStall; }
+
+    // Accuracy counters.
+    UINT32  Warnings() const { return m_uWarnings; }
+    UINT32  Hits() const { return m_uHits; }
+    UINT32  Misses() const { return m_uMisses; }
+    UINT32  FalseAlarms() const { return m_uFalseAlarms; }
+    UINT32  MeanError() const;
+
+private:
+    UINT32  ConsumeRate() const;
+
+private:
+    UINT32  m_uBitrate;
+    UINT32  m_uWarningThreshold;
+
+    UINT64  m_uConsumedBytes;
+    UINT64  m_uConsumedTime;            // 100-nanosecond units
+
+    UINT32  m_uTimeToStall;             // Latest estimation, in milliseconds
+    BOOL    m_bWarning;                 // Warning raised and not yet scored
+    UINT64  m_uPredictedStall;          // Tick count when the stall is expected
+
+    UINT32  m_uWarnings;
+    UINT32  m_uHits;
+    UINT32  m_uMisses;
+    UINT32  m_uFalseAlarms;
+    UINT64  m_uTotalError;
+};
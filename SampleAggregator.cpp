@@ -0,0 +1,160 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SampleAggregator.cpp
+// Packs consecutive audio access units into one sample.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "SampleAggregator.h"
+#include "SampleAttributes.h"
+#include "SafeRelease.h"
+#include "Trace.h"
+
+SampleAggregator::SampleAggregator()
+    : m_uMaxFrames(0)
+    , m_hnsMaxDuration(AGGREGATE_DEFAULT_LATENCY * 10000LL)
+    , m_pPending(NULL)
+    , m_uFrames(0)
+    , m_hnsDuration(0)
+    , m_uMerged(0)
+{
+}
+
+SampleAggregator::~SampleAggregator()
+{
+    Clear();
+}
+
+void SampleAggregator::SetLimits(UINT32 uMaxFrames, UINT32 uMaxLatencyMs)
+{
+    m_uMaxFrames = uMaxFrames;
+    m_hnsMaxDuration = uMaxLatencyMs * 10000LL;
+}
+
+HRESULT SampleAggregator::Add(IMFSample *pSample, IMFSample **ppReady)
+{
+    HRESULT hr = S_OK;
+
+    *ppReady = NULL;
+
+    // Samples that change the stream start a new aggregate.
+    if (m_pPending
+        && (MFGetAttributeUINT32(pSample, MFSampleExtension_Discontinuity, FALSE)
+            || SUCCEEDED(pSample->GetItem(PPBOX_SAMPLE_MEDIA_TYPE, NULL))))
+    {
+        Flush(ppReady);
+    }
+
+    if (m_pPending == NULL)
+    {
+        hr = Start(pSample);
+    }
+    else
+    {
+        hr = Append(pSample);
+    }
+
+    if (SUCCEEDED(hr) && *ppReady == NULL
+        && (m_uFrames >= m_uMaxFrames || m_hnsDuration >= m_hnsMaxDuration))
+    {
+        Flush(ppReady);
+    }
+
+    TRACEHR_RET(hr);
+}
+
+void SampleAggregator::Flush(IMFSample **ppReady)
+{
+    *ppReady = m_pPending;
+    m_pPending = NULL;
+    m_uFrames = 0;
+    m_hnsDuration = 0;
+}
+
+void SampleAggregator::Clear()
+{
+    SafeRelease(&m_pPending);
+    m_uFrames = 0;
+    m_hnsDuration = 0;
+}
+
+//-------------------------------------------------------------------
+// Start
+// Creates the aggregate. The buffers are shared, but not the sample:
+// the time shift buffer may hold the original.
+//-------------------------------------------------------------------
+
+HRESULT SampleAggregator::Start(IMFSample *pSample)
+{
+    IMFSample *pAggregate = NULL;
+    LONGLONG hnsTime = 0;
+
+    HRESULT hr = MFCreateSample(&pAggregate);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pSample->CopyAllItems(pAggregate);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pSample->GetSampleTime(&hnsTime);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pAggregate->SetSampleTime(hnsTime);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_pPending = pAggregate;
+        m_pPending->AddRef();
+        hr = Append(pSample);
+        if (FAILED(hr))
+        {
+            Clear();
+        }
+        else
+        {
+            // The first frame is not merged into anything.
+            --m_uMerged;
+        }
+    }
+
+    SafeRelease(&pAggregate);
+    TRACEHR_RET(hr);
+}
+
+HRESULT SampleAggregator::Append(IMFSample *pSample)
+{
+    DWORD cBuffers = 0;
+    LONGLONG hnsDuration = 0;
+
+    HRESULT hr = pSample->GetBufferCount(&cBuffers);
+
+    for (DWORD i = 0; SUCCEEDED(hr) && i < cBuffers; ++i)
+    {
+        IMFMediaBuffer *pBuffer = NULL;
+        hr = pSample->GetBufferByIndex(i, &pBuffer);
+        if (SUCCEEDED(hr))
+        {
+            hr = m_pPending->AddBuffer(pBuffer);
+        }
+        SafeRelease(&pBuffer);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        (void)pSample->GetSampleDuration(&hnsDuration);
+        m_hnsDuration += hnsDuration;
+        hr = m_pPending->SetSampleDuration(m_hnsDuration);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        ++m_uFrames;
+        ++m_uMerged;
+    }
+
+    TRACEHR_RET(hr);
+}
@@ -0,0 +1,62 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SampleAggregator.h
+// Packs consecutive audio access units into one sample.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <windows.h>
+#include <mfapi.h>
+
+const UINT32 AGGREGATE_DEFAULT_LATENCY = 100;   // Milliseconds
+
+//-------------------------------------------------------------------
+// SampleAggregator class
+//
+// Audio frames are a few hundred bytes and last about 20 ms, and each
+// one costs a sample, an MEMediaSample event and a request round trip.
+// The aggregator collects the buffers of consecutive samples into a
+// new sample with one buffer per frame, up to a number of frames or a
+// duration, whichever comes first.
+//
+// A discontinuity or a format change starts a new aggregate, so the
+// attributes of the first sample hold for the whole aggregate.
+//-------------------------------------------------------------------
+
+class SampleAggregator
+{
+public:
+    SampleAggregator();
+    ~SampleAggregator();
+
+    // Fewer than 2 frames disables the aggregation.
+    void    SetLimits(UINT32 uMaxFrames, UINT32 uMaxLatencyMs);
+
+    BOOL    IsEnabled() const { return m_uMaxFrames > 1; }
+
+    // Adds a sample. Sets *ppReady to a complete aggregate, or NULL.
+    HRESULT Add(IMFSample *pSample, IMFSample **ppReady);
+
+    // Takes the pending aggregate, or NULL.
+    void    Flush(IMFSample **ppReady);
+
+    void    Clear();
+
+    // Number of samples merged into others.
+    UINT32  Merged() const { return m_uMerged; }
+
+private:
+    HRESULT Start(IMFSample *pSample);
+    HRESULT Append(IMFSample *pSample);
+
+private:
+    UINT32      m_uMaxFrames;
+    LONGLONG    m_hnsMaxDuration;
+
+    IMFSample   *m_pPending;
+    UINT32      m_uFrames;
+    LONGLONG    m_hnsDuration;
+    UINT32      m_uMerged;
+};
@@ -0,0 +1,31 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SampleAttributes.h
+// Attributes the source sets on its samples.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <mfapi.h>
+
+// Suggested playback rate for audio samples while catching up (double).
+// {0F93A6D2-C4B1-47E5-A2D8-5B6E19F4C083}
+DEFINE_GUID(PPBOX_SAMPLE_RATE_HINT,
+    0x0f93a6d2, 0xc4b1, 0x47e5, 0xa2, 0xd8, 0x5b, 0x6e, 0x19, 0xf4, 0xc0, 0x83);
+
+// Media type that takes effect with this sample (IMFMediaType). The
+// stream removes it, and sends MEStreamFormatChanged before the sample.
+// {A53C07E4-92D1-4B6F-8C2A-E71D40B95F18}
+DEFINE_GUID(PPBOX_SAMPLE_MEDIA_TYPE,
+    0xa53c07e4, 0x92d1, 0x4b6f, 0x8c, 0x2a, 0xe7, 0x1d, 0x40, 0xb9, 0x5f, 0x18);
+
+// When the payload was read from the runtime, and when the sample was
+// queued on its stream, for the latency statistics (UINT64, microseconds
+// of PpboxMediaStream::Microseconds).
+// {6C2E8F14-3B97-4A0D-9E51-B84D27C0F3A6}
+DEFINE_GUID(PPBOX_SAMPLE_READ_TIME,
+    0x6c2e8f14, 0x3b97, 0x4a0d, 0x9e, 0x51, 0xb8, 0x4d, 0x27, 0xc0, 0xf3, 0xa6);
+// {D1F47A05-6E2C-4B83-A7D9-0C5B93E16F28}
+DEFINE_GUID(PPBOX_SAMPLE_QUEUE_TIME,
+    0xd1f47a05, 0x6e2c, 0x4b83, 0xa7, 0xd9, 0x0c, 0x5b, 0x93, 0xe1, 0x6f, 0x28);
@@ -0,0 +1,269 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SamplePool.cpp
+// Recycles samples whose buffers are expensive to allocate.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "SamplePool.h"
+#include "SafeRelease.h"
+#include "Trace.h"
+
+#pragma warning( push )
+#pragma warning( disable : 4355 )  // 'this' used in base member initializer list
+
+HRESULT SamplePool::CreateInstance(DWORD dwWidth, DWORD dwHeight, DWORD dwFourCC, SamplePool **ppPool)
+{
+    if (ppPool == NULL)
+    {
+        return E_POINTER;
+    }
+
+    SamplePool *pPool = new (std::nothrow) SamplePool(dwWidth, dwHeight, dwFourCC, 0, 0);
+    if (pPool == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    *ppPool = pPool;
+    return S_OK;
+}
+
+HRESULT SamplePool::CreateInstance(DWORD cbBuffer, DWORD cbAlignment, SamplePool **ppPool)
+{
+    if (ppPool == NULL)
+    {
+        return E_POINTER;
+    }
+    if (cbAlignment == 0 || (cbAlignment & (cbAlignment - 1)) != 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    SamplePool *pPool = new (std::nothrow) SamplePool(0, 0, 0, cbBuffer, cbAlignment);
+    if (pPool == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    *ppPool = pPool;
+    return S_OK;
+}
+
+SamplePool::SamplePool(DWORD dwWidth, DWORD dwHeight, DWORD dwFourCC, DWORD cbBuffer, DWORD cbAlignment)
+    : m_cRef(1)
+    , m_dwWidth(dwWidth)
+    , m_dwHeight(dwHeight)
+    , m_dwFourCC(dwFourCC)
+    , m_cbBuffer(cbBuffer)
+    , m_cbAlignment(cbAlignment)
+    , m_cbSample(0)
+    , m_uAllocated(0)
+    , m_uReused(0)
+    , m_OnSampleReleased(this, &SamplePool::OnSampleReleased)
+{
+    InitializeCriticalSectionEx(&m_critSec, 1000, 0);
+}
+
+SamplePool::~SamplePool()
+{
+    for (size_t i = 0; i < m_Free.size(); ++i)
+    {
+        SafeRelease(&m_Free[i]);
+    }
+    DeleteCriticalSection(&m_critSec);
+}
+
+ULONG SamplePool::AddRef()
+{
+    return InterlockedIncrement(&m_cRef);
+}
+
+ULONG SamplePool::Release()
+{
+    LONG cRef = InterlockedDecrement(&m_cRef);
+    if (cRef == 0)
+    {
+        delete this;
+    }
+    return cRef;
+}
+
+//-------------------------------------------------------------------
+// GetSample
+// Takes a free sample, or allocates one, and arms its allocator
+// callback so that it comes back when released.
+//-------------------------------------------------------------------
+
+HRESULT SamplePool::GetSample(IMFSample **ppSample)
+{
+    HRESULT hr = S_OK;
+    IMFSample *pSample = NULL;
+    IMFTrackedSample *pTracked = NULL;
+
+    EnterCriticalSection(&m_critSec);
+    if (!m_Free.empty())
+    {
+        pSample = m_Free.back();
+        m_Free.pop_back();
+        ++m_uReused;
+    }
+    LeaveCriticalSection(&m_critSec);
+
+    if (pSample == NULL)
+    {
+        hr = AllocateSample(&pSample);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pSample->QueryInterface(IID_PPV_ARGS(&pTracked));
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pTracked->SetAllocator(&m_OnSampleReleased, NULL);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        *ppSample = pSample;
+        (*ppSample)->AddRef();
+    }
+
+    SafeRelease(&pTracked);
+    SafeRelease(&pSample);
+    TRACEHR_RET(hr);
+}
+
+HRESULT SamplePool::AllocateSample(IMFSample **ppSample)
+{
+    IMFTrackedSample *pTracked = NULL;
+    IMFSample *pSample = NULL;
+    IMFMediaBuffer *pBuffer = NULL;
+
+    HRESULT hr = MFCreateTrackedSample(&pTracked);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pTracked->QueryInterface(IID_PPV_ARGS(&pSample));
+    }
+    if (SUCCEEDED(hr))
+    {
+        if (m_dwFourCC)
+        {
+            hr = MFCreate2DMediaBuffer(m_dwWidth, m_dwHeight, m_dwFourCC, FALSE, &pBuffer);
+        }
+        else
+        {
+            // The flags are the alignment minus 1, as MF_64_BYTE_ALIGNMENT.
+            hr = MFCreateAlignedMemoryBuffer(m_cbBuffer, m_cbAlignment - 1, &pBuffer);
+        }
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pSample->AddBuffer(pBuffer);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pBuffer->GetMaxLength(&m_cbSample);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        ++m_uAllocated;
+        *ppSample = pSample;
+        (*ppSample)->AddRef();
+    }
+
+    SafeRelease(&pBuffer);
+    SafeRelease(&pSample);
+    SafeRelease(&pTracked);
+    TRACEHR_RET(hr);
+}
+
+UINT64 SamplePool::IdleBytes()
+{
+    EnterCriticalSection(&m_critSec);
+    UINT64 cbIdle = (UINT64)m_Free.size() * m_cbSample;
+    LeaveCriticalSection(&m_critSec);
+    return cbIdle;
+}
+
+void SamplePool::Trim()
+{
+    std::vector<IMFSample *> free;
+
+    EnterCriticalSection(&m_critSec);
+    free.swap(m_Free);
+    LeaveCriticalSection(&m_critSec);
+
+    for (size_t i = 0; i < free.size(); ++i)
+    {
+        SafeRelease(&free[i]);
+    }
+}
+
+//-------------------------------------------------------------------
+// OnSampleReleased
+// Called when the last reference to a sample is released.
+//-------------------------------------------------------------------
+
+HRESULT SamplePool::OnSampleReleased(IMFAsyncResult *pResult)
+{
+    IUnknown *pUnk = NULL;
+    IMFSample *pSample = NULL;
+
+    IMFMediaBuffer *pBuffer = NULL;
+
+    HRESULT hr = pResult->GetObject(&pUnk);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pUnk->QueryInterface(IID_PPV_ARGS(&pSample));
+    }
+
+    // A buffer shared with another sample is still in use. The sample
+    // and this reference hold two references, the count returned by
+    // Release tells if anybody else does.
+    if (SUCCEEDED(hr))
+    {
+        hr = pSample->GetBufferByIndex(0, &pBuffer);
+    }
+    if (SUCCEEDED(hr))
+    {
+        pBuffer->AddRef();
+        if (pBuffer->Release() > 2)
+        {
+            hr = S_FALSE;
+        }
+    }
+
+    // Drop the attributes of the last use, such as the request token.
+    if (hr == S_OK)
+    {
+        hr = pSample->DeleteAllItems();
+    }
+
+    if (hr == S_OK)
+    {
+        EnterCriticalSection(&m_critSec);
+        try
+        {
+            m_Free.push_back(pSample);
+            pSample = NULL;
+        }
+        catch (std::bad_alloc const &)
+        {
+            hr = E_OUTOFMEMORY;
+        }
+        LeaveCriticalSection(&m_critSec);
+    }
+
+    SafeRelease(&pBuffer);
+    SafeRelease(&pSample);
+    SafeRelease(&pUnk);
+    return SUCCEEDED(hr) ? S_OK : hr;
+}
+
+#pragma warning( pop )
@@ -0,0 +1,81 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SamplePool.h
+// Recycles samples whose buffers are expensive to allocate.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <windows.h>
+#include <mfapi.h>
+#include <mfidl.h>
+
+#include <vector>
+
+//-------------------------------------------------------------------
+// SamplePool class
+//
+// Hands out tracked samples that hold one 2D buffer of a fixed format,
+// or one aligned memory buffer of a fixed size. When the pipeline
+// releases the last reference to a sample, the sample comes back to
+// the pool instead of being freed, so that large video frames are not
+// allocated again for every sample. A sample whose buffer is still
+// referenced elsewhere, by an aggregate or a time shift copy, is freed
+// instead.
+//
+// Outstanding samples hold a reference on the pool, which therefore
+// lives until they all came back. To change the format, release the
+// pool and create another one.
+//-------------------------------------------------------------------
+
+class SamplePool
+{
+public:
+    static HRESULT CreateInstance(DWORD dwWidth, DWORD dwHeight, DWORD dwFourCC, SamplePool **ppPool);
+
+    // cbAlignment: Power of 2.
+    static HRESULT CreateInstance(DWORD cbBuffer, DWORD cbAlignment, SamplePool **ppPool);
+
+    // Reference counting, for the allocator callback of the samples.
+    STDMETHODIMP_(ULONG) AddRef();
+    STDMETHODIMP_(ULONG) Release();
+
+    // Gets a sample with one buffer. Attributes, time, duration and
+    // buffer length of a recycled sample are unspecified.
+    HRESULT GetSample(IMFSample **ppSample);
+
+    UINT32  Allocated() const { return m_uAllocated; }
+    UINT32  Reused() const { return m_uReused; }
+
+    // Bytes held by the free samples.
+    UINT64  IdleBytes();
+
+    // Frees the free samples.
+    void    Trim();
+
+    HRESULT OnSampleReleased(IMFAsyncResult *pResult);
+
+private:
+    SamplePool(DWORD dwWidth, DWORD dwHeight, DWORD dwFourCC, DWORD cbBuffer, DWORD cbAlignment);
+    ~SamplePool();
+
+    HRESULT AllocateSample(IMFSample **ppSample);
+
+private:
+    long                    m_cRef;
+    CRITICAL_SECTION        m_critSec;          // Samples come back on any thread
+
+    DWORD                   m_dwWidth;
+    DWORD                   m_dwHeight;
+    DWORD                   m_dwFourCC;         // 0 for memory buffers
+    DWORD                   m_cbBuffer;
+    DWORD                   m_cbAlignment;
+    DWORD                   m_cbSample;         // Buffer size, known after the first allocation
+
+    std::vector<IMFSample *> m_Free;
+    UINT32                  m_uAllocated;
+    UINT32                  m_uReused;
+
+    AsyncCallback<SamplePool> m_OnSampleReleased;
+};
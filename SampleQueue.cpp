@@ -0,0 +1,133 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SampleQueue.cpp
+// Samples of a stream waiting to be delivered.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "SampleQueue.h"
+#include "SampleAttributes.h"
+#include "SafeRelease.h"
+
+SampleQueue::SampleQueue()
+    : m_hnsQueued(0)
+    , m_cbQueued(0)
+{
+}
+
+SampleQueue::~SampleQueue()
+{
+    Clear();
+}
+
+HRESULT SampleQueue::Push(IMFSample *pSample)
+{
+    try
+    {
+        m_Samples.push_back(pSample);
+    }
+    catch (std::bad_alloc const &)
+    {
+        return E_OUTOFMEMORY;
+    }
+    pSample->AddRef();
+    Account(pSample, TRUE);
+    return S_OK;
+}
+
+HRESULT SampleQueue::Pop(IMFSample **ppSample)
+{
+    if (m_Samples.empty())
+    {
+        return E_UNEXPECTED;
+    }
+    *ppSample = m_Samples.front();
+    m_Samples.pop_front();
+    Account(*ppSample, FALSE);
+    return S_OK;
+}
+
+HRESULT SampleQueue::Front(IMFSample **ppSample) const
+{
+    if (m_Samples.empty())
+    {
+        return E_UNEXPECTED;
+    }
+    *ppSample = m_Samples.front();
+    (*ppSample)->AddRef();
+    return S_OK;
+}
+
+//-------------------------------------------------------------------
+// DropOldest
+// The next sample takes over a format change of the dropped one, and
+// is marked discontinuous.
+//-------------------------------------------------------------------
+
+DWORD SampleQueue::DropOldest()
+{
+    IMFSample *pSample = NULL;
+    IUnknown *pType = NULL;
+    DWORD cbSample = 0;
+
+    if (FAILED(Pop(&pSample)))
+    {
+        return 0;
+    }
+
+    (void)pSample->GetTotalLength(&cbSample);
+
+    if (!m_Samples.empty())
+    {
+        IMFSample *pNext = m_Samples.front();
+        if (SUCCEEDED(pSample->GetUnknown(PPBOX_SAMPLE_MEDIA_TYPE, IID_PPV_ARGS(&pType)))
+            && FAILED(pNext->GetItem(PPBOX_SAMPLE_MEDIA_TYPE, NULL)))
+        {
+            (void)pNext->SetUnknown(PPBOX_SAMPLE_MEDIA_TYPE, pType);
+        }
+        (void)pNext->SetUINT32(MFSampleExtension_Discontinuity, TRUE);
+    }
+
+    SafeRelease(&pType);
+    SafeRelease(&pSample);
+    return cbSample;
+}
+
+void SampleQueue::Clear()
+{
+    for (size_t i = 0; i < m_Samples.size(); ++i)
+    {
+        SafeRelease(&m_Samples[i]);
+    }
+    m_Samples.clear();
+    m_hnsQueued = 0;
+    m_cbQueued = 0;
+}
+
+/* Private methods */
+
+//-------------------------------------------------------------------
+// Account
+// Updates the media time and the size of the queue for a sample added
+// or removed.
+//-------------------------------------------------------------------
+
+void SampleQueue::Account(IMFSample *pSample, BOOL bAdded)
+{
+    LONGLONG hnsDuration = 0;
+    DWORD cbSample = 0;
+    (void)pSample->GetSampleDuration(&hnsDuration);
+    (void)pSample->GetTotalLength(&cbSample);
+
+    if (bAdded)
+    {
+        m_hnsQueued += hnsDuration;
+        m_cbQueued += cbSample;
+    }
+    else
+    {
+        m_hnsQueued -= min((UINT64)hnsDuration, m_hnsQueued);
+        m_cbQueued -= min((UINT64)cbSample, m_cbQueued);
+    }
+}
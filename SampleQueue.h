@@ -0,0 +1,58 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SampleQueue.h
+// Samples of a stream waiting to be delivered.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <windows.h>
+#include <mfapi.h>
+
+#include <deque>
+
+//-------------------------------------------------------------------
+// SampleQueue class
+//
+// A FIFO of samples, holding a reference on each, that keeps the media
+// time and the bytes it holds for the interleave and memory limits of
+// the source.
+//
+// Dropping the oldest sample does not lose what it carried for the
+// samples after it: the next sample takes over its format change, and
+// is marked discontinuous.
+//-------------------------------------------------------------------
+
+class SampleQueue
+{
+public:
+    SampleQueue();
+    ~SampleQueue();
+
+    HRESULT Push(IMFSample *pSample);
+
+    // Takes the oldest sample, with the reference the queue held.
+    HRESULT Pop(IMFSample **ppSample);
+
+    // Returns the oldest sample, without removing it.
+    HRESULT Front(IMFSample **ppSample) const;
+
+    // Drops the oldest sample, and returns its size.
+    DWORD   DropOldest();
+
+    void    Clear();
+
+    BOOL    IsEmpty() const { return m_Samples.empty(); }
+    DWORD   Count() const { return (DWORD)m_Samples.size(); }
+    UINT64  Duration() const { return m_hnsQueued; }
+    UINT64  Bytes() const { return m_cbQueued; }
+
+private:
+    void    Account(IMFSample *pSample, BOOL bAdded);
+
+private:
+    std::deque<IMFSample *> m_Samples;
+    UINT64                  m_hnsQueued;    // Media time of the queued samples.
+    UINT64                  m_cbQueued;     // Bytes of the queued samples.
+};
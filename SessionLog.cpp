@@ -0,0 +1,552 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SessionLog.cpp
+// Records the runtime calls of a session to a file, and replays them.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "SessionLog.h"
+#include "Trace.h"
+
+static BYTE const SESSION_LOG_MAGIC[4] = { 'P', 'P', 'B', 'R' };
+static UINT16 const SESSION_LOG_VERSION = 1;
+static size_t const SESSION_LOG_FLUSH = 64 * 1024;
+
+struct SessionLogHeader
+{
+    BYTE    magic[4];
+    UINT16  version;
+    UINT16  cbSample;
+    UINT16  cbStreamInfo;
+    UINT16  cbPlayStat;
+    UINT16  cbDataStat;
+};
+
+static SessionLogHeader CurrentHeader()
+{
+    SessionLogHeader header;
+    CopyMemory(header.magic, SESSION_LOG_MAGIC, sizeof(header.magic));
+    header.version = SESSION_LOG_VERSION;
+    header.cbSample = sizeof(JUST_Sample);
+    header.cbStreamInfo = sizeof(JUST_StreamInfo);
+    header.cbPlayStat = sizeof(JUST_PlayStatistic);
+    header.cbDataStat = sizeof(JUST_DataStat);
+    return header;
+}
+
+static BOOL HasStat(PP_err err)
+{
+    return err == just_success || err == just_would_block;
+}
+
+/* SessionLogWriter class */
+
+SessionLogWriter::SessionLogWriter()
+    : m_hFile(INVALID_HANDLE_VALUE)
+    , m_bPayloads(FALSE)
+    , m_uLastTick(0)
+{
+}
+
+SessionLogWriter::~SessionLogWriter()
+{
+    Close();
+}
+
+HRESULT SessionLogWriter::Open(LPCWSTR pszPath, BOOL bPayloads)
+{
+    Close();
+
+    m_hFile = CreateFile2(pszPath, GENERIC_WRITE, 0, CREATE_ALWAYS, NULL);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        TRACEHR_RET(hr);
+    }
+
+    m_bPayloads = bPayloads;
+    m_uLastTick = GetTickCount64();
+
+    SessionLogHeader header = CurrentHeader();
+    Put(&header, sizeof(header));
+    return S_OK;
+}
+
+void SessionLogWriter::Close()
+{
+    if (IsOpen())
+    {
+        Flush();
+    }
+    if (IsOpen())
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+    m_Buffer.clear();
+}
+
+void SessionLogWriter::WriteOpen(PP_err err)
+{
+    Begin(SESSION_LOG_OPEN, err);
+}
+
+void SessionLogWriter::WriteValue(SessionLogRecord type, PP_uint value)
+{
+    Begin(type, just_success);
+    PutVarint(value);
+}
+
+void SessionLogWriter::WriteStreamInfo(PP_uint index, PP_err err, JUST_StreamInfo const * info)
+{
+    Begin(SESSION_LOG_STREAM_INFO, err);
+    PutVarint(index);
+    if (err == just_success)
+    {
+        JUST_StreamInfo copy = *info;
+        copy.format_buffer = NULL;
+        Put(&copy, sizeof(copy));
+        PutVarint(info->format_size);
+        Put(info->format_buffer, info->format_size);
+    }
+}
+
+void SessionLogWriter::WriteSeek(PP_uint time, PP_err err)
+{
+    Begin(SESSION_LOG_SEEK, err);
+    PutVarint(time);
+}
+
+void SessionLogWriter::WriteSample(PP_err err, JUST_Sample const * sample)
+{
+    Begin(SESSION_LOG_SAMPLE, err);
+    if (err == just_success)
+    {
+        JUST_Sample copy = *sample;
+        copy.buffer = NULL;
+        Put(&copy, sizeof(copy));
+
+        BYTE bPayload = m_bPayloads ? 1 : 0;
+        Put(&bPayload, 1);
+        if (bPayload)
+        {
+            Put(sample->buffer, sample->size);
+        }
+    }
+}
+
+void SessionLogWriter::WritePlayStat(PP_err err, JUST_PlayStatistic const * stat)
+{
+    Begin(SESSION_LOG_PLAY_STAT, err);
+    if (HasStat(err))
+    {
+        Put(stat, sizeof(*stat));
+    }
+}
+
+void SessionLogWriter::WriteDataStat(PP_err err, JUST_DataStat const * stat)
+{
+    Begin(SESSION_LOG_DATA_STAT, err);
+    if (HasStat(err))
+    {
+        Put(stat, sizeof(*stat));
+    }
+}
+
+void SessionLogWriter::Begin(SessionLogRecord type, PP_err err)
+{
+    ULONGLONG uTick = GetTickCount64();
+    BYTE bType = (BYTE)type;
+
+    Put(&bType, 1);
+    PutVarint(uTick - m_uLastTick);
+    PutVarint((UINT32)err);
+    m_uLastTick = uTick;
+}
+
+void SessionLogWriter::PutVarint(UINT64 value)
+{
+    BYTE bytes[10];
+    size_t n = 0;
+    do
+    {
+        bytes[n] = (BYTE)(value & 0x7f);
+        value >>= 7;
+        if (value)
+        {
+            bytes[n] |= 0x80;
+        }
+        ++n;
+    } while (value);
+    Put(bytes, n);
+}
+
+void SessionLogWriter::Put(void const * data, size_t size)
+{
+    if (!IsOpen())
+    {
+        return;
+    }
+
+    try
+    {
+        BYTE const * p = (BYTE const *)data;
+        m_Buffer.insert(m_Buffer.end(), p, p + size);
+    }
+    catch (std::bad_alloc const &)
+    {
+        TRACE(1, L"SessionLogWriter::Put out of memory, recording stopped\r\n");
+        m_Buffer.clear();
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+}
+
+void SessionLogWriter::Commit()
+{
+    if (IsOpen() && m_Buffer.size() >= SESSION_LOG_FLUSH)
+    {
+        Flush();
+    }
+}
+
+void SessionLogWriter::Flush()
+{
+    DWORD cbWritten = 0;
+
+    if (!m_Buffer.empty()
+        && (!WriteFile(m_hFile, &m_Buffer[0], (DWORD)m_Buffer.size(), &cbWritten, NULL)
+            || cbWritten != m_Buffer.size()))
+    {
+        TRACE(1, L"SessionLogWriter::Flush write failed, recording stopped\r\n");
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+    m_Buffer.clear();
+}
+
+/* SessionLogReader class */
+
+SessionLogReader::SessionLogReader()
+    : m_uPos(0)
+    , m_uTick(0)
+{
+}
+
+HRESULT SessionLogReader::Open(LPCWSTR pszPath)
+{
+    HRESULT hr = S_OK;
+    FILE_STANDARD_INFO info;
+    DWORD cbRead = 0;
+
+    Close();
+
+    HANDLE hFile = CreateFile2(pszPath, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        TRACEHR_RET(hr);
+    }
+
+    if (!GetFileInformationByHandleEx(hFile, FileStandardInfo, &info, sizeof(info)))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    if (SUCCEEDED(hr) && (info.EndOfFile.QuadPart < (LONGLONG)sizeof(SessionLogHeader) || info.EndOfFile.HighPart != 0))
+    {
+        hr = MF_E_INVALID_FILE_FORMAT;
+    }
+    if (SUCCEEDED(hr))
+    {
+        try
+        {
+            m_File.resize(info.EndOfFile.LowPart);
+        }
+        catch (std::bad_alloc const &)
+        {
+            hr = E_OUTOFMEMORY;
+        }
+    }
+    if (SUCCEEDED(hr) && !ReadFile(hFile, &m_File[0], (DWORD)m_File.size(), &cbRead, NULL))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    if (SUCCEEDED(hr) && cbRead != m_File.size())
+    {
+        hr = MF_E_INVALID_FILE_FORMAT;
+    }
+    CloseHandle(hFile);
+
+    // Structures are stored as they are, the sizes must match.
+    if (SUCCEEDED(hr))
+    {
+        SessionLogHeader header = CurrentHeader();
+        if (memcmp(&m_File[0], &header, sizeof(header)) != 0)
+        {
+            hr = MF_E_INVALID_FILE_FORMAT;
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_uPos = sizeof(SessionLogHeader);
+        m_uTick = GetTickCount64();
+    }
+    else
+    {
+        Close();
+    }
+    TRACEHR_RET(hr);
+}
+
+void SessionLogReader::Close()
+{
+    m_File.clear();
+    m_Payload.clear();
+    m_uPos = 0;
+}
+
+PP_err SessionLogReader::ReadOpen()
+{
+    PP_err err = just_not_open;
+    (void)Next(SESSION_LOG_OPEN, &err);
+    return err;
+}
+
+PP_uint SessionLogReader::ReadValue(SessionLogRecord type)
+{
+    PP_err err = just_success;
+    UINT64 value = 0;
+    if (Next(type, &err))
+    {
+        (void)GetVarint(&value);
+    }
+    return (PP_uint)value;
+}
+
+PP_err SessionLogReader::ReadStreamInfo(PP_uint index, JUST_StreamInfo * info)
+{
+    PP_err err = just_not_open;
+    UINT64 uIndex = 0, cbFormat = 0;
+
+    if (!Next(SESSION_LOG_STREAM_INFO, &err) || !GetVarint(&uIndex))
+    {
+        return just_not_open;
+    }
+    if (err == just_success)
+    {
+        if (!Get(info, sizeof(*info)) || !GetVarint(&cbFormat))
+        {
+            return just_not_open;
+        }
+        // The format buffer stays in the log, valid until Close.
+        info->format_size = (PP_uint)cbFormat;
+        info->format_buffer = Take((size_t)cbFormat);
+        if (info->format_buffer == NULL && cbFormat)
+        {
+            return just_not_open;
+        }
+    }
+    if (uIndex != index)
+    {
+        TRACE(1, L"SessionLogReader::ReadStreamInfo index %u replayed for %u\r\n", (UINT32)uIndex, index);
+    }
+    return err;
+}
+
+PP_err SessionLogReader::ReadSeek(PP_uint time)
+{
+    PP_err err = just_not_open;
+    UINT64 uTime = 0;
+    if (Next(SESSION_LOG_SEEK, &err) && GetVarint(&uTime) && uTime != time)
+    {
+        TRACE(1, L"SessionLogReader::ReadSeek %u replayed for %u\r\n", (UINT32)uTime, time);
+    }
+    return err;
+}
+
+PP_err SessionLogReader::ReadSample(JUST_Sample * sample)
+{
+    PP_err err = just_stream_end;
+    BYTE bPayload = 0;
+
+    if (!Next(SESSION_LOG_SAMPLE, &err))
+    {
+        return just_stream_end;
+    }
+    if (err != just_success)
+    {
+        return err;
+    }
+    if (!Get(sample, sizeof(*sample)) || !Get(&bPayload, 1))
+    {
+        return just_stream_end;
+    }
+
+    if (bPayload)
+    {
+        sample->buffer = Take(sample->size);
+        if (sample->buffer == NULL && sample->size)
+        {
+            return just_stream_end;
+        }
+    }
+    else
+    {
+        try
+        {
+            m_Payload.assign(sample->size, 0);
+        }
+        catch (std::bad_alloc const &)
+        {
+            return just_stream_end;
+        }
+        sample->buffer = m_Payload.empty() ? NULL : &m_Payload[0];
+    }
+    return err;
+}
+
+PP_err SessionLogReader::ReadPlayStat(JUST_PlayStatistic * stat)
+{
+    PP_err err = just_not_open;
+    if (Next(SESSION_LOG_PLAY_STAT, &err) && HasStat(err) && !Get(stat, sizeof(*stat)))
+    {
+        err = just_not_open;
+    }
+    return err;
+}
+
+PP_err SessionLogReader::ReadDataStat(JUST_DataStat * stat)
+{
+    PP_err err = just_not_open;
+    if (Next(SESSION_LOG_DATA_STAT, &err) && HasStat(err) && !Get(stat, sizeof(*stat)))
+    {
+        err = just_not_open;
+    }
+    return err;
+}
+
+//-------------------------------------------------------------------
+// Next
+// Moves to the body of the next record of the given type. Records of
+// other types on the way are skipped, and advance the virtual time.
+//-------------------------------------------------------------------
+
+BOOL SessionLogReader::Next(SessionLogRecord type, PP_err * err)
+{
+    while (m_uPos < m_File.size())
+    {
+        BYTE bType = 0;
+        UINT64 uDelta = 0, uErr = 0;
+
+        if (!Get(&bType, 1) || !GetVarint(&uDelta) || !GetVarint(&uErr))
+        {
+            break;
+        }
+        m_uTick += uDelta;
+
+        if (bType == type)
+        {
+            *err = (PP_err)(UINT32)uErr;
+            return TRUE;
+        }
+
+        TRACE(3, L"SessionLogReader::Next skipped record %u\r\n", bType);
+        if (!Skip(bType, (PP_err)(UINT32)uErr))
+        {
+            break;
+        }
+    }
+
+    m_uPos = m_File.size();
+    return FALSE;
+}
+
+BOOL SessionLogReader::Skip(BYTE bType, PP_err err)
+{
+    UINT64 value = 0;
+    BYTE bPayload = 0;
+    JUST_Sample sample;
+
+    switch (bType)
+    {
+    case SESSION_LOG_OPEN:
+        return TRUE;
+
+    case SESSION_LOG_DURATION:
+    case SESSION_LOG_STREAMS:
+    case SESSION_LOG_SEEK:
+        return GetVarint(&value);
+
+    case SESSION_LOG_STREAM_INFO:
+        if (!GetVarint(&value))
+        {
+            return FALSE;
+        }
+        return err != just_success
+            || (Take(sizeof(JUST_StreamInfo)) && GetVarint(&value) && (value == 0 || Take((size_t)value)));
+
+    case SESSION_LOG_SAMPLE:
+        if (err != just_success)
+        {
+            return TRUE;
+        }
+        if (!Get(&sample, sizeof(sample)) || !Get(&bPayload, 1))
+        {
+            return FALSE;
+        }
+        return bPayload == 0 || sample.size == 0 || Take(sample.size) != NULL;
+
+    case SESSION_LOG_PLAY_STAT:
+        return !HasStat(err) || Take(sizeof(JUST_PlayStatistic)) != NULL;
+
+    case SESSION_LOG_DATA_STAT:
+        return !HasStat(err) || Take(sizeof(JUST_DataStat)) != NULL;
+
+    default:
+        return FALSE;
+    }
+}
+
+BOOL SessionLogReader::GetVarint(UINT64 * value)
+{
+    UINT64 result = 0;
+    for (UINT32 shift = 0; shift < 64; shift += 7)
+    {
+        BYTE b = 0;
+        if (!Get(&b, 1))
+        {
+            return FALSE;
+        }
+        result |= (UINT64)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0)
+        {
+            *value = result;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+BOOL SessionLogReader::Get(void * data, size_t size)
+{
+    BYTE const * p = Take(size);
+    if (p == NULL)
+    {
+        return FALSE;
+    }
+    CopyMemory(data, p, size);
+    return TRUE;
+}
+
+BYTE * SessionLogReader::Take(size_t size)
+{
+    if (size == 0 || size > m_File.size() - m_uPos)
+    {
+        return NULL;
+    }
+    BYTE * p = &m_File[m_uPos];
+    m_uPos += size;
+    return p;
+}
@@ -0,0 +1,145 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SessionLog.h
+// Records the runtime calls of a session to a file, and replays them.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <windows.h>
+
+#include <vector>
+
+//-------------------------------------------------------------------
+// Session log format
+//
+// A header, then one record per call, in call order:
+//
+//   header:  "PPBR", version, sizes of the JUST_Sample,
+//            JUST_StreamInfo, JUST_PlayStatistic and JUST_DataStat
+//            structures (UINT16 each)
+//   record:  type (BYTE), milliseconds since the previous record
+//            (varint), result (varint), then by type:
+//              OPEN                -
+//              DURATION, STREAMS   value (varint)
+//              STREAM_INFO         index (varint), on success the
+//                                  structure and the format buffer
+//                                  (varint size, bytes)
+//              SEEK                time (varint)
+//              SAMPLE              on success the structure, a payload
+//                                  flag (BYTE) and the payload
+//              PLAY_STAT, DATA_STAT on success or would_block, the
+//                                  structure
+//
+// Structures are stored as they are in memory, with pointers cleared,
+// so a log only replays with the runtime headers it was recorded with.
+//-------------------------------------------------------------------
+
+enum SessionLogRecord
+{
+    SESSION_LOG_OPEN = 1,
+    SESSION_LOG_DURATION,
+    SESSION_LOG_STREAMS,
+    SESSION_LOG_STREAM_INFO,
+    SESSION_LOG_SEEK,
+    SESSION_LOG_SAMPLE,
+    SESSION_LOG_PLAY_STAT,
+    SESSION_LOG_DATA_STAT,
+};
+
+//-------------------------------------------------------------------
+// SessionLogWriter class
+//
+// Writes are buffered in memory, and only reach the file in Commit
+// and Close, so a caller can record under its lock and do the file
+// I/O after releasing it. A write error stops the recording, and
+// never fails the call that is recorded.
+//-------------------------------------------------------------------
+
+class SessionLogWriter
+{
+public:
+    SessionLogWriter();
+    ~SessionLogWriter();
+
+    // bPayloads: Also record the sample payloads.
+    HRESULT Open(LPCWSTR pszPath, BOOL bPayloads);
+    void    Close();
+
+    BOOL    IsOpen() const { return m_hFile != INVALID_HANDLE_VALUE; }
+
+    void    WriteOpen(PP_err err);
+    void    WriteValue(SessionLogRecord type, PP_uint value);
+    void    WriteStreamInfo(PP_uint index, PP_err err, JUST_StreamInfo const * info);
+    void    WriteSeek(PP_uint time, PP_err err);
+    void    WriteSample(PP_err err, JUST_Sample const * sample);
+    void    WritePlayStat(PP_err err, JUST_PlayStatistic const * stat);
+    void    WriteDataStat(PP_err err, JUST_DataStat const * stat);
+
+    // Writes the buffered records to the file once they reach the
+    // flush size.
+    void    Commit();
+
+private:
+    void    Begin(SessionLogRecord type, PP_err err);
+    void    PutVarint(UINT64 value);
+    void    Put(void const * data, size_t size);
+    void    Flush();
+
+private:
+    HANDLE              m_hFile;
+    BOOL                m_bPayloads;
+    ULONGLONG           m_uLastTick;
+    std::vector<BYTE>   m_Buffer;
+};
+
+//-------------------------------------------------------------------
+// SessionLogReader class
+//
+// Answers the calls of a session from a log, in order. Each call takes
+// the next record of its type, so a replay that makes the same calls
+// as the recording gets the same results. The virtual time moves to
+// the time of each record taken, from the tick count of Open.
+//
+// Payloads that were not recorded are replayed as zeros.
+//-------------------------------------------------------------------
+
+class SessionLogReader
+{
+public:
+    SessionLogReader();
+
+    HRESULT Open(LPCWSTR pszPath);
+    void    Close();
+
+    BOOL    IsOpen() const { return !m_File.empty(); }
+
+    // Virtual tick count, in milliseconds.
+    ULONGLONG Tick() const { return m_uTick; }
+
+    // Type of the next record, 0 at the end of the log. An offline
+    // driver makes its calls in this order to see the recorded timing.
+    BYTE    NextType() const { return m_uPos < m_File.size() ? m_File[m_uPos] : 0; }
+
+    PP_err  ReadOpen();
+    PP_uint ReadValue(SessionLogRecord type);
+    PP_err  ReadStreamInfo(PP_uint index, JUST_StreamInfo * info);
+    PP_err  ReadSeek(PP_uint time);
+    PP_err  ReadSample(JUST_Sample * sample);
+    PP_err  ReadPlayStat(JUST_PlayStatistic * stat);
+    PP_err  ReadDataStat(JUST_DataStat * stat);
+
+private:
+    BOOL    Next(SessionLogRecord type, PP_err * err);
+    BOOL    Skip(BYTE bType, PP_err err);
+    BOOL    GetVarint(UINT64 * value);
+    BOOL    Get(void * data, size_t size);
+    BYTE *  Take(size_t size);
+
+private:
+    std::vector<BYTE>   m_File;
+    size_t              m_uPos;
+    ULONGLONG           m_uTick;
+    std::vector<BYTE>   m_Payload;          // Zeros for payloads not recorded
+};
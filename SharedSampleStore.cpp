@@ -0,0 +1,63 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SharedSampleStore.cpp
+// Runtime samples shared by the sessions that play the same playlink.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "SharedSampleStore.h"
+
+#include <assert.h>
+
+SharedSampleStore::SharedSampleStore()
+    : m_uBegin(0)
+    , m_uBytes(0)
+{
+}
+
+HRESULT SharedSampleStore::Push(JUST_Sample const & sample)
+{
+    Entry entry;
+    entry.sample = sample;
+
+    try
+    {
+        entry.payload = std::make_shared<std::vector<BYTE> >(sample.buffer, sample.buffer + sample.size);
+        m_Samples.push_back(entry);
+    }
+    catch (std::bad_alloc const &)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    m_uBytes += sample.size;
+    return S_OK;
+}
+
+void SharedSampleStore::Get(UINT64 uIndex, JUST_Sample *sample, SharedPayload *payload) const
+{
+    assert(uIndex >= m_uBegin && uIndex < End());
+
+    Entry const & entry = m_Samples[(size_t)(uIndex - m_uBegin)];
+    *sample = entry.sample;
+    *payload = entry.payload;
+    sample->buffer = entry.payload->empty() ? NULL : &entry.payload->front();
+}
+
+void SharedSampleStore::Trim(UINT64 uIndex)
+{
+    while (!m_Samples.empty() && (m_uBegin < uIndex || m_uBytes > SHARED_STORE_BUDGET))
+    {
+        m_uBytes -= m_Samples.front().sample.size;
+        m_Samples.pop_front();
+        ++m_uBegin;
+    }
+}
+
+void SharedSampleStore::Clear()
+{
+    m_uBegin = End();
+    m_Samples.clear();
+    m_uBytes = 0;
+}
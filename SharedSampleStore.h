@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SharedSampleStore.h
+// Runtime samples shared by the sessions that play the same playlink.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <windows.h>
+
+#include <deque>
+#include <vector>
+#include <memory>
+
+const UINT64 SHARED_STORE_BUDGET = 32 * 1024 * 1024;    // Bytes kept for lagging readers.
+
+typedef std::shared_ptr<std::vector<BYTE> > SharedPayload;
+
+//-------------------------------------------------------------------
+// SharedSampleStore class
+//
+// Samples are numbered in read order. Each reader keeps the number of
+// the next sample it wants. The runtime is only read when a reader
+// asks for a sample nobody has read yet, and a sample is released as
+// soon as every reader has passed it, or when the store exceeds its
+// budget (lagging readers then skip ahead).
+//
+// Payloads are reference counted, so a reader keeps its current
+// payload valid after the store released it.
+//
+// The caller serializes access.
+//-------------------------------------------------------------------
+
+class SharedSampleStore
+{
+public:
+    SharedSampleStore();
+
+    UINT64  Begin() const { return m_uBegin; }
+    UINT64  End() const { return m_uBegin + m_Samples.size(); }
+    UINT64  Bytes() const { return m_uBytes; }
+
+    // Copies a sample read from the runtime to the end of the store.
+    HRESULT Push(JUST_Sample const & sample);
+
+    // Gets sample number uIndex, which must be in [Begin(), End()).
+    void    Get(UINT64 uIndex, JUST_Sample *sample, SharedPayload *payload) const;
+
+    // Releases samples before uIndex, and beyond the budget.
+    void    Trim(UINT64 uIndex);
+
+    void    Clear();
+
+private:
+    struct Entry
+    {
+        JUST_Sample     sample;
+        SharedPayload   payload;
+    };
+
+    std::deque<Entry>   m_Samples;
+    UINT64              m_uBegin;       // Number of the front sample
+    UINT64              m_uBytes;
+};
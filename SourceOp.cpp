@@ -72,6 +72,24 @@ HRESULT SourceOp::CreateStartOp(IMFPresentationDescriptor *pPD, SourceOp **ppOp)
 }
 
 
+HRESULT SourceOp::CreateTimerOp(IMFAsyncCallback *pCallback, TimerOp **ppOp)
+{
+    if (ppOp == NULL)
+    {
+        return E_POINTER;
+    }
+
+    TimerOp *pOp = new (std::nothrow) TimerOp(pCallback);
+    if (pOp == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    *ppOp = pOp;
+    return S_OK;
+}
+
+
 ULONG SourceOp::AddRef()
 {
     return InterlockedIncrement(&m_cRef);
@@ -149,4 +167,15 @@ HRESULT StartOp::GetPresentationDescriptor(IMFPresentationDescriptor **ppPD)
     return S_OK;
 }
 
+
+TimerOp::TimerOp(IMFAsyncCallback *pCallback) : SourceOp(SourceOp::OP_TIMER), m_pCallback(pCallback)
+{
+    m_pCallback->AddRef();
+}
+
+TimerOp::~TimerOp()
+{
+    SafeRelease(&m_pCallback);
+}
+
 #pragma warning( pop )
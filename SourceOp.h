@@ -25,6 +25,8 @@
 
 #include "OpQueue.h"
 
+class TimerOp;
+
 // Represents a request for an asynchronous operation.
 
 class SourceOp : public IUnknown
@@ -43,6 +45,7 @@ public:
 
     static HRESULT CreateOp(Operation op, SourceOp **ppOp);
     static HRESULT CreateStartOp(IMFPresentationDescriptor *pPD, SourceOp **ppOp);
+    static HRESULT CreateTimerOp(IMFAsyncCallback *pCallback, TimerOp **ppOp);
 
     // IUnknown
     STDMETHODIMP QueryInterface(REFIID iid, void** ppv);
@@ -75,5 +78,21 @@ protected:
     IMFPresentationDescriptor   *m_pPD; // Presentation descriptor for Start operations.
 };
 
+// One arm of a timer. It is the context of the runtime timer and the
+// state of the work item the timer queues, so a callback can tell
+// whether it belongs to the timer that is armed now.
+
+class TimerOp : public SourceOp
+{
+public:
+    TimerOp(IMFAsyncCallback *pCallback);
+    ~TimerOp();
+
+    IMFAsyncCallback * Callback() const { return m_pCallback; }
+
+protected:
+    IMFAsyncCallback            *m_pCallback;   // Invoked when the timer fires.
+};
+
 
 
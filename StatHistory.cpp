@@ -0,0 +1,128 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// StatHistory.cpp
+// Fixed-size history of sampled statistics, with window summaries.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "StatHistory.h"
+
+#include <algorithm>
+#include <new>
+
+StatHistory::StatHistory()
+    : m_pSamples(NULL)
+    , m_pScratch(NULL)
+    , m_cLength(0)
+    , m_cSamples(0)
+    , m_iNext(0)
+{
+}
+
+StatHistory::~StatHistory()
+{
+    SetLength(0);
+}
+
+BOOL StatHistory::SetLength(DWORD cSamples)
+{
+    delete [] m_pSamples;
+    delete [] m_pScratch;
+    m_pSamples = NULL;
+    m_pScratch = NULL;
+    m_cLength = 0;
+    m_cSamples = 0;
+    m_iNext = 0;
+
+    if (cSamples == 0)
+    {
+        return TRUE;
+    }
+
+    m_pSamples = new (std::nothrow) Sample[cSamples];
+    m_pScratch = new (std::nothrow) UINT32[cSamples];
+    if (m_pSamples == NULL || m_pScratch == NULL)
+    {
+        SetLength(0);
+        return FALSE;
+    }
+    m_cLength = cSamples;
+    return TRUE;
+}
+
+void StatHistory::Add(UINT64 uTick, UINT32 const values[STAT_METRICS])
+{
+    if (m_cLength == 0)
+    {
+        return;
+    }
+
+    Sample &sample = m_pSamples[m_iNext];
+    sample.uTick = uTick;
+    for (DWORD i = 0; i < STAT_METRICS; ++i)
+    {
+        sample.values[i] = values[i];
+    }
+
+    m_iNext = (m_iNext + 1) % m_cLength;
+    if (m_cSamples < m_cLength)
+    {
+        ++m_cSamples;
+    }
+}
+
+//-------------------------------------------------------------------
+// Summarize
+// Walks back from the newest sample to the first one older than the
+// window, collecting the values in the scratch array.
+//-------------------------------------------------------------------
+
+BOOL StatHistory::Summarize(StatMetric metric, UINT64 uTick, UINT32 uWindow, StatSummary *pSummary)
+{
+    DWORD cValues = 0;
+    UINT64 uSum = 0;
+    UINT32 uMin = 0xffffffff;
+    UINT32 uMax = 0;
+    DWORD iSlot = m_iNext;
+
+    while (cValues < m_cSamples)
+    {
+        iSlot = (iSlot == 0 ? m_cLength : iSlot) - 1;
+        Sample const &sample = m_pSamples[iSlot];
+        if (sample.uTick + uWindow < uTick)
+        {
+            break;
+        }
+
+        UINT32 uValue = sample.values[metric];
+        m_pScratch[cValues++] = uValue;
+        uSum += uValue;
+        uMin = uValue < uMin ? uValue : uMin;
+        uMax = uValue > uMax ? uValue : uMax;
+    }
+
+    if (cValues == 0)
+    {
+        return FALSE;
+    }
+
+    pSummary->cSamples = cValues;
+    pSummary->uMin = uMin;
+    pSummary->uMax = uMax;
+    pSummary->uMean = (UINT32)(uSum / cValues);
+
+    // Each selection only reorders the values above the previous rank,
+    // so the three together stay linear.
+    static DWORD const s_Percents[] = { 50, 90, 99 };
+    UINT32 *pResults[] = { &pSummary->uP50, &pSummary->uP90, &pSummary->uP99 };
+    DWORD iFirst = 0;
+    for (DWORD i = 0; i < 3; ++i)
+    {
+        DWORD iRank = (DWORD)((UINT64)(cValues - 1) * s_Percents[i] / 100);
+        std::nth_element(m_pScratch + iFirst, m_pScratch + iRank, m_pScratch + cValues);
+        *pResults[i] = m_pScratch[iRank];
+        iFirst = iRank;
+    }
+    return TRUE;
+}
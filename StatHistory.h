@@ -0,0 +1,83 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// StatHistory.h
+// Fixed-size history of sampled statistics, with window summaries.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+const DWORD STAT_HISTORY_DEFAULT_LENGTH = 6000;     // 10 minutes at 10 Hz
+const DWORD STAT_HISTORY_DEFAULT_INTERVAL = 100;    // Milliseconds
+const DWORD STAT_HISTORY_DEFAULT_WINDOW = 10000;    // Milliseconds
+
+enum StatMetric
+{
+    STAT_DOWNLOAD_SPEED,            // Bytes per second
+    STAT_BUFFER_TIME,               // Milliseconds buffered in the runtime
+    STAT_QUEUE_DEPTH,               // Milliseconds in the longest stream queue
+    STAT_STALLED,                   // 1000 while buffering, else 0
+    STAT_METRICS
+};
+
+struct StatSummary
+{
+    DWORD   cSamples;
+    UINT32  uMin;
+    UINT32  uMax;
+    UINT32  uMean;
+    UINT32  uP50;
+    UINT32  uP90;
+    UINT32  uP99;
+};
+
+//-------------------------------------------------------------------
+// StatHistory class
+//
+// A ring of samples, each holding every metric at one tick. The ring
+// is allocated once, so sampling for hours only overwrites the oldest
+// samples. A summary covers the samples of the last window; its
+// percentiles are found by selection in a scratch array allocated with
+// the ring, in time linear in the window.
+//
+// The mean of STAT_STALLED is the share of the window spent buffering,
+// per mille.
+//-------------------------------------------------------------------
+
+class StatHistory
+{
+public:
+    StatHistory();
+    ~StatHistory();
+
+    // Drops the history. cSamples: 0 disables it.
+    BOOL    SetLength(DWORD cSamples);
+
+    BOOL    IsEnabled() const { return m_cLength != 0; }
+    DWORD   Count() const { return m_cSamples; }
+
+    void    Add(UINT64 uTick, UINT32 const values[STAT_METRICS]);
+
+    // Summarizes the samples taken in the uWindow milliseconds up to
+    // uTick. Returns FALSE if there are none.
+    BOOL    Summarize(StatMetric metric, UINT64 uTick, UINT32 uWindow, StatSummary *pSummary);
+
+private:
+    struct Sample
+    {
+        UINT64  uTick;
+        UINT32  values[STAT_METRICS];
+    };
+
+    StatHistory(StatHistory const &);
+    StatHistory & operator=(StatHistory const &);
+
+private:
+    Sample  *m_pSamples;
+    UINT32  *m_pScratch;
+    DWORD   m_cLength;
+    DWORD   m_cSamples;
+    DWORD   m_iNext;            // Slot of the next sample
+};
@@ -0,0 +1,85 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// StatSampler.cpp
+// Schedules the statistics of the source, each at its own interval.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "StatSampler.h"
+
+StatSampler::StatSampler()
+{
+    for (DWORD i = 0; i < SAMPLER_METRICS; ++i)
+    {
+        m_Metrics[i].uInterval = SAMPLER_DEFAULT_INTERVAL;
+        m_Metrics[i].uDue = 0;
+        m_Metrics[i].cSamples = 0;
+        m_Metrics[i].uTotalCost = 0;
+        m_Metrics[i].uMaxCost = 0;
+    }
+}
+
+void StatSampler::SetInterval(SamplerMetric metric, UINT32 uInterval)
+{
+    m_Metrics[metric].uInterval = uInterval;
+    m_Metrics[metric].uDue = 0;
+}
+
+BOOL StatSampler::IsDue(SamplerMetric metric, UINT64 uNow) const
+{
+    Metric const & m = m_Metrics[metric];
+    return m.uInterval != 0 && uNow >= m.uDue;
+}
+
+//-------------------------------------------------------------------
+// Sampled
+// The next sample is due one interval after this one. A sample that
+// was late does not make the following ones early.
+//-------------------------------------------------------------------
+
+void StatSampler::Sampled(SamplerMetric metric, UINT64 uNow)
+{
+    Metric & m = m_Metrics[metric];
+    m.uDue = uNow + m.uInterval;
+}
+
+UINT32 StatSampler::NextDelay(UINT64 uNow) const
+{
+    UINT64 uDelay = SAMPLER_IDLE_DELAY;
+
+    for (DWORD i = 0; i < SAMPLER_METRICS; ++i)
+    {
+        Metric const & m = m_Metrics[i];
+        if (m.uInterval == 0)
+        {
+            continue;
+        }
+        if (m.uDue <= uNow)
+        {
+            return 0;
+        }
+        if (m.uDue - uNow < uDelay)
+        {
+            uDelay = m.uDue - uNow;
+        }
+    }
+    return (UINT32)uDelay;
+}
+
+void StatSampler::AddCost(SamplerMetric metric, UINT32 uCost)
+{
+    Metric & m = m_Metrics[metric];
+    ++m.cSamples;
+    m.uTotalCost += uCost;
+    if (uCost > m.uMaxCost)
+    {
+        m.uMaxCost = uCost;
+    }
+}
+
+UINT32 StatSampler::MeanCost(SamplerMetric metric) const
+{
+    Metric const & m = m_Metrics[metric];
+    return m.cSamples ? (UINT32)(m.uTotalCost / m.cSamples) : 0;
+}
@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// StatSampler.h
+// Schedules the statistics of the source, each at its own interval.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+const UINT32 SAMPLER_DEFAULT_INTERVAL = 1000;   // Milliseconds
+const UINT32 SAMPLER_IDLE_DELAY = 1000;         // Milliseconds between wake-ups with nothing enabled
+
+enum SamplerMetric
+{
+    SAMPLER_PLAY_STAT,              // JUST_GetPlayStat: buffer time and progress
+    SAMPLER_DATA_STAT,              // JUST_GetDataStat: download speed and bytes
+    SAMPLER_HISTORY,                // A sample of the statistics history
+    SAMPLER_PUBLISH,                // Derived statistics written to the property set
+    SAMPLER_METRICS
+};
+
+//-------------------------------------------------------------------
+// StatSampler class
+//
+// Keeps the interval and next due time of each metric, and the cost
+// of sampling it. The caller wakes up after NextDelay, samples the
+// metrics that are due, and reports each one with Sampled and AddCost.
+// An interval of 0 disables the metric.
+//-------------------------------------------------------------------
+
+class StatSampler
+{
+public:
+    StatSampler();
+
+    void    SetInterval(SamplerMetric metric, UINT32 uInterval);
+    UINT32  Interval(SamplerMetric metric) const { return m_Metrics[metric].uInterval; }
+
+    // uNow: Tick count, in milliseconds.
+    BOOL    IsDue(SamplerMetric metric, UINT64 uNow) const;
+    void    Sampled(SamplerMetric metric, UINT64 uNow);
+
+    // Milliseconds from uNow until a metric is due, 0 if one is.
+    UINT32  NextDelay(UINT64 uNow) const;
+
+    // uCost: Microseconds spent sampling the metric once.
+    void    AddCost(SamplerMetric metric, UINT32 uCost);
+
+    UINT32  Samples(SamplerMetric metric) const { return m_Metrics[metric].cSamples; }
+    UINT32  MeanCost(SamplerMetric metric) const;
+    UINT32  MaxCost(SamplerMetric metric) const { return m_Metrics[metric].uMaxCost; }
+
+private:
+    struct Metric
+    {
+        UINT32  uInterval;
+        UINT64  uDue;               // Tick count
+        UINT32  cSamples;
+        UINT64  uTotalCost;         // Microseconds
+        UINT32  uMaxCost;
+    };
+
+    Metric  m_Metrics[SAMPLER_METRICS];
+};
@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// StreamClock.cpp
+// Tracks the timestamps of one stream.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "StreamClock.h"
+
+StreamClock::StreamClock()
+    : m_uGaps(0)
+    , m_uRewinds(0)
+{
+    Reset();
+}
+
+void StreamClock::Reset()
+{
+    m_bValid = FALSE;
+    m_uLastDts = 0;
+    m_uNextDts = 0;
+    m_uTime = 0;
+}
+
+BOOL StreamClock::Update(UINT64 uDts, UINT64 uPts, UINT64 uDuration)
+{
+    BOOL bDiscontinuity = FALSE;
+
+    if (m_bValid)
+    {
+        if (uDts < m_uLastDts)
+        {
+            ++m_uRewinds;
+            bDiscontinuity = TRUE;
+        }
+        else if (uDts > m_uNextDts + CLOCK_GAP_THRESHOLD)
+        {
+            ++m_uGaps;
+            bDiscontinuity = TRUE;
+        }
+    }
+
+    // The clock restarts at a discontinuity.
+    if (!m_bValid || bDiscontinuity || uPts + uDuration > m_uTime)
+    {
+        m_uTime = uPts + uDuration;
+    }
+
+    m_bValid = TRUE;
+    m_uLastDts = uDts;
+    m_uNextDts = uDts + uDuration;
+
+    return bDiscontinuity;
+}
+
+void StreamClock::Advance(UINT64 uPts, UINT64 uDuration)
+{
+    if (!m_bValid || uPts + uDuration > m_uTime)
+    {
+        m_uTime = uPts + uDuration;
+    }
+    m_bValid = TRUE;
+    m_uLastDts = uPts;
+    m_uNextDts = uPts + uDuration;
+}
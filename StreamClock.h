@@ -0,0 +1,55 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// StreamClock.h
+// Tracks the timestamps of one stream.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+const UINT64 CLOCK_GAP_THRESHOLD = 5000000;             // 500 ms, in 100-nanosecond units
+
+//-------------------------------------------------------------------
+// StreamClock class
+//
+// Follows the decode and presentation timestamps of the samples read
+// for one stream. A decode timestamp going backwards, or jumping past
+// the end of the previous sample by more than CLOCK_GAP_THRESHOLD, is
+// a discontinuity.
+//
+// Time() is the end of the latest sample in presentation order, so it
+// does not step back on reordered video frames.
+//-------------------------------------------------------------------
+
+class StreamClock
+{
+public:
+    StreamClock();
+
+    // Forgets the timestamps, after a seek. The counters are kept.
+    void    Reset();
+
+    // Accounts a sample read from the runtime. Returns TRUE if the
+    // sample is discontinuous with the previous one.
+    BOOL    Update(UINT64 uDts, UINT64 uPts, UINT64 uDuration);
+
+    // Accounts a replayed sample, without checking the timestamps.
+    void    Advance(UINT64 uPts, UINT64 uDuration);
+
+    BOOL    IsValid() const { return m_bValid; }
+    UINT64  Time() const { return m_uTime; }
+
+    UINT32  Gaps() const { return m_uGaps; }
+    UINT32  Rewinds() const { return m_uRewinds; }
+
+private:
+    BOOL    m_bValid;
+    UINT64  m_uLastDts;
+    UINT64  m_uNextDts;             // Expected decode time of the next sample
+    UINT64  m_uTime;
+
+    UINT32  m_uGaps;
+    UINT32  m_uRewinds;
+};
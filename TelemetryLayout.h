@@ -0,0 +1,143 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// TelemetryLayout.h
+// Layout of the shared-memory telemetry of a media source.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+#include <stddef.h>
+#include <string.h>
+
+//-------------------------------------------------------------------
+// Telemetry segment
+//
+// A TelemetryHeader followed by TelemetryData, in a named file mapping
+// that the source writes and monitoring tools read. The source writes
+// it under its lock; readers never take it, and never block the
+// source.
+//
+// The sequence is odd while the data is written. A reader copies the
+// data between two reads of an even sequence, and retries if it moved;
+// TelemetryRead does this.
+//
+// The layout is fixed: fields are only appended to TelemetryData, and
+// cbData grows with them. A reader checks the magic and version, and
+// reads the prefix it knows. TELEMETRY_VERSION changes only when an
+// existing field changes. The asserts below keep the offsets stable,
+// whatever the compiler and platform of the reader.
+//-------------------------------------------------------------------
+
+const UINT32 TELEMETRY_MAGIC = 0x4d545050;     // "PPTM"
+const UINT32 TELEMETRY_VERSION = 1;
+const DWORD TELEMETRY_MAX_STREAMS = 8;
+
+struct TelemetryStream
+{
+    UINT32  uQueuedSamples;
+    UINT32  uQueuedTime;            // Milliseconds
+    UINT32  uDropped;               // Samples dropped from the queue
+    UINT32  bActive;
+};
+
+struct TelemetryData
+{
+    UINT64  uTick;                  // Tick count of the update, milliseconds
+    UINT32  uState;                 // SourceState
+    UINT32  bBuffering;
+    UINT32  uBufferTime;            // Milliseconds buffered in the runtime
+    UINT32  uBufferPercent;         // Progress while buffering
+    UINT32  uDownloadSpeed;         // Bytes per second
+    UINT32  uConnectionStatus;
+    UINT64  uBytesReceived;
+    UINT32  uStalls;                // Buffering events since the source was created
+    UINT32  uDropped;               // Samples dropped from all queues
+    UINT32  uOpQueueDepth;          // Operations queued, not dispatched
+    UINT32  cStreams;
+    TelemetryStream streams[TELEMETRY_MAX_STREAMS];
+};
+
+struct TelemetryHeader
+{
+    UINT32          uMagic;
+    UINT16          uVersion;
+    UINT16          cbData;
+    UINT32 volatile uSequence;
+    UINT32          uReserved;
+    TelemetryData   data;
+};
+
+static_assert(sizeof(TelemetryStream) == 16, "TelemetryStream layout");
+static_assert(offsetof(TelemetryData, uState) == 8, "TelemetryData layout");
+static_assert(offsetof(TelemetryData, uBytesReceived) == 32, "TelemetryData layout");
+static_assert(offsetof(TelemetryData, streams) == 56, "TelemetryData layout");
+static_assert(sizeof(TelemetryData) == 184, "TelemetryData layout");
+static_assert(offsetof(TelemetryHeader, data) == 16, "TelemetryHeader layout");
+
+#if defined(_MSC_VER)
+#define TELEMETRY_FENCE() MemoryBarrier()
+#else
+#define TELEMETRY_FENCE() __sync_synchronize()
+#endif
+
+//-------------------------------------------------------------------
+// TelemetryInit / TelemetryWrite
+// The writer side, for a single writer. The magic is written last, so
+// a reader never takes a half initialized header for a valid one.
+//-------------------------------------------------------------------
+
+inline void TelemetryInit(TelemetryHeader *pHeader)
+{
+    memset(pHeader, 0, sizeof(TelemetryHeader));
+    pHeader->uVersion = TELEMETRY_VERSION;
+    pHeader->cbData = sizeof(TelemetryData);
+    TELEMETRY_FENCE();
+    pHeader->uMagic = TELEMETRY_MAGIC;
+}
+
+inline void TelemetryWrite(TelemetryHeader *pHeader, TelemetryData const *pData)
+{
+    UINT32 uSequence = pHeader->uSequence;
+    pHeader->uSequence = uSequence + 1;
+    TELEMETRY_FENCE();
+    memcpy(&pHeader->data, pData, sizeof(TelemetryData));
+    TELEMETRY_FENCE();
+    pHeader->uSequence = uSequence + 2;
+}
+
+//-------------------------------------------------------------------
+// TelemetryRead
+// Copies a consistent snapshot of the data. Returns FALSE if the
+// segment is not a telemetry segment of this version, or if it was
+// written during every retry.
+//-------------------------------------------------------------------
+
+inline BOOL TelemetryRead(TelemetryHeader const volatile *pHeader, TelemetryData *pData, DWORD cRetries)
+{
+    if (pHeader->uMagic != TELEMETRY_MAGIC
+        || pHeader->uVersion != TELEMETRY_VERSION
+        || pHeader->cbData < sizeof(TelemetryData))
+    {
+        return FALSE;
+    }
+
+    for (DWORD i = 0; i < cRetries; ++i)
+    {
+        UINT32 uSequence = pHeader->uSequence;
+        if (uSequence & 1)
+        {
+            continue;
+        }
+        TELEMETRY_FENCE();
+        memcpy(pData, (void const *)&pHeader->data, sizeof(TelemetryData));
+        TELEMETRY_FENCE();
+        if (pHeader->uSequence == uSequence)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
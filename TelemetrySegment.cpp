@@ -0,0 +1,78 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// TelemetrySegment.cpp
+// Publishes the telemetry of a media source in shared memory.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "TelemetrySegment.h"
+#include "Trace.h"
+
+TelemetrySegment::TelemetrySegment()
+    : m_hMapping(NULL)
+    , m_pHeader(NULL)
+{
+}
+
+TelemetrySegment::~TelemetrySegment()
+{
+    Close();
+}
+
+HRESULT TelemetrySegment::Open(LPCWSTR pszName)
+{
+    HRESULT hr = S_OK;
+
+    Close();
+
+    m_hMapping = CreateFileMappingFromApp(
+        INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, sizeof(TelemetryHeader), pszName);
+    if (m_hMapping == NULL)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_pHeader = (TelemetryHeader *)MapViewOfFileFromApp(
+            m_hMapping, FILE_MAP_WRITE, 0, sizeof(TelemetryHeader));
+        if (m_pHeader == NULL)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        TelemetryInit(m_pHeader);
+    }
+
+    if (FAILED(hr))
+    {
+        Close();
+    }
+    TRACEHR_RET(hr);
+}
+
+void TelemetrySegment::Close()
+{
+    if (m_pHeader)
+    {
+        UnmapViewOfFile(m_pHeader);
+        m_pHeader = NULL;
+    }
+    if (m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+}
+
+void TelemetrySegment::Publish(TelemetryData const & data)
+{
+    if (m_pHeader)
+    {
+        TelemetryWrite(m_pHeader, &data);
+    }
+}
@@ -0,0 +1,41 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// TelemetrySegment.h
+// Publishes the telemetry of a media source in shared memory.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <windows.h>
+
+#include "TelemetryLayout.h"
+
+const DWORD TELEMETRY_INTERVAL = 100;           // Milliseconds between updates
+
+//-------------------------------------------------------------------
+// TelemetrySegment class
+//
+// Owns the file mapping of the segment. There is one writer, the
+// source, so Publish only needs the sequence to order the readers.
+//-------------------------------------------------------------------
+
+class TelemetrySegment
+{
+public:
+    TelemetrySegment();
+    ~TelemetrySegment();
+
+    // pszName: Name of the file mapping, for example
+    // Local\PpboxTelemetry.
+    HRESULT Open(LPCWSTR pszName);
+    void    Close();
+
+    BOOL    IsOpen() const { return m_pHeader != NULL; }
+
+    void    Publish(TelemetryData const & data);
+
+private:
+    HANDLE              m_hMapping;
+    TelemetryHeader     *m_pHeader;
+};
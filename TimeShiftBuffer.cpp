@@ -0,0 +1,218 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// TimeShiftBuffer.cpp
+// Keeps the recent samples of a live session, so it can be seeked.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "TimeShiftBuffer.h"
+#include "SafeRelease.h"
+
+TimeShiftBuffer::TimeShiftBuffer()
+    : m_uWindow(0)
+    , m_uBudget(TIMESHIFT_DEFAULT_BUDGET)
+    , m_uBytes(0)
+    , m_uCursor(0)
+{
+}
+
+TimeShiftBuffer::~TimeShiftBuffer()
+{
+    Clear();
+}
+
+void TimeShiftBuffer::Clear()
+{
+    while (!m_Entries.empty())
+    {
+        PopFront();
+    }
+    m_uCursor = 0;
+}
+
+void TimeShiftBuffer::PopFront()
+{
+    Entry & entry = m_Entries.front();
+    m_uBytes -= entry.cbSize;
+    SafeRelease(&entry.pSample);
+    m_Entries.pop_front();
+    if (m_uCursor > 0)
+    {
+        --m_uCursor;
+    }
+}
+
+HRESULT TimeShiftBuffer::Push(DWORD dwStream, IMFSample *pSample, UINT64 uTime, BOOL bKey, UINT32 cbSize)
+{
+    IMFSample *pCopy = NULL;
+
+    HRESULT hr = CopySample(pSample, &pCopy);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    Entry entry = {dwStream, pCopy, uTime, bKey, cbSize};
+
+    BOOL bLive = !IsReplaying();
+
+    try
+    {
+        m_Entries.push_back(entry);
+    }
+    catch (std::bad_alloc const &)
+    {
+        SafeRelease(&pCopy);
+        return E_OUTOFMEMORY;
+    }
+    m_uBytes += cbSize;
+    if (bLive)
+    {
+        m_uCursor = m_Entries.size();
+    }
+
+    // Evict from the front. The replay cursor is moved along when the
+    // sample under it is evicted.
+    while (m_Entries.size() > 1
+        && (m_uBytes > m_uBudget || uTime > m_Entries.front().uTime + m_uWindow))
+    {
+        PopFront();
+    }
+
+    return S_OK;
+}
+
+HRESULT TimeShiftBuffer::Seek(UINT64 uTime, UINT64 *puTime)
+{
+    if (m_Entries.empty() || uTime > m_Entries.back().uTime)
+    {
+        // Back to the live edge.
+        m_uCursor = m_Entries.size();
+        *puTime = m_Entries.empty() ? uTime : m_Entries.back().uTime;
+        return S_OK;
+    }
+
+    size_t uKey = m_Entries.size();
+    for (size_t i = 0; i < m_Entries.size(); ++i)
+    {
+        if (m_Entries[i].bKey)
+        {
+            if (m_Entries[i].uTime > uTime && uKey != m_Entries.size())
+            {
+                break;
+            }
+            uKey = i;
+        }
+    }
+
+    if (uKey == m_Entries.size())
+    {
+        // No key frame in the window yet.
+        return MF_E_OUT_OF_RANGE;
+    }
+
+    m_uCursor = uKey;
+    *puTime = m_Entries[uKey].uTime;
+    return S_OK;
+}
+
+// Creates a sample with the attributes, buffers, time and duration of
+// pSample. The buffers are shared, not copied.
+
+HRESULT TimeShiftBuffer::CopySample(IMFSample *pSample, IMFSample **ppCopy)
+{
+    HRESULT hr = S_OK;
+    IMFSample *pCopy = NULL;
+    IMFMediaBuffer *pBuffer = NULL;
+    DWORD cBuffers = 0;
+    LONGLONG llTime = 0;
+    LONGLONG llDuration = 0;
+
+    hr = MFCreateSample(&pCopy);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pSample->CopyAllItems(pCopy);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = pSample->GetBufferCount(&cBuffers);
+    }
+    for (DWORD i = 0; SUCCEEDED(hr) && i < cBuffers; ++i)
+    {
+        hr = pSample->GetBufferByIndex(i, &pBuffer);
+        if (SUCCEEDED(hr))
+        {
+            hr = pCopy->AddBuffer(pBuffer);
+        }
+        SafeRelease(&pBuffer);
+    }
+    if (SUCCEEDED(hr) && SUCCEEDED(pSample->GetSampleTime(&llTime)))
+    {
+        hr = pCopy->SetSampleTime(llTime);
+    }
+    if (SUCCEEDED(hr) && SUCCEEDED(pSample->GetSampleDuration(&llDuration)))
+    {
+        hr = pCopy->SetSampleDuration(llDuration);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        *ppCopy = pCopy;
+        (*ppCopy)->AddRef();
+    }
+
+    SafeRelease(&pCopy);
+    return hr;
+}
+
+HRESULT TimeShiftBuffer::Pop(DWORD *pdwStream, IMFSample **ppSample)
+{
+    if (!IsReplaying())
+    {
+        return MF_E_END_OF_STREAM;
+    }
+
+    Entry const & entry = m_Entries[m_uCursor];
+
+    HRESULT hr = S_OK;
+    IMFSample *pSample = NULL;
+
+    hr = CopySample(entry.pSample, &pSample);
+
+    // The request token belongs to the first delivery.
+    if (SUCCEEDED(hr))
+    {
+        (void)pSample->DeleteItem(MFSampleExtension_Token);
+        hr = pSample->SetSampleTime(entry.uTime);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        *pdwStream = entry.dwStream;
+        *ppSample = pSample;
+        (*ppSample)->AddRef();
+        ++m_uCursor;
+    }
+
+    SafeRelease(&pSample);
+    return hr;
+}
+
+UINT64 TimeShiftBuffer::Start() const
+{
+    for (size_t i = 0; i < m_Entries.size(); ++i)
+    {
+        if (m_Entries[i].bKey)
+        {
+            return m_Entries[i].uTime;
+        }
+    }
+    return End();
+}
+
+UINT64 TimeShiftBuffer::End() const
+{
+    return m_Entries.empty() ? 0 : m_Entries.back().uTime;
+}
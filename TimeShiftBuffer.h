@@ -0,0 +1,89 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// TimeShiftBuffer.h
+// Keeps the recent samples of a live session, so it can be seeked.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <windows.h>
+#include <mfobjects.h>
+
+#include <deque>
+
+const UINT64 TIMESHIFT_DEFAULT_BUDGET = 64 * 1024 * 1024;   // Default memory budget, in bytes.
+
+//-------------------------------------------------------------------
+// TimeShiftBuffer class
+//
+// A ring of the samples delivered during the last N seconds of a live
+// session, bounded by a byte budget. After a seek inside the window,
+// the samples are replayed from the ring while new ones keep being
+// appended, so playback stays the seeked distance behind the live edge
+// until the application seeks back to the end.
+//
+// The source holds its critical section while using this object.
+//-------------------------------------------------------------------
+
+class TimeShiftBuffer
+{
+public:
+    TimeShiftBuffer();
+    ~TimeShiftBuffer();
+
+    // uWindow: Window in seconds, 0 disables time shifting.
+    void    SetWindow(UINT32 uWindow) { m_uWindow = (UINT64)uWindow * 10000000; }
+    void    SetBudget(UINT64 uBudget) { m_uBudget = uBudget; }
+
+    BOOL    IsEnabled() const { return m_uWindow != 0; }
+    BOOL    IsReplaying() const { return m_uCursor < m_Entries.size(); }
+
+    // Appends a copy of the sample that shares its buffers, evicting the
+    // oldest ones beyond the window or the budget. Later changes to the
+    // attributes of pSample, once delivered, do not reach the copy.
+    //
+    // bKey:    The sample is a random access point of the seek stream.
+    HRESULT Push(DWORD dwStream, IMFSample *pSample, UINT64 uTime, BOOL bKey, UINT32 cbSize);
+
+    // Moves the replay cursor to the last key sample at or before uTime.
+    // Seeking after the newest sample returns to the live edge.
+    //
+    // puTime:  Receives the actual start position.
+    HRESULT Seek(UINT64 uTime, UINT64 *puTime);
+
+    // Takes the sample under the replay cursor.
+    //
+    // ppSample receives a copy of the sample that shares its buffers.
+    HRESULT Pop(DWORD *pdwStream, IMFSample **ppSample);
+
+    void    Clear();
+
+    // Seekable range, in 100-nanosecond units.
+    UINT64  Start() const;
+    UINT64  End() const;
+
+    UINT64  Bytes() const { return m_uBytes; }
+
+private:
+    struct Entry
+    {
+        DWORD       dwStream;
+        IMFSample   *pSample;
+        UINT64      uTime;
+        BOOL        bKey;
+        UINT32      cbSize;
+    };
+
+    void    PopFront();
+
+    static HRESULT CopySample(IMFSample *pSample, IMFSample **ppCopy);
+
+private:
+    UINT64              m_uWindow;      // 100-nanosecond units
+    UINT64              m_uBudget;
+    UINT64              m_uBytes;
+
+    std::deque<Entry>   m_Entries;
+    size_t              m_uCursor;      // Next entry to replay, size() when live
+};
@@ -0,0 +1,11 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// TraceGate.cpp
+// Trace macros for the sample path, gated at compile time and run time.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "TraceGate.h"
+
+int TraceGate::s_iLevel = PPBOX_TRACE_LEVEL;
@@ -0,0 +1,77 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// TraceGate.h
+// Trace macros for the sample path, gated at compile time and run time.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Trace.h"
+
+//-------------------------------------------------------------------
+// TRACE and TRACEHR_RET evaluate their arguments, and format, before
+// the trace level is checked. On the sample path, which runs for every
+// sample, the macros below are used instead:
+//
+//   TRACE_HOT(level, format, ...)
+//   TRACE_HOT_SAMPLED(level, interval, format, ...)
+//                              Traces one call in interval
+//   TRACEHR_HOT_RET(hr)        Returns hr, traces it if it failed
+//
+// A level above PPBOX_TRACE_LEVEL is compiled out: the condition is a
+// constant, and no code is generated. Define PPBOX_TRACE_LEVEL in the
+// build, -1 removes them all. Other levels are checked against the run
+// time level, one load and one predictable branch, before any argument
+// is evaluated. The run time level is set with the TraceLevel option of
+// the source, and does not replace the filtering done by TRACE itself.
+//
+// The sampling counter of each call site is not synchronized: a count
+// lost to a race only moves the next trace.
+//-------------------------------------------------------------------
+
+#ifndef PPBOX_TRACE_LEVEL
+#define PPBOX_TRACE_LEVEL   3
+#endif
+
+class TraceGate
+{
+public:
+    static void SetLevel(int iLevel) { s_iLevel = iLevel; }
+
+    // Read by the macros.
+    static int  s_iLevel;
+};
+
+#define TRACE_HOT_ON(level) \
+    ((level) <= PPBOX_TRACE_LEVEL && (level) <= TraceGate::s_iLevel)
+
+#define TRACE_HOT(level, ...) \
+    do { \
+        if (TRACE_HOT_ON(level)) \
+        { \
+            TRACE(level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define TRACE_HOT_SAMPLED(level, interval, ...) \
+    do { \
+        if (TRACE_HOT_ON(level)) \
+        { \
+            static UINT32 s_uTraceCalls = 0; \
+            if (s_uTraceCalls++ % (interval) == 0) \
+            { \
+                TRACE(level, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+#define TRACEHR_HOT_RET(hr) \
+    do { \
+        HRESULT hrTrace_ = (hr); \
+        if (FAILED(hrTrace_) && TRACE_HOT_ON(1)) \
+        { \
+            TRACE(1, L"%S failed, hr = 0x%08X\r\n", __FUNCTION__, hrTrace_); \
+        } \
+        return hrTrace_; \
+    } while (0)
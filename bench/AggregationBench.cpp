@@ -0,0 +1,234 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// AggregationBench.cpp
+// Compares the events and the CPU of the audio path of the source with
+// and without SampleAggregator, against the fake runtime.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "FakeJustRuntime.h"
+#include "SampleAggregator.h"
+#include "SampleQueue.h"
+#include "PpboxMediaType.h"
+#include "SafeRelease.h"
+
+#include <benchmark/benchmark.h>
+
+#include <deque>
+#include <vector>
+
+static PP_uint const AUDIO_TRACK = 1;
+
+static void OnOpen(PP_context user, PP_err err)
+{
+    *(PP_err *)user = err;
+}
+
+//-------------------------------------------------------------------
+// AudioPath
+//
+// What the source does for each audio frame: a sample with a copy of
+// the payload, from CreateSample of PpboxMediaType.cpp, then
+// PpboxMediaStream::DeliverPayload, which gives it to the aggregator
+// and queues what comes out on its SampleQueue. Each sample queued
+// costs an MEMediaSample
+// event and a request round trip through the op queue; here an event
+// is a locked queue of AddRef'd samples, drained as the pipeline does,
+// and a request a heap allocated op through another one.
+//-------------------------------------------------------------------
+
+class AudioPath
+{
+public:
+    AudioPath(UINT32 uMaxFrames, UINT32 uMaxLatencyMs)
+        : m_uEvents(0)
+    {
+        InitializeCriticalSectionEx(&m_critSec, 1000, 0);
+        m_Aggregator.SetLimits(uMaxFrames, uMaxLatencyMs);
+    }
+
+    ~AudioPath()
+    {
+        Drain();
+        DeleteCriticalSection(&m_critSec);
+    }
+
+    HRESULT Deliver(JUST_Sample const & sample)
+    {
+        IMFSample *pSample = NULL;
+        IMFSample *pReady = NULL;
+
+        HRESULT hr = CreateSample(sample, &pSample);
+
+        if (SUCCEEDED(hr) && m_Aggregator.IsEnabled())
+        {
+            hr = m_Aggregator.Add(pSample, &pReady);
+            SafeRelease(&pSample);
+            pSample = pReady;
+        }
+        if (SUCCEEDED(hr) && pSample)
+        {
+            Queue(pSample);
+        }
+
+        SafeRelease(&pSample);
+        return hr;
+    }
+
+    // As FlushAggregate, at the end of the stream.
+    void Flush()
+    {
+        IMFSample *pReady = NULL;
+        m_Aggregator.Flush(&pReady);
+        if (pReady)
+        {
+            Queue(pReady);
+        }
+        SafeRelease(&pReady);
+        Drain();
+    }
+
+    UINT64 Events() const { return m_uEvents; }
+    UINT32 Merged() const { return m_Aggregator.Merged(); }
+
+private:
+    struct Request
+    {
+        UINT64  uToken;
+    };
+
+    // Queues the sample on the stream, and dispatches it to the next
+    // request.
+    void Queue(IMFSample *pSample)
+    {
+        if (FAILED(m_Samples.Push(pSample)))
+        {
+            return;
+        }
+
+        Request *pRequest = new Request();
+        EnterCriticalSection(&m_critSec);
+        pRequest->uToken = m_uEvents;
+        m_Requests.push_back(pRequest);
+        pRequest = m_Requests.front();
+        m_Requests.pop_front();
+        (void)m_Samples.Pop(&pSample);
+        m_Events.push_back(pSample);
+        ++m_uEvents;
+        LeaveCriticalSection(&m_critSec);
+        delete pRequest;
+
+        if (m_Events.size() >= 8)
+        {
+            Drain();
+        }
+    }
+
+    void Drain()
+    {
+        EnterCriticalSection(&m_critSec);
+        while (!m_Events.empty())
+        {
+            m_Events.front()->Release();
+            m_Events.pop_front();
+        }
+        LeaveCriticalSection(&m_critSec);
+    }
+
+private:
+    SampleAggregator        m_Aggregator;
+    SampleQueue             m_Samples;
+    CRITICAL_SECTION        m_critSec;
+    std::deque<IMFSample *> m_Events;
+    std::deque<Request *>   m_Requests;
+    UINT64                  m_uEvents;
+};
+
+//-------------------------------------------------------------------
+// ReadAudio
+// Reads the audio frames of the script from the fake runtime, with a
+// copy of their payloads, so the timing only covers the source.
+//-------------------------------------------------------------------
+
+static BOOL ReadAudio(FakeJustScript const & script, std::vector<JUST_Sample> * frames, std::vector<BYTE> * payloads)
+{
+    FakeJust_Load(script);
+    PP_err err = -1;
+    JUST_AsyncOpenEx("fake", "", &err, OnOpen);
+    FakeJust_Advance(0);
+    FakeJust_Advance(script.uDuration);
+    if (err != just_success)
+    {
+        return FALSE;
+    }
+
+    std::vector<size_t> offsets;
+    JUST_Sample sample;
+    while (JUST_ReadSample(&sample) == just_success)
+    {
+        if (sample.itrack == AUDIO_TRACK)
+        {
+            offsets.push_back(payloads->size());
+            payloads->insert(payloads->end(), sample.buffer, sample.buffer + sample.size);
+            frames->push_back(sample);
+        }
+    }
+    for (size_t i = 0; i < frames->size(); ++i)
+    {
+        (*frames)[i].buffer = &(*payloads)[offsets[i]];
+    }
+    JUST_Close();
+    return TRUE;
+}
+
+//-------------------------------------------------------------------
+// BM_AudioAggregation
+// Delivers the audio frames of 60 s of content, about 23 ms each,
+// aggregated up to range(0) frames and range(1) milliseconds; 1 frame
+// is the path without aggregation.
+//-------------------------------------------------------------------
+
+static void BM_AudioAggregation(benchmark::State & state)
+{
+    FakeJustScript script;
+    FakeJust_Load(script);
+    script.speeds[0].uBytesPerSecond = FakeJust_ContentRate() * 10;
+
+    std::vector<JUST_Sample> frames;
+    std::vector<BYTE> payloads;
+    if (!ReadAudio(script, &frames, &payloads))
+    {
+        state.SkipWithError("open failed");
+        return;
+    }
+
+    UINT64 cEvents = 0;
+    UINT32 cMerged = 0;
+    for (auto _ : state)
+    {
+        AudioPath path((UINT32)state.range(0), (UINT32)state.range(1));
+        for (size_t i = 0; i < frames.size(); ++i)
+        {
+            (void)path.Deliver(frames[i]);
+        }
+        path.Flush();
+        cEvents += path.Events();
+        cMerged = path.Merged();
+    }
+
+    UINT64 cFrames = (UINT64)frames.size() * state.iterations();
+    double fSeconds = (double)script.uDuration / 1000 * state.iterations();
+    state.SetItemsProcessed(cFrames);
+    state.counters["events_per_s"] = (double)cEvents / fSeconds;
+    state.counters["frames_per_event"] = cEvents ? (double)cFrames / cEvents : 0;
+    state.counters["merged"] = cMerged;
+}
+BENCHMARK(BM_AudioAggregation)
+    ->Args({1, 100})
+    ->Args({4, 100})
+    ->Args({8, 100})
+    ->Args({16, 400})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
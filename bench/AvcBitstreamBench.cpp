@@ -0,0 +1,144 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// AvcBitstreamBench.cpp
+// Measures the throughput of the start code scan for each instruction
+// set, and of the rewriting of access units.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "AvcBitstreamVariants.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+static UINT32 const ACCESS_UNIT_SIZE = 256 * 1024;
+static UINT32 const SLICE_COUNT = 8;
+
+static BYTE const s_Sps[] = {0x67, 0x42, 0xc0, 0x1e, 0xd9, 0x00, 0xa0, 0x47, 0xfe, 0xc8};
+static BYTE const s_Pps[] = {0x68, 0xce, 0x3c, 0x80};
+
+//-------------------------------------------------------------------
+// MakeAccessUnit
+// SLICE_COUNT slices of random payload, escaped as an encoder does,
+// with one zero byte in uZeroEvery on average. Slice data has few
+// zeros; headers and CAVLC streams have more.
+//-------------------------------------------------------------------
+
+static std::vector<BYTE> MakeAccessUnit(UINT32 uZeroEvery, BOOL bAnnexB)
+{
+    std::vector<BYTE> data;
+    UINT32 uSeed = uZeroEvery;
+    UINT32 cbSlice = ACCESS_UNIT_SIZE / SLICE_COUNT;
+    for (UINT32 iSlice = 0; iSlice < SLICE_COUNT; ++iSlice)
+    {
+        std::vector<BYTE> nal;
+        nal.push_back(iSlice == 0 ? 0x65 : 0x41);
+        UINT32 cZeros = 0;
+        while (nal.size() < cbSlice)
+        {
+            uSeed = uSeed * 1103515245 + 12345;
+            BYTE b = (uSeed >> 16) % uZeroEvery == 0 ? 0 : (BYTE)((uSeed >> 24) | 1);
+            if (cZeros == 2 && b <= 3)
+            {
+                nal.push_back(3);
+                cZeros = 0;
+            }
+            nal.push_back(b);
+            cZeros = b == 0 ? cZeros + 1 : 0;
+        }
+        nal.back() = 0x80;
+
+        UINT32 cbNal = (UINT32)nal.size();
+        BYTE prefix[4] = {0, 0, 0, 1};
+        if (!bAnnexB)
+        {
+            prefix[0] = (BYTE)(cbNal >> 24);
+            prefix[1] = (BYTE)(cbNal >> 16);
+            prefix[2] = (BYTE)(cbNal >> 8);
+            prefix[3] = (BYTE)cbNal;
+        }
+        data.insert(data.end(), prefix, prefix + 4);
+        data.insert(data.end(), nal.begin(), nal.end());
+    }
+    return data;
+}
+
+// Finds every start code of an Annex B access unit, as SplitAnnexB
+// does.
+static void BM_AvcFindStartCode(benchmark::State & state, AvcFindStartCodeScan pfnFind)
+{
+    std::vector<BYTE> data = MakeAccessUnit((UINT32)state.range(0), TRUE);
+    UINT32 cbData = (UINT32)data.size();
+    for (auto _ : state)
+    {
+        UINT32 cFound = 0;
+        for (UINT32 i = pfnFind(&data[0], cbData, 0); i < cbData; i = pfnFind(&data[0], cbData, i + 3))
+        {
+            ++cFound;
+        }
+        benchmark::DoNotOptimize(cFound);
+    }
+    state.SetBytesProcessed((int64_t)state.iterations() * cbData);
+}
+
+static void BM_AvcRewrite(benchmark::State & state, BOOL bAnnexB)
+{
+    std::vector<BYTE> config;
+    BYTE const start[4] = {0, 0, 0, 1};
+    config.insert(config.end(), start, start + 4);
+    config.insert(config.end(), s_Sps, s_Sps + sizeof(s_Sps));
+    config.insert(config.end(), start, start + 4);
+    config.insert(config.end(), s_Pps, s_Pps + sizeof(s_Pps));
+
+    AvcRewriter_Sse2 rewriter;
+    if (bAnnexB)
+    {
+        rewriter.SetCodecPrivate(&config[0], (UINT32)config.size());
+    }
+    else
+    {
+        // avcC with 4-byte lengths.
+        BYTE const avcC[] = {1, 0x42, 0xc0, 0x1e, 0xff, 0xe1, 0, sizeof(s_Sps),
+            0x67, 0x42, 0xc0, 0x1e, 0xd9, 0x00, 0xa0, 0x47, 0xfe, 0xc8,
+            1, 0, sizeof(s_Pps), 0x68, 0xce, 0x3c, 0x80};
+        rewriter.SetCodecPrivate(avcC, sizeof(avcC));
+    }
+    rewriter.SetOutputFormat(AVC_FORMAT_ANNEXB);
+    rewriter.SetInsertParameterSets(TRUE);
+
+    std::vector<BYTE> data = MakeAccessUnit((UINT32)state.range(0), bAnnexB);
+    for (auto _ : state)
+    {
+        if (rewriter.Rewrite(&data[0], (UINT32)data.size(), TRUE) != S_OK)
+        {
+            state.SkipWithError("Rewrite did not rewrite");
+            break;
+        }
+        benchmark::DoNotOptimize(rewriter.Output());
+    }
+    state.SetBytesProcessed((int64_t)state.iterations() * data.size());
+}
+
+int main(int argc, char ** argv)
+{
+    AvcScanVariant variants[3];
+    int cVariants = AvcScanVariants(variants);
+    for (int i = 0; i < cVariants; ++i)
+    {
+        benchmark::RegisterBenchmark(
+            ("BM_AvcFindStartCode/" + std::string(variants[i].pszName)).c_str(),
+            BM_AvcFindStartCode, variants[i].pfnFind)->Arg(256)->Arg(16);
+    }
+    benchmark::RegisterBenchmark("BM_AvcRewrite/AvccToAnnexB", BM_AvcRewrite, FALSE)->Arg(256)->Arg(16);
+    benchmark::RegisterBenchmark("BM_AvcRewrite/AnnexBInsert", BM_AvcRewrite, TRUE)->Arg(256)->Arg(16);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -0,0 +1,45 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// AvcBitstreamVariants.h
+// The AVC bitstream helpers, built once per instruction set for the
+// benchmark and the test. The AVX2 build is the one of the plug-in,
+// which only takes the AVX2 scan where the processor has it.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#define AvcIsDisposable AvcIsDisposable_Sse2
+#define AvcFindStartCode AvcFindStartCode_Sse2
+#define AvcRewriter AvcRewriter_Sse2
+#include "AvcBitstream.h"
+#undef AvcIsDisposable
+#undef AvcFindStartCode
+#undef AvcRewriter
+
+UINT32 AvcFindStartCode_Scalar(BYTE const * pData, UINT32 cbData, UINT32 uOffset);
+UINT32 AvcFindStartCode_Avx2(BYTE const * pData, UINT32 cbData, UINT32 uOffset);
+
+typedef UINT32 (* AvcFindStartCodeScan)(BYTE const *, UINT32, UINT32);
+
+struct AvcScanVariant
+{
+    char const *            pszName;
+    AvcFindStartCodeScan    pfnFind;
+};
+
+// The variants the processor runs, the scalar one first.
+inline int AvcScanVariants(AvcScanVariant * pVariants)
+{
+    int c = 0;
+    AvcScanVariant scalar = {"Scalar", AvcFindStartCode_Scalar};
+    AvcScanVariant sse2 = {"Sse2", AvcFindStartCode_Sse2};
+    AvcScanVariant avx2 = {"Avx2", AvcFindStartCode_Avx2};
+    pVariants[c++] = scalar;
+    pVariants[c++] = sse2;
+    if (__builtin_cpu_supports("avx2"))
+    {
+        pVariants[c++] = avx2;
+    }
+    return c;
+}
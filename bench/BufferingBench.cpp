@@ -0,0 +1,135 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// BufferingBench.cpp
+// Compares the CPU a rebuffer takes when the source spins on the
+// progress, as DeliverPayload did, and when BufferingController paces
+// the checks on the runtime timer.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "FakeJustRuntime.h"
+
+#include "BufferingController.h"
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+
+static UINT32 const BUFFER_TARGET = 250;        // Milliseconds of content that read as 100 percent
+
+//-------------------------------------------------------------------
+// OpenRebuffer
+// Opens a session that starts empty. The download runs at the content
+// rate, so the buffer grows a millisecond per millisecond, except for
+// 100 ms without progress: the rebuffer lasts BUFFER_TARGET + 100 ms.
+//-------------------------------------------------------------------
+
+static void OnOpen(PP_context user, PP_err err)
+{
+    (void)user;
+    (void)err;
+}
+
+static void OpenRebuffer()
+{
+    FakeJustScript script;
+    script.uBufferTarget = BUFFER_TARGET;
+    FakeJust_Load(script);
+    UINT32 uRate = FakeJust_ContentRate();
+    script.speeds.clear();
+    FakeJustSpeed start = {0, uRate};
+    FakeJustSpeed stuck = {100, 0};
+    FakeJustSpeed resumed = {200, uRate};
+    script.speeds.push_back(start);
+    script.speeds.push_back(stuck);
+    script.speeds.push_back(resumed);
+    FakeJust_Load(script);
+    JUST_AsyncOpenEx("fake", "", NULL, OnOpen);
+    FakeJust_Advance(0);
+}
+
+//-------------------------------------------------------------------
+// BM_RebufferSpin
+// The loop DeliverPayload ran: check the progress again as soon as it
+// is below 100 percent. The fake clock follows the real one, so the
+// loop spins for as long as the rebuffer lasts.
+//-------------------------------------------------------------------
+
+static void BM_RebufferSpin(benchmark::State & state)
+{
+    UINT64 cChecks = 0;
+    for (auto _ : state)
+    {
+        OpenRebuffer();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        UINT64 uElapsed = 0;
+        JUST_PlayStatistic stat;
+        do
+        {
+            UINT64 uReal = (UINT64)std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            if (uReal > uElapsed)
+            {
+                FakeJust_Advance((UINT32)(uReal - uElapsed));
+                uElapsed = uReal;
+            }
+            ++cChecks;
+        } while (JUST_GetPlayStat(&stat) == just_success && stat.buffering_present < 100);
+        state.counters["rebuffer_ms"] = (double)FakeJust_Now();
+    }
+    state.counters["checks"] = benchmark::Counter((double)cChecks, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_RebufferSpin)->Unit(benchmark::kMillisecond);
+
+//-------------------------------------------------------------------
+// BM_RebufferTimer
+// CheckBuffering: one check per timer callback, at the delay the
+// controller gives. The thread is free between the callbacks, so the
+// CPU time is that of the checks alone.
+//-------------------------------------------------------------------
+
+struct TimerRebuffer
+{
+    BufferingController     buffering;
+    BOOL                    bDone;
+
+    static void OnTimer(PP_context user, PP_err err)
+    {
+        (void)err;
+        ((TimerRebuffer *)user)->Check();
+    }
+
+    void Check()
+    {
+        JUST_PlayStatistic stat;
+        bDone = JUST_GetPlayStat(&stat) == just_success
+            ? buffering.Check(FakeJust_Now(), stat.buffering_present)
+            : buffering.Fail(FakeJust_Now());
+        if (!bDone)
+        {
+            JUST_ScheduleCallback(buffering.NextDelay(), this, OnTimer);
+        }
+    }
+};
+
+static void BM_RebufferTimer(benchmark::State & state)
+{
+    UINT64 cChecks = 0;
+    for (auto _ : state)
+    {
+        OpenRebuffer();
+        TimerRebuffer rebuffer;
+        rebuffer.buffering.Start(FakeJust_Now());
+        rebuffer.Check();
+        while (!rebuffer.bDone)
+        {
+            FakeJust_Advance(rebuffer.buffering.NextDelay());
+        }
+        cChecks += rebuffer.buffering.Checks();
+        state.counters["rebuffer_ms"] = (double)FakeJust_Now();
+    }
+    state.counters["checks"] = benchmark::Counter((double)cChecks, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_RebufferTimer)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,343 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// DeliveryBench.cpp
+// Runs the delivery logic of the media source against the fake runtime,
+// and times the classes it is made of.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "FakeJustRuntime.h"
+#include "PpboxMediaType.h"
+#include "SampleQueue.h"
+#include "SampleAttributes.h"
+#include "SafeRelease.h"
+
+#include "RebufferPredictor.h"
+#include "BufferingController.h"
+#include "StreamClock.h"
+#include "InterleaveBalancer.h"
+#include "MemoryGovernor.h"
+#include "LatencyHistogram.h"
+
+#include <benchmark/benchmark.h>
+
+static UINT32 const PLAYBACK_STEP = 40;         // Milliseconds the renderer consumes at a time
+static UINT32 const STAT_PERIOD = 1000;         // Milliseconds between the statistics timers
+static UINT64 const READ_AHEAD = 10000000;      // Media time the streams queue, 100-nanosecond units
+
+//-------------------------------------------------------------------
+// DeliveryModel
+//
+// PpboxMediaSource::DeliverPayload and the controllers around it, over
+// the fake Media Foundation: the media types come from CreateMediaType,
+// each payload becomes a sample from CreateSample, and the samples wait
+// on the SampleQueue of their stream, under the interleave and memory
+// limits, until a renderer drains the queues in real time, as the fake
+// clock moves.
+//
+// The requests do not go through SourceOp and the op queue of the
+// source, which is the OpQueue template of the Common project, and the
+// samples are not sent as events, so the times leave out the
+// scheduling of the source and the Media Foundation pipeline.
+//-------------------------------------------------------------------
+
+class DeliveryModel
+{
+public:
+    DeliveryModel()
+        : m_uPosition(0)
+        , m_uNextStat(0)
+        , m_uSamples(0)
+        , m_uStalls(0)
+        , m_bEnded(FALSE)
+    {
+        m_pTypes[0] = NULL;
+        m_pTypes[1] = NULL;
+    }
+
+    ~DeliveryModel()
+    {
+        SafeRelease(&m_pTypes[0]);
+        SafeRelease(&m_pTypes[1]);
+    }
+
+    static void OnOpen(PP_context user, PP_err err)
+    {
+        (void)user;
+        (void)err;
+    }
+
+    HRESULT Open(FakeJustScript const & script)
+    {
+        HRESULT hr = S_OK;
+
+        FakeJust_Load(script);
+        JUST_AsyncOpenEx("fake", "", this, OnOpen);
+        FakeJust_Advance(0);
+
+        UINT32 uBitrate = 0;
+        for (PP_uint i = 0; SUCCEEDED(hr) && i < JUST_GetStreamCount() && i < 2; ++i)
+        {
+            JUST_StreamInfo info;
+            JUST_GetStreamInfo(i, &info);
+            uBitrate += info.bitrate;
+            hr = CreateMediaType(info, &m_pTypes[i]);
+        }
+        m_Predictor.SetBitrate(uBitrate);
+        m_Memory.SetBudget(4 * 1024 * 1024);
+        m_Buffering.Start(FakeJust_Now());
+        return hr;
+    }
+
+    // Runs the session to the end of the content.
+    void Run()
+    {
+        while (!m_bEnded)
+        {
+            if (m_Buffering.IsBuffering())
+            {
+                FakeJust_Advance(m_Buffering.NextDelay());
+                JUST_PlayStatistic stat;
+                if (JUST_GetPlayStat(&stat) == just_success)
+                {
+                    m_Buffering.Check(FakeJust_Now(), stat.buffering_present);
+                }
+                else
+                {
+                    m_Buffering.Fail(FakeJust_Now());
+                }
+            }
+            else if (QueuedAhead() < READ_AHEAD)
+            {
+                Read();
+            }
+            else
+            {
+                Play();
+            }
+            if (FakeJust_Now() >= m_uNextStat)
+            {
+                Sample();
+            }
+        }
+    }
+
+    UINT32 Samples() const { return m_uSamples; }
+    UINT32 Stalls() const { return m_uStalls; }
+    BufferingController const & Buffering() const { return m_Buffering; }
+    RebufferPredictor const & Predictor() const { return m_Predictor; }
+    MemoryGovernor const & Memory() const { return m_Memory; }
+    LatencyHistogram const & Latency() const { return m_Latency; }
+
+private:
+    void Read()
+    {
+        JUST_Sample sample;
+        IMFSample *pSample = NULL;
+        PP_err err = JUST_ReadSample(&sample);
+        if (err == just_would_block)
+        {
+            m_Buffering.Start(FakeJust_Now());
+            m_Predictor.OnStall(FakeJust_Now());
+            ++m_uStalls;
+            return;
+        }
+        if (err == just_stream_end)
+        {
+            m_bEnded = TRUE;
+            return;
+        }
+
+        ++m_uSamples;
+        m_Clocks[sample.itrack].Update(
+            sample.decode_time, sample.decode_time + sample.composite_time_delta, sample.duration);
+        m_Predictor.AddConsumed(sample.size, sample.duration);
+
+        // The queue time is the fake clock here, in milliseconds.
+        if (SUCCEEDED(CreateSample(sample, &pSample))
+            && SUCCEEDED(pSample->SetUINT64(PPBOX_SAMPLE_QUEUE_TIME, FakeJust_Now())))
+        {
+            (void)m_Queues[sample.itrack].Push(pSample);
+        }
+        SafeRelease(&pSample);
+
+        for (int i = 0; i < 2; ++i)
+        {
+            m_Interleave.Observe(m_Queues[i].Duration(), m_Queues[i].IsEmpty());
+        }
+        DWORD cLimit = m_Interleave.Update();
+        for (int i = 0; i < 2; ++i)
+        {
+            while (m_Queues[i].Count() > cLimit)
+            {
+                (void)m_Queues[i].DropOldest();
+            }
+        }
+
+        UINT64 cbExcess = m_Memory.Update(m_Queues[0].Bytes() + m_Queues[1].Bytes());
+        if (cbExcess)
+        {
+            UINT64 cbShare = m_Memory.FairShare(0, 2);
+            UINT64 cbEvicted = 0;
+            for (int i = 0; i < 2; ++i)
+            {
+                while (m_Queues[i].Bytes() > cbShare && !m_Queues[i].IsEmpty())
+                {
+                    cbEvicted += m_Queues[i].DropOldest();
+                }
+            }
+            m_Memory.OnEvicted(cbEvicted);
+        }
+    }
+
+    // Renders what is due, then lets the clock move.
+    void Play()
+    {
+        FakeJust_Advance(PLAYBACK_STEP);
+        m_uPosition += PLAYBACK_STEP * 10000;
+        for (int i = 0; i < 2; ++i)
+        {
+            IMFSample *pSample = NULL;
+            while (SUCCEEDED(m_Queues[i].Front(&pSample)))
+            {
+                LONGLONG hnsTime = 0;
+                UINT64 uQueued = 0;
+                (void)pSample->GetSampleTime(&hnsTime);
+                (void)pSample->GetUINT64(PPBOX_SAMPLE_QUEUE_TIME, &uQueued);
+                SafeRelease(&pSample);
+                if ((UINT64)hnsTime > m_uPosition)
+                {
+                    break;
+                }
+                m_Latency.Add((UINT32)(FakeJust_Now() - uQueued));
+                (void)m_Queues[i].Pop(&pSample);
+                SafeRelease(&pSample);
+            }
+        }
+    }
+
+    void Sample()
+    {
+        m_uNextStat = FakeJust_Now() + STAT_PERIOD;
+        JUST_PlayStatistic play;
+        JUST_DataStat data;
+        if (JUST_GetPlayStat(&play) == just_success && JUST_GetDataStat(&data) == just_success)
+        {
+            m_Predictor.Update(FakeJust_Now(), data.average_speed_five_seconds, play.buffer_time);
+        }
+    }
+
+    UINT64 QueuedAhead() const
+    {
+        return min(m_Queues[0].Duration(), m_Queues[1].Duration());
+    }
+
+private:
+    RebufferPredictor       m_Predictor;
+    BufferingController     m_Buffering;
+    StreamClock             m_Clocks[2];
+    InterleaveBalancer      m_Interleave;
+    MemoryGovernor          m_Memory;
+    LatencyHistogram        m_Latency;
+    IMFMediaType            *m_pTypes[2];
+    SampleQueue             m_Queues[2];
+    UINT64                  m_uPosition;        // Rendered media time, 100-nanosecond units
+    UINT64                  m_uNextStat;
+    UINT32                  m_uSamples;
+    UINT32                  m_uStalls;
+    BOOL                    m_bEnded;
+};
+
+//-------------------------------------------------------------------
+// BM_Delivery
+// A session of 60 s, downloaded at range(0) percent of the content
+// rate, with a 2 s outage in the middle. Under 100 percent the session
+// stalls, and the counters show how the controllers handle it.
+//-------------------------------------------------------------------
+
+static void BM_Delivery(benchmark::State & state)
+{
+    FakeJustScript script;
+    FakeJust_Load(script);
+    UINT32 uSpeed = (UINT32)((UINT64)FakeJust_ContentRate() * state.range(0) / 100);
+    script.speeds.clear();
+    FakeJustSpeed before = {0, uSpeed};
+    FakeJustSpeed outage = {20000, 0};
+    FakeJustSpeed after = {22000, uSpeed};
+    script.speeds.push_back(before);
+    script.speeds.push_back(outage);
+    script.speeds.push_back(after);
+
+    UINT32 uSamples = 0;
+    for (auto _ : state)
+    {
+        DeliveryModel model;
+        if (FAILED(model.Open(script)))
+        {
+            state.SkipWithError("open failed");
+            return;
+        }
+        model.Run();
+        uSamples += model.Samples();
+
+        state.counters["stalls"] = model.Stalls();
+        state.counters["buffering_checks"] = model.Buffering().Checks();
+        state.counters["buffering_ms"] = (double)model.Buffering().TotalTime();
+        state.counters["rebuffer_warnings"] = model.Predictor().Warnings();
+        state.counters["rebuffer_hits"] = model.Predictor().Hits();
+        state.counters["memory_peak"] = (double)model.Memory().Peak();
+        state.counters["latency_p99_ms"] = model.Latency().Percentile(99);
+    }
+    state.SetItemsProcessed(uSamples);
+}
+BENCHMARK(BM_Delivery)->Arg(150)->Arg(90)->Unit(benchmark::kMillisecond);
+
+static void BM_RebufferPredictorUpdate(benchmark::State & state)
+{
+    RebufferPredictor predictor;
+    predictor.SetBitrate(1000000);
+    UINT64 uNow = 0;
+    UINT32 uBuffer = 10000;
+    for (auto _ : state)
+    {
+        uNow += 1000;
+        uBuffer = uBuffer > 500 ? uBuffer - 500 : 10000;
+        benchmark::DoNotOptimize(predictor.Update(uNow, 100000, uBuffer));
+    }
+}
+BENCHMARK(BM_RebufferPredictorUpdate);
+
+static void BM_BufferingControllerCheck(benchmark::State & state)
+{
+    BufferingController buffering;
+    UINT64 uNow = 0;
+    UINT32 uPercent = 0;
+    for (auto _ : state)
+    {
+        if (!buffering.IsBuffering())
+        {
+            buffering.Start(uNow);
+            uPercent = 0;
+        }
+        uNow += buffering.NextDelay();
+        uPercent += 5;
+        benchmark::DoNotOptimize(buffering.Check(uNow, uPercent));
+    }
+}
+BENCHMARK(BM_BufferingControllerCheck);
+
+static void BM_LatencyHistogramAdd(benchmark::State & state)
+{
+    LatencyHistogram histogram;
+    UINT32 uValue = 1;
+    for (auto _ : state)
+    {
+        uValue = uValue * 1103515245 + 12345;
+        histogram.Add(uValue >> 12);
+    }
+    benchmark::DoNotOptimize(histogram.Percentile(99));
+}
+BENCHMARK(BM_LatencyHistogramAdd);
+
+BENCHMARK_MAIN();
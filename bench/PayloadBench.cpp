@@ -0,0 +1,184 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// PayloadBench.cpp
+// Counts the copies and the allocations of the video payloads from the
+// runtime to a decoder that wants aligned and padded input, with plain
+// memory buffers and with PayloadAllocator.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "FakeJustRuntime.h"
+#include "PayloadAllocator.h"
+#include "PpboxMediaType.h"
+#include "SafeRelease.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+static PP_uint const VIDEO_TRACK = 0;
+static DWORD const DECODER_ALIGNMENT = 64;
+static DWORD const DECODER_PADDING = 64;
+static size_t const PIPELINE_DEPTH = 8;         // Samples held downstream at a time
+
+static void OnOpen(PP_context user, PP_err err)
+{
+    *(PP_err *)user = err;
+}
+
+//-------------------------------------------------------------------
+// Decoder
+// Reads a payload in place if it starts on DECODER_ALIGNMENT and is
+// followed by DECODER_PADDING bytes of the buffer, and otherwise
+// copies it into a padded buffer of its own first, as the bitstream
+// readers of the decoders do.
+//-------------------------------------------------------------------
+
+class Decoder
+{
+public:
+    Decoder() : m_uCheck(0) {}
+
+    HRESULT Decode(IMFSample *pSample)
+    {
+        IMFMediaBuffer *pBuffer = NULL;
+        BYTE *pData = NULL;
+        DWORD cbMax = 0;
+        DWORD cbData = 0;
+
+        HRESULT hr = pSample->GetBufferByIndex(0, &pBuffer);
+        if (SUCCEEDED(hr))
+        {
+            hr = pBuffer->Lock(&pData, &cbMax, &cbData);
+        }
+        if (SUCCEEDED(hr))
+        {
+            BYTE const *pInput = pData;
+            if ((size_t)pData % DECODER_ALIGNMENT != 0 || cbMax < cbData + DECODER_PADDING)
+            {
+                m_Padded.resize(cbData + DECODER_PADDING + DECODER_ALIGNMENT);
+                BYTE *pPadded = &m_Padded[0] + (DECODER_ALIGNMENT - (size_t)&m_Padded[0] % DECODER_ALIGNMENT) % DECODER_ALIGNMENT;
+                CopyMemory(pPadded, pData, cbData);
+                ZeroMemory(pPadded + cbData, DECODER_PADDING);
+                pInput = pPadded;
+            }
+            m_uCheck += pInput[0] + pInput[cbData / 2];
+            hr = pBuffer->Unlock();
+        }
+        SafeRelease(&pBuffer);
+        return hr;
+    }
+
+    UINT64 Check() const { return m_uCheck; }
+
+private:
+    std::vector<BYTE>   m_Padded;
+    UINT64              m_uCheck;
+};
+
+static BOOL ReadVideo(FakeJustScript const & script, std::vector<JUST_Sample> * frames, std::vector<BYTE> * payloads)
+{
+    FakeJust_Load(script);
+    PP_err err = -1;
+    JUST_AsyncOpenEx("fake", "", &err, OnOpen);
+    FakeJust_Advance(0);
+    FakeJust_Advance(script.uDuration);
+    if (err != just_success)
+    {
+        return FALSE;
+    }
+
+    std::vector<size_t> offsets;
+    JUST_Sample sample;
+    while (JUST_ReadSample(&sample) == just_success)
+    {
+        if (sample.itrack == VIDEO_TRACK)
+        {
+            offsets.push_back(payloads->size());
+            payloads->insert(payloads->end(), sample.buffer, sample.buffer + sample.size);
+            frames->push_back(sample);
+        }
+    }
+    for (size_t i = 0; i < frames->size(); ++i)
+    {
+        (*frames)[i].buffer = &(*payloads)[offsets[i]];
+    }
+    JUST_Close();
+    return TRUE;
+}
+
+//-------------------------------------------------------------------
+// BM_Payload
+// Delivers the video frames of 60 s of content to the decoder, with
+// PIPELINE_DEPTH samples held downstream. range(0) is 0 for the plain
+// buffers of CreateSample, as the source makes them without an
+// allocator, or the alignment of PayloadAllocator. The counters are per
+// frame.
+//-------------------------------------------------------------------
+
+static void BM_Payload(benchmark::State & state)
+{
+    FakeJustScript script;
+    FakeJust_Load(script);
+    script.speeds[0].uBytesPerSecond = FakeJust_ContentRate() * 10;
+
+    std::vector<JUST_Sample> frames;
+    std::vector<BYTE> payloads;
+    if (!ReadVideo(script, &frames, &payloads))
+    {
+        state.SkipWithError("open failed");
+        return;
+    }
+
+    DWORD cbAlignment = (DWORD)state.range(0);
+    UINT64 cCopies = FakeWin32_CopyCount();
+    UINT64 cbCopied = FakeWin32_CopyBytes();
+    UINT64 cBuffers = FakeMF_BufferCount();
+    UINT64 cbBuffers = FakeMF_BufferBytes();
+    UINT64 cbPayloads = 0;
+
+    for (auto _ : state)
+    {
+        PayloadAllocator allocator;
+        allocator.SetLayout(cbAlignment, DECODER_PADDING);
+        Decoder decoder;
+        std::vector<IMFSample *> pipeline(PIPELINE_DEPTH, NULL);
+
+        for (size_t i = 0; i < frames.size(); ++i)
+        {
+            IMFSample *pSample = NULL;
+            HRESULT hr = allocator.IsEnabled()
+                ? allocator.CreateSample(frames[i].buffer, frames[i].size, &pSample)
+                : CreateSample(frames[i], &pSample);
+            if (FAILED(hr))
+            {
+                state.SkipWithError("sample failed");
+                return;
+            }
+            (void)decoder.Decode(pSample);
+            cbPayloads += frames[i].size;
+
+            // The sample goes back to its pool when the pipeline is
+            // done with it.
+            SafeRelease(&pipeline[i % PIPELINE_DEPTH]);
+            pipeline[i % PIPELINE_DEPTH] = pSample;
+        }
+        for (size_t i = 0; i < PIPELINE_DEPTH; ++i)
+        {
+            SafeRelease(&pipeline[i]);
+        }
+        benchmark::DoNotOptimize(decoder.Check());
+    }
+
+    double cFrames = (double)frames.size() * state.iterations();
+    state.SetItemsProcessed((int64_t)cFrames);
+    state.SetBytesProcessed((int64_t)cbPayloads);
+    state.counters["copies_per_frame"] = (FakeWin32_CopyCount() - cCopies) / cFrames;
+    state.counters["copied_per_payload_byte"] = (double)(FakeWin32_CopyBytes() - cbCopied) / cbPayloads;
+    state.counters["allocs_per_frame"] = (FakeMF_BufferCount() - cBuffers) / cFrames;
+    state.counters["alloc_bytes_per_frame"] = (FakeMF_BufferBytes() - cbBuffers) / cFrames;
+}
+BENCHMARK(BM_Payload)->Arg(0)->Arg(64)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
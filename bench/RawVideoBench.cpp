@@ -0,0 +1,92 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RawVideoBench.cpp
+// Times the conversion of a frame by the raw video kernels, for each
+// instruction set.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "RawVideoVariants.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+// Frame sizes: SD, HD and full HD. The odd width leaves a tail to
+// every row.
+static int const s_Sizes[][2] = {{720, 576}, {1279, 720}, {1920, 1080}};
+
+static void Fill(std::vector<BYTE> & buffer)
+{
+    UINT32 uValue = 1;
+    for (size_t i = 0; i < buffer.size(); ++i)
+    {
+        uValue = uValue * 1103515245 + 12345;
+        buffer[i] = (BYTE)(uValue >> 16);
+    }
+}
+
+static void BM_I420ToNV12(benchmark::State & state, I420ToNV12Kernel pfnKernel)
+{
+    UINT32 uWidth = (UINT32)state.range(0);
+    UINT32 uHeight = (UINT32)state.range(1);
+    UINT32 cbChroma = ((uWidth + 1) / 2) * ((uHeight + 1) / 2);
+    LONG lPitch = (LONG)((uWidth + 63) & ~63);
+
+    std::vector<BYTE> src(uWidth * uHeight + 2 * cbChroma);
+    std::vector<BYTE> dst(lPitch * (uHeight + (uHeight + 1) / 2));
+    Fill(src);
+
+    for (auto _ : state)
+    {
+        pfnKernel(&src[0], uWidth, uHeight, &dst[0], lPitch);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed((int64_t)state.iterations() * src.size());
+}
+
+static void BM_RGB24ToRGB32(benchmark::State & state, RGB24ToRGB32Kernel pfnKernel)
+{
+    UINT32 uWidth = (UINT32)state.range(0);
+    UINT32 uHeight = (UINT32)state.range(1);
+    UINT32 uSrcPitch = (uWidth * 3 + 3) & ~3;
+    LONG lPitch = (LONG)(uWidth * 4);
+
+    std::vector<BYTE> src(uSrcPitch * uHeight);
+    std::vector<BYTE> dst(lPitch * uHeight);
+    Fill(src);
+
+    for (auto _ : state)
+    {
+        pfnKernel(&src[0], uSrcPitch, uWidth, uHeight, &dst[0], lPitch);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed((int64_t)state.iterations() * src.size());
+}
+
+int main(int argc, char ** argv)
+{
+    RawVideoVariant variants[3];
+    int cVariants = RawVideoVariants(variants);
+    for (int i = 0; i < cVariants; ++i)
+    {
+        std::string name = variants[i].pszName;
+        benchmark::internal::Benchmark * pI420 = benchmark::RegisterBenchmark(
+            ("BM_I420ToNV12/" + name).c_str(), BM_I420ToNV12, variants[i].pfnI420ToNV12);
+        benchmark::internal::Benchmark * pRGB24 = benchmark::RegisterBenchmark(
+            ("BM_RGB24ToRGB32/" + name).c_str(), BM_RGB24ToRGB32, variants[i].pfnRGB24ToRGB32);
+        for (size_t j = 0; j < sizeof(s_Sizes) / sizeof(s_Sizes[0]); ++j)
+        {
+            pI420->Args({s_Sizes[j][0], s_Sizes[j][1]})->Unit(benchmark::kMicrosecond);
+            pRGB24->Args({s_Sizes[j][0], s_Sizes[j][1]})->Unit(benchmark::kMicrosecond);
+        }
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
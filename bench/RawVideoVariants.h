@@ -0,0 +1,47 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RawVideoVariants.h
+// The raw video kernels, built once per instruction set for the
+// benchmark and the test.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+#define RAW_VIDEO_KERNELS(suffix) \
+    void ConvertI420ToNV12_##suffix(BYTE const * pSrc, UINT32 uWidth, UINT32 uHeight, BYTE * pDst, LONG lDstPitch); \
+    void ConvertRGB24ToRGB32_##suffix(BYTE const * pSrc, UINT32 uSrcPitch, UINT32 uWidth, UINT32 uHeight, BYTE * pDst, LONG lDstPitch);
+
+RAW_VIDEO_KERNELS(Scalar)
+RAW_VIDEO_KERNELS(Sse2)
+RAW_VIDEO_KERNELS(Avx2)
+
+#undef RAW_VIDEO_KERNELS
+
+typedef void (* I420ToNV12Kernel)(BYTE const *, UINT32, UINT32, BYTE *, LONG);
+typedef void (* RGB24ToRGB32Kernel)(BYTE const *, UINT32, UINT32, UINT32, BYTE *, LONG);
+
+struct RawVideoVariant
+{
+    char const *        pszName;
+    I420ToNV12Kernel    pfnI420ToNV12;
+    RGB24ToRGB32Kernel  pfnRGB24ToRGB32;
+};
+
+// The variants the processor runs, the scalar one first.
+inline int RawVideoVariants(RawVideoVariant * pVariants)
+{
+    int c = 0;
+    RawVideoVariant scalar = {"Scalar", ConvertI420ToNV12_Scalar, ConvertRGB24ToRGB32_Scalar};
+    RawVideoVariant sse2 = {"Sse2", ConvertI420ToNV12_Sse2, ConvertRGB24ToRGB32_Sse2};
+    RawVideoVariant avx2 = {"Avx2", ConvertI420ToNV12_Avx2, ConvertRGB24ToRGB32_Avx2};
+    pVariants[c++] = scalar;
+    pVariants[c++] = sse2;
+    if (__builtin_cpu_supports("avx2"))
+    {
+        pVariants[c++] = avx2;
+    }
+    return c;
+}
@@ -0,0 +1,104 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SessionBench.cpp
+// Runs 1 to 16 sessions on one playlink against the fake runtime, as
+// the sources of a multi-view grid do, and times their reads.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "PpboxSession.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+static void OnOpen(PP_context user, PP_err err)
+{
+    *(PP_err *)user = err;
+}
+
+static UINT64 ReadAll(PpboxSession * session)
+{
+    JUST_Sample sample;
+    UINT64 cSamples = 0;
+    while (session->ReadSample(&sample) == just_success)
+    {
+        ++cSamples;
+    }
+    return cSamples;
+}
+
+//-------------------------------------------------------------------
+// BM_Sessions
+// range(0) sessions open the playlink; the content is downloaded
+// before the timing starts, so the reads never block. Each session
+// then reads all of it on its own thread. The runtime is read once,
+// the other sessions take the samples from the shared store, and all
+// of them contend for the runtime lock.
+//-------------------------------------------------------------------
+
+static void BM_Sessions(benchmark::State & state)
+{
+    size_t cSessions = (size_t)state.range(0);
+
+    FakeJustScript script;
+    script.uDuration = 20000;
+    FakeJust_Load(script);
+    script.speeds[0].uBytesPerSecond = FakeJust_ContentRate() * 10;
+
+    UINT64 cSamples = 0;
+    UINT64 cSessionSamples = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        FakeJust_Load(script);
+        std::vector<std::unique_ptr<PpboxSession> > sessions;
+        std::vector<PP_err> errs(cSessions, -1);
+        for (size_t i = 0; i < cSessions; ++i)
+        {
+            sessions.emplace_back(new PpboxSession());
+            sessions[i]->AsyncOpen("fake", "", &errs[i], OnOpen);
+        }
+        FakeJust_Advance(0);
+        FakeJust_Advance(script.uDuration);
+        for (size_t i = 0; i < cSessions; ++i)
+        {
+            if (errs[i] != just_success)
+            {
+                state.SkipWithError("open failed");
+                return;
+            }
+        }
+        std::vector<UINT64> counts(cSessions, 0);
+        state.ResumeTiming();
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < cSessions; ++i)
+        {
+            threads.emplace_back([&sessions, &counts, i]() { counts[i] = ReadAll(sessions[i].get()); });
+        }
+        for (size_t i = 0; i < cSessions; ++i)
+        {
+            threads[i].join();
+        }
+
+        state.PauseTiming();
+        for (size_t i = 0; i < cSessions; ++i)
+        {
+            cSamples += counts[i];
+        }
+        cSessionSamples = counts[0];
+        sessions.clear();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(cSamples);
+    state.counters["samples_per_session"] = (double)cSessionSamples;
+    state.counters["session_samples_per_s"] = benchmark::Counter(
+        (double)cSamples / cSessions, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Sessions)->RangeMultiplier(2)->Range(1, 16)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,109 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// TraceGateBench.cpp
+// Times a trace on the sample path with the plain TRACE macro and with
+// the TraceGate macros, tracing off and on, over the fake trace.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "TraceGate.h"
+
+#include <benchmark/benchmark.h>
+
+//-------------------------------------------------------------------
+// Each benchmark traces one sample, with the arguments of the drop
+// trace of the stream and the discontinuity trace of the source. The
+// fake trace formats its message as the real one does, and passes
+// level 3 and below, the default of the source.
+//-------------------------------------------------------------------
+
+static int const TRACE_LEVEL = 3;
+
+static void BeginTrace(int iGate)
+{
+    FakeTrace_SetLevel(TRACE_LEVEL);
+    TraceGate::SetLevel(iGate);
+}
+
+static void EndTrace(benchmark::State & state, UINT64 cBefore)
+{
+    state.counters["traces"] = (double)(FakeTrace_Count() - cBefore);
+    TraceGate::SetLevel(PPBOX_TRACE_LEVEL);
+}
+
+// TRACE above the level: filtered after the message is formatted.
+static void BM_TraceFiltered(benchmark::State & state)
+{
+    BeginTrace(PPBOX_TRACE_LEVEL);
+    UINT64 cBefore = FakeTrace_Count();
+    UINT32 uTrack = 0;
+    for (auto _ : state)
+    {
+        TRACE(TRACE_LEVEL + 1, L"PpboxMediaSource::DeliverPayload discontinuity on stream %u\r\n", uTrack);
+        uTrack ^= 1;
+    }
+    EndTrace(state, cBefore);
+}
+BENCHMARK(BM_TraceFiltered);
+
+// TRACE_HOT with the run time level under the trace level.
+static void BM_TraceHotOff(benchmark::State & state)
+{
+    BeginTrace(0);
+    UINT64 cBefore = FakeTrace_Count();
+    UINT32 uTrack = 0;
+    for (auto _ : state)
+    {
+        TRACE_HOT(TRACE_LEVEL, L"PpboxMediaSource::DeliverPayload discontinuity on stream %u\r\n", uTrack);
+        uTrack ^= 1;
+        benchmark::ClobberMemory();
+    }
+    EndTrace(state, cBefore);
+}
+BENCHMARK(BM_TraceHotOff);
+
+// TRACE_HOT above PPBOX_TRACE_LEVEL: no code.
+static void BM_TraceHotCompiledOut(benchmark::State & state)
+{
+    BeginTrace(PPBOX_TRACE_LEVEL);
+    UINT64 cBefore = FakeTrace_Count();
+    UINT32 uTrack = 0;
+    for (auto _ : state)
+    {
+        TRACE_HOT(PPBOX_TRACE_LEVEL + 1, L"PpboxMediaSource::DeliverPayload discontinuity on stream %u\r\n", uTrack);
+        uTrack ^= 1;
+        benchmark::ClobberMemory();
+    }
+    EndTrace(state, cBefore);
+}
+BENCHMARK(BM_TraceHotCompiledOut);
+
+// TRACE_HOT on: formats and traces each call.
+static void BM_TraceHotOn(benchmark::State & state)
+{
+    BeginTrace(PPBOX_TRACE_LEVEL);
+    UINT64 cBefore = FakeTrace_Count();
+    UINT32 uTrack = 0;
+    for (auto _ : state)
+    {
+        TRACE_HOT(TRACE_LEVEL, L"PpboxMediaSource::DeliverPayload discontinuity on stream %u\r\n", uTrack);
+        uTrack ^= 1;
+    }
+    EndTrace(state, cBefore);
+}
+BENCHMARK(BM_TraceHotOn);
+
+// TRACE_HOT_SAMPLED on, as for the dropped samples: one call in 64.
+static void BM_TraceHotSampled(benchmark::State & state)
+{
+    BeginTrace(PPBOX_TRACE_LEVEL);
+    UINT64 cBefore = FakeTrace_Count();
+    for (auto _ : state)
+    {
+        TRACE_HOT_SAMPLED(TRACE_LEVEL, 64, L"[PpboxMediaStream::DeliverPayload] drop sample\r\n");
+    }
+    EndTrace(state, cBefore);
+}
+BENCHMARK(BM_TraceHotSampled);
+
+BENCHMARK_MAIN();
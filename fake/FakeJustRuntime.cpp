@@ -0,0 +1,444 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FakeJustRuntime.cpp
+// Scriptable stand-in for the JUST runtime, to run the portable code of
+// the source on other platforms.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "FakeJustRuntime.h"
+
+#include <string.h>
+
+static UINT64 const HNS_PER_SECOND = 10000000;
+static UINT32 const AUDIO_FRAME_SAMPLES = 1024;
+
+FakeJustScript::FakeJustScript()
+    : uDuration(60000)
+    , uVideoFps(25)
+    , cbVideoFrame(4000)
+    , cbKeyFrame(40000)
+    , uGop(50)
+    , uAudioRate(44100)
+    , cbAudioFrame(400)
+    , uBufferTarget(5000)
+    , errOpen(just_success)
+{
+    FakeJustSpeed speed = {0, 1000000};
+    speeds.push_back(speed);
+}
+
+struct PendingOpen
+{
+    PP_context      user;
+    JUST_Callback   callback;
+    PP_err          err;
+};
+
+struct Timer
+{
+    UINT64          uDue;
+    UINT64          uKey;
+    PP_context      user;
+    JUST_Callback   callback;
+};
+
+static FakeJustScript               s_script;
+static UINT64                       s_uNow = 0;
+static BOOL                         s_bOpen = FALSE;
+static std::vector<PendingOpen>     s_opens;
+static std::vector<Timer>           s_timers;
+static UINT64                       s_uNextKey = 1;
+static std::vector<BYTE>            s_payload;
+
+// Download and read positions, since the open or the last seek.
+static UINT64                       s_uBase = 0;        // Content time of the position, milliseconds
+static UINT64                       s_cbDownloaded = 0; // Since the position
+static UINT64                       s_cbTotal = 0;      // Since the open
+static UINT64                       s_uVideoFrame = 0;  // Next frame to read
+static UINT64                       s_uAudioFrame = 0;
+
+/* Content */
+
+static UINT32 VideoTrack()
+{
+    return 0;
+}
+
+static UINT32 AudioTrack()
+{
+    return s_script.uVideoFps ? 1 : 0;
+}
+
+static UINT64 VideoTime(UINT64 uFrame)
+{
+    return uFrame * HNS_PER_SECOND / s_script.uVideoFps;
+}
+
+static UINT64 AudioTime(UINT64 uFrame)
+{
+    return uFrame * AUDIO_FRAME_SAMPLES * HNS_PER_SECOND / s_script.uAudioRate;
+}
+
+UINT32 FakeJust_ContentRate()
+{
+    UINT64 uRate = 0;
+    if (s_script.uVideoFps)
+    {
+        UINT32 uGop = s_script.uGop ? s_script.uGop : 1;
+        uRate += (UINT64)s_script.uVideoFps
+            * ((uGop - 1) * (UINT64)s_script.cbVideoFrame + s_script.cbKeyFrame) / uGop;
+    }
+    if (s_script.uAudioRate)
+    {
+        uRate += (UINT64)s_script.uAudioRate * s_script.cbAudioFrame / AUDIO_FRAME_SAMPLES;
+    }
+    return uRate ? (UINT32)uRate : 1;
+}
+
+// Content time downloaded, in milliseconds.
+static UINT64 DownloadedEnd()
+{
+    UINT64 uEnd = s_uBase + s_cbDownloaded * 1000 / FakeJust_ContentRate();
+    return uEnd < s_script.uDuration ? uEnd : s_script.uDuration;
+}
+
+static UINT32 SpeedAt(UINT64 uTime)
+{
+    UINT32 uSpeed = 0;
+    for (size_t i = 0; i < s_script.speeds.size() && s_script.speeds[i].uStart <= uTime; ++i)
+    {
+        uSpeed = s_script.speeds[i].uBytesPerSecond;
+    }
+    return uSpeed;
+}
+
+static UINT64 NextSpeedChange(UINT64 uTime)
+{
+    for (size_t i = 0; i < s_script.speeds.size(); ++i)
+    {
+        if (s_script.speeds[i].uStart > uTime)
+        {
+            return s_script.speeds[i].uStart;
+        }
+    }
+    return (UINT64)-1;
+}
+
+/* Clock */
+
+void FakeJust_Load(FakeJustScript const & script)
+{
+    s_script = script;
+    s_uNow = 0;
+    s_bOpen = FALSE;
+    s_opens.clear();
+    s_timers.clear();
+    s_uBase = 0;
+    s_cbDownloaded = 0;
+    s_cbTotal = 0;
+    s_uVideoFrame = 0;
+    s_uAudioFrame = 0;
+
+    UINT32 cbMax = script.cbKeyFrame;
+    cbMax = script.cbVideoFrame > cbMax ? script.cbVideoFrame : cbMax;
+    cbMax = script.cbAudioFrame > cbMax ? script.cbAudioFrame : cbMax;
+    s_payload.resize(cbMax ? cbMax : 1);
+    for (size_t i = 0; i < s_payload.size(); ++i)
+    {
+        s_payload[i] = (BYTE)i;
+    }
+}
+
+UINT64 FakeJust_Now()
+{
+    return s_uNow;
+}
+
+static void Download(UINT64 uElapsed)
+{
+    if (!s_bOpen)
+    {
+        return;
+    }
+    UINT64 cb = uElapsed * SpeedAt(s_uNow) / 1000;
+    s_cbDownloaded += cb;
+    s_cbTotal += cb;
+}
+
+//-------------------------------------------------------------------
+// FakeJust_Advance
+// Moves the clock in steps that end at a speed change or at the next
+// timer, so the download and the callbacks keep their order.
+//-------------------------------------------------------------------
+
+void FakeJust_Advance(UINT32 uMilliseconds)
+{
+    UINT64 uTarget = s_uNow + uMilliseconds;
+
+    std::vector<PendingOpen> opens;
+    opens.swap(s_opens);
+    for (size_t i = 0; i < opens.size(); ++i)
+    {
+        if (opens[i].err == just_success)
+        {
+            s_bOpen = TRUE;
+        }
+        opens[i].callback(opens[i].user, opens[i].err);
+    }
+
+    for (;;)
+    {
+        size_t iTimer = s_timers.size();
+        for (size_t i = 0; i < s_timers.size(); ++i)
+        {
+            if (iTimer == s_timers.size() || s_timers[i].uDue < s_timers[iTimer].uDue)
+            {
+                iTimer = i;
+            }
+        }
+
+        UINT64 uNext = uTarget;
+        if (iTimer < s_timers.size() && s_timers[iTimer].uDue < uNext)
+        {
+            uNext = s_timers[iTimer].uDue;
+        }
+        UINT64 uChange = NextSpeedChange(s_uNow);
+        if (uChange < uNext)
+        {
+            uNext = uChange;
+        }
+
+        if (uNext > s_uNow)
+        {
+            Download(uNext - s_uNow);
+            s_uNow = uNext;
+        }
+
+        if (iTimer < s_timers.size() && s_timers[iTimer].uDue <= s_uNow)
+        {
+            Timer timer = s_timers[iTimer];
+            s_timers.erase(s_timers.begin() + iTimer);
+            timer.callback(timer.user, just_success);
+            continue;
+        }
+        if (s_uNow >= uTarget)
+        {
+            break;
+        }
+    }
+}
+
+/* Runtime API */
+
+void JUST_AsyncOpenEx(char const * playlink, char const * config, PP_context user, JUST_Callback callback)
+{
+    (void)playlink;
+    (void)config;
+    PendingOpen open = {user, callback, s_bOpen ? just_already_open : s_script.errOpen};
+    s_opens.push_back(open);
+}
+
+// A pending open completes with just_operation_canceled.
+void JUST_Close()
+{
+    s_bOpen = FALSE;
+    for (size_t i = 0; i < s_opens.size(); ++i)
+    {
+        s_opens[i].err = just_operation_canceled;
+    }
+    s_uBase = 0;
+    s_cbDownloaded = 0;
+    s_cbTotal = 0;
+    s_uVideoFrame = 0;
+    s_uAudioFrame = 0;
+}
+
+PP_uint JUST_GetDuration()
+{
+    return s_bOpen ? s_script.uDuration : 0;
+}
+
+PP_uint JUST_GetStreamCount()
+{
+    if (!s_bOpen)
+    {
+        return 0;
+    }
+    return (s_script.uVideoFps ? 1 : 0) + (s_script.uAudioRate ? 1 : 0);
+}
+
+PP_err JUST_GetStreamInfo(PP_uint index, JUST_StreamInfo * info)
+{
+    if (!s_bOpen)
+    {
+        return just_not_open;
+    }
+    if (index >= JUST_GetStreamCount())
+    {
+        return just_stream_end;
+    }
+
+    memset(info, 0, sizeof(*info));
+    if (s_script.uVideoFps && index == VideoTrack())
+    {
+        UINT32 uGop = s_script.uGop ? s_script.uGop : 1;
+        info->type = JUST_StreamType::VIDE;
+        info->sub_type = JUST_VideoSubType::AVC1;
+        info->bitrate = (PP_uint)(8ull * s_script.uVideoFps
+            * ((uGop - 1) * (UINT64)s_script.cbVideoFrame + s_script.cbKeyFrame) / uGop);
+        info->format.video.width = 1280;
+        info->format.video.height = 720;
+        info->format.video.frame_rate_num = s_script.uVideoFps;
+        info->format.video.frame_rate_den = 1;
+    }
+    else
+    {
+        info->type = JUST_StreamType::AUDI;
+        info->sub_type = JUST_AudioSubType::MP4A;
+        info->bitrate = (PP_uint)(8ull * s_script.uAudioRate * s_script.cbAudioFrame / AUDIO_FRAME_SAMPLES);
+        info->format.audio.channel_count = 2;
+        info->format.audio.sample_size = 16;
+        info->format.audio.sample_rate = s_script.uAudioRate;
+    }
+    return just_success;
+}
+
+// Moves to the key frame at or before time, and drops the buffer.
+PP_err JUST_Seek(PP_uint time)
+{
+    if (!s_bOpen)
+    {
+        return just_not_open;
+    }
+
+    UINT64 uTime = time < s_script.uDuration ? time : s_script.uDuration;
+    if (s_script.uVideoFps)
+    {
+        UINT32 uGop = s_script.uGop ? s_script.uGop : 1;
+        s_uVideoFrame = uTime * s_script.uVideoFps / 1000 / uGop * uGop;
+        uTime = VideoTime(s_uVideoFrame) / 10000;
+    }
+    if (s_script.uAudioRate)
+    {
+        s_uAudioFrame = uTime * 10000 * s_script.uAudioRate / AUDIO_FRAME_SAMPLES / HNS_PER_SECOND;
+    }
+    s_uBase = uTime;
+    s_cbDownloaded = 0;
+    return just_success;
+}
+
+//-------------------------------------------------------------------
+// JUST_ReadSample
+// Returns the track whose next frame decodes first, once its end is
+// downloaded.
+//-------------------------------------------------------------------
+
+PP_err JUST_ReadSample(JUST_Sample * sample)
+{
+    if (!s_bOpen)
+    {
+        return just_not_open;
+    }
+
+    UINT64 const uEnd = (UINT64)s_script.uDuration * 10000;
+    UINT64 uVideo = s_script.uVideoFps ? VideoTime(s_uVideoFrame) : uEnd;
+    UINT64 uAudio = s_script.uAudioRate ? AudioTime(s_uAudioFrame) : uEnd;
+    BOOL bVideo = uVideo <= uAudio;
+    UINT64 uTime = bVideo ? uVideo : uAudio;
+
+    if (uTime >= uEnd)
+    {
+        return just_stream_end;
+    }
+
+    UINT64 uDuration = bVideo
+        ? VideoTime(s_uVideoFrame + 1) - uVideo
+        : AudioTime(s_uAudioFrame + 1) - uAudio;
+    if ((uTime + uDuration) / 10000 > DownloadedEnd() && DownloadedEnd() < s_script.uDuration)
+    {
+        return just_would_block;
+    }
+
+    memset(sample, 0, sizeof(*sample));
+    sample->time = uTime;
+    sample->decode_time = uTime;
+    sample->duration = uDuration;
+    sample->buffer = &s_payload[0];
+    if (bVideo)
+    {
+        BOOL bKey = s_uVideoFrame % (s_script.uGop ? s_script.uGop : 1) == 0;
+        sample->itrack = VideoTrack();
+        sample->flags = bKey ? JUST_SampleFlag::sync : 0;
+        sample->size = bKey ? s_script.cbKeyFrame : s_script.cbVideoFrame;
+        ++s_uVideoFrame;
+    }
+    else
+    {
+        sample->itrack = AudioTrack();
+        sample->flags = JUST_SampleFlag::sync;
+        sample->size = s_script.cbAudioFrame;
+        ++s_uAudioFrame;
+    }
+    return just_success;
+}
+
+PP_err JUST_GetPlayStat(JUST_PlayStatistic * stat)
+{
+    if (!s_bOpen)
+    {
+        return just_not_open;
+    }
+
+    UINT64 uRead = s_script.uVideoFps ? VideoTime(s_uVideoFrame) : AudioTime(s_uAudioFrame);
+    uRead /= 10000;
+    UINT64 uEnd = DownloadedEnd();
+    UINT64 uBuffer = uEnd > uRead ? uEnd - uRead : 0;
+
+    stat->length = sizeof(*stat);
+    stat->play_status = 0;
+    stat->buffer_time = (PP_uint)uBuffer;
+    if (uEnd >= s_script.uDuration || s_script.uBufferTarget == 0 || uBuffer >= s_script.uBufferTarget)
+    {
+        stat->buffering_present = 100;
+    }
+    else
+    {
+        stat->buffering_present = (PP_uint)(uBuffer * 100 / s_script.uBufferTarget);
+    }
+    return just_success;
+}
+
+PP_err JUST_GetDataStat(JUST_DataStat * stat)
+{
+    if (!s_bOpen)
+    {
+        return just_not_open;
+    }
+
+    stat->total_elapse = (PP_uint)s_uNow;
+    stat->average_speed_five_seconds = SpeedAt(s_uNow);
+    stat->total_download_bytes = (PP_uint)s_cbTotal;
+    stat->connection_status = 0;
+    return just_success;
+}
+
+void const * JUST_ScheduleCallback(PP_uint delay, PP_context user, JUST_Callback callback)
+{
+    Timer timer = {s_uNow + delay, s_uNextKey++, user, callback};
+    s_timers.push_back(timer);
+    return (void const *)(size_t)timer.uKey;
+}
+
+// The callback of a canceled timer is not called.
+void JUST_CancelCallback(void const * key)
+{
+    for (size_t i = 0; i < s_timers.size(); ++i)
+    {
+        if ((void const *)(size_t)s_timers[i].uKey == key)
+        {
+            s_timers.erase(s_timers.begin() + i);
+            return;
+        }
+    }
+}
@@ -0,0 +1,195 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FakeJustRuntime.h
+// Scriptable stand-in for the JUST runtime, to run the portable code of
+// the source on other platforms.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+#include <vector>
+
+//-------------------------------------------------------------------
+// The subset of the runtime API that the source uses, with the same
+// names, so code written against the runtime builds against the fake.
+// The values of the enumerations are the fake's own. The subtypes are
+// FourCCs, so that video and audio ones differ, as the source maps
+// both through one table.
+//-------------------------------------------------------------------
+
+typedef void *  PP_context;
+typedef UINT32  PP_uint;
+typedef INT32   PP_err;
+
+enum
+{
+    just_success = 0,
+    just_not_open,
+    just_already_open,
+    just_operation_canceled,
+    just_would_block,
+    just_stream_end,
+};
+
+namespace JUST_StreamType
+{
+    enum { VIDE = 1, AUDI = 2 };
+}
+
+#define FAKE_JUST_FOURCC(a, b, c, d) \
+    ((PP_uint)(a) | ((PP_uint)(b) << 8) | ((PP_uint)(c) << 16) | ((PP_uint)(d) << 24))
+
+namespace JUST_VideoSubType
+{
+    enum : PP_uint
+    {
+        AVC1 = FAKE_JUST_FOURCC('a', 'v', 'c', '1'),
+        MP4V = FAKE_JUST_FOURCC('m', 'p', '4', 'v'),
+        WMV2 = FAKE_JUST_FOURCC('W', 'M', 'V', '2'),
+        WMV3 = FAKE_JUST_FOURCC('W', 'M', 'V', '3'),
+        I420 = FAKE_JUST_FOURCC('I', '4', '2', '0'),
+        RGBT = FAKE_JUST_FOURCC('R', 'G', 'B', 'T'),
+    };
+}
+
+namespace JUST_AudioSubType
+{
+    enum : PP_uint
+    {
+        MP4A = FAKE_JUST_FOURCC('m', 'p', '4', 'a'),
+        MP3  = FAKE_JUST_FOURCC('m', 'p', '3', ' '),
+        MP2  = FAKE_JUST_FOURCC('m', 'p', '2', ' '),
+        WMA2 = FAKE_JUST_FOURCC('W', 'M', 'A', '2'),
+        AC3  = FAKE_JUST_FOURCC('a', 'c', '-', '3'),
+        EAC3 = FAKE_JUST_FOURCC('e', 'c', '-', '3'),
+        FLT  = FAKE_JUST_FOURCC('f', 'l', '3', '2'),
+        PCM  = FAKE_JUST_FOURCC('l', 'p', 'c', 'm'),
+    };
+}
+
+namespace JUST_SampleFlag
+{
+    enum { sync = 1, discontinuity = 2 };
+}
+
+struct JUST_StreamInfo
+{
+    PP_uint         type;
+    PP_uint         sub_type;
+    PP_uint         bitrate;            // Bits per second
+    PP_uint         format_type;
+    PP_uint         format_size;
+    BYTE const *    format_buffer;
+    struct
+    {
+        struct
+        {
+            PP_uint width;
+            PP_uint height;
+            PP_uint frame_rate_num;
+            PP_uint frame_rate_den;
+        } video;
+        struct
+        {
+            PP_uint channel_count;
+            PP_uint sample_size;
+            PP_uint sample_rate;
+            PP_uint block_align;
+        } audio;
+    } format;
+};
+
+// Times are in 100-nanosecond units, as the source configures the
+// runtime.
+struct JUST_Sample
+{
+    PP_uint         itrack;
+    PP_uint         flags;
+    UINT64          time;
+    UINT64          decode_time;
+    PP_uint         composite_time_delta;
+    UINT64          duration;
+    PP_uint         size;
+    BYTE const *    buffer;
+};
+
+struct JUST_PlayStatistic
+{
+    PP_uint         length;
+    PP_uint         play_status;
+    PP_uint         buffering_present;  // Percent
+    PP_uint         buffer_time;        // Milliseconds
+};
+
+struct JUST_DataStat
+{
+    PP_uint         total_elapse;               // Milliseconds
+    PP_uint         average_speed_five_seconds; // Bytes per second
+    PP_uint         total_download_bytes;
+    PP_uint         connection_status;
+};
+
+typedef void (* JUST_Callback)(PP_context user, PP_err err);
+
+void            JUST_AsyncOpenEx(char const * playlink, char const * config, PP_context user, JUST_Callback callback);
+void            JUST_Close();
+PP_uint         JUST_GetDuration();
+PP_uint         JUST_GetStreamCount();
+PP_err          JUST_GetStreamInfo(PP_uint index, JUST_StreamInfo * info);
+PP_err          JUST_Seek(PP_uint time);
+PP_err          JUST_ReadSample(JUST_Sample * sample);
+PP_err          JUST_GetPlayStat(JUST_PlayStatistic * stat);
+PP_err          JUST_GetDataStat(JUST_DataStat * stat);
+void const *    JUST_ScheduleCallback(PP_uint delay, PP_context user, JUST_Callback callback);
+void            JUST_CancelCallback(void const * key);
+
+//-------------------------------------------------------------------
+// FakeJustScript
+//
+// Describes the content and the network of a fake session. The
+// content is one video and one audio track of constant frame sizes;
+// the network downloads it at the speed of the segment the clock is
+// in. A segment of speed 0 stalls the download, so reads return
+// just_would_block once the buffer runs dry.
+//
+// The fake has its own clock, in milliseconds, which only moves with
+// FakeJust_Advance. Open completions and scheduled callbacks run from
+// there, on the calling thread.
+//-------------------------------------------------------------------
+
+struct FakeJustSpeed
+{
+    UINT32          uStart;             // Clock time the segment starts, milliseconds
+    UINT32          uBytesPerSecond;
+};
+
+struct FakeJustScript
+{
+    FakeJustScript();
+
+    UINT32          uDuration;          // Milliseconds of content
+    UINT32          uVideoFps;
+    UINT32          cbVideoFrame;
+    UINT32          cbKeyFrame;
+    UINT32          uGop;               // Frames from a key frame to the next
+    UINT32          uAudioRate;         // Samples per second, 1024 per frame
+    UINT32          cbAudioFrame;
+    UINT32          uBufferTarget;      // Buffer that reads as 100 percent, milliseconds
+    PP_err          errOpen;            // Result of the open
+    std::vector<FakeJustSpeed> speeds;  // By start time, the first at 0
+};
+
+// Replaces the session; the runtime is closed.
+void            FakeJust_Load(FakeJustScript const & script);
+
+// Moves the clock, downloading at the scripted speeds, and runs the
+// callbacks that become due, in time order.
+void            FakeJust_Advance(UINT32 uMilliseconds);
+
+UINT64          FakeJust_Now();
+
+// Bytes per second of the content, at the scripted frame sizes.
+UINT32          FakeJust_ContentRate();
@@ -0,0 +1,924 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FakeMF.cpp
+// The part of COM and Media Foundation the sample classes use, to
+// build them against the fake runtime.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "FakeMF.h"
+#include "SafeRelease.h"
+
+#include <stdlib.h>
+
+#include <map>
+#include <new>
+#include <vector>
+
+static thread_local UINT64 t_cMediaTypes = 0;
+static thread_local UINT64 t_cSamples = 0;
+static thread_local UINT64 t_cBuffers = 0;
+static thread_local UINT64 t_cbBuffers = 0;
+
+// The IIDs only need to differ from each other.
+#define FAKE_IID(name, n) \
+    IID const & name::Iid() \
+    { \
+        static IID const iid = {n, 0, 0, {0, 0, 0, 0, 0, 0, 0, 0}}; \
+        return iid; \
+    }
+
+FAKE_IID(IUnknown, 1)
+FAKE_IID(IMFAttributes, 2)
+FAKE_IID(IMFMediaBuffer, 3)
+FAKE_IID(IMFSample, 4)
+FAKE_IID(IMFAsyncResult, 5)
+FAKE_IID(IMFAsyncCallback, 6)
+FAKE_IID(IMFTrackedSample, 7)
+FAKE_IID(IMFMediaType, 8)
+
+/* FakeBuffer class */
+
+class FakeBuffer final : public IMFMediaBuffer
+{
+public:
+    static HRESULT Create(DWORD cbMax, DWORD cbAlignment, IMFMediaBuffer **ppBuffer)
+    {
+        FakeBuffer *pBuffer = new (std::nothrow) FakeBuffer(cbMax);
+        if (pBuffer == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        // aligned_alloc takes a multiple of the alignment.
+        size_t cbAlloc = ((size_t)cbMax + cbAlignment - 1) / cbAlignment * cbAlignment;
+        pBuffer->m_pData = (BYTE *)aligned_alloc(cbAlignment, cbAlloc ? cbAlloc : cbAlignment);
+        if (pBuffer->m_pData == NULL)
+        {
+            delete pBuffer;
+            return E_OUTOFMEMORY;
+        }
+        ++t_cBuffers;
+        t_cbBuffers += cbMax;
+        *ppBuffer = pBuffer;
+        return S_OK;
+    }
+
+    STDMETHODIMP QueryInterface(REFIID riid, void **ppv)
+    {
+        if (riid == IUnknown::Iid() || riid == IMFMediaBuffer::Iid())
+        {
+            *ppv = static_cast<IMFMediaBuffer *>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppv = NULL;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHODIMP_(ULONG) AddRef() { return InterlockedIncrement(&m_cRef); }
+
+    STDMETHODIMP_(ULONG) Release()
+    {
+        long cRef = InterlockedDecrement(&m_cRef);
+        if (cRef == 0)
+        {
+            delete this;
+        }
+        return (ULONG)cRef;
+    }
+
+    STDMETHODIMP Lock(BYTE **ppbBuffer, DWORD *pcbMaxLength, DWORD *pcbCurrentLength)
+    {
+        *ppbBuffer = m_pData;
+        if (pcbMaxLength)
+        {
+            *pcbMaxLength = m_cbMax;
+        }
+        if (pcbCurrentLength)
+        {
+            *pcbCurrentLength = m_cbCurrent;
+        }
+        return S_OK;
+    }
+
+    STDMETHODIMP Unlock() { return S_OK; }
+
+    STDMETHODIMP GetCurrentLength(DWORD *pcbCurrentLength)
+    {
+        *pcbCurrentLength = m_cbCurrent;
+        return S_OK;
+    }
+
+    STDMETHODIMP SetCurrentLength(DWORD cbCurrentLength)
+    {
+        if (cbCurrentLength > m_cbMax)
+        {
+            return E_INVALIDARG;
+        }
+        m_cbCurrent = cbCurrentLength;
+        return S_OK;
+    }
+
+    STDMETHODIMP GetMaxLength(DWORD *pcbMaxLength)
+    {
+        *pcbMaxLength = m_cbMax;
+        return S_OK;
+    }
+
+private:
+    FakeBuffer(DWORD cbMax) : m_cRef(1), m_pData(NULL), m_cbMax(cbMax), m_cbCurrent(0) {}
+    ~FakeBuffer() { free(m_pData); }
+
+private:
+    long    m_cRef;
+    BYTE    *m_pData;
+    DWORD   m_cbMax;
+    DWORD   m_cbCurrent;
+};
+
+/* FakeAsyncResult class */
+
+class FakeAsyncResult final : public IMFAsyncResult
+{
+public:
+    FakeAsyncResult(IUnknown *pObject, IUnknown *pState)
+        : m_cRef(1)
+        , m_pObject(pObject)
+        , m_pState(pState)
+        , m_hrStatus(S_OK)
+    {
+        m_pObject->AddRef();
+        if (m_pState)
+        {
+            m_pState->AddRef();
+        }
+    }
+
+    STDMETHODIMP QueryInterface(REFIID riid, void **ppv)
+    {
+        if (riid == IUnknown::Iid() || riid == IMFAsyncResult::Iid())
+        {
+            *ppv = static_cast<IMFAsyncResult *>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppv = NULL;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHODIMP_(ULONG) AddRef() { return InterlockedIncrement(&m_cRef); }
+
+    STDMETHODIMP_(ULONG) Release()
+    {
+        long cRef = InterlockedDecrement(&m_cRef);
+        if (cRef == 0)
+        {
+            delete this;
+        }
+        return (ULONG)cRef;
+    }
+
+    STDMETHODIMP GetState(IUnknown **ppunkState)
+    {
+        *ppunkState = m_pState;
+        if (m_pState)
+        {
+            m_pState->AddRef();
+        }
+        return S_OK;
+    }
+
+    STDMETHODIMP GetStatus() { return m_hrStatus; }
+
+    STDMETHODIMP SetStatus(HRESULT hrStatus)
+    {
+        m_hrStatus = hrStatus;
+        return S_OK;
+    }
+
+    STDMETHODIMP GetObject(IUnknown **ppObject)
+    {
+        *ppObject = m_pObject;
+        m_pObject->AddRef();
+        return S_OK;
+    }
+
+private:
+    ~FakeAsyncResult()
+    {
+        SafeRelease(&m_pObject);
+        SafeRelease(&m_pState);
+    }
+
+private:
+    long        m_cRef;
+    IUnknown    *m_pObject;
+    IUnknown    *m_pState;
+    HRESULT     m_hrStatus;
+};
+
+/* FakeAttributes class */
+
+//-------------------------------------------------------------------
+// FakeAttributes
+// The attribute store of the fake samples and media types. The items
+// hold references on the IUnknown values.
+//-------------------------------------------------------------------
+
+template <class Base>
+class FakeAttributes : public Base
+{
+public:
+    STDMETHODIMP GetItem(REFGUID guidKey, PROPVARIANT *pValue)
+    {
+        if (pValue)
+        {
+            return E_NOTIMPL;
+        }
+        return m_Items.count(guidKey) ? S_OK : MF_E_ATTRIBUTENOTFOUND;
+    }
+
+    STDMETHODIMP GetUINT32(REFGUID guidKey, UINT32 *punValue)
+    {
+        Item const *pItem = NULL;
+        HRESULT hr = Find(guidKey, ITEM_UINT32, &pItem);
+        if (SUCCEEDED(hr))
+        {
+            *punValue = (UINT32)pItem->uValue;
+        }
+        return hr;
+    }
+
+    STDMETHODIMP SetUINT32(REFGUID guidKey, UINT32 unValue)
+    {
+        Item item(ITEM_UINT32);
+        item.uValue = unValue;
+        return Set(guidKey, item);
+    }
+
+    STDMETHODIMP GetUINT64(REFGUID guidKey, UINT64 *punValue)
+    {
+        Item const *pItem = NULL;
+        HRESULT hr = Find(guidKey, ITEM_UINT64, &pItem);
+        if (SUCCEEDED(hr))
+        {
+            *punValue = pItem->uValue;
+        }
+        return hr;
+    }
+
+    STDMETHODIMP SetUINT64(REFGUID guidKey, UINT64 unValue)
+    {
+        Item item(ITEM_UINT64);
+        item.uValue = unValue;
+        return Set(guidKey, item);
+    }
+
+    STDMETHODIMP GetDouble(REFGUID guidKey, double *pfValue)
+    {
+        Item const *pItem = NULL;
+        HRESULT hr = Find(guidKey, ITEM_DOUBLE, &pItem);
+        if (SUCCEEDED(hr))
+        {
+            *pfValue = pItem->fValue;
+        }
+        return hr;
+    }
+
+    STDMETHODIMP SetDouble(REFGUID guidKey, double fValue)
+    {
+        Item item(ITEM_DOUBLE);
+        item.fValue = fValue;
+        return Set(guidKey, item);
+    }
+
+    STDMETHODIMP GetGUID(REFGUID guidKey, GUID *pguidValue)
+    {
+        Item const *pItem = NULL;
+        HRESULT hr = Find(guidKey, ITEM_GUID, &pItem);
+        if (SUCCEEDED(hr))
+        {
+            *pguidValue = pItem->guidValue;
+        }
+        return hr;
+    }
+
+    STDMETHODIMP SetGUID(REFGUID guidKey, REFGUID guidValue)
+    {
+        Item item(ITEM_GUID);
+        item.guidValue = guidValue;
+        return Set(guidKey, item);
+    }
+
+    STDMETHODIMP GetBlobSize(REFGUID guidKey, UINT32 *pcbBlobSize)
+    {
+        Item const *pItem = NULL;
+        HRESULT hr = Find(guidKey, ITEM_BLOB, &pItem);
+        if (SUCCEEDED(hr))
+        {
+            *pcbBlobSize = (UINT32)pItem->blob.size();
+        }
+        return hr;
+    }
+
+    STDMETHODIMP GetBlob(REFGUID guidKey, UINT8 *pBuf, UINT32 cbBufSize, UINT32 *pcbBlobSize)
+    {
+        Item const *pItem = NULL;
+        HRESULT hr = Find(guidKey, ITEM_BLOB, &pItem);
+        if (SUCCEEDED(hr) && pItem->blob.size() > cbBufSize)
+        {
+            hr = HRESULT_FROM_WIN32(122);       // ERROR_INSUFFICIENT_BUFFER
+        }
+        if (SUCCEEDED(hr))
+        {
+            memcpy(pBuf, pItem->blob.data(), pItem->blob.size());
+            if (pcbBlobSize)
+            {
+                *pcbBlobSize = (UINT32)pItem->blob.size();
+            }
+        }
+        return hr;
+    }
+
+    STDMETHODIMP SetBlob(REFGUID guidKey, UINT8 const *pBuf, UINT32 cbBufSize)
+    {
+        Item item(ITEM_BLOB);
+        try
+        {
+            item.blob.assign(pBuf, pBuf + cbBufSize);
+        }
+        catch (std::bad_alloc const &)
+        {
+            return E_OUTOFMEMORY;
+        }
+        return Set(guidKey, item);
+    }
+
+    STDMETHODIMP GetUnknown(REFGUID guidKey, REFIID riid, void **ppv)
+    {
+        Item const *pItem = NULL;
+        HRESULT hr = Find(guidKey, ITEM_UNKNOWN, &pItem);
+        if (FAILED(hr))
+        {
+            *ppv = NULL;
+            return hr;
+        }
+        return pItem->pUnknown->QueryInterface(riid, ppv);
+    }
+
+    STDMETHODIMP SetUnknown(REFGUID guidKey, IUnknown *pUnknown)
+    {
+        Item item(ITEM_UNKNOWN);
+        item.pUnknown = pUnknown;
+        return Set(guidKey, item);
+    }
+
+    STDMETHODIMP DeleteItem(REFGUID guidKey)
+    {
+        typename std::map<GUID, Item>::iterator it = m_Items.find(guidKey);
+        if (it != m_Items.end())
+        {
+            SafeRelease(&it->second.pUnknown);
+            m_Items.erase(it);
+        }
+        return S_OK;
+    }
+
+    STDMETHODIMP DeleteAllItems()
+    {
+        for (typename std::map<GUID, Item>::iterator it = m_Items.begin(); it != m_Items.end(); ++it)
+        {
+            SafeRelease(&it->second.pUnknown);
+        }
+        m_Items.clear();
+        return S_OK;
+    }
+
+    STDMETHODIMP GetCount(UINT32 *pcItems)
+    {
+        *pcItems = (UINT32)m_Items.size();
+        return S_OK;
+    }
+
+    STDMETHODIMP CopyAllItems(IMFAttributes *pDest)
+    {
+        HRESULT hr = pDest->DeleteAllItems();
+        for (typename std::map<GUID, Item>::iterator it = m_Items.begin(); SUCCEEDED(hr) && it != m_Items.end(); ++it)
+        {
+            Item const & item = it->second;
+            switch (item.eType)
+            {
+            case ITEM_UINT32:
+                hr = pDest->SetUINT32(it->first, (UINT32)item.uValue);
+                break;
+            case ITEM_UINT64:
+                hr = pDest->SetUINT64(it->first, item.uValue);
+                break;
+            case ITEM_DOUBLE:
+                hr = pDest->SetDouble(it->first, item.fValue);
+                break;
+            case ITEM_GUID:
+                hr = pDest->SetGUID(it->first, item.guidValue);
+                break;
+            case ITEM_BLOB:
+                hr = pDest->SetBlob(it->first, item.blob.data(), (UINT32)item.blob.size());
+                break;
+            case ITEM_UNKNOWN:
+                hr = pDest->SetUnknown(it->first, item.pUnknown);
+                break;
+            }
+        }
+        return hr;
+    }
+
+protected:
+    ~FakeAttributes()
+    {
+        (void)DeleteAllItems();
+    }
+
+private:
+    enum ItemType
+    {
+        ITEM_UINT32,
+        ITEM_UINT64,
+        ITEM_DOUBLE,
+        ITEM_GUID,
+        ITEM_BLOB,
+        ITEM_UNKNOWN,
+    };
+
+    struct Item
+    {
+        Item(ItemType e = ITEM_UINT32) : eType(e), uValue(0), fValue(0), guidValue(GUID_NULL), pUnknown(NULL) {}
+
+        ItemType            eType;
+        UINT64              uValue;
+        double              fValue;
+        GUID                guidValue;
+        std::vector<BYTE>   blob;
+        IUnknown            *pUnknown;
+    };
+
+    HRESULT Find(REFGUID guidKey, ItemType eType, Item const **ppItem) const
+    {
+        typename std::map<GUID, Item>::const_iterator it = m_Items.find(guidKey);
+        if (it == m_Items.end())
+        {
+            return MF_E_ATTRIBUTENOTFOUND;
+        }
+        if (it->second.eType != eType)
+        {
+            return MF_E_INVALIDTYPE;
+        }
+        *ppItem = &it->second;
+        return S_OK;
+    }
+
+    HRESULT Set(REFGUID guidKey, Item const & item)
+    {
+        try
+        {
+            Item & slot = m_Items[guidKey];
+            if (item.pUnknown)
+            {
+                item.pUnknown->AddRef();
+            }
+            SafeRelease(&slot.pUnknown);
+            slot = item;
+        }
+        catch (std::bad_alloc const &)
+        {
+            return E_OUTOFMEMORY;
+        }
+        return S_OK;
+    }
+
+private:
+    std::map<GUID, Item>    m_Items;
+};
+
+/* FakeMediaType class */
+
+class FakeMediaType final : public FakeAttributes<IMFMediaType>
+{
+public:
+    static HRESULT Create(IMFMediaType **ppType)
+    {
+        FakeMediaType *pType = new (std::nothrow) FakeMediaType();
+        if (pType == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        ++t_cMediaTypes;
+        *ppType = pType;
+        return S_OK;
+    }
+
+    STDMETHODIMP QueryInterface(REFIID riid, void **ppv)
+    {
+        if (riid == IUnknown::Iid() || riid == IMFAttributes::Iid() || riid == IMFMediaType::Iid())
+        {
+            *ppv = static_cast<IMFMediaType *>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppv = NULL;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHODIMP_(ULONG) AddRef() { return InterlockedIncrement(&m_cRef); }
+
+    STDMETHODIMP_(ULONG) Release()
+    {
+        long cRef = InterlockedDecrement(&m_cRef);
+        if (cRef == 0)
+        {
+            delete this;
+        }
+        return (ULONG)cRef;
+    }
+
+    STDMETHODIMP GetMajorType(GUID *pguidMajorType)
+    {
+        return GetGUID(MF_MT_MAJOR_TYPE, pguidMajorType);
+    }
+
+private:
+    FakeMediaType() : m_cRef(1) {}
+
+private:
+    long    m_cRef;
+};
+
+/* FakeSample class */
+
+//-------------------------------------------------------------------
+// FakeSample
+// A sample, tracked or not. When the last reference to a tracked
+// sample with an allocator goes, the sample lives on, and the
+// allocator is called with it as the object of the result, once: it
+// has to set the allocator again to be called again.
+//-------------------------------------------------------------------
+
+class FakeSample final : public FakeAttributes<IMFSample>, public IMFTrackedSample
+{
+public:
+    static HRESULT Create(BOOL bTracked, FakeSample **ppSample)
+    {
+        FakeSample *pSample = new (std::nothrow) FakeSample(bTracked);
+        if (pSample == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        ++t_cSamples;
+        *ppSample = pSample;
+        return S_OK;
+    }
+
+    STDMETHODIMP QueryInterface(REFIID riid, void **ppv)
+    {
+        if (riid == IUnknown::Iid() || riid == IMFAttributes::Iid() || riid == IMFSample::Iid())
+        {
+            *ppv = static_cast<IMFSample *>(this);
+        }
+        else if (riid == IMFTrackedSample::Iid() && m_bTracked)
+        {
+            *ppv = static_cast<IMFTrackedSample *>(this);
+        }
+        else
+        {
+            *ppv = NULL;
+            return E_NOINTERFACE;
+        }
+        AddRef();
+        return S_OK;
+    }
+
+    STDMETHODIMP_(ULONG) AddRef() { return InterlockedIncrement(&m_cRef); }
+
+    STDMETHODIMP_(ULONG) Release()
+    {
+        long cRef = InterlockedDecrement(&m_cRef);
+        if (cRef != 0)
+        {
+            return (ULONG)cRef;
+        }
+
+        IMFAsyncCallback *pAllocator = m_pAllocator;
+        IUnknown *pState = m_pAllocatorState;
+        m_pAllocator = NULL;
+        m_pAllocatorState = NULL;
+        if (pAllocator == NULL)
+        {
+            delete this;
+            return 0;
+        }
+
+        // The result holds the only reference.
+        FakeAsyncResult *pResult = new (std::nothrow) FakeAsyncResult(static_cast<IMFSample *>(this), pState);
+        if (pResult)
+        {
+            (void)pAllocator->Invoke(pResult);
+            pResult->Release();
+        }
+        else
+        {
+            delete this;
+        }
+        SafeRelease(&pState);
+        SafeRelease(&pAllocator);
+        return 0;
+    }
+
+    // IMFSample
+
+    STDMETHODIMP GetSampleTime(LONGLONG *phnsSampleTime)
+    {
+        if (!m_bTime)
+        {
+            return MF_E_ATTRIBUTENOTFOUND;
+        }
+        *phnsSampleTime = m_hnsTime;
+        return S_OK;
+    }
+
+    STDMETHODIMP SetSampleTime(LONGLONG hnsSampleTime)
+    {
+        m_hnsTime = hnsSampleTime;
+        m_bTime = TRUE;
+        return S_OK;
+    }
+
+    STDMETHODIMP GetSampleDuration(LONGLONG *phnsSampleDuration)
+    {
+        if (!m_bDuration)
+        {
+            return MF_E_ATTRIBUTENOTFOUND;
+        }
+        *phnsSampleDuration = m_hnsDuration;
+        return S_OK;
+    }
+
+    STDMETHODIMP SetSampleDuration(LONGLONG hnsSampleDuration)
+    {
+        m_hnsDuration = hnsSampleDuration;
+        m_bDuration = TRUE;
+        return S_OK;
+    }
+
+    STDMETHODIMP GetBufferCount(DWORD *pdwBufferCount)
+    {
+        *pdwBufferCount = (DWORD)m_Buffers.size();
+        return S_OK;
+    }
+
+    STDMETHODIMP GetBufferByIndex(DWORD dwIndex, IMFMediaBuffer **ppBuffer)
+    {
+        if (dwIndex >= m_Buffers.size())
+        {
+            *ppBuffer = NULL;
+            return E_INVALIDARG;
+        }
+        *ppBuffer = m_Buffers[dwIndex];
+        (*ppBuffer)->AddRef();
+        return S_OK;
+    }
+
+    // Copies the buffers into a new one if there are several, as the
+    // platform does.
+    STDMETHODIMP ConvertToContiguousBuffer(IMFMediaBuffer **ppBuffer)
+    {
+        if (m_Buffers.size() == 1)
+        {
+            return GetBufferByIndex(0, ppBuffer);
+        }
+
+        DWORD cbTotal = 0;
+        HRESULT hr = GetTotalLength(&cbTotal);
+        IMFMediaBuffer *pBuffer = NULL;
+        BYTE *pDst = NULL;
+        if (SUCCEEDED(hr))
+        {
+            hr = MFCreateMemoryBuffer(cbTotal, &pBuffer);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = pBuffer->Lock(&pDst, NULL, NULL);
+        }
+        for (size_t i = 0; SUCCEEDED(hr) && i < m_Buffers.size(); ++i)
+        {
+            BYTE *pSrc = NULL;
+            DWORD cbSrc = 0;
+            hr = m_Buffers[i]->Lock(&pSrc, NULL, &cbSrc);
+            if (SUCCEEDED(hr))
+            {
+                CopyMemory(pDst, pSrc, cbSrc);
+                pDst += cbSrc;
+                hr = m_Buffers[i]->Unlock();
+            }
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = pBuffer->SetCurrentLength(cbTotal);
+        }
+        if (SUCCEEDED(hr))
+        {
+            (void)RemoveAllBuffers();
+            hr = AddBuffer(pBuffer);
+        }
+        if (SUCCEEDED(hr))
+        {
+            *ppBuffer = pBuffer;
+            pBuffer = NULL;
+        }
+        SafeRelease(&pBuffer);
+        return hr;
+    }
+
+    STDMETHODIMP AddBuffer(IMFMediaBuffer *pBuffer)
+    {
+        try
+        {
+            m_Buffers.push_back(pBuffer);
+        }
+        catch (std::bad_alloc const &)
+        {
+            return E_OUTOFMEMORY;
+        }
+        pBuffer->AddRef();
+        return S_OK;
+    }
+
+    STDMETHODIMP RemoveAllBuffers()
+    {
+        for (size_t i = 0; i < m_Buffers.size(); ++i)
+        {
+            SafeRelease(&m_Buffers[i]);
+        }
+        m_Buffers.clear();
+        return S_OK;
+    }
+
+    STDMETHODIMP GetTotalLength(DWORD *pcbTotalLength)
+    {
+        DWORD cbTotal = 0;
+        for (size_t i = 0; i < m_Buffers.size(); ++i)
+        {
+            DWORD cbBuffer = 0;
+            (void)m_Buffers[i]->GetCurrentLength(&cbBuffer);
+            cbTotal += cbBuffer;
+        }
+        *pcbTotalLength = cbTotal;
+        return S_OK;
+    }
+
+    // IMFTrackedSample
+
+    STDMETHODIMP SetAllocator(IMFAsyncCallback *pSampleAllocator, IUnknown *pUnkState)
+    {
+        if (m_pAllocator)
+        {
+            return MF_E_NOTACCEPTING;
+        }
+        m_pAllocator = pSampleAllocator;
+        m_pAllocator->AddRef();
+        m_pAllocatorState = pUnkState;
+        if (m_pAllocatorState)
+        {
+            m_pAllocatorState->AddRef();
+        }
+        return S_OK;
+    }
+
+private:
+    FakeSample(BOOL bTracked)
+        : m_cRef(1)
+        , m_bTracked(bTracked)
+        , m_hnsTime(0)
+        , m_hnsDuration(0)
+        , m_bTime(FALSE)
+        , m_bDuration(FALSE)
+        , m_pAllocator(NULL)
+        , m_pAllocatorState(NULL)
+    {
+    }
+
+    ~FakeSample()
+    {
+        (void)RemoveAllBuffers();
+    }
+
+private:
+    long                            m_cRef;
+    BOOL                            m_bTracked;
+    std::vector<IMFMediaBuffer *>   m_Buffers;
+    LONGLONG                        m_hnsTime;
+    LONGLONG                        m_hnsDuration;
+    BOOL                            m_bTime;
+    BOOL                            m_bDuration;
+    IMFAsyncCallback                *m_pAllocator;
+    IUnknown                        *m_pAllocatorState;
+};
+
+/* Functions */
+
+UINT32 MFGetAttributeUINT32(IMFAttributes *pAttributes, REFGUID guidKey, UINT32 unDefault)
+{
+    UINT32 unValue = unDefault;
+    if (FAILED(pAttributes->GetUINT32(guidKey, &unValue)))
+    {
+        unValue = unDefault;
+    }
+    return unValue;
+}
+
+HRESULT MFSetAttributeSize(IMFAttributes *pAttributes, REFGUID guidKey, UINT32 unWidth, UINT32 unHeight)
+{
+    return pAttributes->SetUINT64(guidKey, ((UINT64)unWidth << 32) | unHeight);
+}
+
+HRESULT MFGetAttributeSize(IMFAttributes *pAttributes, REFGUID guidKey, UINT32 *punWidth, UINT32 *punHeight)
+{
+    UINT64 unValue = 0;
+    HRESULT hr = pAttributes->GetUINT64(guidKey, &unValue);
+    if (SUCCEEDED(hr))
+    {
+        *punWidth = (UINT32)(unValue >> 32);
+        *punHeight = (UINT32)unValue;
+    }
+    return hr;
+}
+
+HRESULT MFSetAttributeRatio(IMFAttributes *pAttributes, REFGUID guidKey, UINT32 unNumerator, UINT32 unDenominator)
+{
+    return MFSetAttributeSize(pAttributes, guidKey, unNumerator, unDenominator);
+}
+
+HRESULT MFGetAttributeRatio(IMFAttributes *pAttributes, REFGUID guidKey, UINT32 *punNumerator, UINT32 *punDenominator)
+{
+    return MFGetAttributeSize(pAttributes, guidKey, punNumerator, punDenominator);
+}
+
+HRESULT MFCreateMediaType(IMFMediaType **ppMediaType)
+{
+    return FakeMediaType::Create(ppMediaType);
+}
+
+HRESULT MFCreateSample(IMFSample **ppSample)
+{
+    FakeSample *pSample = NULL;
+    HRESULT hr = FakeSample::Create(FALSE, &pSample);
+    *ppSample = pSample;
+    return hr;
+}
+
+HRESULT MFCreateTrackedSample(IMFTrackedSample **ppSample)
+{
+    FakeSample *pSample = NULL;
+    HRESULT hr = FakeSample::Create(TRUE, &pSample);
+    *ppSample = pSample;
+    return hr;
+}
+
+HRESULT MFCreateMemoryBuffer(DWORD cbMaxLength, IMFMediaBuffer **ppBuffer)
+{
+    return FakeBuffer::Create(cbMaxLength, MF_16_BYTE_ALIGNMENT + 1, ppBuffer);
+}
+
+HRESULT MFCreateAlignedMemoryBuffer(DWORD cbMaxLength, DWORD fAlignmentFlags, IMFMediaBuffer **ppBuffer)
+{
+    DWORD cbAlignment = fAlignmentFlags + 1;
+    if ((cbAlignment & fAlignmentFlags) != 0)
+    {
+        return E_INVALIDARG;
+    }
+    return FakeBuffer::Create(cbMaxLength, max(cbAlignment, (DWORD)MF_16_BYTE_ALIGNMENT + 1), ppBuffer);
+}
+
+HRESULT MFCreate2DMediaBuffer(DWORD dwWidth, DWORD dwHeight, DWORD dwFourCC, BOOL fBottomUp, IMFMediaBuffer **ppBuffer)
+{
+    (void)dwFourCC;
+    (void)fBottomUp;
+    return FakeBuffer::Create(dwWidth * dwHeight * 4, MF_16_BYTE_ALIGNMENT + 1, ppBuffer);
+}
+
+UINT64 FakeMF_MediaTypeCount()
+{
+    return t_cMediaTypes;
+}
+
+UINT64 FakeMF_SampleCount()
+{
+    return t_cSamples;
+}
+
+UINT64 FakeMF_BufferCount()
+{
+    return t_cBuffers;
+}
+
+UINT64 FakeMF_BufferBytes()
+{
+    return t_cbBuffers;
+}
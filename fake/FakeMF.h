@@ -0,0 +1,372 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FakeMF.h
+// The part of COM and Media Foundation the sample classes use, to
+// build them against the fake runtime.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FakeWin32.h"
+
+//-------------------------------------------------------------------
+// The sample classes and PpboxMediaType.cpp include <mfapi.h>, which
+// is fake/mfapi.h in this build. Samples, media types, buffers and
+// attributes behave as the platform ones do for the calls the classes
+// make: reference counting, shared buffers, aligned buffers, and
+// tracked samples that call their allocator back when the last
+// reference goes.
+//
+// Interfaces are plain abstract classes. IID_PPV_ARGS takes the IID
+// from the static Iid of the interface.
+//
+// The objects created are counted, per thread, for the benchmarks.
+//-------------------------------------------------------------------
+
+#ifndef _WIN32
+
+struct GUID
+{
+    UINT32  Data1;
+    UINT16  Data2;
+    UINT16  Data3;
+    BYTE    Data4[8];
+};
+
+typedef GUID            IID;
+typedef GUID const &    REFGUID;
+typedef IID const &     REFIID;
+
+inline bool operator==(GUID const & a, GUID const & b) { return memcmp(&a, &b, sizeof(GUID)) == 0; }
+inline bool operator!=(GUID const & a, GUID const & b) { return !(a == b); }
+inline bool operator<(GUID const & a, GUID const & b) { return memcmp(&a, &b, sizeof(GUID)) < 0; }
+inline BOOL IsEqualGUID(REFGUID a, REFGUID b) { return a == b; }
+
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    static GUID const name = {l, w1, w2, {b1, b2, b3, b4, b5, b6, b7, b8}}
+
+DEFINE_GUID(GUID_NULL, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+#define STDMETHODCALLTYPE
+#define STDMETHODIMP                HRESULT
+#define STDMETHODIMP_(type)         type
+#define STDMETHOD(method)           virtual HRESULT method
+#define STDMETHOD_(type, method)    virtual type method
+
+template <class T> inline IID const & FakeIidOf(T **) { return T::Iid(); }
+#define IID_PPV_ARGS(pp)            FakeIidOf(pp), reinterpret_cast<void **>(pp)
+
+#define MF_E_ATTRIBUTENOTFOUND      ((HRESULT)0xC00D36E6)
+#define MF_E_INVALIDMEDIATYPE       ((HRESULT)0xC00D36B4)
+#define MF_E_NOTACCEPTING           ((HRESULT)0xC00D36B5)
+#define MF_E_INVALIDTYPE            ((HRESULT)0xC00D36BD)
+
+#define MF_16_BYTE_ALIGNMENT        0x0000000f
+#define MF_64_BYTE_ALIGNMENT        0x0000003f
+
+DEFINE_GUID(MFSampleExtension_Discontinuity,
+    0x9cdf01d9, 0xa0f0, 0x43ba, 0xb0, 0x77, 0xea, 0xa0, 0x6c, 0xbd, 0x72, 0x8a);
+
+// Media type attributes.
+DEFINE_GUID(MF_MT_MAJOR_TYPE,
+    0x48eba18e, 0xf8c9, 0x4687, 0xbf, 0x11, 0x0a, 0x74, 0xc9, 0xf9, 0x6a, 0x8f);
+DEFINE_GUID(MF_MT_SUBTYPE,
+    0xf7e34c9a, 0x42e8, 0x4714, 0xb7, 0x4b, 0xcb, 0x29, 0xd7, 0x2c, 0x35, 0xe5);
+DEFINE_GUID(MF_MT_USER_DATA,
+    0xb6bc765f, 0x4c3b, 0x40a4, 0xbd, 0x51, 0x25, 0x35, 0xb6, 0x6f, 0xe0, 0x9d);
+DEFINE_GUID(MF_MT_FRAME_SIZE,
+    0x1652c33d, 0xd6b2, 0x4012, 0xb8, 0x34, 0x72, 0x03, 0x08, 0x49, 0xa3, 0x7d);
+DEFINE_GUID(MF_MT_FRAME_RATE,
+    0xc459a2e8, 0x3d2c, 0x4e44, 0xb1, 0x32, 0xfe, 0xe5, 0x15, 0x6c, 0x7b, 0xb0);
+DEFINE_GUID(MF_MT_PIXEL_ASPECT_RATIO,
+    0xc6376a1e, 0x8d0a, 0x4027, 0xbe, 0x45, 0x6d, 0x9a, 0x0a, 0xd3, 0x9b, 0xb6);
+DEFINE_GUID(MF_MT_INTERLACE_MODE,
+    0xe2724bb8, 0xe676, 0x4806, 0xb4, 0xb2, 0xa8, 0xd6, 0xef, 0xb4, 0x4c, 0xcd);
+DEFINE_GUID(MF_MT_MPEG2_PROFILE,
+    0xad76a80b, 0x2d5c, 0x4e0b, 0xb3, 0x75, 0x64, 0xe5, 0x20, 0x13, 0x70, 0x36);
+DEFINE_GUID(MF_MT_MPEG2_LEVEL,
+    0x96f66574, 0x11c5, 0x4015, 0x86, 0x66, 0xbf, 0xf5, 0x16, 0x43, 0x6d, 0xa7);
+DEFINE_GUID(MF_MT_MPEG_SEQUENCE_HEADER,
+    0x3c036de7, 0x3ad0, 0x4c9e, 0x92, 0x16, 0xee, 0x6d, 0x6a, 0xc2, 0x1c, 0xb3);
+DEFINE_GUID(MF_MT_VIDEO_NOMINAL_RANGE,
+    0xc21b8ee5, 0xb956, 0x4071, 0x8d, 0xaf, 0x32, 0x5e, 0xdf, 0x5c, 0xab, 0x11);
+DEFINE_GUID(MF_MT_VIDEO_PRIMARIES,
+    0xdbfbe4d7, 0x0740, 0x4ee0, 0x81, 0x92, 0x85, 0x0a, 0xb0, 0xe2, 0x19, 0x35);
+DEFINE_GUID(MF_MT_TRANSFER_FUNCTION,
+    0x5fb0fce9, 0xbe5c, 0x4935, 0xa8, 0x11, 0xec, 0x83, 0x8f, 0x8e, 0xed, 0x93);
+DEFINE_GUID(MF_MT_YUV_MATRIX,
+    0x3e23d450, 0x2c75, 0x4d25, 0xa0, 0x0e, 0xb9, 0x16, 0x70, 0xd1, 0x23, 0x27);
+DEFINE_GUID(MF_MT_AUDIO_NUM_CHANNELS,
+    0x37e48bf5, 0x645e, 0x4c5b, 0x89, 0xde, 0xad, 0xa9, 0xe2, 0x9b, 0x69, 0x6a);
+DEFINE_GUID(MF_MT_AUDIO_SAMPLES_PER_SECOND,
+    0x5faeeae7, 0x0290, 0x4c31, 0x9e, 0x8a, 0xc5, 0x34, 0xf6, 0x8d, 0x9d, 0xba);
+DEFINE_GUID(MF_MT_AUDIO_AVG_BYTES_PER_SECOND,
+    0x1aab75c8, 0xcfef, 0x451c, 0xab, 0x95, 0xac, 0x03, 0x4b, 0x8e, 0x17, 0x31);
+DEFINE_GUID(MF_MT_AUDIO_BLOCK_ALIGNMENT,
+    0x322de230, 0x9eeb, 0x43bd, 0xab, 0x7a, 0xff, 0x41, 0x22, 0x51, 0x54, 0x1d);
+DEFINE_GUID(MF_MT_AUDIO_BITS_PER_SAMPLE,
+    0xf2deb57f, 0x40fa, 0x4764, 0xaa, 0x33, 0xed, 0x4f, 0x2d, 0x1f, 0xf6, 0x69);
+DEFINE_GUID(MF_MT_AAC_PAYLOAD_TYPE,
+    0xbfbabe79, 0x7434, 0x4d1c, 0x94, 0xf0, 0x72, 0xa3, 0xb9, 0xe1, 0x71, 0x88);
+DEFINE_GUID(MF_MT_AAC_AUDIO_PROFILE_LEVEL_INDICATION,
+    0x7632f0e6, 0x9538, 0x4d61, 0xac, 0xda, 0xea, 0x29, 0xc8, 0xc1, 0x44, 0x56);
+
+// Major types and subtypes. Most subtypes are a FourCC or a wave
+// format tag in the base GUID.
+#define FAKE_MF_BASE_GUID(name, l) \
+    DEFINE_GUID(name, l, 0x0000, 0x0010, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71)
+
+FAKE_MF_BASE_GUID(MFMediaType_Video,        0x73646976);
+FAKE_MF_BASE_GUID(MFMediaType_Audio,        0x73647561);
+FAKE_MF_BASE_GUID(MFVideoFormat_H264,       0x34363248);
+FAKE_MF_BASE_GUID(MFVideoFormat_MP4V,       0x5634504d);
+FAKE_MF_BASE_GUID(MFVideoFormat_WMV2,       0x32564d57);
+FAKE_MF_BASE_GUID(MFVideoFormat_WMV3,       0x33564d57);
+FAKE_MF_BASE_GUID(MFVideoFormat_I420,       0x30323449);
+FAKE_MF_BASE_GUID(MFVideoFormat_NV12,       0x3231564e);
+FAKE_MF_BASE_GUID(MFVideoFormat_RGB24,      20);
+FAKE_MF_BASE_GUID(MFVideoFormat_RGB32,      22);
+FAKE_MF_BASE_GUID(MFAudioFormat_PCM,        0x0001);
+FAKE_MF_BASE_GUID(MFAudioFormat_Float,      0x0003);
+FAKE_MF_BASE_GUID(MFAudioFormat_MPEG,       0x0050);
+FAKE_MF_BASE_GUID(MFAudioFormat_MP3,        0x0055);
+FAKE_MF_BASE_GUID(MFAudioFormat_WMAudioV8,  0x0161);
+FAKE_MF_BASE_GUID(MFAudioFormat_AAC,        0x1610);
+DEFINE_GUID(MFAudioFormat_Dolby_AC3,
+    0xe06d802c, 0xdb46, 0x11cf, 0xb4, 0xd1, 0x00, 0x80, 0x5f, 0x6c, 0xbb, 0xea);
+DEFINE_GUID(MFAudioFormat_Dolby_DDPlus,
+    0xa7fb87af, 0x2d02, 0x42fb, 0xa4, 0xd4, 0x05, 0xcd, 0x93, 0x84, 0x3b, 0xdd);
+
+enum MFVideoInterlaceMode
+{
+    MFVideoInterlace_Unknown = 0,
+    MFVideoInterlace_Progressive = 2,
+    MFVideoInterlace_MixedInterlaceOrProgressive = 7,
+};
+
+enum MFNominalRange
+{
+    MFNominalRange_Unknown = 0,
+    MFNominalRange_0_255 = 1,
+    MFNominalRange_16_235 = 2,
+};
+
+enum MFVideoPrimaries
+{
+    MFVideoPrimaries_Unknown = 0,
+    MFVideoPrimaries_BT709 = 2,
+    MFVideoPrimaries_BT470_2_SysM = 3,
+    MFVideoPrimaries_BT470_2_SysBG = 4,
+    MFVideoPrimaries_SMPTE170M = 5,
+    MFVideoPrimaries_SMPTE240M = 6,
+};
+
+enum MFVideoTransferFunction
+{
+    MFVideoTransFunc_Unknown = 0,
+    MFVideoTransFunc_10 = 1,
+    MFVideoTransFunc_22 = 4,
+    MFVideoTransFunc_709 = 5,
+    MFVideoTransFunc_240M = 6,
+    MFVideoTransFunc_28 = 8,
+};
+
+enum MFVideoTransferMatrix
+{
+    MFVideoTransferMatrix_Unknown = 0,
+    MFVideoTransferMatrix_BT709 = 1,
+    MFVideoTransferMatrix_BT601 = 2,
+    MFVideoTransferMatrix_SMPTE240M = 3,
+};
+
+// The wave formats of the AAC media type, packed as in mmreg.h.
+#define WAVE_FORMAT_MPEG_HEAAC      0x1610
+
+#pragma pack(push, 1)
+
+typedef struct tWAVEFORMATEX
+{
+    WORD    wFormatTag;
+    WORD    nChannels;
+    DWORD   nSamplesPerSec;
+    DWORD   nAvgBytesPerSec;
+    WORD    nBlockAlign;
+    WORD    wBitsPerSample;
+    WORD    cbSize;
+} WAVEFORMATEX, *PWAVEFORMATEX;
+
+typedef struct heaacwaveinfo_tag
+{
+    WAVEFORMATEX    wfx;
+    WORD            wPayloadType;
+    WORD            wAudioProfileLevelIndication;
+    WORD            wStructType;
+    WORD            wReserved1;
+    DWORD           dwReserved2;
+} HEAACWAVEINFO, *PHEAACWAVEINFO;
+
+typedef struct heaacwaveformat_tag
+{
+    HEAACWAVEINFO   wfInfo;
+    BYTE            pbAudioSpecificConfig[1];
+} HEAACWAVEFORMAT, *PHEAACWAVEFORMAT;
+
+#pragma pack(pop)
+
+// Only NULL is passed for the value.
+struct PROPVARIANT;
+
+struct IUnknown
+{
+    static IID const & Iid();
+
+    STDMETHOD(QueryInterface)(REFIID riid, void **ppv) = 0;
+    STDMETHOD_(ULONG, AddRef)() = 0;
+    STDMETHOD_(ULONG, Release)() = 0;
+};
+
+struct IMFAttributes : public IUnknown
+{
+    static IID const & Iid();
+
+    STDMETHOD(GetItem)(REFGUID guidKey, PROPVARIANT *pValue) = 0;
+    STDMETHOD(GetUINT32)(REFGUID guidKey, UINT32 *punValue) = 0;
+    STDMETHOD(SetUINT32)(REFGUID guidKey, UINT32 unValue) = 0;
+    STDMETHOD(GetUINT64)(REFGUID guidKey, UINT64 *punValue) = 0;
+    STDMETHOD(SetUINT64)(REFGUID guidKey, UINT64 unValue) = 0;
+    STDMETHOD(GetDouble)(REFGUID guidKey, double *pfValue) = 0;
+    STDMETHOD(SetDouble)(REFGUID guidKey, double fValue) = 0;
+    STDMETHOD(GetGUID)(REFGUID guidKey, GUID *pguidValue) = 0;
+    STDMETHOD(SetGUID)(REFGUID guidKey, REFGUID guidValue) = 0;
+    STDMETHOD(GetBlobSize)(REFGUID guidKey, UINT32 *pcbBlobSize) = 0;
+    STDMETHOD(GetBlob)(REFGUID guidKey, UINT8 *pBuf, UINT32 cbBufSize, UINT32 *pcbBlobSize) = 0;
+    STDMETHOD(SetBlob)(REFGUID guidKey, UINT8 const *pBuf, UINT32 cbBufSize) = 0;
+    STDMETHOD(GetUnknown)(REFGUID guidKey, REFIID riid, void **ppv) = 0;
+    STDMETHOD(SetUnknown)(REFGUID guidKey, IUnknown *pUnknown) = 0;
+    STDMETHOD(DeleteItem)(REFGUID guidKey) = 0;
+    STDMETHOD(DeleteAllItems)() = 0;
+    STDMETHOD(GetCount)(UINT32 *pcItems) = 0;
+    STDMETHOD(CopyAllItems)(IMFAttributes *pDest) = 0;
+};
+
+struct IMFMediaType : public IMFAttributes
+{
+    static IID const & Iid();
+
+    STDMETHOD(GetMajorType)(GUID *pguidMajorType) = 0;
+};
+
+struct IMFMediaBuffer : public IUnknown
+{
+    static IID const & Iid();
+
+    STDMETHOD(Lock)(BYTE **ppbBuffer, DWORD *pcbMaxLength, DWORD *pcbCurrentLength) = 0;
+    STDMETHOD(Unlock)() = 0;
+    STDMETHOD(GetCurrentLength)(DWORD *pcbCurrentLength) = 0;
+    STDMETHOD(SetCurrentLength)(DWORD cbCurrentLength) = 0;
+    STDMETHOD(GetMaxLength)(DWORD *pcbMaxLength) = 0;
+};
+
+struct IMFSample : public IMFAttributes
+{
+    static IID const & Iid();
+
+    STDMETHOD(GetSampleTime)(LONGLONG *phnsSampleTime) = 0;
+    STDMETHOD(SetSampleTime)(LONGLONG hnsSampleTime) = 0;
+    STDMETHOD(GetSampleDuration)(LONGLONG *phnsSampleDuration) = 0;
+    STDMETHOD(SetSampleDuration)(LONGLONG hnsSampleDuration) = 0;
+    STDMETHOD(GetBufferCount)(DWORD *pdwBufferCount) = 0;
+    STDMETHOD(GetBufferByIndex)(DWORD dwIndex, IMFMediaBuffer **ppBuffer) = 0;
+    STDMETHOD(ConvertToContiguousBuffer)(IMFMediaBuffer **ppBuffer) = 0;
+    STDMETHOD(AddBuffer)(IMFMediaBuffer *pBuffer) = 0;
+    STDMETHOD(RemoveAllBuffers)() = 0;
+    STDMETHOD(GetTotalLength)(DWORD *pcbTotalLength) = 0;
+};
+
+struct IMFAsyncResult : public IUnknown
+{
+    static IID const & Iid();
+
+    STDMETHOD(GetState)(IUnknown **ppunkState) = 0;
+    STDMETHOD(GetStatus)() = 0;
+    STDMETHOD(SetStatus)(HRESULT hrStatus) = 0;
+    STDMETHOD(GetObject)(IUnknown **ppObject) = 0;
+};
+
+struct IMFAsyncCallback : public IUnknown
+{
+    static IID const & Iid();
+
+    STDMETHOD(GetParameters)(DWORD *pdwFlags, DWORD *pdwQueue) = 0;
+    STDMETHOD(Invoke)(IMFAsyncResult *pAsyncResult) = 0;
+};
+
+struct IMFTrackedSample : public IUnknown
+{
+    static IID const & Iid();
+
+    STDMETHOD(SetAllocator)(IMFAsyncCallback *pSampleAllocator, IUnknown *pUnkState) = 0;
+};
+
+UINT32  MFGetAttributeUINT32(IMFAttributes *pAttributes, REFGUID guidKey, UINT32 unDefault);
+
+// Two UINT32 in one UINT64 attribute, the first in the high half.
+HRESULT MFSetAttributeSize(IMFAttributes *pAttributes, REFGUID guidKey, UINT32 unWidth, UINT32 unHeight);
+HRESULT MFGetAttributeSize(IMFAttributes *pAttributes, REFGUID guidKey, UINT32 *punWidth, UINT32 *punHeight);
+HRESULT MFSetAttributeRatio(IMFAttributes *pAttributes, REFGUID guidKey, UINT32 unNumerator, UINT32 unDenominator);
+HRESULT MFGetAttributeRatio(IMFAttributes *pAttributes, REFGUID guidKey, UINT32 *punNumerator, UINT32 *punDenominator);
+
+HRESULT MFCreateMediaType(IMFMediaType **ppMediaType);
+HRESULT MFCreateSample(IMFSample **ppSample);
+HRESULT MFCreateTrackedSample(IMFTrackedSample **ppSample);
+HRESULT MFCreateMemoryBuffer(DWORD cbMaxLength, IMFMediaBuffer **ppBuffer);
+HRESULT MFCreateAlignedMemoryBuffer(DWORD cbMaxLength, DWORD fAlignmentFlags, IMFMediaBuffer **ppBuffer);
+
+// A contiguous buffer of 4 bytes per pixel, enough for the formats of
+// RawVideoConverter.
+HRESULT MFCreate2DMediaBuffer(DWORD dwWidth, DWORD dwHeight, DWORD dwFourCC, BOOL fBottomUp, IMFMediaBuffer **ppBuffer);
+
+// Objects created by the calling thread.
+UINT64  FakeMF_MediaTypeCount();
+UINT64  FakeMF_SampleCount();
+UINT64  FakeMF_BufferCount();
+UINT64  FakeMF_BufferBytes();
+
+//-------------------------------------------------------------------
+// AsyncCallback class
+// Forwards Invoke to a method of the parent, as the one of the Common
+// project does.
+//-------------------------------------------------------------------
+
+template <class T>
+class AsyncCallback : public IMFAsyncCallback
+{
+public:
+    typedef HRESULT (T::*InvokeFn)(IMFAsyncResult *pAsyncResult);
+
+    AsyncCallback(T *pParent, InvokeFn fn) : m_pParent(pParent), m_pInvokeFn(fn) {}
+
+    STDMETHODIMP QueryInterface(REFIID riid, void **ppv)
+    {
+        if (riid == IUnknown::Iid() || riid == IMFAsyncCallback::Iid())
+        {
+            *ppv = static_cast<IMFAsyncCallback *>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppv = NULL;
+        return E_NOINTERFACE;
+    }
+    STDMETHODIMP_(ULONG) AddRef() { return m_pParent->AddRef(); }
+    STDMETHODIMP_(ULONG) Release() { return m_pParent->Release(); }
+
+    STDMETHODIMP GetParameters(DWORD *, DWORD *) { return E_NOTIMPL; }
+    STDMETHODIMP Invoke(IMFAsyncResult *pAsyncResult) { return (m_pParent->*m_pInvokeFn)(pAsyncResult); }
+
+private:
+    T           *m_pParent;
+    InvokeFn    m_pInvokeFn;
+};
+
+#endif
@@ -0,0 +1,61 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FakeTrace.cpp
+// Stands in for the trace functions of the Common project in the fake
+// runtime build.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "Trace.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <wchar.h>
+
+static int s_iLevel = 0;
+static BOOL s_bOutput = FALSE;
+static UINT64 s_cTraces = 0;
+
+void FakeTrace(int iLevel, wchar_t const * pszFormat, ...)
+{
+    wchar_t szMessage[512];
+    va_list args;
+
+    va_start(args, pszFormat);
+    vswprintf(szMessage, sizeof(szMessage) / sizeof(szMessage[0]), pszFormat, args);
+    va_end(args);
+
+    if (iLevel > s_iLevel)
+    {
+        return;
+    }
+    ++s_cTraces;
+    if (s_bOutput)
+    {
+        fputws(szMessage, stderr);
+    }
+}
+
+HRESULT FakeTraceHr(HRESULT hr, char const * pszFunction)
+{
+    if (FAILED(hr))
+    {
+        FakeTrace(1, L"%s failed, hr = 0x%08X\r\n", pszFunction, (UINT32)hr);
+    }
+    return hr;
+}
+
+void FakeTrace_SetLevel(int iLevel)
+{
+    s_iLevel = iLevel;
+}
+
+void FakeTrace_SetOutput(BOOL bOutput)
+{
+    s_bOutput = bOutput;
+}
+
+UINT64 FakeTrace_Count()
+{
+    return s_cTraces;
+}
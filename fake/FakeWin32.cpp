@@ -0,0 +1,142 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FakeWin32.cpp
+// The part of Win32 the session layer uses, over the C++ library, to
+// build it against the fake runtime.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "FakeWin32.h"
+#include "FakeJustRuntime.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+static thread_local DWORD t_dwLastError = 0;
+static thread_local UINT64 t_cCopies = 0;
+static thread_local UINT64 t_cbCopied = 0;
+
+ULONGLONG GetTickCount64()
+{
+    return FakeJust_Now();
+}
+
+void FakeWin32_CopyMemory(void * pDst, void const * pSrc, size_t cb)
+{
+    memcpy(pDst, pSrc, cb);
+    ++t_cCopies;
+    t_cbCopied += cb;
+}
+
+UINT64 FakeWin32_CopyCount()
+{
+    return t_cCopies;
+}
+
+UINT64 FakeWin32_CopyBytes()
+{
+    return t_cbCopied;
+}
+
+static FILE * File(HANDLE hFile)
+{
+    return (FILE *)hFile;
+}
+
+static BOOL Fail()
+{
+    t_dwLastError = errno ? (DWORD)errno : 1;
+    return FALSE;
+}
+
+HANDLE CreateFile2(LPCWSTR pszPath, DWORD dwAccess, DWORD dwShare, DWORD dwDisposition, void * pParams)
+{
+    (void)dwShare;
+    (void)pParams;
+
+    std::string path(wcslen(pszPath) * MB_CUR_MAX + 1, '\0');
+    size_t cch = wcstombs(&path[0], pszPath, path.size());
+    if (cch == (size_t)-1)
+    {
+        t_dwLastError = EINVAL;
+        return INVALID_HANDLE_VALUE;
+    }
+    path.resize(cch);
+
+    char const * pszMode = NULL;
+    if (dwAccess == GENERIC_WRITE && dwDisposition == CREATE_ALWAYS)
+    {
+        pszMode = "wb";
+    }
+    else if (dwAccess == GENERIC_READ && dwDisposition == OPEN_EXISTING)
+    {
+        pszMode = "rb";
+    }
+    else
+    {
+        t_dwLastError = EINVAL;
+        return INVALID_HANDLE_VALUE;
+    }
+
+    FILE * file = fopen(path.c_str(), pszMode);
+    if (file == NULL)
+    {
+        Fail();
+        return INVALID_HANDLE_VALUE;
+    }
+    return file;
+}
+
+BOOL ReadFile(HANDLE hFile, void * pBuffer, DWORD cbRead, DWORD * pcbRead, void * pOverlapped)
+{
+    (void)pOverlapped;
+    *pcbRead = (DWORD)fread(pBuffer, 1, cbRead, File(hFile));
+    return ferror(File(hFile)) ? Fail() : TRUE;
+}
+
+BOOL WriteFile(HANDLE hFile, void const * pBuffer, DWORD cbWrite, DWORD * pcbWritten, void * pOverlapped)
+{
+    (void)pOverlapped;
+    *pcbWritten = (DWORD)fwrite(pBuffer, 1, cbWrite, File(hFile));
+    return *pcbWritten == cbWrite ? TRUE : Fail();
+}
+
+BOOL GetFileInformationByHandleEx(HANDLE hFile, FILE_INFO_BY_HANDLE_CLASS eClass, void * pInfo, DWORD cbInfo)
+{
+    if (eClass != FileStandardInfo || cbInfo < sizeof(FILE_STANDARD_INFO))
+    {
+        t_dwLastError = EINVAL;
+        return FALSE;
+    }
+
+    long lPos = ftell(File(hFile));
+    if (lPos < 0 || fseek(File(hFile), 0, SEEK_END) != 0)
+    {
+        return Fail();
+    }
+    long lEnd = ftell(File(hFile));
+    if (lEnd < 0 || fseek(File(hFile), lPos, SEEK_SET) != 0)
+    {
+        return Fail();
+    }
+
+    FILE_STANDARD_INFO * info = (FILE_STANDARD_INFO *)pInfo;
+    memset(info, 0, sizeof(*info));
+    info->EndOfFile.QuadPart = lEnd;
+    info->AllocationSize.QuadPart = lEnd;
+    info->NumberOfLinks = 1;
+    return TRUE;
+}
+
+BOOL CloseHandle(HANDLE hFile)
+{
+    return fclose(File(hFile)) == 0 ? TRUE : Fail();
+}
+
+DWORD GetLastError()
+{
+    return t_dwLastError;
+}
@@ -0,0 +1,120 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FakeWin32.h
+// The part of Win32 and Media Foundation the session layer uses, over
+// the C++ library, to build it against the fake runtime.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+#include <mutex>
+#include <string.h>
+
+//-------------------------------------------------------------------
+// PpboxSession, SharedSampleStore and SessionLog include <windows.h>,
+// which is fake/windows.h in this build, and then only use what is
+// declared here. The tick count is the clock of the fake runtime, so
+// a session recorded against the fake has the timing of the script.
+//-------------------------------------------------------------------
+
+#ifndef _WIN32
+
+typedef unsigned char   BOOLEAN;
+typedef uint8_t         UINT8;
+typedef uint16_t        WORD;
+typedef int64_t         INT64;
+typedef uint32_t        ULONG;
+typedef uint64_t        ULONGLONG;
+typedef wchar_t         WCHAR;
+typedef WCHAR const *   LPCWSTR;
+typedef void *          HANDLE;
+
+typedef union _LARGE_INTEGER
+{
+    struct
+    {
+        DWORD   LowPart;
+        LONG    HighPart;
+    };
+    LONGLONG    QuadPart;
+} LARGE_INTEGER;
+
+#define __cdecl
+#define __declspec(x)               FAKE_WIN32_DECLSPEC_##x
+#define FAKE_WIN32_DECLSPEC_thread  thread_local
+#define __FUNCTIONW__               L""
+
+#define HRESULT_FROM_WIN32(x) \
+    ((HRESULT)(x) <= 0 ? (HRESULT)(x) : (HRESULT)(((x) & 0x0000FFFF) | 0x80070000))
+
+#define E_UNEXPECTED                ((HRESULT)0x8000FFFF)
+#define E_POINTER                   ((HRESULT)0x80004003)
+#define E_NOINTERFACE               ((HRESULT)0x80004002)
+#define E_INVALIDARG                ((HRESULT)0x80070057)
+#define MF_E_INVALIDREQUEST         ((HRESULT)0xC00D36B2)
+#define MF_E_INVALID_FILE_FORMAT    ((HRESULT)0xC00D3E8C)
+
+// Copies are counted, per thread, for the benchmarks of the payload
+// path.
+#define CopyMemory(dst, src, size)  FakeWin32_CopyMemory((dst), (src), (size))
+#define ZeroMemory(dst, size)       memset((dst), 0, (size))
+#define ARRAYSIZE(a)                (sizeof(a) / sizeof((a)[0]))
+
+void    FakeWin32_CopyMemory(void * pDst, void const * pSrc, size_t cb);
+UINT64  FakeWin32_CopyCount();
+UINT64  FakeWin32_CopyBytes();
+
+// Reference counts are long in the sources, which is 64 bits here.
+template <class T> inline T InterlockedIncrement(T volatile * p) { return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST); }
+template <class T> inline T InterlockedDecrement(T volatile * p) { return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST); }
+
+template <class T> inline T const & min(T const & a, T const & b) { return b < a ? b : a; }
+template <class T> inline T const & max(T const & a, T const & b) { return a < b ? b : a; }
+
+ULONGLONG GetTickCount64();
+
+// Recursive, as the Win32 one.
+struct CRITICAL_SECTION
+{
+    std::recursive_mutex    mutex;
+};
+
+inline BOOL InitializeCriticalSectionEx(CRITICAL_SECTION *, DWORD, DWORD) { return TRUE; }
+inline void DeleteCriticalSection(CRITICAL_SECTION *) {}
+inline void EnterCriticalSection(CRITICAL_SECTION * cs) { cs->mutex.lock(); }
+inline void LeaveCriticalSection(CRITICAL_SECTION * cs) { cs->mutex.unlock(); }
+
+// Files, on stdio. The share mode and the security attributes are
+// ignored.
+#define INVALID_HANDLE_VALUE        ((HANDLE)(intptr_t)-1)
+#define GENERIC_READ                0x80000000
+#define GENERIC_WRITE               0x40000000
+#define FILE_SHARE_READ             0x00000001
+#define CREATE_ALWAYS               2
+#define OPEN_EXISTING               3
+
+enum FILE_INFO_BY_HANDLE_CLASS
+{
+    FileStandardInfo = 1,
+};
+
+struct FILE_STANDARD_INFO
+{
+    LARGE_INTEGER   AllocationSize;
+    LARGE_INTEGER   EndOfFile;
+    DWORD           NumberOfLinks;
+    BOOLEAN         DeletePending;
+    BOOLEAN         Directory;
+};
+
+HANDLE  CreateFile2(LPCWSTR pszPath, DWORD dwAccess, DWORD dwShare, DWORD dwDisposition, void * pParams);
+BOOL    ReadFile(HANDLE hFile, void * pBuffer, DWORD cbRead, DWORD * pcbRead, void * pOverlapped);
+BOOL    WriteFile(HANDLE hFile, void const * pBuffer, DWORD cbWrite, DWORD * pcbWritten, void * pOverlapped);
+BOOL    GetFileInformationByHandleEx(HANDLE hFile, FILE_INFO_BY_HANDLE_CLASS eClass, void * pInfo, DWORD cbInfo);
+BOOL    CloseHandle(HANDLE hFile);
+DWORD   GetLastError();
+
+#endif
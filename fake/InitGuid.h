@@ -0,0 +1,10 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// InitGuid.h
+// Stands in for the GUID definition header in the fake runtime build.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FakeMF.h"
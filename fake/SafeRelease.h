@@ -0,0 +1,18 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SafeRelease.h
+// Stands in for the header of the Common project in the fake runtime
+// build.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+template <class T> void SafeRelease(T **ppT)
+{
+    if (*ppT)
+    {
+        (*ppT)->Release();
+        *ppT = NULL;
+    }
+}
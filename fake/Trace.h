@@ -0,0 +1,28 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// Trace.h
+// Stands in for the trace header of the Common project in the fake
+// runtime build.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PortableTypes.h"
+
+//-------------------------------------------------------------------
+// TRACE formats its message, as the real one does, before checking
+// the level against FakeTrace_SetLevel. Messages that pass are
+// counted, not printed, unless FakeTrace_SetOutput is on.
+//-------------------------------------------------------------------
+
+void    FakeTrace(int iLevel, wchar_t const * pszFormat, ...);
+HRESULT FakeTraceHr(HRESULT hr, char const * pszFunction);
+
+void    FakeTrace_SetLevel(int iLevel);
+void    FakeTrace_SetOutput(BOOL bOutput);
+UINT64  FakeTrace_Count();
+
+#define TRACE(level, ...)   FakeTrace((level), __VA_ARGS__)
+
+#define TRACEHR_RET(hr)     return FakeTraceHr((hr), __FUNCTION__)
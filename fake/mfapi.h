@@ -0,0 +1,10 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// mfapi.h
+// Stands in for the Media Foundation header in the fake runtime build.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FakeMF.h"
@@ -0,0 +1,10 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// windows.h
+// Stands in for the Windows header in the fake runtime build.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FakeWin32.h"
@@ -0,0 +1,10 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// wmcodecdsp.h
+// Stands in for the Windows codec header in the fake runtime build.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FakeMF.h"
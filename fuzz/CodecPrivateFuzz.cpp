@@ -0,0 +1,160 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// CodecPrivateFuzz.cpp
+// Fuzz target for the codec private data parsers.
+//
+// Built with -fsanitize=fuzzer, it is a libFuzzer target. Otherwise
+// CODEC_PRIVATE_FUZZ_DRIVER adds a main that runs the target over the
+// files given on the command line, or over mutations of the built-in
+// seeds, so the target also runs where libFuzzer is not available.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "CodecPrivate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const * data, size_t size)
+{
+    AvcConfig config;
+    if (AvcParseConfig(data, size, config))
+    {
+        for (size_t i = 0; i < config.sps.size(); ++i)
+        {
+            AvcSpsInfo info;
+            AvcParseSps(&config.sps[i][0], config.sps[i].size(), info);
+        }
+        std::vector<uint8_t> header;
+        AvcBuildSequenceHeader(config, header);
+    }
+
+    // A bare NAL unit, as some muxers store it.
+    AvcSpsInfo info;
+    AvcParseSps(data, size, info);
+
+    Mp4vVolInfo vol;
+    Mp4vParseVol(data, size, vol);
+    return 0;
+}
+
+#ifdef CODEC_PRIVATE_FUZZ_DRIVER
+
+// avcC of a High profile 1080p SPS with VUI, and a MPEG-4 VOL.
+static uint8_t const s_AvcC[] = {
+    0x01, 0x64, 0x00, 0x28, 0xff, 0xe1, 0x00, 0x1e,
+    0x67, 0x64, 0x00, 0x28, 0xad, 0xff, 0xff, 0x80, 0xd9, 0x40, 0x78, 0x02, 0x27, 0xe5, 0xc3, 0x9b,
+    0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x03, 0x00, 0x20, 0x00, 0x00, 0x0c, 0x90, 0x80,
+    0x01, 0x00, 0x04, 0x68, 0xeb, 0xe3, 0xcb,
+};
+
+static uint8_t const s_Vol[] = {
+    0x00, 0x00, 0x01, 0xb0, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x20,
+    0x00, 0x84, 0x40, 0x07, 0xa8, 0x50, 0x20, 0xf0, 0xa0,
+};
+
+static uint32_t s_uSeed = 1;
+
+static uint32_t Random(uint32_t uLimit)
+{
+    s_uSeed = s_uSeed * 1103515245 + 12345;
+    return (s_uSeed >> 8) % uLimit;
+}
+
+//-------------------------------------------------------------------
+// Mutate
+// Flips bits, overwrites and inserts bytes, and cuts the tail, a few
+// times. The input is copied to a buffer of its exact size, so the
+// sanitizers catch any read past it.
+//-------------------------------------------------------------------
+
+static void Mutate(uint8_t const * seed, size_t size, std::vector<uint8_t> & data)
+{
+    data.assign(seed, seed + size);
+    for (uint32_t n = Random(4) + 1; n > 0 && !data.empty(); --n)
+    {
+        size_t pos = Random((uint32_t)data.size());
+        switch (Random(4))
+        {
+        case 0:
+            data[pos] ^= (uint8_t)(1 << Random(8));
+            break;
+        case 1:
+            data[pos] = (uint8_t)Random(256);
+            break;
+        case 2:
+            data.insert(data.begin() + pos, (uint8_t)Random(256));
+            break;
+        default:
+            data.resize(pos);
+            break;
+        }
+    }
+}
+
+static int RunFile(char const * pszPath)
+{
+    FILE * file = fopen(pszPath, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "cannot open %s\n", pszPath);
+        return 1;
+    }
+    std::vector<uint8_t> data;
+    int c;
+    while ((c = fgetc(file)) != EOF)
+    {
+        data.push_back((uint8_t)c);
+    }
+    fclose(file);
+    uint8_t * copy = (uint8_t *)malloc(data.size() ? data.size() : 1);
+    if (!data.empty())
+    {
+        memcpy(copy, &data[0], data.size());
+    }
+    LLVMFuzzerTestOneInput(copy, data.size());
+    free(copy);
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc > 1)
+    {
+        int result = 0;
+        for (int i = 1; i < argc; ++i)
+        {
+            result |= RunFile(argv[i]);
+        }
+        return result;
+    }
+
+    std::vector<uint8_t> data;
+    for (int i = 0; i < 200000; ++i)
+    {
+        switch (i % 3)
+        {
+        case 0:
+            Mutate(s_AvcC, sizeof(s_AvcC), data);
+            break;
+        case 1:
+            Mutate(s_Vol, sizeof(s_Vol), data);
+            break;
+        default:
+            // The SPS alone, as a bare NAL unit.
+            Mutate(s_AvcC + 8, 0x1e, data);
+            break;
+        }
+        uint8_t * copy = (uint8_t *)malloc(data.size() ? data.size() : 1);
+        if (!data.empty())
+        {
+            memcpy(copy, &data[0], data.size());
+        }
+        LLVMFuzzerTestOneInput(copy, data.size());
+        free(copy);
+    }
+    printf("CodecPrivateFuzz: 200000 inputs\n");
+    return 0;
+}
+
+#endif
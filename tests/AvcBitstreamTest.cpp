@@ -0,0 +1,177 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// AvcBitstreamTest.cpp
+// Checks the start code scans against a plain reference, and the
+// rewriting of access units between AVCC and Annex B.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "AvcBitstreamVariants.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#define CHECK(x) \
+    do { if (!(x)) { fprintf(stderr, "%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #x); return 1; } } while (0)
+
+static BYTE const s_Sps[] = {0x67, 0x42, 0xc0, 0x1e, 0xd9, 0x00, 0xa0, 0x47, 0xfe, 0xc8};
+static BYTE const s_Pps[] = {0x68, 0xce, 0x3c, 0x80};
+
+static UINT32 FindReference(BYTE const * pData, UINT32 cbData, UINT32 uOffset)
+{
+    for (UINT32 i = uOffset; i + 3 <= cbData; ++i)
+    {
+        if (pData[i] == 0 && pData[i + 1] == 0 && pData[i + 2] == 1)
+        {
+            return i;
+        }
+    }
+    return cbData;
+}
+
+//-------------------------------------------------------------------
+// TestScan
+// Buffers of every length up to 200 bytes, made mostly of zeros and
+// ones so that start codes and near misses fall at every position
+// relative to the vector blocks.
+//-------------------------------------------------------------------
+
+static int TestScan()
+{
+    AvcScanVariant variants[3];
+    int cVariants = AvcScanVariants(variants);
+
+    UINT32 uSeed = 1;
+    std::vector<BYTE> buffer;
+    for (UINT32 cbData = 0; cbData <= 200; ++cbData)
+    {
+        for (int iRound = 0; iRound < 20; ++iRound)
+        {
+            buffer.resize(cbData);
+            for (UINT32 i = 0; i < cbData; ++i)
+            {
+                uSeed = uSeed * 1103515245 + 12345;
+                UINT32 uValue = (uSeed >> 16) & 7;
+                buffer[i] = (BYTE)(uValue < 5 ? 0 : uValue < 7 ? 1 : uSeed >> 24);
+            }
+            for (int v = 0; v < cVariants; ++v)
+            {
+                UINT32 i = 0;
+                for (;;)
+                {
+                    UINT32 uExpected = FindReference(buffer.data(), cbData, i);
+                    CHECK(variants[v].pfnFind(buffer.data(), cbData, i) == uExpected);
+                    if (uExpected == cbData)
+                    {
+                        break;
+                    }
+                    i = uExpected + 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static void AppendLength(std::vector<BYTE> & data, BYTE const * pNal, UINT32 cbNal)
+{
+    BYTE length[4] = {(BYTE)(cbNal >> 24), (BYTE)(cbNal >> 16), (BYTE)(cbNal >> 8), (BYTE)cbNal};
+    data.insert(data.end(), length, length + 4);
+    data.insert(data.end(), pNal, pNal + cbNal);
+}
+
+static void AppendStartCode(std::vector<BYTE> & data, BYTE const * pNal, UINT32 cbNal)
+{
+    static BYTE const start[4] = {0, 0, 0, 1};
+    data.insert(data.end(), start, start + 4);
+    data.insert(data.end(), pNal, pNal + cbNal);
+}
+
+static int TestRewrite()
+{
+    std::vector<BYTE> avcC;
+    BYTE const header[] = {1, 0x42, 0xc0, 0x1e, 0xff, 0xe1};
+    avcC.insert(avcC.end(), header, header + sizeof(header));
+    avcC.push_back(0);
+    avcC.push_back(sizeof(s_Sps));
+    avcC.insert(avcC.end(), s_Sps, s_Sps + sizeof(s_Sps));
+    avcC.push_back(1);
+    avcC.push_back(0);
+    avcC.push_back(sizeof(s_Pps));
+    avcC.insert(avcC.end(), s_Pps, s_Pps + sizeof(s_Pps));
+
+    BYTE const aud[] = {0x09, 0xf0};
+    BYTE const idr[] = {0x65, 0x88, 0x84, 0x00, 0x00, 0x03, 0x00, 0x21};
+    BYTE const slice[] = {0x41, 0x9a, 0x00, 0x00};
+
+    AvcRewriter_Sse2 rewriter;
+    rewriter.SetCodecPrivate(&avcC[0], (UINT32)avcC.size());
+    CHECK(rewriter.NalLengthSize() == 4);
+
+    std::vector<BYTE> input;
+    AppendLength(input, aud, sizeof(aud));
+    AppendLength(input, idr, sizeof(idr));
+
+    // Unchanged format, no insertion: nothing to do.
+    CHECK(rewriter.Rewrite(&input[0], (UINT32)input.size(), TRUE) == S_FALSE);
+
+    // The parameter sets go after the access unit delimiter, and the
+    // escaped payload is copied as it is.
+    rewriter.SetOutputFormat(AVC_FORMAT_ANNEXB);
+    rewriter.SetInsertParameterSets(TRUE);
+    std::vector<BYTE> expected;
+    AppendStartCode(expected, aud, sizeof(aud));
+    AppendStartCode(expected, s_Sps, sizeof(s_Sps));
+    AppendStartCode(expected, s_Pps, sizeof(s_Pps));
+    AppendStartCode(expected, idr, sizeof(idr));
+    CHECK(rewriter.Rewrite(&input[0], (UINT32)input.size(), TRUE) == S_OK);
+    CHECK(std::vector<BYTE>(rewriter.Output(), rewriter.Output() + rewriter.OutputSize()) == expected);
+
+    // Not a key frame: converted only.
+    input.clear();
+    AppendLength(input, slice, sizeof(slice));
+    expected.clear();
+    AppendStartCode(expected, slice, sizeof(slice));
+    CHECK(rewriter.Rewrite(&input[0], (UINT32)input.size(), FALSE) == S_OK);
+    CHECK(std::vector<BYTE>(rewriter.Output(), rewriter.Output() + rewriter.OutputSize()) == expected);
+
+    // A length past the end is passed on.
+    input[3] = 0x40;
+    CHECK(rewriter.Rewrite(&input[0], (UINT32)input.size(), FALSE) == S_FALSE);
+
+    // Annex B input: the trailing zeros of a NAL belong to the next
+    // start code, and a key frame with its own SPS is left alone.
+    AvcRewriter_Sse2 annexB;
+    std::vector<BYTE> config;
+    AppendStartCode(config, s_Sps, sizeof(s_Sps));
+    AppendStartCode(config, s_Pps, sizeof(s_Pps));
+    annexB.SetCodecPrivate(&config[0], (UINT32)config.size());
+    annexB.SetInsertParameterSets(TRUE);
+    CHECK(annexB.NalLengthSize() == 0);
+
+    input.clear();
+    AppendStartCode(input, idr, sizeof(idr));
+    input.push_back(0);
+    AppendStartCode(input, slice, sizeof(slice) - 2);
+    expected = config;
+    AppendStartCode(expected, idr, sizeof(idr));
+    AppendStartCode(expected, slice, sizeof(slice) - 2);
+    CHECK(annexB.Rewrite(&input[0], (UINT32)input.size(), TRUE) == S_OK);
+    CHECK(std::vector<BYTE>(annexB.Output(), annexB.Output() + annexB.OutputSize()) == expected);
+    CHECK(annexB.Rewrite(&expected[0], (UINT32)expected.size(), TRUE) == S_FALSE);
+    return 0;
+}
+
+int main()
+{
+    int result = 0;
+    result |= TestScan();
+    result |= TestRewrite();
+    if (result == 0)
+    {
+        printf("AvcBitstreamTest passed\n");
+    }
+    return result;
+}
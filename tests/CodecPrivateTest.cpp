@@ -0,0 +1,281 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// CodecPrivateTest.cpp
+// Checks the codec private data parsers on headers written field by
+// field, and on every truncation of them.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "CodecPrivate.h"
+
+#include <stdio.h>
+
+#define CHECK(x) \
+    do { if (!(x)) { fprintf(stderr, "%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #x); return 1; } } while (0)
+
+//-------------------------------------------------------------------
+// BitWriter class
+// Writes the fields of a header, most significant bit first.
+//-------------------------------------------------------------------
+
+class BitWriter
+{
+public:
+    BitWriter() : m_cBits(0) {}
+
+    void bits(unsigned n, uint32_t v)
+    {
+        for (unsigned i = n; i-- > 0; )
+        {
+            if (m_cBits % 8 == 0)
+            {
+                m_data.push_back(0);
+            }
+            m_data.back() |= ((v >> i) & 1) << (7 - m_cBits % 8);
+            ++m_cBits;
+        }
+    }
+
+    void bit(uint32_t v) { bits(1, v); }
+
+    void ue(uint32_t v)
+    {
+        unsigned n = 0;
+        while (((v + 1) >> (n + 1)) != 0)
+        {
+            ++n;
+        }
+        bits(n, 0);
+        bits(n + 1, v + 1);
+    }
+
+    // rbsp_trailing_bits
+    std::vector<uint8_t> const & finish()
+    {
+        bit(1);
+        while (m_cBits % 8)
+        {
+            bit(0);
+        }
+        return m_data;
+    }
+
+private:
+    std::vector<uint8_t> m_data;
+    size_t m_cBits;
+};
+
+// Adds the emulation prevention bytes.
+static std::vector<uint8_t> Escape(std::vector<uint8_t> const & rbsp)
+{
+    std::vector<uint8_t> nal;
+    unsigned zeros = 0;
+    for (size_t i = 0; i < rbsp.size(); ++i)
+    {
+        if (zeros >= 2 && rbsp[i] <= 3)
+        {
+            nal.push_back(3);
+            zeros = 0;
+        }
+        zeros = rbsp[i] == 0 ? zeros + 1 : 0;
+        nal.push_back(rbsp[i]);
+    }
+    return nal;
+}
+
+//-------------------------------------------------------------------
+// MakeSps
+// High profile 1920x1080 (1088 cropped by 8 lines), or 1920x1080
+// interlaced, with a 4:3 SAR, full range BT.709 colour, and a tick of
+// 1/50 s that needs emulation prevention.
+//-------------------------------------------------------------------
+
+static std::vector<uint8_t> MakeSps(bool bInterlaced)
+{
+    BitWriter w;
+    w.bits(8, 100);                             // profile_idc
+    w.bits(8, 0);                               // constraint flags
+    w.bits(8, 40);                              // level_idc
+    w.ue(0);                                    // seq_parameter_set_id
+    w.ue(1);                                    // chroma_format_idc
+    w.ue(0);                                    // bit_depth_luma_minus8
+    w.ue(0);                                    // bit_depth_chroma_minus8
+    w.bit(0);                                   // qpprime_y_zero_transform_bypass_flag
+    w.bit(1);                                   // seq_scaling_matrix_present_flag
+    for (int i = 0; i < 8; ++i)
+    {
+        w.bit(i == 0);                          // seq_scaling_list_present_flag
+        for (int j = 0; i == 0 && j < 16; ++j)
+        {
+            w.ue(0);                            // delta_scale, se(0)
+        }
+    }
+    w.ue(0);                                    // log2_max_frame_num_minus4
+    w.ue(0);                                    // pic_order_cnt_type
+    w.ue(2);                                    // log2_max_pic_order_cnt_lsb_minus4
+    w.ue(4);                                    // max_num_ref_frames
+    w.bit(0);                                   // gaps_in_frame_num_value_allowed_flag
+    w.ue(119);                                  // pic_width_in_mbs_minus1
+    w.ue(bInterlaced ? 33 : 67);                // pic_height_in_map_units_minus1
+    w.bit(!bInterlaced);                        // frame_mbs_only_flag
+    if (bInterlaced)
+    {
+        w.bit(1);                               // mb_adaptive_frame_field_flag
+    }
+    w.bit(1);                                   // direct_8x8_inference_flag
+    w.bit(1);                                   // frame_cropping_flag
+    w.ue(0);
+    w.ue(0);
+    w.ue(0);
+    w.ue(bInterlaced ? 2 : 4);                  // bottom, in 2 or 4 lines
+    w.bit(1);                                   // vui_parameters_present_flag
+    w.bit(1);                                   // aspect_ratio_info_present_flag
+    w.bits(8, 14);                              // 4:3
+    w.bit(0);                                   // overscan_info_present_flag
+    w.bit(1);                                   // video_signal_type_present_flag
+    w.bits(3, 5);                               // video_format
+    w.bit(1);                                   // video_full_range_flag
+    w.bit(1);                                   // colour_description_present_flag
+    w.bits(8, 1);
+    w.bits(8, 1);
+    w.bits(8, 1);
+    w.bit(0);                                   // chroma_loc_info_present_flag
+    w.bit(1);                                   // timing_info_present_flag
+    w.bits(32, 1);                              // num_units_in_tick
+    w.bits(32, 100);                            // time_scale
+    w.bit(1);                                   // fixed_frame_rate_flag
+    w.bit(0);                                   // nal_hrd_parameters_present_flag
+    w.bit(0);                                   // vcl_hrd_parameters_present_flag
+    w.bit(0);                                   // pic_struct_present_flag
+    w.bit(0);                                   // bitstream_restriction_flag
+
+    std::vector<uint8_t> nal(1, 0x67);
+    std::vector<uint8_t> escaped = Escape(w.finish());
+    nal.insert(nal.end(), escaped.begin(), escaped.end());
+    return nal;
+}
+
+static int TestSps()
+{
+    std::vector<uint8_t> sps = MakeSps(false);
+
+    AvcSpsInfo info;
+    CHECK(AvcParseSps(&sps[0], sps.size(), info));
+    CHECK(info.profile_idc == 100);
+    CHECK(info.level_idc == 40);
+    CHECK(info.chroma_format_idc == 1);
+    CHECK(info.bit_depth_luma == 8);
+    CHECK(info.width == 1920);
+    CHECK(info.height == 1080);
+    CHECK(info.frame_mbs_only);
+    CHECK(info.sar_num == 4 && info.sar_den == 3);
+    CHECK(info.video_signal_present && info.full_range);
+    CHECK(info.colour_present);
+    CHECK(info.colour_primaries == 1 && info.transfer_characteristics == 1 && info.matrix_coefficients == 1);
+    CHECK(info.num_units_in_tick == 1 && info.time_scale == 100);
+
+    std::vector<uint8_t> interlaced = MakeSps(true);
+    CHECK(AvcParseSps(&interlaced[0], interlaced.size(), info));
+    CHECK(!info.frame_mbs_only);
+    CHECK(info.width == 1920);
+    CHECK(info.height == 1080);
+
+    // The parser reads through the emulation prevention.
+    std::vector<uint8_t> rbsp;
+    CodecUnescapeRbsp(&sps[1], sps.size() - 1, rbsp);
+    CHECK(rbsp.size() < sps.size() - 1);
+
+    // Every truncation fails cleanly until the timing info is read.
+    for (size_t size = 0; size < sps.size() - 2; ++size)
+    {
+        CHECK(!AvcParseSps(&sps[0], size, info));
+    }
+
+    // Not a SPS.
+    sps[0] = 0x68;
+    CHECK(!AvcParseSps(&sps[0], sps.size(), info));
+    return 0;
+}
+
+static int TestConfig()
+{
+    std::vector<uint8_t> sps = MakeSps(false);
+    uint8_t const pps[] = {0x68, 0xeb, 0xe3, 0xcb, 0x22, 0xc0};
+
+    std::vector<uint8_t> avcC;
+    uint8_t const header[] = {1, 100, 0, 40, 0xfd, 0xe1};
+    avcC.insert(avcC.end(), header, header + sizeof(header));
+    avcC.push_back((uint8_t)(sps.size() >> 8));
+    avcC.push_back((uint8_t)sps.size());
+    avcC.insert(avcC.end(), sps.begin(), sps.end());
+    avcC.push_back(1);
+    avcC.push_back(0);
+    avcC.push_back(sizeof(pps));
+    avcC.insert(avcC.end(), pps, pps + sizeof(pps));
+
+    AvcConfig config;
+    CHECK(AvcParseConfig(&avcC[0], avcC.size(), config));
+    CHECK(config.nal_length_size == 2);
+    CHECK(config.sps.size() == 1 && config.sps[0] == sps);
+    CHECK(config.pps.size() == 1 && config.pps[0].size() == sizeof(pps));
+
+    // The sequence header is the Annex B form, which parses back.
+    std::vector<uint8_t> annexB;
+    AvcBuildSequenceHeader(config, annexB);
+    CHECK(annexB.size() == 8 + sps.size() + sizeof(pps));
+    AvcConfig parsed;
+    CHECK(AvcParseConfig(&annexB[0], annexB.size(), parsed));
+    CHECK(parsed.nal_length_size == 0);
+    CHECK(parsed.sps == config.sps && parsed.pps == config.pps);
+
+    // A truncated record fails once the SPS is cut.
+    for (size_t size = 0; size < 8 + sps.size(); ++size)
+    {
+        CHECK(!AvcParseConfig(&avcC[0], size, config));
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------------
+// TestVol
+// A visual object sequence and a VOL of 320x240, progressive, with a
+// square pixel aspect ratio.
+//-------------------------------------------------------------------
+
+static int TestVol()
+{
+    uint8_t const vol[] = {
+        0x00, 0x00, 0x01, 0xb0, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x20,
+        0x00, 0x84, 0x40, 0x07, 0xa8, 0x50, 0x20, 0xf0, 0xa0,
+    };
+
+    Mp4vVolInfo info;
+    CHECK(Mp4vParseVol(vol, sizeof(vol), info));
+    CHECK(info.width == 320);
+    CHECK(info.height == 240);
+    CHECK(!info.interlaced);
+    CHECK(info.par_num == 1 && info.par_den == 1);
+
+    for (size_t size = 0; size < sizeof(vol); ++size)
+    {
+        CHECK(!Mp4vParseVol(vol, size, info));
+    }
+
+    // Without the VOL start code.
+    std::vector<uint8_t> vos(vol, vol + 12);
+    CHECK(!Mp4vParseVol(&vos[0], vos.size(), info));
+    return 0;
+}
+
+int main()
+{
+    int result = 0;
+    result |= TestSps();
+    result |= TestConfig();
+    result |= TestVol();
+    if (result == 0)
+    {
+        printf("CodecPrivateTest passed\n");
+    }
+    return result;
+}
@@ -0,0 +1,168 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// FakeJustRuntimeTest.cpp
+// Checks that the fake runtime behaves as the source expects the real
+// one to.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "FakeJustRuntime.h"
+
+#include <stdio.h>
+
+#define CHECK(x) \
+    do { if (!(x)) { fprintf(stderr, "%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #x); return 1; } } while (0)
+
+static PP_err s_errOpen = -1;
+static UINT32 s_cTimers = 0;
+
+static void OnOpen(PP_context user, PP_err err)
+{
+    (void)user;
+    s_errOpen = err;
+}
+
+static void OnTimer(PP_context user, PP_err err)
+{
+    (void)err;
+    s_cTimers += (UINT32)(size_t)user;
+}
+
+static FakeJustScript Script()
+{
+    FakeJustScript script;
+    script.uDuration = 4000;
+    script.speeds.clear();
+    FakeJustSpeed fast = {0, 1000000};
+    FakeJustSpeed stalled = {1000, 0};
+    FakeJustSpeed resumed = {3000, 1000000};
+    script.speeds.push_back(fast);
+    script.speeds.push_back(stalled);
+    script.speeds.push_back(resumed);
+    return script;
+}
+
+static int TestOpen()
+{
+    FakeJust_Load(Script());
+    s_errOpen = -1;
+    JUST_AsyncOpenEx("fake", "", NULL, OnOpen);
+    CHECK(s_errOpen == -1);
+    FakeJust_Advance(0);
+    CHECK(s_errOpen == just_success);
+    CHECK(JUST_GetStreamCount() == 2);
+    CHECK(JUST_GetDuration() == 4000);
+
+    JUST_StreamInfo info;
+    CHECK(JUST_GetStreamInfo(0, &info) == just_success);
+    CHECK(info.type == JUST_StreamType::VIDE);
+    CHECK(JUST_GetStreamInfo(1, &info) == just_success);
+    CHECK(info.type == JUST_StreamType::AUDI);
+
+    // Closing cancels an open that has not completed.
+    JUST_Close();
+    JUST_AsyncOpenEx("fake", "", NULL, OnOpen);
+    JUST_Close();
+    FakeJust_Advance(0);
+    CHECK(s_errOpen == just_operation_canceled);
+    CHECK(JUST_GetStreamCount() == 0);
+    return 0;
+}
+
+//-------------------------------------------------------------------
+// TestRead
+// Samples come in decode order, block when the download stalls, and
+// resume once it does not.
+//-------------------------------------------------------------------
+
+static int TestRead()
+{
+    FakeJust_Load(Script());
+    JUST_AsyncOpenEx("fake", "", NULL, OnOpen);
+    FakeJust_Advance(0);
+
+    JUST_Sample sample;
+    CHECK(JUST_ReadSample(&sample) == just_would_block);
+
+    // 1 MB/s for a second is more than the 4 s of content.
+    FakeJust_Advance(1000);
+    UINT64 uLast = 0;
+    UINT32 cVideo = 0;
+    UINT32 cAudio = 0;
+    PP_err err;
+    while ((err = JUST_ReadSample(&sample)) == just_success)
+    {
+        CHECK(sample.decode_time >= uLast);
+        uLast = sample.decode_time;
+        if (sample.itrack == 0)
+        {
+            CHECK(((sample.flags & JUST_SampleFlag::sync) != 0) == (cVideo % 50 == 0));
+            ++cVideo;
+        }
+        else
+        {
+            ++cAudio;
+        }
+    }
+    CHECK(err == just_stream_end);
+    CHECK(cVideo == 100);
+    CHECK(cAudio == 173);
+
+    // Seeking drops the buffer, and the download is stalled.
+    CHECK(JUST_Seek(2500) == just_success);
+    CHECK(JUST_ReadSample(&sample) == just_would_block);
+    JUST_PlayStatistic stat;
+    CHECK(JUST_GetPlayStat(&stat) == just_success);
+    CHECK(stat.buffer_time == 0);
+    CHECK(stat.buffering_present == 0);
+    JUST_DataStat data;
+    CHECK(JUST_GetDataStat(&data) == just_success);
+    CHECK(data.average_speed_five_seconds == 0);
+
+    // The download resumes at 3 s.
+    FakeJust_Advance(2000);
+    CHECK(JUST_ReadSample(&sample) == just_would_block);
+    FakeJust_Advance(100);
+    // Audio resumes with the frame that covers the key frame.
+    CHECK(JUST_ReadSample(&sample) == just_success);
+    CHECK(sample.itrack == 1);
+    CHECK(sample.decode_time < 20000000);
+    CHECK(sample.decode_time + sample.duration > 20000000);
+    CHECK(JUST_ReadSample(&sample) == just_success);
+    CHECK(sample.itrack == 0);
+    CHECK(sample.decode_time == 20000000);
+    CHECK((sample.flags & JUST_SampleFlag::sync) != 0);
+    return 0;
+}
+
+static int TestTimers()
+{
+    FakeJust_Load(Script());
+    s_cTimers = 0;
+    JUST_ScheduleCallback(100, (PP_context)1, OnTimer);
+    void const * key = JUST_ScheduleCallback(50, (PP_context)10, OnTimer);
+    JUST_ScheduleCallback(200, (PP_context)100, OnTimer);
+    JUST_CancelCallback(key);
+
+    FakeJust_Advance(99);
+    CHECK(s_cTimers == 0);
+    FakeJust_Advance(1);
+    CHECK(s_cTimers == 1);
+    CHECK(FakeJust_Now() == 100);
+    FakeJust_Advance(1000);
+    CHECK(s_cTimers == 101);
+    return 0;
+}
+
+int main()
+{
+    int result = 0;
+    result |= TestOpen();
+    result |= TestRead();
+    result |= TestTimers();
+    if (result == 0)
+    {
+        printf("FakeJustRuntimeTest passed\n");
+    }
+    return result;
+}
@@ -0,0 +1,93 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RawVideoKernelsTest.cpp
+// Checks that the SIMD raw video kernels write the same frames as the
+// scalar ones, padding included.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "RawVideoVariants.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#define CHECK(x) \
+    do { if (!(x)) { fprintf(stderr, "%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #x); return 1; } } while (0)
+
+static BYTE const PADDING = 0xcd;
+
+static void Fill(std::vector<BYTE> & buffer, UINT32 uSeed)
+{
+    for (size_t i = 0; i < buffer.size(); ++i)
+    {
+        uSeed = uSeed * 1103515245 + 12345;
+        buffer[i] = (BYTE)(uSeed >> 16);
+    }
+}
+
+static int TestI420ToNV12(RawVideoVariant const & variant, UINT32 uWidth, UINT32 uHeight)
+{
+    UINT32 cbChroma = ((uWidth + 1) / 2) * ((uHeight + 1) / 2);
+    LONG lPitch = (LONG)(uWidth + 40);
+    size_t cbDst = lPitch * (uHeight + (uHeight + 1) / 2);
+
+    std::vector<BYTE> src(uWidth * uHeight + 2 * cbChroma);
+    std::vector<BYTE> expected(cbDst, PADDING);
+    std::vector<BYTE> actual(cbDst, PADDING);
+    Fill(src, uWidth * uHeight);
+
+    ConvertI420ToNV12_Scalar(&src[0], uWidth, uHeight, &expected[0], lPitch);
+    variant.pfnI420ToNV12(&src[0], uWidth, uHeight, &actual[0], lPitch);
+    CHECK(expected == actual);
+
+    // The first chroma pair of the last row.
+    BYTE const * pV = &src[uWidth * uHeight + cbChroma];
+    UINT32 uLast = (uHeight + 1) / 2 - 1;
+    CHECK(actual[(uHeight + uLast) * lPitch + 1] == pV[uLast * ((uWidth + 1) / 2)]);
+    return 0;
+}
+
+static int TestRGB24ToRGB32(RawVideoVariant const & variant, UINT32 uWidth, UINT32 uHeight)
+{
+    UINT32 uSrcPitch = (uWidth * 3 + 3) & ~3;
+    LONG lPitch = (LONG)(uWidth * 4 + 16);
+    size_t cbDst = lPitch * uHeight;
+
+    // No slack after the last row, so a read past it is caught by the
+    // sanitizers.
+    std::vector<BYTE> src(uSrcPitch * (uHeight - 1) + uWidth * 3);
+    std::vector<BYTE> expected(cbDst, PADDING);
+    std::vector<BYTE> actual(cbDst, PADDING);
+    Fill(src, uWidth + uHeight);
+
+    ConvertRGB24ToRGB32_Scalar(&src[0], uSrcPitch, uWidth, uHeight, &expected[0], lPitch);
+    variant.pfnRGB24ToRGB32(&src[0], uSrcPitch, uWidth, uHeight, &actual[0], lPitch);
+    CHECK(expected == actual);
+
+    // The top row comes from the last row of the source.
+    BYTE const * s = &src[(uHeight - 1) * uSrcPitch];
+    UINT32 uPixel = s[0] | (s[1] << 8) | (s[2] << 16) | 0xff000000;
+    CHECK(memcmp(&actual[0], &uPixel, 4) == 0);
+    return 0;
+}
+
+int main()
+{
+    static UINT32 const sizes[][2] = {{1, 1}, {2, 2}, {7, 3}, {33, 5}, {64, 9}, {65, 17}, {1279, 7}};
+
+    RawVideoVariant variants[3];
+    int cVariants = RawVideoVariants(variants);
+    int result = 0;
+    for (int i = 0; i < cVariants; ++i)
+    {
+        for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j)
+        {
+            result |= TestI420ToNV12(variants[i], sizes[j][0], sizes[j][1]);
+            result |= TestRGB24ToRGB32(variants[i], sizes[j][0], sizes[j][1]);
+        }
+        printf("%s: %s\n", variants[i].pszName, result ? "failed" : "passed");
+    }
+    return result;
+}
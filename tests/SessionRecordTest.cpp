@@ -0,0 +1,267 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// SessionRecordTest.cpp
+// Records a session that stalls, with the rebuffer predictor running
+// as in the media source, and checks that the log replays it. The log
+// is left for the RebufferReplay test, which must find the same
+// predictor counters offline.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "PpboxSession.h"
+#include "RebufferPredictor.h"
+#include "BufferingController.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#define CHECK(x) \
+    do { if (!(x)) { fprintf(stderr, "%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #x); return 1; } } while (0)
+
+static UINT32 const PLAYBACK_STEP = 40;         // Milliseconds the renderer consumes at a time
+static UINT32 const STAT_PERIOD = 1000;         // Milliseconds between the statistics timers
+static UINT64 const READ_AHEAD = 30000000;      // Media time read ahead, 100-nanosecond units
+
+static void OnOpen(PP_context user, PP_err err)
+{
+    *(PP_err *)user = err;
+}
+
+//-------------------------------------------------------------------
+// Script
+// 60 s of content: fast, then slower than the content for 15 s, which
+// drains the buffer, then an outage of 3 s, and fast again.
+//-------------------------------------------------------------------
+
+static FakeJustScript Script()
+{
+    FakeJustScript script;
+    script.uDuration = 60000;
+    FakeJust_Load(script);
+    UINT32 uRate = FakeJust_ContentRate();
+    script.speeds.clear();
+    FakeJustSpeed fast = {0, uRate * 3 / 2};
+    FakeJustSpeed slow = {10000, uRate * 3 / 5};
+    FakeJustSpeed outage = {25000, 0};
+    FakeJustSpeed resumed = {28000, uRate * 3 / 2};
+    script.speeds.push_back(fast);
+    script.speeds.push_back(slow);
+    script.speeds.push_back(outage);
+    script.speeds.push_back(resumed);
+    return script;
+}
+
+//-------------------------------------------------------------------
+// Player
+// The calls of PpboxMediaSource on its session, in the same order:
+// the play statistics then the data statistics on each timer, the
+// predictor updated unless buffering, a buffering phase on each read
+// that would block, checked on its own timer, and the reads resumed
+// as soon as it ends. The renderer stops while buffering.
+//-------------------------------------------------------------------
+
+class Player
+{
+public:
+    Player(PpboxSession & session)
+        : m_session(session)
+        , m_uPosition(0)
+        , m_uRead(0)
+        , m_uNextStat(STAT_PERIOD)
+        , m_uSpeed(0)
+        , m_uSamples(0)
+        , m_uStalls(0)
+        , m_uUpdates(0)
+        , m_bEnded(FALSE)
+    {
+    }
+
+    void Open()
+    {
+        UINT32 uBitrate = 0;
+        for (PP_uint i = 0; i < m_session.GetStreamCount(); ++i)
+        {
+            JUST_StreamInfo info;
+            m_session.GetStreamInfo(i, &info);
+            uBitrate += info.bitrate;
+        }
+        m_Predictor.SetBitrate(uBitrate);
+    }
+
+    void Run()
+    {
+        while (!m_bEnded)
+        {
+            if (m_Buffering.IsBuffering())
+            {
+                FakeJust_Advance(m_Buffering.NextDelay());
+            }
+            else if (m_uRead < m_uPosition + READ_AHEAD)
+            {
+                Read();
+                continue;
+            }
+            else
+            {
+                FakeJust_Advance(PLAYBACK_STEP);
+                m_uPosition += PLAYBACK_STEP * 10000;
+            }
+
+            if (FakeJust_Now() >= m_uNextStat)
+            {
+                SampleStats();
+            }
+            if (m_Buffering.IsBuffering() && CheckBuffering())
+            {
+                Read();
+            }
+        }
+    }
+
+    UINT32 Samples() const { return m_uSamples; }
+    UINT32 Stalls() const { return m_uStalls; }
+    UINT32 Updates() const { return m_uUpdates; }
+    RebufferPredictor const & Predictor() const { return m_Predictor; }
+
+private:
+    void Read()
+    {
+        JUST_Sample sample;
+        PP_err err = m_session.ReadSample(&sample);
+        if (err == just_success)
+        {
+            ++m_uSamples;
+            m_Predictor.AddConsumed(sample.size, sample.duration);
+            UINT64 uEnd = sample.decode_time + sample.duration;
+            m_uRead = uEnd > m_uRead ? uEnd : m_uRead;
+        }
+        else if (err == just_would_block)
+        {
+            ++m_uStalls;
+            m_Buffering.Start(m_session.TickCount());
+            m_Predictor.OnStall(m_session.TickCount());
+        }
+        else
+        {
+            m_bEnded = TRUE;
+        }
+    }
+
+    void SampleStats()
+    {
+        m_uNextStat = FakeJust_Now() + STAT_PERIOD;
+        JUST_PlayStatistic play;
+        (void)UpdatePlayStat(&play);
+        JUST_DataStat data;
+        if (m_session.GetDataStat(&data) == just_success)
+        {
+            m_uSpeed = data.average_speed_five_seconds;
+        }
+    }
+
+    PP_err UpdatePlayStat(JUST_PlayStatistic * play)
+    {
+        PP_err err = m_session.GetPlayStat(play);
+        if ((err == just_success || err == just_would_block) && !m_Buffering.IsBuffering())
+        {
+            (void)m_Predictor.Update(m_session.TickCount(), m_uSpeed, play->buffer_time);
+            ++m_uUpdates;
+        }
+        return err;
+    }
+
+    BOOL CheckBuffering()
+    {
+        JUST_PlayStatistic play;
+        PP_err err = UpdatePlayStat(&play);
+        return (err == just_success || err == just_would_block)
+            ? m_Buffering.Check(m_session.TickCount(), play.buffering_present)
+            : m_Buffering.Fail(m_session.TickCount());
+    }
+
+private:
+    PpboxSession &      m_session;
+    RebufferPredictor   m_Predictor;
+    BufferingController m_Buffering;
+    UINT64              m_uPosition;        // Rendered media time, 100-nanosecond units
+    UINT64              m_uRead;            // End of the samples read, 100-nanosecond units
+    UINT64              m_uNextStat;
+    UINT32              m_uSpeed;
+    UINT32              m_uSamples;
+    UINT32              m_uStalls;
+    UINT32              m_uUpdates;
+    BOOL                m_bEnded;
+};
+
+static int TestRecord(std::wstring const & path)
+{
+    FakeJust_Load(Script());
+
+    PpboxSession session;
+    CHECK(SUCCEEDED(session.SetRecordFile(path.c_str(), FALSE)));
+    PP_err err = -1;
+    session.AsyncOpen("fake", "", &err, OnOpen);
+    FakeJust_Advance(0);
+    CHECK(err == just_success);
+
+    Player player(session);
+    player.Open();
+    player.Run();
+    session.Close();
+
+    RebufferPredictor const & predictor = player.Predictor();
+    CHECK(player.Stalls() > 0);
+    CHECK(predictor.Warnings() > 0);
+    printf("samples=%u stalls=%u updates=%u warnings=%u hits=%u misses=%u false_alarms=%u mean_error=%ums\n",
+        player.Samples(), player.Stalls(), player.Updates(), predictor.Warnings(), predictor.Hits(),
+        predictor.Misses(), predictor.FalseAlarms(), predictor.MeanError());
+
+    // The session replays from the log, without the runtime.
+    JUST_Close();
+    PpboxSession replay;
+    CHECK(SUCCEEDED(replay.SetReplayFile(path.c_str())));
+    err = -1;
+    replay.AsyncOpen("fake", "", &err, OnOpen);
+    CHECK(err == just_success);
+    CHECK(replay.GetStreamCount() == 2);
+
+    UINT32 uSamples = 0;
+    UINT32 uStalls = 0;
+    JUST_Sample sample;
+    while ((err = replay.ReadSample(&sample)) != just_stream_end)
+    {
+        CHECK(err == just_success || err == just_would_block);
+        if (err == just_success)
+        {
+            ++uSamples;
+        }
+        else
+        {
+            ++uStalls;
+        }
+    }
+    CHECK(uSamples == player.Samples());
+    CHECK(uStalls == player.Stalls());
+    replay.Close();
+    return 0;
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <log>\n", argv[0]);
+        return 2;
+    }
+
+    int result = 0;
+    result |= TestRecord(std::wstring(argv[1], argv[1] + strlen(argv[1])));
+    if (result == 0)
+    {
+        printf("SessionRecordTest passed\n");
+    }
+    return result;
+}
@@ -0,0 +1,224 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// TelemetryLayoutTest.cpp
+// Pins the offset and size of every field of the telemetry segment,
+// and checks that readers get consistent snapshots while it is
+// written.
+//
+// With an argument, also writes a sample segment to that path for the
+// reader tool to read.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "TelemetryLayout.h"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#define CHECK(x) \
+    do { if (!(x)) { fprintf(stderr, "%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #x); return 1; } } while (0)
+
+#define CHECK_FIELD(type, field, offset, size) \
+    do { CHECK(offsetof(type, field) == offset); CHECK(sizeof(((type *)0)->field) == size); } while (0)
+
+// The layout of version 1. Monitoring tools built from older headers
+// read these offsets; a change here breaks them.
+static int TestLayout()
+{
+    CHECK_FIELD(TelemetryStream, uQueuedSamples, 0, 4);
+    CHECK_FIELD(TelemetryStream, uQueuedTime, 4, 4);
+    CHECK_FIELD(TelemetryStream, uDropped, 8, 4);
+    CHECK_FIELD(TelemetryStream, bActive, 12, 4);
+    CHECK(sizeof(TelemetryStream) == 16);
+
+    CHECK_FIELD(TelemetryData, uTick, 0, 8);
+    CHECK_FIELD(TelemetryData, uState, 8, 4);
+    CHECK_FIELD(TelemetryData, bBuffering, 12, 4);
+    CHECK_FIELD(TelemetryData, uBufferTime, 16, 4);
+    CHECK_FIELD(TelemetryData, uBufferPercent, 20, 4);
+    CHECK_FIELD(TelemetryData, uDownloadSpeed, 24, 4);
+    CHECK_FIELD(TelemetryData, uConnectionStatus, 28, 4);
+    CHECK_FIELD(TelemetryData, uBytesReceived, 32, 8);
+    CHECK_FIELD(TelemetryData, uStalls, 40, 4);
+    CHECK_FIELD(TelemetryData, uDropped, 44, 4);
+    CHECK_FIELD(TelemetryData, uOpQueueDepth, 48, 4);
+    CHECK_FIELD(TelemetryData, cStreams, 52, 4);
+    CHECK_FIELD(TelemetryData, streams, 56, 16 * TELEMETRY_MAX_STREAMS);
+    CHECK(sizeof(TelemetryData) == 184);
+
+    CHECK_FIELD(TelemetryHeader, uMagic, 0, 4);
+    CHECK_FIELD(TelemetryHeader, uVersion, 4, 2);
+    CHECK_FIELD(TelemetryHeader, cbData, 6, 2);
+    CHECK_FIELD(TelemetryHeader, uSequence, 8, 4);
+    CHECK_FIELD(TelemetryHeader, uReserved, 12, 4);
+    CHECK_FIELD(TelemetryHeader, data, 16, 184);
+    CHECK(sizeof(TelemetryHeader) == 200);
+
+    CHECK(TELEMETRY_MAGIC == 0x4d545050);
+    CHECK(TELEMETRY_VERSION == 1);
+    return 0;
+}
+
+// Every field holds a value derived from uTick, so a torn copy shows.
+static void Fill(TelemetryData & data, UINT64 uTick)
+{
+    memset(&data, 0, sizeof(data));
+    data.uTick = uTick;
+    UINT32 * pFields = (UINT32 *)&data.uState;
+    UINT32 * pEnd = (UINT32 *)(&data + 1);
+    for (UINT32 i = 0; pFields + i < pEnd; ++i)
+    {
+        pFields[i] = (UINT32)uTick * 2654435761u + i;
+    }
+    data.cStreams = 2;
+}
+
+static bool IsConsistent(TelemetryData const & data)
+{
+    TelemetryData expected;
+    Fill(expected, data.uTick);
+    return memcmp(&expected, &data, sizeof(data)) == 0;
+}
+
+static int TestRead()
+{
+    static TelemetryHeader header;
+    TelemetryData data;
+
+    // Not initialized.
+    memset(&header, 0, sizeof(header));
+    CHECK(!TelemetryRead(&header, &data, 4));
+
+    TelemetryInit(&header);
+    CHECK(header.uMagic == TELEMETRY_MAGIC);
+    CHECK(header.cbData == sizeof(TelemetryData));
+    CHECK(TelemetryRead(&header, &data, 4));
+
+    Fill(data, 7);
+    TelemetryWrite(&header, &data);
+    CHECK(header.uSequence == 2);
+    TelemetryData copy;
+    CHECK(TelemetryRead(&header, &copy, 4));
+    CHECK(copy.uTick == 7 && IsConsistent(copy));
+
+    // A writer in the middle of an update.
+    header.uSequence = 3;
+    CHECK(!TelemetryRead(&header, &copy, 4));
+    header.uSequence = 4;
+
+    // A newer writer with more fields is still read; another version
+    // is not.
+    header.cbData = sizeof(TelemetryData) + 16;
+    CHECK(TelemetryRead(&header, &copy, 4));
+    header.cbData = sizeof(TelemetryData);
+    header.uVersion = TELEMETRY_VERSION + 1;
+    CHECK(!TelemetryRead(&header, &copy, 4));
+    header.uVersion = TELEMETRY_VERSION;
+    return 0;
+}
+
+//-------------------------------------------------------------------
+// TestConcurrent
+// One thread writes as fast as it can; the reader must never get a
+// snapshot mixing two updates.
+//-------------------------------------------------------------------
+
+static int TestConcurrent()
+{
+    static TelemetryHeader header;
+    TelemetryInit(&header);
+    TelemetryData initial;
+    Fill(initial, 0);
+    TelemetryWrite(&header, &initial);
+
+    std::atomic<bool> bStop(false);
+    std::thread writer([&]() {
+        TelemetryData data;
+        for (UINT64 uTick = 1; !bStop.load(); ++uTick)
+        {
+            Fill(data, uTick);
+            TelemetryWrite(&header, &data);
+        }
+    });
+
+    // On a single processor the writer can be preempted in the middle
+    // of an update; the reader then yields, as a monitor would wait for
+    // its next poll.
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    UINT32 cRead = 0;
+    UINT32 cTorn = 0;
+    UINT64 uLast = 0;
+    while (cRead < 100000 && std::chrono::steady_clock::now() < end)
+    {
+        TelemetryData data;
+        if (TelemetryRead(&header, &data, 16))
+        {
+            ++cRead;
+            cTorn += !IsConsistent(data);
+            cTorn += data.uTick < uLast;
+            uLast = data.uTick;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    bStop = true;
+    writer.join();
+
+    CHECK(cRead == 100000);
+    CHECK(uLast > 0);
+    CHECK(cTorn == 0);
+    return 0;
+}
+
+static int WriteSample(char const * pszPath)
+{
+    static TelemetryHeader header;
+    TelemetryInit(&header);
+
+    TelemetryData data;
+    memset(&data, 0, sizeof(data));
+    data.uTick = 123456;
+    data.uState = 2;
+    data.bBuffering = 1;
+    data.uBufferTime = 1500;
+    data.uBufferPercent = 30;
+    data.uDownloadSpeed = 250000;
+    data.uBytesReceived = 5000000000ull;
+    data.uStalls = 3;
+    data.uDropped = 5;
+    data.uOpQueueDepth = 1;
+    data.cStreams = 2;
+    TelemetryStream video = {12, 480, 4, 1};
+    TelemetryStream audio = {30, 700, 1, 1};
+    data.streams[0] = video;
+    data.streams[1] = audio;
+    TelemetryWrite(&header, &data);
+
+    FILE * file = fopen(pszPath, "wb");
+    CHECK(file != NULL);
+    CHECK(fwrite(&header, sizeof(header), 1, file) == 1);
+    CHECK(fclose(file) == 0);
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    int result = 0;
+    result |= TestLayout();
+    result |= TestRead();
+    result |= TestConcurrent();
+    if (argc > 1)
+    {
+        result |= WriteSample(argv[1]);
+    }
+    if (result == 0)
+    {
+        printf("TelemetryLayoutTest passed\n");
+    }
+    return result;
+}
@@ -0,0 +1,168 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RebufferReplay.cpp
+// Replays a recorded session log through the rebuffer predictor, and
+// prints how well it predicted the stalls of the session.
+//
+// Usage: RebufferReplay <log> [threshold]
+//
+// <log> is a file recorded with the RecordFile option of the source.
+// threshold is the warning threshold, in milliseconds, 5000 by
+// default, to compare settings on the same session.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "SessionLog.h"
+#include "RebufferPredictor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+static BOOL HasStat(PP_err err)
+{
+    return err == just_success || err == just_would_block;
+}
+
+//-------------------------------------------------------------------
+// Replay
+// Takes the records in the recorded order, and feeds the predictor as
+// PpboxMediaSource does: the nominal bitrate of the streams, the
+// samples read, the download speed, and the buffer time of each play
+// statistic, except while buffering. Buffering starts with a read
+// that would block, and ends with the next sample read, since the
+// source only reads again once it is over.
+//-------------------------------------------------------------------
+
+struct ReplayResult
+{
+    UINT32  uSamples;
+    UINT32  uStalls;
+    UINT32  uUpdates;
+};
+
+static void Replay(SessionLogReader & log, RebufferPredictor & predictor, ReplayResult * result)
+{
+    UINT32 uBitrate = 0;
+    BOOL bBitrateKnown = TRUE;
+    PP_uint uStreamInfos = 0;
+    UINT32 uDownloadSpeed = 0;
+    BOOL bBuffering = FALSE;
+
+    result->uSamples = 0;
+    result->uStalls = 0;
+    result->uUpdates = 0;
+
+    BYTE bType;
+    while ((bType = log.NextType()) != 0)
+    {
+        PP_err err = just_success;
+        switch (bType)
+        {
+        case SESSION_LOG_OPEN:
+            (void)log.ReadOpen();
+            break;
+
+        case SESSION_LOG_DURATION:
+        case SESSION_LOG_STREAMS:
+            (void)log.ReadValue((SessionLogRecord)bType);
+            break;
+
+        case SESSION_LOG_STREAM_INFO:
+        {
+            JUST_StreamInfo info;
+            if (log.ReadStreamInfo(uStreamInfos++, &info) == just_success)
+            {
+                bBitrateKnown = bBitrateKnown && info.bitrate != 0;
+                uBitrate += info.bitrate;
+                predictor.SetBitrate(bBitrateKnown ? uBitrate : 0);
+            }
+            break;
+        }
+
+        case SESSION_LOG_SEEK:
+            (void)log.ReadSeek(0);
+            predictor.Reset();
+            break;
+
+        case SESSION_LOG_SAMPLE:
+        {
+            JUST_Sample sample;
+            err = log.ReadSample(&sample);
+            if (err == just_success)
+            {
+                bBuffering = FALSE;
+                predictor.AddConsumed(sample.size, sample.duration);
+                ++result->uSamples;
+            }
+            else if (err == just_would_block)
+            {
+                bBuffering = TRUE;
+                predictor.OnStall(log.Tick());
+                ++result->uStalls;
+            }
+            break;
+        }
+
+        case SESSION_LOG_PLAY_STAT:
+        {
+            JUST_PlayStatistic stat;
+            err = log.ReadPlayStat(&stat);
+            if (HasStat(err) && !bBuffering)
+            {
+                (void)predictor.Update(log.Tick(), uDownloadSpeed, stat.buffer_time);
+                ++result->uUpdates;
+            }
+            break;
+        }
+
+        case SESSION_LOG_DATA_STAT:
+        {
+            JUST_DataStat stat;
+            err = log.ReadDataStat(&stat);
+            if (HasStat(err))
+            {
+                uDownloadSpeed = stat.average_speed_five_seconds;
+            }
+            break;
+        }
+
+        default:
+            fprintf(stderr, "unknown record %u, replay stopped\n", bType);
+            return;
+        }
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <log> [threshold]\n", argv[0]);
+        return 2;
+    }
+
+    std::wstring path(argv[1], argv[1] + strlen(argv[1]));
+    SessionLogReader log;
+    if (FAILED(log.Open(path.c_str())))
+    {
+        fprintf(stderr, "%s: cannot read the session log\n", argv[1]);
+        return 1;
+    }
+
+    RebufferPredictor predictor;
+    if (argc > 2)
+    {
+        predictor.SetWarningThreshold((UINT32)strtoul(argv[2], NULL, 10));
+    }
+
+    ReplayResult result;
+    Replay(log, predictor, &result);
+
+    printf("samples=%u stalls=%u updates=%u warnings=%u hits=%u misses=%u false_alarms=%u mean_error=%ums\n",
+        result.uSamples, result.uStalls, result.uUpdates, predictor.Warnings(), predictor.Hits(),
+        predictor.Misses(), predictor.FalseAlarms(), predictor.MeanError());
+    return 0;
+}
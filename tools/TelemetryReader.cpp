@@ -0,0 +1,134 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// TelemetryReader.cpp
+// Prints the telemetry segment of a media source.
+//
+// Usage: TelemetryReader <segment> [count [interval]]
+//
+// <segment> is the name of the file mapping on Windows (for example
+// Local\PpboxTelemetry), and the path of a file holding a segment
+// elsewhere (for example under /dev/shm). Prints count snapshots,
+// 1 by default, interval milliseconds apart, 1000 by default.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "TelemetryLayout.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static DWORD const READ_RETRIES = 100;
+
+//-------------------------------------------------------------------
+// MapSegment
+// Maps the segment read-only. Returns NULL if it does not exist or is
+// too small to hold a header.
+//-------------------------------------------------------------------
+
+static TelemetryHeader const volatile * MapSegment(char const * pszSegment)
+{
+#ifdef _WIN32
+    WCHAR szName[MAX_PATH];
+    if (MultiByteToWideChar(CP_ACP, 0, pszSegment, -1, szName, MAX_PATH) == 0)
+    {
+        return NULL;
+    }
+    HANDLE hMapping = OpenFileMappingW(FILE_MAP_READ, FALSE, szName);
+    if (hMapping == NULL)
+    {
+        return NULL;
+    }
+    void * pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, sizeof(TelemetryHeader));
+    CloseHandle(hMapping);
+    return (TelemetryHeader const volatile *)pView;
+#else
+    int fd = open(pszSegment, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    struct stat st;
+    void * pView = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TelemetryHeader))
+    {
+        pView = mmap(NULL, sizeof(TelemetryHeader), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    return pView == MAP_FAILED ? NULL : (TelemetryHeader const volatile *)pView;
+#endif
+}
+
+static void SleepMilliseconds(unsigned uMilliseconds)
+{
+#ifdef _WIN32
+    Sleep(uMilliseconds);
+#else
+    usleep(uMilliseconds * 1000);
+#endif
+}
+
+static void Print(TelemetryData const & data)
+{
+    printf("tick=%llu state=%u buffering=%u buffer=%ums (%u%%) speed=%uB/s bytes=%llu"
+        " stalls=%u dropped=%u ops=%u streams=%u\n",
+        (unsigned long long)data.uTick, data.uState, data.bBuffering,
+        data.uBufferTime, data.uBufferPercent, data.uDownloadSpeed,
+        (unsigned long long)data.uBytesReceived, data.uStalls, data.uDropped,
+        data.uOpQueueDepth, data.cStreams);
+
+    DWORD cStreams = data.cStreams < TELEMETRY_MAX_STREAMS ? data.cStreams : TELEMETRY_MAX_STREAMS;
+    for (DWORD i = 0; i < cStreams; ++i)
+    {
+        TelemetryStream const & stream = data.streams[i];
+        printf("  stream %u: active=%u queued=%u (%ums) dropped=%u\n",
+            i, stream.bActive, stream.uQueuedSamples, stream.uQueuedTime, stream.uDropped);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <segment> [count [interval]]\n", argv[0]);
+        return 1;
+    }
+    unsigned uCount = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : 1;
+    unsigned uInterval = argc > 3 ? (unsigned)strtoul(argv[3], NULL, 10) : 1000;
+
+    TelemetryHeader const volatile * pHeader = MapSegment(argv[1]);
+    if (pHeader == NULL)
+    {
+        fprintf(stderr, "%s: cannot map %s\n", argv[0], argv[1]);
+        return 1;
+    }
+    if (pHeader->uMagic != TELEMETRY_MAGIC || pHeader->uVersion != TELEMETRY_VERSION)
+    {
+        fprintf(stderr, "%s: %s is not a telemetry segment of version %u\n",
+            argv[0], argv[1], TELEMETRY_VERSION);
+        return 2;
+    }
+
+    for (unsigned i = 0; i < uCount; ++i)
+    {
+        if (i > 0)
+        {
+            SleepMilliseconds(uInterval);
+        }
+        TelemetryData data;
+        if (!TelemetryRead(pHeader, &data, READ_RETRIES))
+        {
+            fprintf(stderr, "%s: no consistent snapshot after %u retries\n", argv[0], READ_RETRIES);
+            return 2;
+        }
+        Print(data);
+        fflush(stdout);
+    }
+    return 0;
+}